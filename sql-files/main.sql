@@ -187,7 +187,7 @@ CREATE TABLE IF NOT EXISTS `cart_inventory` (
   `unique_id` bigint(20) unsigned NOT NULL default '0',
   PRIMARY KEY  (`id`),
   KEY `char_id` (`char_id`)
-) ENGINE=MyISAM;
+) ENGINE=InnoDB;
 
 --
 -- Table structure for table `char`
@@ -264,7 +264,7 @@ CREATE TABLE IF NOT EXISTS `char` (
   KEY `party_id` (`party_id`),
   KEY `guild_id` (`guild_id`),
   KEY `online` (`online`)
-) ENGINE=MyISAM AUTO_INCREMENT=150000; 
+) ENGINE=InnoDB AUTO_INCREMENT=150000; 
 
 --
 -- Table structure for table `char_reg_num`
@@ -393,7 +393,7 @@ CREATE TABLE IF NOT EXISTS `friends` (
   `friend_account` int(11) NOT NULL default '0',
   `friend_id` int(11) NOT NULL default '0',
   PRIMARY KEY (`char_id`, `friend_id`)
-) ENGINE=MyISAM;
+) ENGINE=InnoDB;
 
 --
 -- Table structure for table `global_acc_reg_num`
@@ -583,7 +583,7 @@ CREATE TABLE IF NOT EXISTS `guild_storage` (
   `unique_id` bigint(20) unsigned NOT NULL default '0',
   PRIMARY KEY  (`id`),
   KEY `guild_id` (`guild_id`)
-) ENGINE=MyISAM;
+) ENGINE=InnoDB;
 
 --
 -- Table structure for table `guild_storage_log`
@@ -669,7 +669,7 @@ CREATE TABLE IF NOT EXISTS `hotkey` (
   `itemskill_id` INT(11) unsigned NOT NULL default '0',
   `skill_lvl` TINYINT(4) unsigned NOT NULL default '0',
   PRIMARY KEY (`char_id`,`hotkey`)
-) ENGINE=MyISAM;
+) ENGINE=InnoDB;
 
 -- 
 -- Table structure for table `interlog`
@@ -732,7 +732,7 @@ CREATE TABLE IF NOT EXISTS `inventory` (
   `equip_switch` int(11) unsigned NOT NULL default '0',
   PRIMARY KEY  (`id`),
   KEY `char_id` (`char_id`)
-) ENGINE=MyISAM;
+) ENGINE=InnoDB;
 
 --
 -- Table structure for table `ipbanlist`
@@ -869,7 +869,7 @@ CREATE TABLE IF NOT EXISTS `memo` (
   `y` smallint(4) unsigned NOT NULL default '0',
   PRIMARY KEY  (`memo_id`),
   KEY `char_id` (`char_id`)
-) ENGINE=MyISAM;
+) ENGINE=InnoDB;
 
 --
 -- Table structure for table `mercenary`
@@ -1002,7 +1002,7 @@ CREATE TABLE IF NOT EXISTS `skill` (
   `lv` tinyint(4) unsigned NOT NULL default '0',
   `flag` TINYINT(1) UNSIGNED NOT NULL default 0,
   PRIMARY KEY  (`char_id`,`id`)
-) ENGINE=MyISAM;
+) ENGINE=InnoDB;
 
 --
 -- Table structure for table `skill_homunculus`
@@ -1052,7 +1052,7 @@ CREATE TABLE IF NOT EXISTS `storage` (
   `unique_id` bigint(20) unsigned NOT NULL default '0',
   PRIMARY KEY  (`id`),
   KEY `account_id` (`account_id`)
-) ENGINE=MyISAM;
+) ENGINE=InnoDB;
 
 --
 -- Table structure for table `vending_items`
@@ -35,4 +35,4 @@ CREATE TABLE IF NOT EXISTS `storage_1` (
   `unique_id` bigint(20) unsigned NOT NULL default '0',
   PRIMARY KEY  (`id`),
   KEY `account_id` (`account_id`)
-) ENGINE=MyISAM;
+) ENGINE=InnoDB;
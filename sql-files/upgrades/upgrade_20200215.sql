@@ -0,0 +1,12 @@
+-- The write-back cache of the char-server writes a character together with its
+-- items in one transaction, which is only atomic on a transactional engine.
+-- Convert additional storage tables (see conf/inter_server.yml) the same way.
+ALTER TABLE `cart_inventory` ENGINE=InnoDB;
+ALTER TABLE `char` ENGINE=InnoDB;
+ALTER TABLE `friends` ENGINE=InnoDB;
+ALTER TABLE `guild_storage` ENGINE=InnoDB;
+ALTER TABLE `hotkey` ENGINE=InnoDB;
+ALTER TABLE `inventory` ENGINE=InnoDB;
+ALTER TABLE `memo` ENGINE=InnoDB;
+ALTER TABLE `skill` ENGINE=InnoDB;
+ALTER TABLE `storage` ENGINE=InnoDB;
@@ -4,11 +4,22 @@
 #pragma warning(disable:4800)
 #include "char.hpp"
 
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 #include "../common/cbasetypes.hpp"
 #include "../common/cli.hpp"
@@ -20,11 +31,14 @@
 #include "../common/random.hpp"
 #include "../common/showmsg.hpp"
 #include "../common/socket.hpp"
+#include "../common/sqlpool.hpp"
 #include "../common/strlib.hpp"
 #include "../common/timer.hpp"
+#include "../common/utils.hpp"
 
 #include "char_clif.hpp"
 #include "char_cnslif.hpp"
+#include "char_journal.hpp"
 #include "char_logif.hpp"
 #include "char_mapif.hpp"
 #include "inter.hpp"
@@ -67,9 +81,43 @@ struct s_subnet {
 } subnet[16];
 int subnet_count = 0;
 
+struct char_cache_entry {
+	struct mmo_charstatus status;
+	t_tick expire;
+};
+
 DBMap* auth_db; // uint32 account_id -> struct auth_node*
 DBMap* online_char_db; // uint32 account_id -> struct online_char_data*
 DBMap* char_db_; // uint32 char_id -> struct mmo_charstatus*
+DBMap* char_writeback_db; // uint32 char_id -> struct mmo_charstatus* (state in sql of characters with pending saves)
+DBMap* char_cache_db; // uint32 char_id -> struct char_cache_entry* (characters that logged out recently)
+static CharJournal* char_writeback_journal = NULL;
+static std::deque<std::pair<uint32, t_tick>> char_cache_order; // char_id and expiration of the cached characters, oldest first
+
+/// Entry types of the write-back journal
+enum e_writeback_journal : uint8 {
+	WRITEBACK_JOURNAL_CHAR = 0, // struct mmo_charstatus
+	WRITEBACK_JOURNAL_ITEMS, // struct s_writeback_items
+};
+
+/// Inventory, cart or storage save kept in memory by the write-back
+struct s_writeback_items {
+	int id; // Character, account or guild ID
+	enum storage_type type;
+	int max; // Number of entries of the container
+	struct s_storage stor;
+};
+
+// Pending saves of characters (char_writeback_key) and containers (char_item_snapshot_key)
+static CharWriteback* char_writeback = NULL;
+// Rows of inventories, carts and storages as they are in the database, see char_memitemdata_to_sql
+// uint64 char_item_snapshot_key -> item rows, shared with the workers of sql_pool
+static std::unordered_map<uint64, std::vector<struct item>> item_snapshots;
+static std::mutex item_snapshot_mutex;
+static void char_writeback_add(struct mmo_charstatus* p, struct mmo_charstatus* cp);
+static void char_cache_add(struct mmo_charstatus* cp);
+static uint64 char_item_snapshot_key(int id, enum storage_type tableswitch, uint8 stor_id);
+static void char_item_snapshot_erase(uint64 key);
 DBMap* char_get_authdb() { return auth_db; }
 DBMap* char_get_onlinedb() { return online_char_db; }
 DBMap* char_get_chardb() { return char_db_; }
@@ -159,8 +207,17 @@ void char_set_char_offline(uint32 char_id, uint32 account_id){
 	{
 		struct mmo_charstatus* cp = (struct mmo_charstatus*)idb_get(char_db_,char_id);
 		inter_guild_CharOffline(char_id, cp?cp->guild_id:-1);
-		if (cp)
+		// Pending saves are written right away, so everything reading the char table sees the final state.
+		// If that fails the character stays in memory and char_writeback_timer retries.
+		if (cp && char_writeback_now(char_id)) {
+			char_cache_add(cp);
 			idb_remove(char_db_,char_id);
+		}
+		// The containers are read again on the next login
+		char_item_snapshot_invalidate(char_id, TABLE_INVENTORY, 0);
+		char_item_snapshot_invalidate(char_id, TABLE_CART, 0);
+		for( auto& storage_table : interServerDb )
+			char_item_snapshot_invalidate(account_id, TABLE_STORAGE, (uint8)storage_table.first);
 
 		if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `online`='0' WHERE `char_id`='%d' LIMIT 1", schema_config.char_db, char_id) )
 			Sql_ShowDebug(sql_handle);
@@ -266,19 +323,21 @@ DBData char_create_charstatus(DBKey key, va_list args) {
 	return db_ptr2data(cp);
 }
 
-int char_mmo_char_tosql(uint32 char_id, struct mmo_charstatus* p){
+/**
+ * Writes the differences between a character and its state in sql.
+ * @param char_id: Character ID
+ * @param p: Character data to save
+ * @param cp: State of the character in sql
+ * @return Number of errors
+ */
+static int char_mmo_char_tosql_sub(uint32 char_id, struct mmo_charstatus* p, struct mmo_charstatus* cp){
 	int i = 0;
 	int count = 0;
 	int diff = 0;
 	char save_status[128]; //For displaying save information. [Skotlex]
-	struct mmo_charstatus *cp;
-	int errors = 0; //If there are any errors while saving, "cp" will not be updated at the end.
+	int errors = 0; //If there are any errors while saving, "cp" will not be updated by the caller.
 	StringBuf buf;
 
-	if (char_id!=p->char_id) return 0;
-
-	cp = (struct mmo_charstatus *)idb_ensure(char_db_, char_id, char_create_charstatus);
-
 	StringBuf_Init(&buf);
 	memset(save_status, 0, sizeof(save_status));
 
@@ -515,51 +574,622 @@ int char_mmo_char_tosql(uint32 char_id, struct mmo_charstatus* p){
 	StringBuf_Destroy(&buf);
 	if (save_status[0]!='\0' && charserv_config.save_log)
 		ShowInfo("Saved char %d - %s:%s.\n", char_id, p->name, save_status);
-	if (!errors)
+	return errors;
+}
+
+int char_mmo_char_tosql(uint32 char_id, struct mmo_charstatus* p){
+	struct mmo_charstatus *cp;
+
+	if (char_id!=p->char_id) return 0;
+
+	cp = (struct mmo_charstatus *)idb_ensure(char_db_, char_id, char_create_charstatus);
+
+	if( charserv_config.charcache_config.writeback_interval > 0 ) {
+		char_writeback_add(p, cp);
+		return 0;
+	}
+
+	if (!char_mmo_char_tosql_sub(char_id, p, cp))
 		memcpy(cp, p, sizeof(struct mmo_charstatus));
 	return 0;
 }
 
-/// Saves an array of 'item' entries into the specified table.
-int char_memitemdata_to_sql(const struct item items[], int max, int id, enum storage_type tableswitch, uint8 stor_id) {
-	StringBuf buf;
-	SqlStmt* stmt;
-	int i, j, offset = 0, errors = 0;
-	const char *tablename, *selectoption, *printname;
-	struct item item; // temp storage variable
-	bool* flag; // bit array for inventory matching
-	bool found;
+/**
+ * Returns the key of the pending save of a character, next to the keys of its containers.
+ * @param char_id: Character ID
+ */
+static uint64 char_writeback_key(uint32 char_id){
+	return ((uint64)0xFF << 40) | char_id;
+}
 
-	switch (tableswitch) {
-		case TABLE_INVENTORY:
-			printname = "Inventory";
-			tablename = schema_config.inventory_db;
-			selectoption = "char_id";
-			break;
-		case TABLE_CART:
-			printname = "Cart";
-			tablename = schema_config.cart_db;
-			selectoption = "char_id";
-			break;
-		case TABLE_STORAGE:
-			printname = inter_premiumStorage_getPrintableName(stor_id);
-			tablename = inter_premiumStorage_getTableName(stor_id);
-			selectoption = "account_id";
+/**
+ * Keeps a save from a map-server in memory, it is written by char_writeback_timer.
+ * @param p: Character data to save
+ * @param cp: Character in memory, holds the state in sql until now
+ */
+static void char_writeback_add(struct mmo_charstatus* p, struct mmo_charstatus* cp){
+	if( !idb_exists(char_writeback_db, p->char_id) ) {// remember what is in sql to write only the differences
+		struct mmo_charstatus* saved;
+
+		CREATE(saved, struct mmo_charstatus, 1);
+		memcpy(saved, cp, sizeof(struct mmo_charstatus));
+		idb_put(char_writeback_db, p->char_id, saved);
+	}
+
+	memcpy(cp, p, sizeof(struct mmo_charstatus));
+	if( !CharWriteback_Put(char_writeback, char_writeback_key(p->char_id), WRITEBACK_JOURNAL_CHAR, p, sizeof(struct mmo_charstatus)) )
+		ShowError("char_writeback_add: Failed to append to '%s', the save is only kept in memory until it is written.\n", charserv_config.charcache_config.writeback_journal);
+}
+
+/// Returns the entries of a pending item save.
+static const struct item* char_writeback_items_entries(const struct s_writeback_items* w){
+	switch( w->type ) {
+		case TABLE_INVENTORY: return w->stor.u.items_inventory;
+		case TABLE_CART: return w->stor.u.items_cart;
+		case TABLE_STORAGE: return w->stor.u.items_storage;
+		default: return w->stor.u.items_guild;
+	}
+}
+
+/**
+ * Keeps an inventory, cart or storage save from a map-server in memory.
+ * It is written together with the character saves, so a crash never leaves sql
+ * with the items of one save and the zeny or status of another.
+ * @param id: Character ID (inventory, cart), account ID (storage) or guild ID (guild storage)
+ * @param type: Container type
+ * @param max: Number of entries of the container
+ * @param stor: Saved entries
+ * @return True if the save is kept, false if write-back is disabled and the caller has to write it
+ */
+bool char_writeback_items_add(int id, enum storage_type type, int max, struct s_storage* stor){
+	if( charserv_config.charcache_config.writeback_interval <= 0 )
+		return false;
+
+	std::unique_ptr<struct s_writeback_items> w(new struct s_writeback_items());
+
+	w->id = id;
+	w->type = type;
+	w->max = max;
+	memcpy(&w->stor, stor, sizeof(struct s_storage));
+	if( !CharWriteback_Put(char_writeback, char_item_snapshot_key(id, type, stor->stor_id), WRITEBACK_JOURNAL_ITEMS, w.get(), sizeof(struct s_writeback_items)) )
+		ShowError("char_writeback_items_add: Failed to append to '%s', the save is only kept in memory until it is written.\n", charserv_config.charcache_config.writeback_journal);
+	return true;
+}
+
+/**
+ * Loads a container from its pending save instead of sql.
+ * @param id: Character, account or guild ID
+ * @param type: Container type
+ * @param stor_id: Storage ID
+ * @param stor: Loaded entries
+ * @return True if a save is pending
+ */
+bool char_writeback_items_load(int id, enum storage_type type, uint8 stor_id, struct s_storage* stor){
+	const struct s_writeback_items* w = (const struct s_writeback_items*)CharWriteback_Get(char_writeback, char_item_snapshot_key(id, type, stor_id), NULL, NULL);
+
+	if( w == NULL )
+		return false;
+
+	memcpy(stor, &w->stor, sizeof(struct s_storage));
+	return true;
+}
+
+/**
+ * Writes the pending save of a character.
+ * Characters without a remembered state in sql (saves of a replayed journal) are compared against sql.
+ * @param p: Saved character
+ * @return True on success, characters deleted meanwhile are skipped
+ */
+static bool char_writeback_char_write(const struct mmo_charstatus* p){
+	struct mmo_charstatus* saved = (struct mmo_charstatus*)idb_get(char_writeback_db, p->char_id);
+	struct mmo_charstatus sql;
+
+	if( saved == NULL ) {
+		if( !char_mmo_char_fromsql(p->char_id, &sql, true) )
+			return true;
+		idb_remove(char_db_, p->char_id); // loaded by char_mmo_char_fromsql, outdated once the save is written
+		saved = &sql;
+	}
+
+	return char_mmo_char_tosql_sub(p->char_id, (struct mmo_charstatus*)p, saved) == 0;
+}
+
+/**
+ * Writes groups of pending saves in one transaction.
+ * If anything fails the transaction is rolled back and all saves stay pending.
+ * The tables have to use a transactional engine, see upgrade_20200215.sql.
+ * @param groups: Keys of the saves
+ * @return True on success
+ */
+static bool char_writeback_write_groups(const std::vector<std::vector<uint64>>& groups){
+	bool success = true;
+
+	// Loads of the containers that are still queued store the rows of their snapshots.
+	// Waited for before the transaction, so it is not held open while the workers run.
+	for( const std::vector<uint64>& group : groups ) {
+		for( uint64 key : group ) {
+			uint8 type;
+			const void* data = CharWriteback_Get(char_writeback, key, &type, NULL);
+
+			if( data != NULL && type == WRITEBACK_JOURNAL_ITEMS )
+				SqlPool_WaitKey(sql_pool, char_sqlpool_key(((const struct s_writeback_items*)data)->id, ((const struct s_writeback_items*)data)->type));
+		}
+	}
+
+	if( SQL_ERROR == Sql_QueryStr(sql_handle, "START TRANSACTION") ) {
+		Sql_ShowDebug(sql_handle);
+		return false;
+	}
+
+	for( size_t i = 0; i < groups.size() && success; i++ ) {
+		for( size_t j = 0; j < groups[i].size() && success; j++ ) {
+			uint8 type;
+			const void* data = CharWriteback_Get(char_writeback, groups[i][j], &type, NULL);
+
+			if( type == WRITEBACK_JOURNAL_CHAR )
+				success = char_writeback_char_write((const struct mmo_charstatus*)data);
+			else {
+				const struct s_writeback_items* w = (const struct s_writeback_items*)data;
+
+				success = char_memitemdata_to_sql(sql_handle, char_writeback_items_entries(w), w->max, w->id, w->type, w->stor.stor_id) == 0;
+			}
+		}
+	}
+
+	if( success && SQL_ERROR == Sql_QueryStr(sql_handle, "COMMIT") ) {
+		Sql_ShowDebug(sql_handle);
+		success = false;
+	}
+
+	if( !success ) {
+		if( SQL_ERROR == Sql_QueryStr(sql_handle, "ROLLBACK") )
+			Sql_ShowDebug(sql_handle);
+		// The snapshots describe rows that were rolled back
+		for( const std::vector<uint64>& group : groups ) {
+			for( uint64 key : group )
+				char_item_snapshot_erase(key);
+		}
+		return false;
+	}
+
+	// sql holds the saves now, see char_writeback_add
+	for( const std::vector<uint64>& group : groups ) {
+		for( uint64 key : group ) {
+			uint8 type;
+			const void* data = CharWriteback_Get(char_writeback, key, &type, NULL);
+
+			if( type == WRITEBACK_JOURNAL_CHAR )
+				idb_remove(char_writeback_db, ((const struct mmo_charstatus*)data)->char_id);
+		}
+	}
+	return true;
+}
+
+/**
+ * Empties the write-back journal once nothing is pending anymore.
+ */
+static void char_writeback_truncate(void){
+	if( !CharWriteback_Truncate(char_writeback) )
+		ShowError("char_writeback_truncate: Failed to truncate '%s', it is replayed on the next start.\n", charserv_config.charcache_config.writeback_journal);
+}
+
+/**
+ * Collects what has to be written together with a character:
+ * its pending save, its inventory and cart and the storages of its account.
+ * @param char_id: Character ID
+ * @return Keys of the group
+ */
+static std::vector<uint64> char_writeback_group(uint32 char_id){
+	struct mmo_charstatus* cp = (struct mmo_charstatus*)idb_get(char_db_, char_id);
+	std::vector<uint64> group = { char_writeback_key(char_id), char_item_snapshot_key(char_id, TABLE_INVENTORY, 0), char_item_snapshot_key(char_id, TABLE_CART, 0) };
+
+	if( cp != NULL ) {
+		for( auto& storage_table : interServerDb )
+			group.push_back(char_item_snapshot_key(cp->account_id, TABLE_STORAGE, (uint8)storage_table.first));
+	}
+
+	return group;
+}
+
+/**
+ * Writes the pending saves of a character and its items immediately.
+ * @param char_id: Character ID
+ * @return True if there is nothing left to write
+ */
+bool char_writeback_now(uint32 char_id){
+	std::vector<std::vector<uint64>> groups = { char_writeback_group(char_id) };
+
+	if( CharWriteback_Flush(char_writeback, groups, 1, char_writeback_write_groups) > 0 )
+		return false;
+
+	char_writeback_truncate();
+	return true;
+}
+
+/**
+ * Writes the pending save of a container immediately, before its rows are changed directly in sql.
+ * @param id: Character, account or guild ID
+ * @param type: Container type
+ * @param stor_id: Storage ID
+ * @return True if there is nothing left to write
+ */
+bool char_writeback_items_now(int id, enum storage_type type, uint8 stor_id){
+	std::vector<std::vector<uint64>> groups = { { char_item_snapshot_key(id, type, stor_id) } };
+
+	if( CharWriteback_Flush(char_writeback, groups, 1, char_writeback_write_groups) > 0 ) {
+		ShowError("char_writeback_items_now: Failed to write the pending items of %d (type %d).\n", id, type);
+		return false;
+	}
+
+	char_writeback_truncate();
+	return true;
+}
+
+/**
+ * Forgets the pending save of a container whose rows are deleted.
+ * @param id: Character, account or guild ID
+ * @param type: Container type
+ * @param stor_id: Storage ID
+ */
+void char_writeback_items_discard(int id, enum storage_type type, uint8 stor_id){
+	CharWriteback_Remove(char_writeback, char_item_snapshot_key(id, type, stor_id));
+}
+
+/**
+ * Forgets the pending saves and cached state of a character that is deleted.
+ * @param char_id: Character ID
+ */
+void char_writeback_discard(uint32 char_id){
+	CharWriteback_Remove(char_writeback, char_writeback_key(char_id));
+	idb_remove(char_writeback_db, char_id);
+	idb_remove(char_cache_db, char_id);
+	char_writeback_items_discard(char_id, TABLE_INVENTORY, 0);
+	char_writeback_items_discard(char_id, TABLE_CART, 0);
+}
+
+/**
+ * Writes all pending saves, writeback_batch characters per transaction.
+ * A character is written together with its items, containers without a pending
+ * character save (e.g. guild storages) follow in batches of their own.
+ * Saves that could not be written stay pending and in the journal.
+ * @return Number of characters and containers that could not be written
+ */
+static int char_writeback_flush(void){
+	std::vector<std::vector<uint64>> groups;
+	std::unordered_set<uint64> grouped;
+	std::vector<uint64> keys;
+	int failed;
+
+	if( CharWriteback_Size(char_writeback) == 0 )
+		return 0;
+
+	keys = CharWriteback_Keys(char_writeback);
+	for( uint64 key : keys ) {
+		uint8 type;
+		const void* data = CharWriteback_Get(char_writeback, key, &type, NULL);
+
+		if( type != WRITEBACK_JOURNAL_CHAR )
+			continue;
+		groups.push_back(char_writeback_group(((const struct mmo_charstatus*)data)->char_id));
+		grouped.insert(groups.back().begin(), groups.back().end());
+	}
+
+	for( uint64 key : keys ) {
+		if( !grouped.count(key) )
+			groups.push_back({ key });
+	}
+
+	failed = CharWriteback_Flush(char_writeback, groups, charserv_config.charcache_config.writeback_batch, char_writeback_write_groups);
+	if( failed )
+		ShowWarning("char_writeback_flush: %d character(s) or container(s) could not be saved, retrying in %d ms.\n", failed, charserv_config.charcache_config.writeback_interval);
+	else
+		char_writeback_truncate();
+
+	return failed;
+}
+
+/**
+ * Timer writing the pending character saves.
+ */
+TIMER_FUNC(char_writeback_timer){
+	char_writeback_flush();
+	return 0;
+}
+
+/**
+ * Returns the key of an entry of the write-back journal.
+ * @return Key or 0 for entries written by a different build
+ */
+static uint64 char_writeback_journal_key(uint8 type, const void* data, uint32 length){
+	switch( type ) {
+		case WRITEBACK_JOURNAL_CHAR:
+			if( length == sizeof(struct mmo_charstatus) )
+				return char_writeback_key(((const struct mmo_charstatus*)data)->char_id);
 			break;
-		case TABLE_GUILD_STORAGE:
-			printname = "Guild Storage";
-			tablename = schema_config.guild_storage_db;
-			selectoption = "guild_id";
+		case WRITEBACK_JOURNAL_ITEMS:
+			if( length == sizeof(struct s_writeback_items) ) {
+				const struct s_writeback_items* w = (const struct s_writeback_items*)data;
+
+				return char_item_snapshot_key(w->id, w->type, w->stor.stor_id);
+			}
 			break;
-		default:
-			ShowError("Invalid table name!\n");
-			return 1;
 	}
+	ShowError("char_writeback_journal_key: Entry of type %d with size %u was written by a different build, it is ignored.\n", type, length);
+	return 0;
+}
 
-	// The following code compares inventory with current database values
-	// and performs modification/deletion/insertion only on relevant rows.
-	// This approach is more complicated than a trivial delete&insert, but
-	// it significantly reduces cpu load on the database server.
+/**
+ * Writes the saves of a journal left behind by a crash, in one transaction.
+ * The server does not start if they cannot be written, the journal is kept then.
+ * @param filename: Journal file
+ */
+static void char_writeback_replay(const char* filename){
+	std::vector<std::vector<uint64>> groups;
+	int count;
+
+	char_writeback = CharWriteback_Create(NULL);
+	if( CharWriteback_Load(char_writeback, filename, char_writeback_journal_key) <= 0 || (count = (int)CharWriteback_Size(char_writeback)) == 0 ) {
+		CharWriteback_Destroy(char_writeback);
+		char_writeback = NULL;
+		return;
+	}
+
+	groups.push_back(CharWriteback_Keys(char_writeback));
+	if( CharWriteback_Flush(char_writeback, groups, 1, char_writeback_write_groups) > 0 ) {
+		ShowFatalError("Could not write the saves of the write-back journal '%s', it is kept for the next start.\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	CharWriteback_Destroy(char_writeback);
+	char_writeback = NULL;
+
+	ShowStatus("Restored '" CL_WHITE "%d" CL_RESET "' character(s) and container(s) from the write-back journal '" CL_WHITE "%s" CL_RESET "'.\n", count, filename);
+}
+
+/**
+ * Keeps the state of a character that logged out for a quick re-login.
+ * The least recently added character is dropped when the cache is full.
+ * @param cp: Character data, fully written to sql
+ */
+static void char_cache_add(struct mmo_charstatus* cp){
+	struct char_cache_entry* entry;
+
+	if( charserv_config.charcache_config.cache_size <= 0 )
+		return;
+
+	while( db_size(char_cache_db) >= (unsigned int)charserv_config.charcache_config.cache_size && !char_cache_order.empty() ) {
+		// entries that were loaded or invalidated meanwhile are skipped
+		entry = (struct char_cache_entry*)idb_get(char_cache_db, char_cache_order.front().first);
+		if( entry != NULL && entry->expire == char_cache_order.front().second )
+			idb_remove(char_cache_db, char_cache_order.front().first);
+		char_cache_order.pop_front();
+	}
+
+	CREATE(entry, struct char_cache_entry, 1);
+	memcpy(&entry->status, cp, sizeof(struct mmo_charstatus));
+	entry->expire = gettick() + charserv_config.charcache_config.cache_timeout * 1000;
+	idb_put(char_cache_db, cp->char_id, entry);
+	char_cache_order.push_back(std::make_pair(cp->char_id, entry->expire));
+}
+
+/**
+ * Forgets the cached state of a character whose row is changed directly in sql.
+ * @param char_id: Character ID
+ */
+void char_cache_invalidate(uint32 char_id){
+	idb_remove(char_cache_db, char_id);
+}
+
+/**
+ * Forgets all cached states, used by updates that affect many characters.
+ */
+void char_cache_clear(void){
+	db_clear(char_cache_db);
+}
+
+/**
+ * Loads a character from memory instead of sql, if it has pending saves or logged out recently.
+ * @param char_id: Character ID
+ * @param p: Character data
+ * @return True if the character was found
+ */
+static bool char_cache_load(uint32 char_id, struct mmo_charstatus* p){
+	struct mmo_charstatus* cp;
+	struct char_cache_entry* entry;
+	bool found = false;
+
+	if( idb_exists(char_writeback_db, char_id) && (cp = (struct mmo_charstatus*)idb_get(char_db_, char_id)) != NULL ) {// newer than sql
+		memcpy(p, cp, sizeof(struct mmo_charstatus));
+		return true;
+	}
+
+	if( (entry = (struct char_cache_entry*)idb_get(char_cache_db, char_id)) == NULL )
+		return false;
+
+	if( DIFF_TICK(entry->expire, gettick()) > 0 ) {
+		memcpy(p, &entry->status, sizeof(struct mmo_charstatus));
+		cp = (struct mmo_charstatus *)idb_ensure(char_db_, char_id, char_create_charstatus);
+		memcpy(cp, p, sizeof(struct mmo_charstatus));
+		found = true;
+	}
+	idb_remove(char_cache_db, char_id);
+	return found;
+}
+
+/**
+ * Timer removing expired states from the cache.
+ */
+TIMER_FUNC(char_cache_cleanup){
+	DBIterator* iter = db_iterator(char_cache_db);
+	struct char_cache_entry* entry;
+
+	for( entry = (struct char_cache_entry*)dbi_first(iter); dbi_exists(iter); entry = (struct char_cache_entry*)dbi_next(iter) ) {
+		if( DIFF_TICK(entry->expire, tick) <= 0 )
+			dbi_remove(iter);
+	}
+	dbi_destroy(iter);
+
+	// all characters are cached for the same time, the order is sorted by expiration
+	while( !char_cache_order.empty() && DIFF_TICK(char_cache_order.front().second, tick) <= 0 )
+		char_cache_order.pop_front();
+	return 0;
+}
+
+/// Builds the key of a container in item_snapshots.
+static uint64 char_item_snapshot_key(int id, enum storage_type tableswitch, uint8 stor_id) {
+	if( tableswitch != TABLE_STORAGE )
+		stor_id = 0;
+	return ((uint64)tableswitch << 40) | ((uint64)stor_id << 32) | (uint32)id;
+}
+
+/// Removes the snapshot of a container and returns its rows.
+/// The snapshot is put back once the save is done, so a container is never used by two threads.
+static bool char_item_snapshot_take(uint64 key, std::vector<struct item>& rows) {
+	std::lock_guard<std::mutex> lock(item_snapshot_mutex);
+	auto it = item_snapshots.find(key);
+
+	if( it == item_snapshots.end() )
+		return false;
+	rows = std::move(it->second);
+	item_snapshots.erase(it);
+	return true;
+}
+
+/// Forgets the snapshot of a container right away, for rows written by the main thread.
+static void char_item_snapshot_erase(uint64 key) {
+	std::lock_guard<std::mutex> lock(item_snapshot_mutex);
+
+	item_snapshots.erase(key);
+}
+
+/// Stores the rows a container has in the database.
+static void char_item_snapshot_put(uint64 key, std::vector<struct item>& rows) {
+	std::lock_guard<std::mutex> lock(item_snapshot_mutex);
+
+	item_snapshots[key] = std::move(rows);
+}
+
+/**
+ * Returns the sql_pool key of the owner of a container, jobs of a container run in order.
+ * @param id: Character, account or guild ID
+ * @param tableswitch: Table of the container
+ * @return key for SqlPool_Post
+ */
+uint64 char_sqlpool_key(int id, enum storage_type tableswitch) {
+	switch( tableswitch ) {
+		case TABLE_STORAGE:       return SqlPool_Key(SQLPOOL_KEY_ACCOUNT, id);
+		case TABLE_GUILD_STORAGE: return SqlPool_Key(SQLPOOL_KEY_GUILD, id);
+		default:                  return SqlPool_Key(SQLPOOL_KEY_CHAR, id);
+	}
+}
+
+/**
+ * Forgets the snapshot of a container, the next save reads its rows from the database again.
+ * Has to be called when the rows were changed by another query or are no longer needed.
+ * The removal is queued behind the pending jobs of the container on sql_pool.
+ * @param id: Character, account or guild ID
+ * @param tableswitch: Table of the container
+ * @param stor_id: Storage ID
+ */
+void char_item_snapshot_invalidate(int id, enum storage_type tableswitch, uint8 stor_id) {
+	uint64 key = char_item_snapshot_key(id, tableswitch, stor_id);
+
+	SqlPool_Post(sql_pool, char_sqlpool_key(id, tableswitch), [key]( Sql* handle ){
+		std::lock_guard<std::mutex> lock(item_snapshot_mutex);
+
+		item_snapshots.erase(key);
+	}, nullptr);
+}
+
+/// Returns a hash of the fields identifying an item, see char_item_same.
+static uint64 char_item_identity(const struct item* it) {
+	return it->unique_id ^ ((uint64)it->nameid << 48) ^ ((uint64)it->card[0] << 32) ^ ((uint64)it->card[2] << 16) ^ it->card[3];
+}
+
+/// Checks if two entries are the same item.
+static bool char_item_same(const struct item* a, const struct item* b) {
+	return a->nameid == b->nameid
+		&& a->card[0] == b->card[0]
+		&& a->card[2] == b->card[2]
+		&& a->card[3] == b->card[3]
+		&& a->unique_id == b->unique_id;
+}
+
+/// Checks if any stored field of the same item differs.
+static bool char_item_changed(const struct item* a, const struct item* b, enum storage_type tableswitch) {
+	int j, k;
+
+	ARR_FIND( 0, MAX_SLOTS, j, a->card[j] != b->card[j] );
+	ARR_FIND( 0, MAX_ITEM_RDM_OPT, k, a->option[k].id != b->option[k].id || a->option[k].value != b->option[k].value || a->option[k].param != b->option[k].param );
+
+	return !( j == MAX_SLOTS &&
+		k == MAX_ITEM_RDM_OPT &&
+		a->amount == b->amount &&
+		a->equip == b->equip &&
+		a->identify == b->identify &&
+		a->refine == b->refine &&
+		a->attribute == b->attribute &&
+		a->expire_time == b->expire_time &&
+		a->bound == b->bound &&
+		(tableswitch != TABLE_INVENTORY || (a->favorite == b->favorite && a->equipSwitch == b->equipSwitch)) );
+}
+
+/// Appends the column list of an item row.
+static void char_memitemdata_columns(StringBuf* buf, enum storage_type tableswitch) {
+	int j;
+
+	StringBuf_AppendStr(buf, "`nameid`, `amount`, `equip`, `identify`, `refine`, `attribute`, `expire_time`, `bound`, `unique_id`");
+	if (tableswitch == TABLE_INVENTORY)
+		StringBuf_AppendStr(buf, ", `favorite`, `equip_switch`");
+	for( j = 0; j < MAX_SLOTS; ++j )
+		StringBuf_Printf(buf, ", `card%d`", j);
+	for( j = 0; j < MAX_ITEM_RDM_OPT; ++j ) {
+		StringBuf_Printf(buf, ", `option_id%d`", j);
+		StringBuf_Printf(buf, ", `option_val%d`", j);
+		StringBuf_Printf(buf, ", `option_parm%d`", j);
+	}
+}
+
+/// Appends the values of an item row, in the order of char_memitemdata_columns.
+static void char_memitemdata_values(StringBuf* buf, const struct item* it, enum storage_type tableswitch) {
+	int j;
+
+	StringBuf_Printf(buf, "'%hu', '%d', '%u', '%d', '%d', '%d', '%u', '%d', '%" PRIu64 "'",
+		it->nameid, it->amount, it->equip, it->identify, it->refine, it->attribute, it->expire_time, it->bound, it->unique_id);
+	if (tableswitch == TABLE_INVENTORY)
+		StringBuf_Printf(buf, ", '%d', '%u'", it->favorite, it->equipSwitch);
+	for( j = 0; j < MAX_SLOTS; ++j )
+		StringBuf_Printf(buf, ", '%hu'", it->card[j]);
+	for( j = 0; j < MAX_ITEM_RDM_OPT; ++j ) {
+		StringBuf_Printf(buf, ", '%d'", it->option[j].id);
+		StringBuf_Printf(buf, ", '%d'", it->option[j].value);
+		StringBuf_Printf(buf, ", '%d'", it->option[j].param);
+	}
+}
+
+/// Appends a select without rows that names the row id and the columns of char_memitemdata_columns,
+/// the first select of a union names the columns of the derived table.
+static void char_memitemdata_names(StringBuf* buf, enum storage_type tableswitch) {
+	int j;
+
+	StringBuf_AppendStr(buf, "SELECT NULL AS `id`, NULL AS `nameid`, NULL AS `amount`, NULL AS `equip`, NULL AS `identify`, NULL AS `refine`, NULL AS `attribute`, NULL AS `expire_time`, NULL AS `bound`, NULL AS `unique_id`");
+	if (tableswitch == TABLE_INVENTORY)
+		StringBuf_AppendStr(buf, ", NULL AS `favorite`, NULL AS `equip_switch`");
+	for( j = 0; j < MAX_SLOTS; ++j )
+		StringBuf_Printf(buf, ", NULL AS `card%d`", j);
+	for( j = 0; j < MAX_ITEM_RDM_OPT; ++j ) {
+		StringBuf_Printf(buf, ", NULL AS `option_id%d`", j);
+		StringBuf_Printf(buf, ", NULL AS `option_val%d`", j);
+		StringBuf_Printf(buf, ", NULL AS `option_parm%d`", j);
+	}
+	StringBuf_AppendStr(buf, " FROM DUAL WHERE 0");
+}
+
+/// Reads the rows of a container, item.id is the row id.
+static bool char_memitemdata_select(Sql* sql_handle, const char* tablename, const char* selectoption, int id, enum storage_type tableswitch, std::vector<struct item>& rows) {
+	StringBuf buf;
+	SqlStmt* stmt;
+	int i, offset = 0;
+	struct item item; // temp storage variable
 
 	StringBuf_Init(&buf);
 	StringBuf_AppendStr(&buf, "SELECT `id`, `nameid`, `amount`, `equip`, `identify`, `refine`, `attribute`, `expire_time`, `bound`, `unique_id`");
@@ -584,9 +1214,10 @@ int char_memitemdata_to_sql(const struct item items[], int max, int id, enum sto
 		SqlStmt_ShowDebug(stmt);
 		SqlStmt_Free(stmt);
 		StringBuf_Destroy(&buf);
-		return 1;
+		return false;
 	}
 
+	memset(&item, 0, sizeof(item));
 	SqlStmt_BindColumn(stmt, 0, SQLDT_INT,       &item.id,          0, NULL, NULL);
 	SqlStmt_BindColumn(stmt, 1, SQLDT_USHORT,    &item.nameid,      0, NULL, NULL);
 	SqlStmt_BindColumn(stmt, 2, SQLDT_SHORT,     &item.amount,      0, NULL, NULL);
@@ -608,134 +1239,200 @@ int char_memitemdata_to_sql(const struct item items[], int max, int id, enum sto
 		SqlStmt_BindColumn(stmt, 11+offset+MAX_SLOTS+i*3, SQLDT_SHORT, &item.option[i].value, 0, NULL, NULL);
 		SqlStmt_BindColumn(stmt, 12+offset+MAX_SLOTS+i*3, SQLDT_CHAR, &item.option[i].param, 0, NULL, NULL);
 	}
-	// bit array indicating which inventory items have already been matched
-	flag = (bool*) aCalloc(max, sizeof(bool));
 
+	rows.clear();
 	while( SQL_SUCCESS == SqlStmt_NextRow(stmt) )
+		rows.push_back(item);
+
+	SqlStmt_Free(stmt);
+	StringBuf_Destroy(&buf);
+	return true;
+}
+
+/// Saves an array of 'item' entries into the specified table.
+/// The connection is passed explicitly since this also runs on the workers of sql_pool.
+/// The entries are compared with the snapshot of the rows kept since the last load or save,
+/// only without one the rows are selected first. Items are matched by nameid, cards and unique_id,
+/// deleted, changed and new rows are each written with one statement.
+int char_memitemdata_to_sql(Sql* sql_handle, const struct item items[], int max, int id, enum storage_type tableswitch, uint8 stor_id) {
+	StringBuf buf;
+	int i, errors = 0;
+	const char *tablename, *selectoption, *printname;
+	uint64 key = char_item_snapshot_key(id, tableswitch, stor_id);
+	std::vector<struct item> rows; // rows in the database
+	std::vector<struct item> saved; // rows after the save
+	std::vector<bool> matched; // rows that have already been matched
+	std::vector<int> changed; // rows of saved to update
+	std::vector<int> inserted; // entries to insert
+	std::unordered_multimap<uint64, size_t> lookup;
+	bool snapshot = charserv_config.charcache_config.item_snapshot; // keep the rows after the save
+
+	switch (tableswitch) {
+		case TABLE_INVENTORY:
+			printname = "Inventory";
+			tablename = schema_config.inventory_db;
+			selectoption = "char_id";
+			break;
+		case TABLE_CART:
+			printname = "Cart";
+			tablename = schema_config.cart_db;
+			selectoption = "char_id";
+			break;
+		case TABLE_STORAGE:
+			printname = inter_premiumStorage_getPrintableName(stor_id);
+			tablename = inter_premiumStorage_getTableName(stor_id);
+			selectoption = "account_id";
+			break;
+		case TABLE_GUILD_STORAGE:
+			printname = "Guild Storage";
+			tablename = schema_config.guild_storage_db;
+			selectoption = "guild_id";
+			break;
+		default:
+			ShowError("Invalid table name!\n");
+			return 1;
+	}
+
+	// The following code compares inventory with current database values
+	// and performs modification/deletion/insertion only on relevant rows.
+	// This approach is more complicated than a trivial delete&insert, but
+	// it significantly reduces cpu load on the database server.
+
+	if( !( snapshot && char_item_snapshot_take(key, rows) )
+	&&  !char_memitemdata_select(sql_handle, tablename, selectoption, id, tableswitch, rows) )
+		return 1;
+
+	matched.resize(rows.size(), false);
+	for( size_t r = 0; r < rows.size(); ++r )
+		lookup.emplace(char_item_identity(&rows[r]), r);
+
+	for( i = 0; i < max; ++i )
 	{
-		found = false;
-		// search for the presence of the item in the char's inventory
-		for( i = 0; i < max; ++i )
-		{
-			// skip empty and already matched entries
-			if( items[i].nameid == 0 || flag[i] )
-				continue;
+		// skip empty entries
+		if( items[i].nameid == 0 )
+			continue;
 
-			if( items[i].nameid == item.nameid
-			&&  items[i].card[0] == item.card[0]
-			&&  items[i].card[2] == item.card[2]
-			&&  items[i].card[3] == item.card[3]
-			&&  items[i].unique_id == item.unique_id
-			) {	//They are the same item.
-				int k;
-				
-				ARR_FIND( 0, MAX_SLOTS, j, items[i].card[j] != item.card[j] );
-				ARR_FIND( 0, MAX_ITEM_RDM_OPT, k, items[i].option[k].id != item.option[k].id || items[i].option[k].value != item.option[k].value || items[i].option[k].param != item.option[k].param );
-				
-				if( j == MAX_SLOTS &&
-					k == MAX_ITEM_RDM_OPT &&
-					items[i].amount == item.amount &&
-					items[i].equip == item.equip &&
-					items[i].identify == item.identify &&
-					items[i].refine == item.refine &&
-					items[i].attribute == item.attribute &&
-					items[i].expire_time == item.expire_time &&
-					items[i].bound == item.bound &&
-					(tableswitch != TABLE_INVENTORY || (items[i].favorite == item.favorite && items[i].equipSwitch == item.equipSwitch)) )
-				;	//Do nothing.
-				else
-				{
-					// update all fields.
-					StringBuf_Clear(&buf);
-					StringBuf_Printf(&buf, "UPDATE `%s` SET `amount`='%d', `equip`='%u', `identify`='%d', `refine`='%d',`attribute`='%d', `expire_time`='%u', `bound`='%d', `unique_id`='%" PRIu64 "'",
-						tablename, items[i].amount, items[i].equip, items[i].identify, items[i].refine, items[i].attribute, items[i].expire_time, items[i].bound, items[i].unique_id);
-					if (tableswitch == TABLE_INVENTORY)
-						StringBuf_Printf(&buf, ", `favorite`='%d', `equip_switch`='%u'", items[i].favorite, items[i].equipSwitch);
-					for( j = 0; j < MAX_SLOTS; ++j )
-						StringBuf_Printf(&buf, ", `card%d`=%hu", j, items[i].card[j]);
-					for( j = 0; j < MAX_ITEM_RDM_OPT; ++j ) {
-						StringBuf_Printf(&buf, ", `option_id%d`=%d", j, items[i].option[j].id);
-						StringBuf_Printf(&buf, ", `option_val%d`=%d", j, items[i].option[j].value);
-						StringBuf_Printf(&buf, ", `option_parm%d`=%d", j, items[i].option[j].param);
-					}
-					StringBuf_Printf(&buf, " WHERE `id`='%d' LIMIT 1", item.id);
-
-					if( SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)) )
-					{
-						Sql_ShowDebug(sql_handle);
-						errors++;
-					}
-				}
+		auto range = lookup.equal_range(char_item_identity(&items[i]));
+		size_t found = SIZE_MAX;
+
+		// prefer an unchanged row, so duplicates do not cause needless updates
+		for( auto it = range.first; it != range.second; ++it ) {
+			size_t r = it->second;
 
-				found = flag[i] = true; //Item dealt with,
-				break; //skip to next item in the db.
+			if( matched[r] || !char_item_same(&rows[r], &items[i]) )
+				continue;
+			if( found == SIZE_MAX )
+				found = r;
+			if( !char_item_changed(&rows[r], &items[i], tableswitch) ) {
+				found = r;
+				break;
 			}
 		}
-		if( !found )
-		{// Item not present in inventory, remove it.
-			if( SQL_ERROR == Sql_Query(sql_handle, "DELETE from `%s` where `id`='%d' LIMIT 1", tablename, item.id) )
-			{
-				Sql_ShowDebug(sql_handle);
-				errors++;
-			}
+
+		if( found == SIZE_MAX ) {
+			inserted.push_back(i);
+			continue;
 		}
-	}
-	SqlStmt_Free(stmt);
 
-	StringBuf_Clear(&buf);
-	StringBuf_Printf(&buf, "INSERT INTO `%s`(`%s`, `nameid`, `amount`, `equip`, `identify`, `refine`, `attribute`, `expire_time`, `bound`, `unique_id`", tablename, selectoption);
-	if (tableswitch == TABLE_INVENTORY)
-		StringBuf_Printf(&buf, ", `favorite`, `equip_switch`");
-	for( j = 0; j < MAX_SLOTS; ++j )
-		StringBuf_Printf(&buf, ", `card%d`", j);
-	for( j = 0; j < MAX_ITEM_RDM_OPT; ++j ) {
-		StringBuf_Printf(&buf, ", `option_id%d`", j);
-		StringBuf_Printf(&buf, ", `option_val%d`", j);
-		StringBuf_Printf(&buf, ", `option_parm%d`", j);
+		matched[found] = true;
+		if( char_item_changed(&rows[found], &items[i], tableswitch) )
+			changed.push_back((int)saved.size());
+		saved.push_back(items[i]);
+		saved.back().id = rows[found].id;
 	}
-	StringBuf_AppendStr(&buf, ") VALUES ");
 
-	found = false;
-	// insert non-matched items into the db as new items
-	for( i = 0; i < max; ++i )
-	{
-		// skip empty and already matched entries
-		if( items[i].nameid == 0 || flag[i] )
-			continue;
+	StringBuf_Init(&buf);
 
-		if( found )
-			StringBuf_AppendStr(&buf, ",");
+	// Items no longer present in the inventory
+	for( size_t r = 0; r < rows.size(); ++r ) {
+		if( matched[r] )
+			continue;
+		if( StringBuf_Length(&buf) == 0 )
+			StringBuf_Printf(&buf, "DELETE FROM `%s` WHERE `%s`='%d' AND `id` IN (", tablename, selectoption, id);
 		else
-			found = true;
+			StringBuf_AppendStr(&buf, ",");
+		StringBuf_Printf(&buf, "'%d'", rows[r].id);
+	}
+	if( StringBuf_Length(&buf) > 0 ) {
+		StringBuf_AppendStr(&buf, ")");
+		if( SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)) ) {
+			Sql_ShowDebug(sql_handle);
+			errors++;
+		}
+	}
+
+	// Changed items, all of them are updated by one join with a derived table of the new rows
+	if( !changed.empty() ) {
+		StringBuf_Clear(&buf);
+		StringBuf_Printf(&buf, "UPDATE `%s` AS `dst` JOIN (", tablename);
+		char_memitemdata_names(&buf, tableswitch);
+		for( size_t c = 0; c < changed.size(); ++c ) {
+			const struct item* it = &saved[changed[c]];
+
+			StringBuf_Printf(&buf, " UNION ALL SELECT '%d', ", it->id);
+			char_memitemdata_values(&buf, it, tableswitch);
+		}
+		StringBuf_Printf(&buf, ") AS `src` ON `dst`.`id`=`src`.`id` AND `dst`.`%s`='%d' SET ", selectoption, id);
+		{
+			static const char* fields[] = { "amount", "equip", "identify", "refine", "attribute", "expire_time", "bound", "unique_id" };
 
-		StringBuf_Printf(&buf, "('%d', '%hu', '%d', '%u', '%d', '%d', '%d', '%u', '%d', '%" PRIu64 "'",
-			id, items[i].nameid, items[i].amount, items[i].equip, items[i].identify, items[i].refine, items[i].attribute, items[i].expire_time, items[i].bound, items[i].unique_id);
+			for( size_t f = 0; f < ARRAYLENGTH(fields); ++f )
+				StringBuf_Printf(&buf, "%s`dst`.`%s`=`src`.`%s`", f ? ", " : "", fields[f], fields[f]);
+		}
 		if (tableswitch == TABLE_INVENTORY)
-			StringBuf_Printf(&buf, ", '%d', '%u'", items[i].favorite, items[i].equipSwitch);
-		for( j = 0; j < MAX_SLOTS; ++j )
-			StringBuf_Printf(&buf, ", '%hu'", items[i].card[j]);
-		for( j = 0; j < MAX_ITEM_RDM_OPT; ++j ) {
-			StringBuf_Printf(&buf, ", '%d'", items[i].option[j].id);
-			StringBuf_Printf(&buf, ", '%d'", items[i].option[j].value);
-			StringBuf_Printf(&buf, ", '%d'", items[i].option[j].param);
+			StringBuf_AppendStr(&buf, ", `dst`.`favorite`=`src`.`favorite`, `dst`.`equip_switch`=`src`.`equip_switch`");
+		for( i = 0; i < MAX_SLOTS; ++i )
+			StringBuf_Printf(&buf, ", `dst`.`card%d`=`src`.`card%d`", i, i);
+		for( i = 0; i < MAX_ITEM_RDM_OPT; ++i ) {
+			StringBuf_Printf(&buf, ", `dst`.`option_id%d`=`src`.`option_id%d`", i, i);
+			StringBuf_Printf(&buf, ", `dst`.`option_val%d`=`src`.`option_val%d`", i, i);
+			StringBuf_Printf(&buf, ", `dst`.`option_parm%d`=`src`.`option_parm%d`", i, i);
+		}
+
+		if( SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)) ) {
+			Sql_ShowDebug(sql_handle);
+			errors++;
 		}
-		StringBuf_AppendStr(&buf, ")");
 	}
 
-	if( found && SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)) )
-	{
-		Sql_ShowDebug(sql_handle);
-		errors++;
+	// insert non-matched items into the db as new items
+	if( !inserted.empty() ) {
+		StringBuf_Clear(&buf);
+		StringBuf_Printf(&buf, "INSERT INTO `%s`(`%s`, ", tablename, selectoption);
+		char_memitemdata_columns(&buf, tableswitch);
+		StringBuf_AppendStr(&buf, ") VALUES ");
+		for( size_t n = 0; n < inserted.size(); ++n ) {
+			StringBuf_Printf(&buf, "%s('%d', ", n ? "," : "", id);
+			char_memitemdata_values(&buf, &items[inserted[n]], tableswitch);
+			StringBuf_AppendStr(&buf, ")");
+		}
+
+		if( SQL_ERROR == Sql_QueryStr(sql_handle, StringBuf_Value(&buf)) ) {
+			Sql_ShowDebug(sql_handle);
+			errors++;
+		} else if( snapshot ) {
+			// The ids of a multi-row insert are not consecutive with innodb_autoinc_lock_mode=2,
+			// so the rows are read back. Without them the next save selects the rows itself.
+			if( inserted.size() == 1 ) {
+				saved.push_back(items[inserted[0]]);
+				saved.back().id = (int)Sql_LastInsertId(sql_handle);
+			} else if( !char_memitemdata_select(sql_handle, tablename, selectoption, id, tableswitch, saved) )
+				snapshot = false;
+		}
 	}
 
+	if( snapshot && errors == 0 )
+		char_item_snapshot_put(key, saved);
+
 	ShowInfo("Saved %s (%d) data to table %s for %s: %d\n", printname, stor_id, tablename, selectoption, id);
 	StringBuf_Destroy(&buf);
-	aFree(flag);
 
 	return errors;
 }
 
-bool char_memitemdata_from_sql(struct s_storage* p, int max, int id, enum storage_type tableswitch, uint8 stor_id) {
+/// Loads 'item' entries of the specified table into the storage.
+/// The connection is passed explicitly since this also runs on the workers of sql_pool.
+bool char_memitemdata_from_sql(Sql* sql_handle, struct s_storage* p, int max, int id, enum storage_type tableswitch, uint8 stor_id) {
 	StringBuf buf;
 	SqlStmt* stmt;
 	int i,j, offset = 0, max2;
@@ -769,7 +1466,7 @@ bool char_memitemdata_from_sql(struct s_storage* p, int max, int id, enum storag
 			tablename = schema_config.guild_storage_db;
 			selectoption = "guild_id";
 			storage = p->u.items_guild;
-			max2 = inter_guild_storagemax(id);
+			max2 = max; // inter_guild_storagemax is resolved by the caller, guild_db_ is not thread safe
 			break;
 		default:
 			ShowError("Invalid table name!\n");
@@ -839,6 +1536,13 @@ bool char_memitemdata_from_sql(struct s_storage* p, int max, int id, enum storag
 		memcpy(&storage[i], &item, sizeof(item));
 
 	p->amount = i;
+
+	// The loaded rows are what the next save is compared with, unless some did not fit
+	if( charserv_config.charcache_config.item_snapshot && ( i < max || SQL_SUCCESS != SqlStmt_NextRow(stmt) ) ) {
+		std::vector<struct item> rows(storage, storage + i);
+
+		char_item_snapshot_put(char_item_snapshot_key(id, tableswitch, stor_id), rows);
+	}
 	ShowInfo("Loaded %s data from table %s for %s: %d (total: %d)\n", printname, tablename, selectoption, id, p->amount);
 
 	SqlStmt_FreeResult(stmt);
@@ -1027,6 +1731,12 @@ int char_mmo_char_fromsql(uint32 char_id, struct mmo_charstatus* p, bool load_ev
 
 	if (charserv_config.save_log) ShowInfo("Char load request (%d)\n", char_id);
 
+	if( load_everything && char_cache_load(char_id, p) ) {
+		if (charserv_config.save_log)
+			ShowInfo("Loaded char (%d - %s): from memory\n", char_id, p->name);
+		return 1;
+	}
+
 	stmt = SqlStmt_Malloc(sql_handle);
 	if( stmt == NULL )
 	{
@@ -1239,6 +1949,28 @@ int char_mmo_char_fromsql(uint32 char_id, struct mmo_charstatus* p, bool load_ev
 //==========================================================================================================
 int char_mmo_sql_init(void) {
 	char_db_= idb_alloc(DB_OPT_RELEASE_DATA);
+	char_writeback_db = idb_alloc(DB_OPT_RELEASE_DATA);
+	char_cache_db = idb_alloc(DB_OPT_RELEASE_DATA);
+
+	if( charserv_config.charcache_config.writeback_journal[0] != '\0' ) {
+		char_writeback_replay(charserv_config.charcache_config.writeback_journal);
+		if( charserv_config.charcache_config.writeback_interval <= 0 )
+			remove(charserv_config.charcache_config.writeback_journal);
+		else if( (char_writeback_journal = CharJournal_Open(charserv_config.charcache_config.writeback_journal, charserv_config.charcache_config.writeback_sync)) == NULL )
+			ShowError("Could not open the write-back journal '%s', character saves are only kept in memory until they are written.\n", charserv_config.charcache_config.writeback_journal);
+	}
+	char_writeback = CharWriteback_Create(char_writeback_journal);
+
+	if( charserv_config.charcache_config.writeback_interval > 0 ) {
+		add_timer_func_list(char_writeback_timer, "char_writeback_timer");
+		add_timer_interval(gettick() + charserv_config.charcache_config.writeback_interval, char_writeback_timer, 0, 0, charserv_config.charcache_config.writeback_interval);
+		ShowStatus("Character saves are written every '" CL_WHITE "%d" CL_RESET "' ms, '" CL_WHITE "%d" CL_RESET "' per transaction.\n", charserv_config.charcache_config.writeback_interval, charserv_config.charcache_config.writeback_batch);
+	}
+
+	if( charserv_config.charcache_config.cache_size > 0 ) {
+		add_timer_func_list(char_cache_cleanup, "char_cache_cleanup");
+		add_timer_interval(gettick() + 1000, char_cache_cleanup, 0, 0, 60 * 1000);
+	}
 
 	ShowStatus("Characters per Account: '%d'.\n", charserv_config.char_config.char_per_account);
 
@@ -1295,6 +2027,7 @@ int char_rename_char_sql(struct char_session_data *sd, uint32 char_id)
 			return 8;
 	}
 
+	char_cache_invalidate(char_id);
 	if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `name` = '%s', `rename` = '%d' WHERE `char_id` = '%d'", schema_config.char_db, esc_name, --char_dat.rename, char_id) )
 	{
 		Sql_ShowDebug(sql_handle);
@@ -1524,10 +2257,17 @@ int char_make_new_char_sql(struct char_session_data* sd, char* name_, int str, i
 /* Divorce Players */
 /*----------------------------------------------------------------------------------------------------------*/
 int char_divorce_char_sql(int partner_id1, int partner_id2){
+	char_cache_invalidate(partner_id1);
+	char_cache_invalidate(partner_id2);
 	if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `partner_id`='0' WHERE `char_id`='%d' OR `char_id`='%d' LIMIT 2", schema_config.char_db, partner_id1, partner_id2) )
 		Sql_ShowDebug(sql_handle);
+	// Pending inventory saves would bring the rings back
+	char_writeback_items_now(partner_id1, TABLE_INVENTORY, 0);
+	char_writeback_items_now(partner_id2, TABLE_INVENTORY, 0);
 	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE (`nameid`='%hu' OR `nameid`='%hu') AND (`char_id`='%d' OR `char_id`='%d') LIMIT 2", schema_config.inventory_db, WEDDING_RING_M, WEDDING_RING_F, partner_id1, partner_id2) )
 		Sql_ShowDebug(sql_handle);
+	char_item_snapshot_invalidate(partner_id1, TABLE_INVENTORY, 0);
+	char_item_snapshot_invalidate(partner_id2, TABLE_INVENTORY, 0);
 	chmapif_send_ackdivorce(partner_id1, partner_id2);
 	return 0;
 }
@@ -1617,6 +2357,8 @@ enum e_char_del_response char_delete(struct char_session_data* sd, uint32 char_i
 	{ // Char is Baby
 		unsigned char buf[64];
 
+		char_cache_invalidate(father_id);
+		char_cache_invalidate(mother_id);
 		if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `child`='0' WHERE `char_id`='%d' OR `char_id`='%d'", schema_config.char_db, father_id, mother_id) )
 			Sql_ShowDebug(sql_handle);
 		if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `id` = '410' AND (`char_id`='%d' OR `char_id`='%d')", schema_config.skill_db, father_id, mother_id) )
@@ -1634,6 +2376,11 @@ enum e_char_del_response char_delete(struct char_session_data* sd, uint32 char_i
 		inter_party_leave(party_id, account_id, char_id, name);
 
 	/* delete char's pet */
+	// Queued inventory and cart saves must not bring back deleted items
+	SqlPool_WaitKey(sql_pool, SqlPool_Key(SQLPOOL_KEY_CHAR, char_id));
+	// Neither must pending character saves
+	char_writeback_discard(char_id);
+
 	//Delete the hatched pet if you have one...
 	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `char_id`='%d' AND `incubate` = '0'", schema_config.pet_db, char_id) )
 		Sql_ShowDebug(sql_handle);
@@ -1677,6 +2424,8 @@ enum e_char_del_response char_delete(struct char_session_data* sd, uint32 char_i
 	/* delete cart inventory */
 	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `char_id`='%d'", schema_config.cart_db, char_id) )
 		Sql_ShowDebug(sql_handle);
+	char_item_snapshot_invalidate(char_id, TABLE_INVENTORY, 0);
+	char_item_snapshot_invalidate(char_id, TABLE_CART, 0);
 
 	/* delete memo areas */
 	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `char_id`='%d'", schema_config.memo_db, char_id) )
@@ -2220,6 +2969,7 @@ TIMER_FUNC(char_clan_member_cleanup){
 		return 0;
 	}
 
+	char_cache_clear();
 	if( SQL_ERROR == Sql_Query( sql_handle, "UPDATE `%s` SET `clan_id`='0' WHERE `online`='0' AND `clan_id`<>'0' AND `last_login` IS NOT NULL AND `last_login` <= NOW() - INTERVAL %d DAY", schema_config.char_db, charserv_config.clan_remove_inactive_days ) ){
 		Sql_ShowDebug(sql_handle);
 	}
@@ -2783,6 +3533,14 @@ void char_set_defaults(){
 	charserv_config.default_map_x = 156;
 	charserv_config.default_map_y = 191;
 
+	charserv_config.charcache_config.writeback_interval = 0;
+	charserv_config.charcache_config.writeback_batch = 50;
+	charserv_config.charcache_config.writeback_journal[0] = '\0';
+	charserv_config.charcache_config.writeback_sync = false;
+	charserv_config.charcache_config.cache_size = 0;
+	charserv_config.charcache_config.cache_timeout = 60;
+	charserv_config.charcache_config.item_snapshot = true;
+
 	charserv_config.clan_remove_inactive_days = 14;
 	charserv_config.mail_return_days = 14;
 	charserv_config.mail_delete_days = 14;
@@ -3056,6 +3814,20 @@ bool char_config_read(const char* cfgName, bool normal){
 			charserv_config.charmove_config.char_movetoused = config_switch(w2);
 		} else if (strcmpi(w1, "char_moves_unlimited") == 0) {
 			charserv_config.charmove_config.char_moves_unlimited = config_switch(w2);
+		} else if (strcmpi(w1, "char_writeback_interval") == 0) {
+			charserv_config.charcache_config.writeback_interval = cap_value(atoi(w2), 0, 600000);
+		} else if (strcmpi(w1, "char_writeback_batch") == 0) {
+			charserv_config.charcache_config.writeback_batch = cap_value(atoi(w2), 1, 1000);
+		} else if (strcmpi(w1, "char_writeback_journal") == 0) {
+			safestrncpy(charserv_config.charcache_config.writeback_journal, w2, sizeof(charserv_config.charcache_config.writeback_journal));
+		} else if (strcmpi(w1, "char_writeback_sync") == 0) {
+			charserv_config.charcache_config.writeback_sync = config_switch(w2);
+		} else if (strcmpi(w1, "char_cache_size") == 0) {
+			charserv_config.charcache_config.cache_size = cap_value(atoi(w2), 0, 100000);
+		} else if (strcmpi(w1, "char_cache_timeout") == 0) {
+			charserv_config.charcache_config.cache_timeout = cap_value(atoi(w2), 1, 86400);
+		} else if (strcmpi(w1, "char_item_snapshot") == 0) {
+			charserv_config.charcache_config.item_snapshot = config_switch(w2);
 		} else if (strcmpi(w1, "char_checkdb") == 0) {
 			charserv_config.char_check_db = config_switch(w2);
 		} else if (strcmpi(w1, "default_map") == 0) {
@@ -3115,6 +3887,12 @@ void do_final(void)
 	char_set_all_offline(-1);
 	char_set_all_offline_sql();
 
+	// The journal is kept for the next start if anything could not be written
+	CharJournal_Close(char_writeback_journal, char_writeback_flush() == 0);
+	char_writeback_journal = NULL;
+	CharWriteback_Destroy(char_writeback);
+	char_writeback = NULL;
+
 	inter_final();
 
 	flush_fifos();
@@ -3124,6 +3902,8 @@ void do_final(void)
 	do_final_chlogif();
 
 	char_db_->destroy(char_db_, NULL);
+	char_writeback_db->destroy(char_writeback_db, NULL);
+	char_cache_db->destroy(char_cache_db, NULL);
 	online_char_db->destroy(online_char_db, NULL);
 	auth_db->destroy(auth_db, NULL);
 
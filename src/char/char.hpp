@@ -9,6 +9,7 @@
 #include "../common/core.hpp" // CORE_ST_LAST
 #include "../common/mmo.hpp"
 #include "../common/msg_conf.hpp"
+#include "../common/sql.hpp"
 #include "../common/timer.hpp"
 #include "../config/core.hpp"
 
@@ -141,6 +142,16 @@ struct Char_Config {
 	bool char_rename_guild;	// Character renaming in a guild
 };
 
+struct CharCache_Config {
+	int writeback_interval; // ms between writes of character saves, 0: write every save immediately
+	int writeback_batch; // characters per transaction
+	char writeback_journal[256]; // file receiving the saves until they are written, empty: none
+	bool writeback_sync; // fsync the journal after every save
+	int cache_size; // characters kept in memory after logging out, 0: none
+	int cache_timeout; // seconds they are kept
+	bool item_snapshot; // keep the saved item rows in memory, saves only write the changes
+};
+
 #define TRIM_CHARS "\255\xA0\032\t\x0A\x0D " //The following characters are trimmed regardless because they cause confusion and problems on the servers. [Skotlex]
 struct CharServ_Config {
 	char userid[24];
@@ -161,6 +172,7 @@ struct CharServ_Config {
 
 	struct CharMove_Config charmove_config;
 	struct Char_Config char_config;
+	struct CharCache_Config charcache_config;
 #if PACKETVER_SUPPORTS_PINCODE
 	struct Pincode_Config pincode_config;
 #endif
@@ -199,6 +211,7 @@ struct mmo_map_server {
 	uint16 port;
 	int users;
 	std::vector<uint16> map;
+	uint32 session_id; // changes with every connection, see chmapif_session
 };
 extern struct mmo_map_server map_server[MAX_MAP_SERVERS];
 
@@ -286,11 +299,23 @@ int char_mmo_char_tobuf(uint8* buffer, struct mmo_charstatus* p);
 int char_mmo_char_tosql(uint32 char_id, struct mmo_charstatus* p);
 int char_mmo_char_fromsql(uint32 char_id, struct mmo_charstatus* p, bool load_everything);
 int char_mmo_chars_fromsql(struct char_session_data* sd, uint8* buf, uint8* count = nullptr);
+bool char_writeback_now(uint32 char_id);
+void char_writeback_discard(uint32 char_id);
+bool char_writeback_items_add(int id, enum storage_type type, int max, struct s_storage* stor);
+bool char_writeback_items_load(int id, enum storage_type type, uint8 stor_id, struct s_storage* stor);
+bool char_writeback_items_now(int id, enum storage_type type, uint8 stor_id);
+void char_writeback_items_discard(int id, enum storage_type type, uint8 stor_id);
+TIMER_FUNC(char_writeback_timer);
+void char_cache_invalidate(uint32 char_id);
+void char_cache_clear(void);
+TIMER_FUNC(char_cache_cleanup);
 enum e_char_del_response char_delete(struct char_session_data* sd, uint32 char_id);
 int char_rename_char_sql(struct char_session_data *sd, uint32 char_id);
 int char_divorce_char_sql(int partner_id1, int partner_id2);
-int char_memitemdata_to_sql(const struct item items[], int max, int id, enum storage_type tableswitch, uint8 stor_id);
-bool char_memitemdata_from_sql(struct s_storage* p, int max, int id, enum storage_type tableswitch, uint8 stor_id);
+uint64 char_sqlpool_key(int id, enum storage_type tableswitch);
+void char_item_snapshot_invalidate(int id, enum storage_type tableswitch, uint8 stor_id);
+int char_memitemdata_to_sql(Sql* sql_handle, const struct item items[], int max, int id, enum storage_type tableswitch, uint8 stor_id);
+bool char_memitemdata_from_sql(Sql* sql_handle, struct s_storage* p, int max, int id, enum storage_type tableswitch, uint8 stor_id);
 
 int char_married(int pl1,int pl2);
 int char_child(int parent_id, int child_id);
@@ -97,6 +97,9 @@ int chclif_parse_moveCharSlot( int fd, struct char_session_data* sd){
 		Sql_Query(sql_handle, "UPDATE `%s` SET `moves`='%d' WHERE `char_id`='%d'", schema_config.char_db, sd->char_moves[from], sd->found_char[from] );
 	}
 
+	char_cache_invalidate(sd->found_char[from]);
+	char_cache_invalidate(sd->found_char[to]);
+
 	// We successfully moved the char - time to notify the client
 	chclif_moveCharSlotReply( fd, sd, from, 0 );
 	chclif_mmo_char_send(fd, sd);
@@ -531,6 +534,7 @@ int chclif_parse_char_delete2_req(int fd, struct char_session_data* sd) {
 		// success
 		delete_date = time(NULL)+(charserv_config.char_config.char_del_delay);
 
+		char_cache_invalidate(char_id);
 		if( SQL_SUCCESS != Sql_Query(sql_handle, "UPDATE `%s` SET `delete_date`='%lu' WHERE `char_id`='%d'", schema_config.char_db, (unsigned long)delete_date, char_id) )
 		{
 			Sql_ShowDebug(sql_handle);
@@ -649,6 +653,7 @@ int chclif_parse_char_delete2_cancel(int fd, struct char_session_data* sd) {
 	// there is no need to check, whether or not the character was
 	// queued for deletion, as the client prints an error message by
 	// itself, if it was not the case (@see char_delete2_cancel_ack)
+	char_cache_invalidate(char_id);
 	if( SQL_SUCCESS != Sql_Query(sql_handle, "UPDATE `%s` SET `delete_date`='0' WHERE `char_id`='%d'", schema_config.char_db, char_id) )
 	{
 		Sql_ShowDebug(sql_handle);
@@ -1151,6 +1156,7 @@ void chclif_block_character( int fd, struct char_session_data* sd){
 			else {
 				WFIFOL(fd, 4+j*24) = 0;
 				sd->unban_time[i] = 0;
+				char_cache_invalidate(sd->found_char[i]);
 				if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `unban_time`='0' WHERE `char_id`='%d' LIMIT 1", schema_config.char_db, sd->found_char[i]) )
 					Sql_ShowDebug(sql_handle);
 			}
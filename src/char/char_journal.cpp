@@ -0,0 +1,244 @@
+// Copyright (c) rAthena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#include "char_journal.hpp"
+
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+/// Largest entry accepted by the replay, guards against damaged lengths
+#define CHARJOURNAL_MAX_ENTRY (16*1024*1024)
+
+struct CharJournal {
+	FILE* fp;
+	std::string filename;
+	bool sync;
+};
+
+/// Latest save of a key
+struct s_charwriteback_save {
+	uint8 type;
+	std::vector<uint8> data;
+};
+
+struct CharWriteback {
+	CharJournal* journal;
+	std::unordered_map<uint64, struct s_charwriteback_save> saves;
+};
+
+/// FNV-1a of the type, length and data of an entry
+static uint32 charjournal_checksum(uint8 type, const void* data, uint32 length) {
+	const uint8* p = (const uint8*)data;
+	uint32 hash = 2166136261U;
+	uint32 i;
+
+	hash = ( hash ^ type ) * 16777619U;
+	for( i = 0; i < 4; i++ )
+		hash = ( hash ^ ( ( length >> ( i * 8 ) ) & 0xFF ) ) * 16777619U;
+	for( i = 0; i < length; i++ )
+		hash = ( hash ^ p[i] ) * 16777619U;
+	return hash;
+}
+
+static bool charjournal_sync(CharJournal* self) {
+	if( fflush(self->fp) != 0 )
+		return false;
+	if( !self->sync )
+		return true;
+#ifdef WIN32
+	return _commit(_fileno(self->fp)) == 0;
+#else
+	return fsync(fileno(self->fp)) == 0;
+#endif
+}
+
+CharJournal* CharJournal_Open(const char* filename, bool sync) {
+	FILE* fp = fopen(filename, "wb");
+
+	if( fp == NULL )
+		return NULL;
+
+	CharJournal* self = new CharJournal();
+
+	self->fp = fp;
+	self->filename = filename;
+	self->sync = sync;
+	return self;
+}
+
+bool CharJournal_Append(CharJournal* self, uint8 type, const void* data, uint32 length) {
+	uint32 checksum = charjournal_checksum(type, data, length);
+
+	if( fwrite(&type, sizeof(type), 1, self->fp) != 1
+	||	fwrite(&length, sizeof(length), 1, self->fp) != 1
+	||	( length > 0 && fwrite(data, length, 1, self->fp) != 1 )
+	||	fwrite(&checksum, sizeof(checksum), 1, self->fp) != 1 )
+	{
+		clearerr(self->fp);
+		return false;
+	}
+
+	return charjournal_sync(self);
+}
+
+bool CharJournal_Truncate(CharJournal* self) {
+	if( fflush(self->fp) != 0 )
+		return false;
+#ifdef WIN32
+	if( _chsize(_fileno(self->fp), 0) != 0 )
+		return false;
+#else
+	if( ftruncate(fileno(self->fp), 0) != 0 )
+		return false;
+#endif
+	rewind(self->fp);
+	return charjournal_sync(self);
+}
+
+void CharJournal_Close(CharJournal* self, bool remove) {
+	if( self == NULL )
+		return;
+	fclose(self->fp);
+	if( remove )
+		::remove(self->filename.c_str());
+	delete self;
+}
+
+int CharJournal_Replay(const char* filename, CharJournalFunc func) {
+	FILE* fp = fopen(filename, "rb");
+	std::vector<uint8> data;
+	uint8 type;
+	uint32 length, checksum;
+	int count = 0;
+
+	if( fp == NULL )
+		return -1;
+
+	while( fread(&type, sizeof(type), 1, fp) == 1 ) {
+		if( fread(&length, sizeof(length), 1, fp) != 1 || length > CHARJOURNAL_MAX_ENTRY )
+			break;
+		data.resize(length);
+		if( ( length > 0 && fread(data.data(), length, 1, fp) != 1 )
+		||	fread(&checksum, sizeof(checksum), 1, fp) != 1
+		||	checksum != charjournal_checksum(type, data.data(), length) )
+			break; // torn entry of the crash, everything before it is complete
+
+		func(type, data.data(), length);
+		count++;
+	}
+
+	fclose(fp);
+	return count;
+}
+
+CharWriteback* CharWriteback_Create(CharJournal* journal) {
+	CharWriteback* self = new CharWriteback();
+
+	self->journal = journal;
+	return self;
+}
+
+void CharWriteback_Destroy(CharWriteback* self) {
+	delete self;
+}
+
+bool CharWriteback_Put(CharWriteback* self, uint64 key, uint8 type, const void* data, uint32 length) {
+	struct s_charwriteback_save& save = self->saves[key];
+
+	save.type = type;
+	save.data.assign((const uint8*)data, (const uint8*)data + length);
+	return self->journal == NULL || CharJournal_Append(self->journal, type, data, length);
+}
+
+const void* CharWriteback_Get(CharWriteback* self, uint64 key, uint8* type, uint32* length) {
+	auto it = self->saves.find(key);
+
+	if( it == self->saves.end() )
+		return NULL;
+	if( type != NULL )
+		*type = it->second.type;
+	if( length != NULL )
+		*length = (uint32)it->second.data.size();
+	return it->second.data.data();
+}
+
+void CharWriteback_Remove(CharWriteback* self, uint64 key) {
+	self->saves.erase(key);
+}
+
+std::vector<uint64> CharWriteback_Keys(CharWriteback* self) {
+	std::vector<uint64> keys;
+
+	keys.reserve(self->saves.size());
+	for( const auto& it : self->saves )
+		keys.push_back(it.first);
+	return keys;
+}
+
+size_t CharWriteback_Size(CharWriteback* self) {
+	return self->saves.size();
+}
+
+int CharWriteback_Flush(CharWriteback* self, const std::vector<std::vector<uint64>>& groups, size_t batch, CharWritebackFunc func) {
+	std::vector<std::vector<uint64>> part;
+	int failed = 0;
+	size_t i = 0;
+
+	if( batch == 0 )
+		batch = 1;
+
+	while( i < groups.size() ) {
+		part.clear();
+		for( ; i < groups.size() && part.size() < batch; i++ ) {
+			std::vector<uint64> group;
+
+			for( uint64 key : groups[i] ) {
+				if( self->saves.find(key) != self->saves.end() && std::find(group.begin(), group.end(), key) == group.end() )
+					group.push_back(key);
+			}
+			if( !group.empty() )
+				part.push_back(std::move(group));
+		}
+		if( part.empty() )
+			continue;
+
+		if( !func(part) ) {
+			failed += (int)part.size();
+			continue;
+		}
+		for( const std::vector<uint64>& group : part ) {
+			for( uint64 key : group )
+				self->saves.erase(key);
+		}
+	}
+
+	return failed;
+}
+
+bool CharWriteback_Truncate(CharWriteback* self) {
+	if( self->journal == NULL || !self->saves.empty() )
+		return true;
+	return CharJournal_Truncate(self->journal);
+}
+
+int CharWriteback_Load(CharWriteback* self, const char* filename, CharWritebackKeyFunc key) {
+	return CharJournal_Replay(filename, [self, &key]( uint8 type, const void* data, uint32 length ) {
+		uint64 k = key(type, data, length);
+
+		if( k == 0 )
+			return;
+
+		struct s_charwriteback_save& save = self->saves[k];
+
+		save.type = type;
+		save.data.assign((const uint8*)data, (const uint8*)data + length);
+	});
+}
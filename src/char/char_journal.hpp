@@ -0,0 +1,103 @@
+// Copyright (c) rAthena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#ifndef CHAR_JOURNAL_HPP
+#define CHAR_JOURNAL_HPP
+
+#include <functional>
+#include <vector>
+
+#include "../common/cbasetypes.hpp"
+
+// Journal of the write-back cache
+//
+// Saves that are kept in memory by the write-back cache are appended to the
+// journal before they are acknowledged to the map-server. Every entry is
+// <type>.B <length>.L <data>.?B <checksum>.L, an entry that was not written
+// completely when the process died fails its checksum and ends the replay.
+// The journal is truncated once everything it holds is in the database, so
+// a replay after a crash only has to apply the entries of the current window.
+
+struct CharJournal;// Journal writer (private access)
+typedef struct CharJournal CharJournal;
+
+/// Called for every complete entry of a journal, in the order they were appended
+typedef std::function<void( uint8 type, const void* data, uint32 length )> CharJournalFunc;
+
+/// Creates an empty journal, an existing file is truncated.
+/// @param sync: fsync every entry, otherwise entries survive a crash of the process but not of the system
+/// @return Journal or NULL if the file could not be opened
+CharJournal* CharJournal_Open(const char* filename, bool sync);
+
+/// Appends an entry.
+/// @return false if the entry could not be written
+bool CharJournal_Append(CharJournal* self, uint8 type, const void* data, uint32 length);
+
+/// Removes all entries, has to be called only after everything is in the database.
+/// @return false if the file could not be truncated, it keeps its entries then
+bool CharJournal_Truncate(CharJournal* self);
+
+/// Closes the journal, removing the file if everything is in the database.
+void CharJournal_Close(CharJournal* self, bool remove);
+
+/// Reads the complete entries of a journal.
+/// @return Number of entries, -1 if the file does not exist
+int CharJournal_Replay(const char* filename, CharJournalFunc func);
+
+// Pending saves of the write-back cache
+//
+// Holds the latest save of every key until it is in the database. Every save is
+// appended to the journal before it is kept. A flush writes the saves in groups,
+// a group that fails stays pending, and the journal is only truncated once
+// nothing is pending, so a save leaves the journal only after it was written.
+
+struct CharWriteback;// Pending saves (private access)
+typedef struct CharWriteback CharWriteback;
+
+/// Writes groups of pending saves in one transaction
+/// @return false if the transaction failed, the saves stay pending then
+typedef std::function<bool( const std::vector<std::vector<uint64>>& groups )> CharWritebackFunc;
+
+/// Returns the key of a journal entry, 0 ignores the entry
+typedef std::function<uint64( uint8 type, const void* data, uint32 length )> CharWritebackKeyFunc;
+
+/// Creates an empty set of pending saves.
+/// @param journal: Journal receiving the saves or NULL
+CharWriteback* CharWriteback_Create(CharJournal* journal);
+
+/// Frees the pending saves, the journal is not closed.
+void CharWriteback_Destroy(CharWriteback* self);
+
+/// Keeps a save, replacing the pending save of the key.
+/// @return false if the save could not be appended to the journal, it is only kept in memory then
+bool CharWriteback_Put(CharWriteback* self, uint64 key, uint8 type, const void* data, uint32 length);
+
+/// Returns the pending save of a key or NULL.
+/// @param type: Receives the entry type, can be NULL
+/// @param length: Receives the length, can be NULL
+const void* CharWriteback_Get(CharWriteback* self, uint64 key, uint8* type, uint32* length);
+
+/// Forgets the pending save of a key without writing it.
+void CharWriteback_Remove(CharWriteback* self, uint64 key);
+
+/// Returns the keys of all pending saves.
+std::vector<uint64> CharWriteback_Keys(CharWriteback* self);
+
+/// Returns the number of pending saves.
+size_t CharWriteback_Size(CharWriteback* self);
+
+/// Writes pending saves, batch groups per call of func.
+/// Keys without a pending save are left out, the saves of a successful call are removed.
+/// @return Number of groups that could not be written
+int CharWriteback_Flush(CharWriteback* self, const std::vector<std::vector<uint64>>& groups, size_t batch, CharWritebackFunc func);
+
+/// Empties the journal if nothing is pending.
+/// @return false if the journal could not be truncated, it is replayed on the next start then
+bool CharWriteback_Truncate(CharWriteback* self);
+
+/// Adds the saves of a journal left behind by a crash, the latest save of every key is kept.
+/// The saves are not appended to the journal of self.
+/// @return Number of entries, -1 if the file does not exist
+int CharWriteback_Load(CharWriteback* self, const char* filename, CharWritebackKeyFunc key);
+
+#endif /* CHAR_JOURNAL_HPP */
@@ -1203,6 +1203,7 @@ int chmapif_parse_reqcharban(int fd){
 			unban_time += timediff; //alterate the time
 			if( unban_time < now ) unban_time=0; //we have totally reduce the time
 
+			char_cache_invalidate(t_cid);
 			if( SQL_SUCCESS != SqlStmt_Prepare(stmt,
 					  "UPDATE `%s` SET `unban_time` = ? WHERE `char_id` = ? LIMIT 1",
 					  schema_config.char_db)
@@ -1243,6 +1244,7 @@ int chmapif_parse_reqcharunban(int fd){
 		RFIFOSKIP(fd,6+NAME_LENGTH);
 
 		Sql_EscapeStringLen(sql_handle, esc_name, name, strnlen(name, NAME_LENGTH));
+		char_cache_clear();
 		if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `unban_time` = '0' WHERE `name` = '%s' LIMIT 1", schema_config.char_db, esc_name) ) {
 			Sql_ShowDebug(sql_handle);
 			return 1;
@@ -1452,8 +1454,42 @@ int chmapif_parse(int fd){
 }
 
 
+/**
+ * Identifies the connection of a map-server, for replies that are sent once a query has finished.
+ * @param fd: map-serv fd
+ * @return : the session id, 0 if fd is not a map-serv
+ */
+uint32 chmapif_session(int fd){
+	int i;
+
+	ARR_FIND( 0, ARRAYLENGTH(map_server), i, fd == map_server[i].fd );
+	if( fd < 0 || i == ARRAYLENGTH(map_server) )
+		return 0;
+	return map_server[i].session_id;
+}
+
+/**
+ * Checks that fd is still the map-server connection identified by chmapif_session.
+ * The fd may have been closed and reused by another connection in the meantime.
+ * @param fd: map-serv fd
+ * @param session_id: id returned by chmapif_session
+ * @return : true if replies can be sent to fd
+ */
+bool chmapif_session_isactive(int fd, uint32 session_id){
+	return session_id != 0 && session_isActive(fd) && chmapif_session(fd) == session_id;
+}
+
 // Initialization process (currently only initialization inter_mapif)
 int chmapif_init(int fd){
+	static uint32 session_counter = 0;
+	int i;
+
+	ARR_FIND( 0, ARRAYLENGTH(map_server), i, fd == map_server[i].fd );
+	if( i < ARRAYLENGTH(map_server) ){
+		if( ++session_counter == 0 )
+			session_counter = 1;
+		map_server[i].session_id = session_counter;
+	}
 	return inter_mapif_init(fd);
 }
 
@@ -9,6 +9,8 @@
 int chmapif_sendall(unsigned char *buf, unsigned int len);
 int chmapif_sendallwos(int sfd, unsigned char *buf, unsigned int len);
 int chmapif_send(int fd, unsigned char *buf, unsigned int len);
+uint32 chmapif_session(int fd);
+bool chmapif_session_isactive(int fd, uint32 session_id);
 int chmapif_send_fame_list(int fd);
 void chmapif_update_fame_list(int type, int index, int fame);
 void chmapif_sendall_playercount(int users);
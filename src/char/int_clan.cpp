@@ -21,6 +21,7 @@
 static DBMap* clan_db; // int clan_id -> struct clan*
 
 int inter_clan_removemember_tosql(uint32 account_id, uint32 char_id){
+	char_cache_invalidate(char_id);
 	if( SQL_ERROR == Sql_Query( sql_handle, "UPDATE `%s` SET `clan_id` = '0' WHERE `char_id` = '%d'", schema_config.char_db, char_id ) ){
 		Sql_ShowDebug( sql_handle );
 		return 1;
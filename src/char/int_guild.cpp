@@ -6,12 +6,14 @@
 #include <stdlib.h>
 #define __STDC_WANT_LIB_EXT1__ 1
 #include <string.h>
+#include <memory>
 
 #include "../common/cbasetypes.hpp"
 #include "../common/malloc.hpp"
 #include "../common/mmo.hpp"
 #include "../common/showmsg.hpp"
 #include "../common/socket.hpp"
+#include "../common/sqlpool.hpp"
 #include "../common/strlib.hpp"
 #include "../common/timer.hpp"
 
@@ -46,6 +48,7 @@ int mapif_guild_basicinfochanged(int guild_id,int type,const void *data,int len)
 int mapif_guild_info(int fd,struct guild *g);
 int guild_break_sub(int key,void *data,va_list ap);
 int inter_guild_tosql(struct guild *g,int flag);
+void inter_guild_tosql_async(struct guild *g,int flag);
 int guild_checkskill(struct guild *g, int id);
 
 TIMER_FUNC(guild_save_timer){
@@ -64,7 +67,7 @@ TIMER_FUNC(guild_save_timer){
 			state++; //Save next guild in the list.
 		else if( state == 1 && g->save_flag&GS_MASK )
 		{
-			inter_guild_tosql(g, g->save_flag&GS_MASK);
+			inter_guild_tosql_async(g, g->save_flag&GS_MASK);
 			g->save_flag &= ~GS_MASK;
 
 			//Some guild saved.
@@ -76,6 +79,7 @@ TIMER_FUNC(guild_save_timer){
 		{// Nothing to save, guild is ready for removal.
 			if (charserv_config.save_log)
 				ShowInfo("Guild Unloaded (%d - %s)\n", g->guild_id, g->name);
+			char_item_snapshot_invalidate(g->guild_id, TABLE_GUILD_STORAGE, 0);
 			db_remove(guild_db_, key);
 		}
 	}
@@ -94,13 +98,15 @@ int inter_guild_removemember_tosql(uint32 account_id, uint32 char_id)
 {
 	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE from `%s` where `account_id` = '%d' and `char_id` = '%d'", schema_config.guild_member_db, account_id, char_id) )
 		Sql_ShowDebug(sql_handle);
+	char_cache_invalidate(char_id);
 	if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `guild_id` = '0' WHERE `char_id` = '%d'", schema_config.char_db, char_id) )
 		Sql_ShowDebug(sql_handle);
 	return 0;
 }
 
 // Save guild into sql
-int inter_guild_tosql(struct guild *g,int flag)
+// The connection is passed explicitly since this also runs on the workers of sql_pool.
+static int inter_guild_tosql_sub(Sql* sql_handle, struct guild *g, int flag)
 {
 	// Table guild (GS_BASIC_MASK)
 	// GS_EMBLEM `emblem_len`,`emblem_id`,`emblem_data`
@@ -335,6 +341,42 @@ int inter_guild_tosql(struct guild *g,int flag)
 	return 1;
 }
 
+// Save guild into sql, waits for queued saves of the guild first
+int inter_guild_tosql(struct guild *g,int flag)
+{
+	if( g->guild_id > 0 )
+		SqlPool_WaitKey(sql_pool, SqlPool_Key(SQLPOOL_KEY_GUILD, g->guild_id));
+
+	return inter_guild_tosql_sub(sql_handle, g, flag);
+}
+
+// Queue a save of an existing guild on sql_pool, the guild is copied as is
+void inter_guild_tosql_async(struct guild *g,int flag)
+{
+	int i;
+
+	if( g->guild_id <= 0 )
+	{// new guilds need their id right away
+		inter_guild_tosql(g, flag);
+		return;
+	}
+
+	std::shared_ptr<struct guild> copy = std::make_shared<struct guild>(*g);
+
+	// The copy carries the modified flags, the cached guild is up to date from now on
+	if( flag&GS_MEMBER )
+		for( i = 0; i < g->max_member; i++ )
+			if( g->member[i].account_id )
+				g->member[i].modified = GS_MEMBER_UNMODIFIED;
+	if( flag&GS_POSITION )
+		for( i = 0; i < MAX_GUILDPOSITION; i++ )
+			g->position[i].modified = GS_POSITION_UNMODIFIED;
+
+	SqlPool_Post(sql_pool, SqlPool_Key(SQLPOOL_KEY_GUILD, g->guild_id), [copy, flag]( Sql* handle ){
+		inter_guild_tosql_sub(handle, copy.get(), flag);
+	}, nullptr);
+}
+
 // Read guild from sql
 struct guild * inter_guild_fromsql(int guild_id)
 {
@@ -355,6 +397,9 @@ struct guild * inter_guild_fromsql(int guild_id)
 	ShowInfo("Guild load request (%d)...\n", guild_id);
 #endif
 
+	// The guild could have been unloaded with its last save still queued
+	SqlPool_WaitKey(sql_pool, SqlPool_Key(SQLPOOL_KEY_GUILD, guild_id));
+
 	if( SQL_ERROR == Sql_Query(sql_handle, "SELECT g.`name`,c.`name`,g.`guild_lv`,g.`connect_member`,g.`max_member`,g.`average_lv`,g.`exp`,g.`next_exp`,g.`skill_point`,g.`mes1`,g.`mes2`,g.`emblem_len`,g.`emblem_id`,COALESCE(UNIX_TIMESTAMP(g.`last_master_change`),0), g.`emblem_data` "
 		"FROM `%s` g LEFT JOIN `%s` c ON c.`char_id` = g.`char_id` WHERE g.`guild_id`='%d'", schema_config.guild_db, schema_config.char_db, guild_id) )
 	{
@@ -1294,6 +1339,7 @@ int mapif_parse_GuildLeave(int fd, int guild_id, uint32 account_id, uint32 char_
 	if( g == NULL )
 	{
 		// Unknown guild, just update the player
+		char_cache_invalidate(char_id);
 		if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `guild_id`='0' WHERE `account_id`='%d' AND `char_id`='%d'", schema_config.char_db, account_id, char_id) )
 			Sql_ShowDebug(sql_handle);
 		// mapif_guild_withdraw(guild_id,account_id,char_id,flag,g->member[i].name,mes);
@@ -1405,6 +1451,9 @@ int mapif_parse_BreakGuild(int fd,int guild_id)
 	if(g==NULL)
 		return 0;
 
+	// Queued saves must not bring back rows of the broken guild
+	SqlPool_WaitKey(sql_pool, SqlPool_Key(SQLPOOL_KEY_GUILD, guild_id));
+
 	// Delete guild from sql
 	//printf("- Delete guild %d from guild\n",guild_id);
 	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `guild_id` = '%d'", schema_config.guild_db, guild_id) )
@@ -1416,8 +1465,10 @@ int mapif_parse_BreakGuild(int fd,int guild_id)
 	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `guild_id` = '%d'", schema_config.guild_castle_db, guild_id) )
 		Sql_ShowDebug(sql_handle);
 
+	char_writeback_items_discard(guild_id, TABLE_GUILD_STORAGE, 0);
 	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `guild_id` = '%d'", schema_config.guild_storage_db, guild_id) )
 		Sql_ShowDebug(sql_handle);
+	char_item_snapshot_invalidate(guild_id, TABLE_GUILD_STORAGE, 0);
 
 	if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `guild_id` = '%d' OR `alliance_id` = '%d'", schema_config.guild_alliance_db, guild_id, guild_id) )
 		Sql_ShowDebug(sql_handle);
@@ -1432,6 +1483,7 @@ int mapif_parse_BreakGuild(int fd,int guild_id)
 		Sql_ShowDebug(sql_handle);
 
 	//printf("- Update guild %d of char\n",guild_id);
+	char_cache_clear();
 	if( SQL_ERROR == Sql_Query(sql_handle, "UPDATE `%s` SET `guild_id`='0' WHERE `guild_id`='%d'", schema_config.char_db, guild_id) )
 		Sql_ShowDebug(sql_handle);
 
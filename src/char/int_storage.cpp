@@ -4,17 +4,21 @@
 #pragma warning(disable:4800) //forcing value to bool
 #include "int_storage.hpp"
 
+#include <memory>
 #include <stdlib.h>
 #include <string.h>
+#include <vector>
 
 #include "../common/malloc.hpp"
 #include "../common/mmo.hpp"
 #include "../common/showmsg.hpp"
 #include "../common/socket.hpp"
 #include "../common/sql.hpp"
+#include "../common/sqlpool.hpp"
 #include "../common/strlib.hpp" // StringBuf
 
 #include "char.hpp"
+#include "char_mapif.hpp"
 #include "inter.hpp"
 #include "int_guild.hpp"
 
@@ -65,69 +69,75 @@ const char *inter_premiumStorage_getPrintableName(uint8 id) {
 
 /**
  * Save inventory entries to SQL
+ * @param handle: Connection to use
  * @param char_id: Character ID to save
  * @param p: Inventory entries
  * @return 0 if success, or error count
  */
-int inventory_tosql(uint32 char_id, struct s_storage* p)
+int inventory_tosql(Sql* handle, uint32 char_id, struct s_storage* p)
 {
-	return char_memitemdata_to_sql(p->u.items_inventory, MAX_INVENTORY, char_id, TABLE_INVENTORY, p->stor_id);
+	return char_memitemdata_to_sql(handle, p->u.items_inventory, MAX_INVENTORY, char_id, TABLE_INVENTORY, p->stor_id);
 }
 
 /**
  * Save storage entries to SQL
+ * @param handle: Connection to use
  * @param char_id: Character ID to save
  * @param p: Storage entries
  * @return 0 if success, or error count
  */
-int storage_tosql(uint32 account_id, struct s_storage* p)
+int storage_tosql(Sql* handle, uint32 account_id, struct s_storage* p)
 {
-	return char_memitemdata_to_sql(p->u.items_storage, MAX_STORAGE, account_id, TABLE_STORAGE, p->stor_id);
+	return char_memitemdata_to_sql(handle, p->u.items_storage, MAX_STORAGE, account_id, TABLE_STORAGE, p->stor_id);
 }
 
 /**
  * Save cart entries to SQL
+ * @param handle: Connection to use
  * @param char_id: Character ID to save
  * @param p: Cart entries
  * @return 0 if success, or error count
  */
-int cart_tosql(uint32 char_id, struct s_storage* p)
+int cart_tosql(Sql* handle, uint32 char_id, struct s_storage* p)
 {
-	return char_memitemdata_to_sql(p->u.items_cart, MAX_CART, char_id, TABLE_CART, p->stor_id);
+	return char_memitemdata_to_sql(handle, p->u.items_cart, MAX_CART, char_id, TABLE_CART, p->stor_id);
 }
 
 /**
  * Fetch inventory entries from table
+ * @param handle: Connection to use
  * @param char_id: Character ID to fetch
  * @param p: Inventory entries
  * @return True if success, False if failed
  */
-bool inventory_fromsql(uint32 char_id, struct s_storage* p)
+bool inventory_fromsql(Sql* handle, uint32 char_id, struct s_storage* p)
 {
-	return char_memitemdata_from_sql( p, MAX_INVENTORY, char_id, TABLE_INVENTORY, p->stor_id );
+	return char_memitemdata_from_sql( handle, p, MAX_INVENTORY, char_id, TABLE_INVENTORY, p->stor_id );
 }
 
 /**
  * Fetch cart entries from table
+ * @param handle: Connection to use
  * @param char_id: Character ID to fetch
  * @param p: Cart entries
  * @return True if success, False if failed
  */
-bool cart_fromsql(uint32 char_id, struct s_storage* p)
+bool cart_fromsql(Sql* handle, uint32 char_id, struct s_storage* p)
 {
-	return char_memitemdata_from_sql( p, MAX_CART, char_id, TABLE_CART, p->stor_id );
+	return char_memitemdata_from_sql( handle, p, MAX_CART, char_id, TABLE_CART, p->stor_id );
 }
 
 /**
  * Fetch storage entries from table
+ * @param handle: Connection to use
  * @param account_id: Account ID to fetch
  * @param p: Storage entries
  * @param stor_id: Storage ID
  * @return True if success, False if failed
  */
-bool storage_fromsql(uint32 account_id, struct s_storage* p)
+bool storage_fromsql(Sql* handle, uint32 account_id, struct s_storage* p)
 {
-	return char_memitemdata_from_sql( p, MAX_STORAGE, account_id, TABLE_STORAGE, p->stor_id );
+	return char_memitemdata_from_sql( handle, p, MAX_STORAGE, account_id, TABLE_STORAGE, p->stor_id );
 }
 
 /**
@@ -139,18 +149,7 @@ bool storage_fromsql(uint32 account_id, struct s_storage* p)
 bool guild_storage_tosql(int guild_id, struct s_storage* p)
 {
 	//ShowInfo("Guild Storage has been saved (GID: %d)\n", guild_id);
-	return char_memitemdata_to_sql(p->u.items_guild, inter_guild_storagemax(guild_id), guild_id, TABLE_GUILD_STORAGE, p->stor_id);
-}
-
-/**
- * Fetch guild_storage entries from table
- * @param guild_id: Guild ID to fetch
- * @param p: Guild Storage entries
- * @return True if success, False if failed
- */
-bool guild_storage_fromsql(int guild_id, struct s_storage* p)
-{
-	return char_memitemdata_from_sql( p, inter_guild_storagemax(guild_id), guild_id, TABLE_GUILD_STORAGE, p->stor_id );
+	return char_memitemdata_to_sql(sql_handle, p->u.items_guild, inter_guild_storagemax(guild_id), guild_id, TABLE_GUILD_STORAGE, p->stor_id);
 }
 
 void inter_storage_checkDB(void) {
@@ -187,47 +186,69 @@ void inter_storage_sql_final(void)
 
 /**
  * Send guild storage data to the map server
+ * The storage is loaded by sql_pool, the reply is sent once the query has finished.
  * @param fd: Map server's fd
  * @param account_id: Account ID requesting
  * @param guild_id: Guild ID requesting
  * @param flag: Additional parameters
- * @return True on success or false on failure
  */
-bool mapif_load_guild_storage(int fd,uint32 account_id,int guild_id, char flag)
+void mapif_load_guild_storage(int fd,uint32 account_id,int guild_id, char flag)
 {
-	if( SQL_ERROR == Sql_Query(sql_handle, "SELECT `guild_id` FROM `%s` WHERE `guild_id`='%d'", schema_config.guild_db, guild_id) )
-		Sql_ShowDebug(sql_handle);
-	else if( Sql_NumRows(sql_handle) > 0 )
-	{// guild exists
-		WFIFOHEAD(fd, sizeof(struct s_storage)+13);
-		WFIFOW(fd,0) = 0x3818;
-		WFIFOW(fd,2) = sizeof(struct s_storage)+13;
-		WFIFOL(fd,4) = account_id;
-		WFIFOL(fd,8) = guild_id;
-		WFIFOB(fd,12) = flag; //1 open storage, 0 don't open
-		guild_storage_fromsql(guild_id, (struct s_storage*)WFIFOP(fd,13));
-		WFIFOSET(fd, WFIFOW(fd,2));
-		return true;
-	}
-	// guild does not exist
-	Sql_FreeResult(sql_handle);
-	WFIFOHEAD(fd, 12);
-	WFIFOW(fd,0) = 0x3818;
-	WFIFOW(fd,2) = 12;
-	WFIFOL(fd,4) = account_id;
-	WFIFOL(fd,8) = 0;
-	WFIFOSET(fd, 12);
-	return false;
+	std::shared_ptr<struct s_storage> stor = std::make_shared<struct s_storage>();
+	std::shared_ptr<bool> exists = std::make_shared<bool>( false );
+	int max = inter_guild_storagemax(guild_id);
+	uint32 session_id = chmapif_session(fd);
+
+	// A pending save of the write-back is newer than sql
+	*exists = char_writeback_items_load(guild_id, TABLE_GUILD_STORAGE, 0, stor.get());
+
+	SqlPool_Post( sql_pool, SqlPool_Key(SQLPOOL_KEY_GUILD, guild_id), [stor, exists, guild_id, max]( Sql* handle ){
+		if( *exists )
+			return;
+		if( SQL_ERROR == Sql_Query(handle, "SELECT `guild_id` FROM `%s` WHERE `guild_id`='%d'", schema_config.guild_db, guild_id) )
+			Sql_ShowDebug(handle);
+		else if( Sql_NumRows(handle) > 0 )
+		{// guild exists
+			Sql_FreeResult(handle);
+			*exists = true;
+			char_memitemdata_from_sql(handle, stor.get(), max, guild_id, TABLE_GUILD_STORAGE, stor->stor_id);
+			return;
+		}
+		Sql_FreeResult(handle);
+	}, [fd, session_id, account_id, guild_id, flag, stor, exists](){
+		std::vector<uint8> buf;
+
+		if( !chmapif_session_isactive(fd, session_id) )
+			return; // map-server disconnected
+
+		if( *exists ){
+			buf.resize( sizeof(struct s_storage)+13 );
+			WBUFW(buf.data(),0) = 0x3818;
+			WBUFW(buf.data(),2) = sizeof(struct s_storage)+13;
+			WBUFL(buf.data(),4) = account_id;
+			WBUFL(buf.data(),8) = guild_id;
+			WBUFB(buf.data(),12) = flag; //1 open storage, 0 don't open
+			memcpy(WBUFP(buf.data(),13), stor.get(), sizeof(struct s_storage));
+		}else{// guild does not exist
+			buf.resize( 12 );
+			WBUFW(buf.data(),0) = 0x3818;
+			WBUFW(buf.data(),2) = 12;
+			WBUFL(buf.data(),4) = account_id;
+			WBUFL(buf.data(),8) = 0;
+		}
+		chmapif_send(fd, buf.data(), (unsigned int)buf.size());
+	} );
 }
 
 void mapif_save_guild_storage_ack(int fd,uint32 account_id,int guild_id,int fail)
 {
-	WFIFOHEAD(fd,11);
-	WFIFOW(fd,0)=0x3819;
-	WFIFOL(fd,2)=account_id;
-	WFIFOL(fd,6)=guild_id;
-	WFIFOB(fd,10)=fail;
-	WFIFOSET(fd,11);
+	unsigned char buf[11];
+
+	WBUFW(buf,0)=0x3819;
+	WBUFL(buf,2)=account_id;
+	WBUFL(buf,6)=guild_id;
+	WBUFB(buf,10)=fail;
+	chmapif_send(fd, buf, 11);
 }
 
 //---------------------------------------------------------
@@ -241,6 +262,7 @@ void mapif_parse_LoadGuildStorage(int fd)
 
 /**
  * Save guild storage data from map server
+ * The storage is saved by sql_pool, the ack is sent once the query has finished.
  * @param fd: Map server's fd
  * @return True on success or false on failure
  */
@@ -248,30 +270,49 @@ bool mapif_parse_SaveGuildStorage(int fd)
 {
 	int guild_id;
 	int len;
+	uint32 account_id;
 
 	RFIFOHEAD(fd);
+	account_id = RFIFOL(fd,4);
 	guild_id = RFIFOL(fd,8);
 	len = RFIFOW(fd,2);
 
 	if( sizeof(struct s_storage) != len - 12 )
 	{
 		ShowError("inter storage: data size error %" PRIuPTR " != %d\n", sizeof(struct s_storage), len - 12);
+		mapif_save_guild_storage_ack(fd, account_id, guild_id, 1);
+		return true;
 	}
-	else
-	{
-		if( SQL_ERROR == Sql_Query(sql_handle, "SELECT `guild_id` FROM `%s` WHERE `guild_id`='%d'", schema_config.guild_db, guild_id) )
-			Sql_ShowDebug(sql_handle);
-		else if( Sql_NumRows(sql_handle) > 0 )
+
+	std::shared_ptr<struct s_storage> stor = std::make_shared<struct s_storage>();
+	std::shared_ptr<bool> saved = std::make_shared<bool>( false );
+	int max = inter_guild_storagemax(guild_id);
+	uint32 session_id = chmapif_session(fd);
+
+	memcpy(stor.get(), RFIFOP(fd,12), sizeof(struct s_storage));
+
+	if( inter_guild_fromsql(guild_id) != NULL && char_writeback_items_add(guild_id, TABLE_GUILD_STORAGE, max, stor.get()) ) {
+		mapif_save_guild_storage_ack(fd, account_id, guild_id, 0);
+		return false;
+	}
+
+	SqlPool_Post( sql_pool, SqlPool_Key(SQLPOOL_KEY_GUILD, guild_id), [stor, saved, guild_id, max]( Sql* handle ){
+		if( SQL_ERROR == Sql_Query(handle, "SELECT `guild_id` FROM `%s` WHERE `guild_id`='%d'", schema_config.guild_db, guild_id) )
+			Sql_ShowDebug(handle);
+		else if( Sql_NumRows(handle) > 0 )
 		{// guild exists
-			Sql_FreeResult(sql_handle);
-			guild_storage_tosql(guild_id, (struct s_storage*)RFIFOP(fd,12));
-			mapif_save_guild_storage_ack(fd, RFIFOL(fd,4), guild_id, 0);
-			return false;
+			Sql_FreeResult(handle);
+			char_memitemdata_to_sql(handle, stor->u.items_guild, max, guild_id, TABLE_GUILD_STORAGE, stor->stor_id);
+			*saved = true;
+			return;
 		}
-		Sql_FreeResult(sql_handle);
-	}
-	mapif_save_guild_storage_ack(fd, RFIFOL(fd,4), guild_id, 1);
-	return true;
+		Sql_FreeResult(handle);
+	}, [fd, session_id, account_id, guild_id, saved](){
+		if( !chmapif_session_isactive(fd, session_id) )
+			return; // map-server disconnected
+		mapif_save_guild_storage_ack(fd, account_id, guild_id, *saved ? 0 : 1);
+	} );
+	return false;
 }
 
 #ifdef BOUND_ITEMS
@@ -331,6 +372,10 @@ bool mapif_parse_itembound_retrieve(int fd)
 	int j, guild_id = RFIFOW(fd,10);
 	uint32 char_id = RFIFOL(fd,2), account_id = RFIFOL(fd,6);
 
+	// Pending inventory saves of the character have to be written first
+	SqlPool_WaitKey(sql_pool, SqlPool_Key(SQLPOOL_KEY_CHAR, char_id));
+	char_writeback_items_now(char_id, TABLE_INVENTORY, 0);
+
 	StringBuf_Init(&buf);
 
 	// Get bound items from player's inventory
@@ -398,6 +443,7 @@ bool mapif_parse_itembound_retrieve(int fd)
 		mapif_itembound_ack(fd,account_id,guild_id);
 		return true;
 	}
+	char_item_snapshot_invalidate(char_id, TABLE_INVENTORY, 0);
 
 	// Send the deleted items to map-server to store them in guild storage [Cydh]
 	mapif_itembound_store2gstorage(fd, guild_id, items, count);
@@ -432,6 +478,7 @@ bool mapif_parse_itembound_retrieve(int fd)
 	if (j) {
 		StringBuf buf2;
 		StringBuf_Init(&buf2);
+		char_cache_invalidate(char_id);
 		StringBuf_Printf(&buf2, "UPDATE `%s` SET %s WHERE `char_id`='%d'", schema_config.char_db, StringBuf_Value(&buf), char_id);
 
 		if( SQL_ERROR == SqlStmt_PrepareStr(stmt, StringBuf_Value(&buf)) ||
@@ -470,15 +517,15 @@ bool mapif_parse_itembound_retrieve(int fd)
  */
 void mapif_storage_data_loaded(int fd, uint32 account_id, char type, struct s_storage* entries, bool result) {
 	uint16 size = sizeof(struct s_storage) + 10;
-	
-	WFIFOHEAD(fd, size);
-	WFIFOW(fd, 0) = 0x388a;
-	WFIFOW(fd, 2) = size;
-	WFIFOB(fd, 4) = type;
-	WFIFOL(fd, 5) = account_id;
-	WFIFOB(fd, 9) = result;
-	memcpy(WFIFOP(fd, 10), entries, sizeof(struct s_storage));
-	WFIFOSET(fd, size);
+	std::vector<uint8> buf( size );
+
+	WBUFW(buf.data(), 0) = 0x388a;
+	WBUFW(buf.data(), 2) = size;
+	WBUFB(buf.data(), 4) = type;
+	WBUFL(buf.data(), 5) = account_id;
+	WBUFB(buf.data(), 9) = result;
+	memcpy(WBUFP(buf.data(), 10), entries, sizeof(struct s_storage));
+	chmapif_send(fd, buf.data(), size);
 }
 
 /**
@@ -492,17 +539,19 @@ void mapif_storage_data_loaded(int fd, uint32 account_id, char type, struct s_st
  * @param stor_id
  */
 void mapif_storage_saved(int fd, uint32 account_id, uint32 char_id, bool success, char type, uint8 stor_id) {
-	WFIFOHEAD(fd,9);
-	WFIFOW(fd, 0) = 0x388b;
-	WFIFOL(fd, 2) = account_id;
-	WFIFOB(fd, 6) = success;
-	WFIFOB(fd, 7) = type;
-	WFIFOB(fd, 8) = stor_id;
-	WFIFOSET(fd,9);
+	unsigned char buf[9];
+
+	WBUFW(buf, 0) = 0x388b;
+	WBUFL(buf, 2) = account_id;
+	WBUFB(buf, 6) = success;
+	WBUFB(buf, 7) = type;
+	WBUFB(buf, 8) = stor_id;
+	chmapif_send(fd, buf, 9);
 }
 
 /**
  * Requested inventory/cart/storage data for a player
+ * The entries are loaded by sql_pool, keyed by char_id (inventory, cart) or account_id (storage).
  * ZI 0x308a <type>.B <account_id>.L <char_id>.L <storage_id>.B <mode>.B
  * @param fd
  */
@@ -510,72 +559,107 @@ bool mapif_parse_StorageLoad(int fd) {
 	uint32 aid, cid;
 	int type;
 	uint8 stor_id, mode;
-	struct s_storage stor;
-	bool res = true;
 
 	type = RFIFOB(fd,2);
 	aid = RFIFOL(fd,3);
 	cid = RFIFOL(fd,7);
 	stor_id = RFIFOB(fd,11);
+	mode = RFIFOB(fd, 12);
 
-	memset(&stor, 0, sizeof(struct s_storage));
-	stor.stor_id = stor_id;
-
-	//ShowInfo("Loading storage for AID=%d.\n", aid);
 	switch (type) {
-		case TABLE_INVENTORY: res = inventory_fromsql(cid, &stor); break;
+		case TABLE_INVENTORY:
+		case TABLE_CART:
+			break;
 		case TABLE_STORAGE:
 			if( !interServerDb.exists( stor_id ) ){
 				ShowError( "Invalid storage with id %d\n", stor_id );
 				return false;
 			}
-
-			res = storage_fromsql(aid, &stor);
 			break;
-		case TABLE_CART:      res = cart_fromsql(cid, &stor);      break;
 		default: return false;
 	}
 
-	mode = RFIFOB(fd, 12);
-	stor.state.put = (mode&STOR_MODE_PUT) ? 1 : 0;
-	stor.state.get = (mode&STOR_MODE_GET) ? 1 : 0;
+	std::shared_ptr<struct s_storage> stor = std::make_shared<struct s_storage>();
+	std::shared_ptr<bool> res = std::make_shared<bool>( true );
+	uint32 session_id = chmapif_session(fd);
+
+	stor->stor_id = stor_id;
 
-	mapif_storage_data_loaded(fd, aid, type, &stor, res);
+	// A pending save of the write-back is newer than sql
+	if( char_writeback_items_load( ( type == TABLE_STORAGE ) ? aid : cid, (enum storage_type)type, ( type == TABLE_STORAGE ) ? stor_id : 0, stor.get() ) ){
+		stor->state.put = (mode&STOR_MODE_PUT) ? 1 : 0;
+		stor->state.get = (mode&STOR_MODE_GET) ? 1 : 0;
+		mapif_storage_data_loaded(fd, aid, type, stor.get(), true);
+		return true;
+	}
+
+	//ShowInfo("Loading storage for AID=%d.\n", aid);
+	SqlPool_Post( sql_pool, char_sqlpool_key(( type == TABLE_STORAGE ) ? aid : cid, (enum storage_type)type), [type, aid, cid, stor, res]( Sql* handle ){
+		switch (type) {
+			case TABLE_INVENTORY: *res = inventory_fromsql(handle, cid, stor.get()); break;
+			case TABLE_STORAGE:   *res = storage_fromsql(handle, aid, stor.get());   break;
+			case TABLE_CART:      *res = cart_fromsql(handle, cid, stor.get());      break;
+		}
+	}, [fd, session_id, aid, type, mode, stor, res](){
+		if( !chmapif_session_isactive(fd, session_id) )
+			return; // map-server disconnected
+		stor->state.put = (mode&STOR_MODE_PUT) ? 1 : 0;
+		stor->state.get = (mode&STOR_MODE_GET) ? 1 : 0;
+
+		mapif_storage_data_loaded(fd, aid, type, stor.get(), *res);
+	} );
 	return true;
 }
 
 /**
  * Asking to save player's inventory/cart/storage data
+ * The entries are saved by sql_pool, keyed by char_id (inventory, cart) or account_id (storage).
  * ZI 0x308b <size>.W <type>.B <account_id>.L <char_id>.L <entries>.?B
  * @param fd
  */
 bool mapif_parse_StorageSave(int fd) {
 	int aid, cid, type;
-	struct s_storage stor;
+	std::shared_ptr<struct s_storage> stor = std::make_shared<struct s_storage>();
+	uint32 session_id = chmapif_session(fd);
 
 	RFIFOHEAD(fd);
 	type = RFIFOB(fd, 4);
 	aid = RFIFOL(fd, 5);
 	cid = RFIFOL(fd, 9);
 	
-	memset(&stor, 0, sizeof(struct s_storage));
-	memcpy(&stor, RFIFOP(fd, 13), sizeof(struct s_storage));
+	memcpy(stor.get(), RFIFOP(fd, 13), sizeof(struct s_storage));
 
-	//ShowInfo("Saving storage data for AID=%d.\n", aid);
 	switch(type){
-		case TABLE_INVENTORY:	inventory_tosql(cid, &stor); break;
+		case TABLE_INVENTORY:
+		case TABLE_CART:
+			break;
 		case TABLE_STORAGE:
-			if( !interServerDb.exists( stor.stor_id ) ){
-				ShowError( "Invalid storage with id %d\n", stor.stor_id );
+			if( !interServerDb.exists( stor->stor_id ) ){
+				ShowError( "Invalid storage with id %d\n", stor->stor_id );
 				return false;
 			}
-
-			storage_tosql(aid, &stor);
 			break;
-		case TABLE_CART:	cart_tosql(cid, &stor); break;
 		default: return false;
 	}
-	mapif_storage_saved(fd, aid, cid, true, type, stor.stor_id);
+
+	// Kept in memory by the write-back and written together with the character
+	if( char_writeback_items_add( ( type == TABLE_STORAGE ) ? aid : cid, (enum storage_type)type, ( type == TABLE_INVENTORY ) ? MAX_INVENTORY : ( type == TABLE_CART ) ? MAX_CART : MAX_STORAGE, stor.get() ) ){
+		mapif_storage_saved(fd, aid, cid, true, type, stor->stor_id);
+		return false;
+	}
+
+	//ShowInfo("Saving storage data for AID=%d.\n", aid);
+	SqlPool_Post( sql_pool, char_sqlpool_key(( type == TABLE_STORAGE ) ? aid : cid, (enum storage_type)type), [type, aid, cid, stor]( Sql* handle ){
+		switch(type){
+			case TABLE_INVENTORY:	inventory_tosql(handle, cid, stor.get()); break;
+			case TABLE_STORAGE:		storage_tosql(handle, aid, stor.get()); break;
+			case TABLE_CART:		cart_tosql(handle, cid, stor.get()); break;
+		}
+	}, [fd, session_id, aid, cid, type, stor](){
+		if( !chmapif_session_isactive(fd, session_id) )
+			return; // map-server disconnected
+		mapif_storage_saved(fd, aid, cid, true, type, stor->stor_id);
+	} );
 	return false;
 }
 
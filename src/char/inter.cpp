@@ -15,8 +15,10 @@
 #include "../common/malloc.hpp"
 #include "../common/showmsg.hpp"
 #include "../common/socket.hpp"
+#include "../common/sqlpool.hpp"
 #include "../common/strlib.hpp"
 #include "../common/timer.hpp"
+#include "../common/utils.hpp"
 
 #include "char.hpp"
 #include "char_logif.hpp"
@@ -43,6 +45,7 @@ InterServerDatabase interServerDb;
 
 
 Sql* sql_handle = NULL;	///Link to mysql db, connection FD
+SqlPool* sql_pool = NULL;	///Worker connections for asynchronous queries
 
 int char_server_port = 3306;
 char char_server_ip[64] = "127.0.0.1";
@@ -50,6 +53,7 @@ char char_server_id[32] = "ragnarok";
 char char_server_pw[32] = ""; // Allow user to send empty password (bugreport:7787)
 char char_server_db[32] = "ragnarok";
 char default_codepage[32] = ""; //Feature by irmin.
+int char_server_sql_workers = 0; ///Amount of asynchronous query workers, 0 runs them on the main thread
 unsigned int party_share_level = 10;
 
 /// Received packet Lengths from map-server
@@ -557,18 +561,21 @@ void mapif_accinfo_ack(bool success, int map_fd, int u_fd, int u_aid, int accoun
 
 /**
  * Handles save reg data from map server and distributes accordingly.
+ * Global account registries (##) are forwarded to the login-server and must be saved on the main thread,
+ * everything else may be saved on the workers of sql_pool.
  *
+ * @param handle connection to use
  * @param val either str or int, depending on type
  * @param type false when int, true otherwise
  **/
-void inter_savereg(uint32 account_id, uint32 char_id, const char *key, uint32 index, int64 int_value, const char* string_value, bool is_string)
+void inter_savereg(Sql* handle, uint32 account_id, uint32 char_id, const char *key, uint32 index, int64 int_value, const char* string_value, bool is_string)
 {
 	char esc_val[254*2+1];
 	char esc_key[32*2+1];
 
-	Sql_EscapeString(sql_handle, esc_key, key);
+	Sql_EscapeString(handle, esc_key, key);
 	if( is_string && string_value ) {
-		Sql_EscapeString(sql_handle, esc_val, string_value);
+		Sql_EscapeString(handle, esc_val, string_value);
 	}
 	if( key[0] == '#' && key[1] == '#' ) { // global account reg
 		if( session_isValid(login_fd) )
@@ -579,57 +586,60 @@ void inter_savereg(uint32 account_id, uint32 char_id, const char *key, uint32 in
 	} else if ( key[0] == '#' ) { // local account reg
 		if( is_string ) {
 			if( string_value ) {
-				if( SQL_ERROR == Sql_Query(sql_handle, "REPLACE INTO `%s` (`account_id`,`key`,`index`,`value`) VALUES ('%" PRIu32 "','%s','%" PRIu32 "','%s')", schema_config.acc_reg_str_table, account_id, esc_key, index, esc_val) )
-					Sql_ShowDebug(sql_handle);
+				if( SQL_ERROR == Sql_Query(handle, "REPLACE INTO `%s` (`account_id`,`key`,`index`,`value`) VALUES ('%" PRIu32 "','%s','%" PRIu32 "','%s')", schema_config.acc_reg_str_table, account_id, esc_key, index, esc_val) )
+					Sql_ShowDebug(handle);
 			} else {
-				if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `account_id` = '%" PRIu32 "' AND `key` = '%s' AND `index` = '%" PRIu32 "' LIMIT 1", schema_config.acc_reg_str_table, account_id, esc_key, index) )
-					Sql_ShowDebug(sql_handle);
+				if( SQL_ERROR == Sql_Query(handle, "DELETE FROM `%s` WHERE `account_id` = '%" PRIu32 "' AND `key` = '%s' AND `index` = '%" PRIu32 "' LIMIT 1", schema_config.acc_reg_str_table, account_id, esc_key, index) )
+					Sql_ShowDebug(handle);
 			}
 		} else {
 			if( int_value ) {
-				if( SQL_ERROR == Sql_Query(sql_handle, "REPLACE INTO `%s` (`account_id`,`key`,`index`,`value`) VALUES ('%" PRIu32 "','%s','%" PRIu32 "','%" PRId64 "')", schema_config.acc_reg_num_table, account_id, esc_key, index, int_value) )
-					Sql_ShowDebug(sql_handle);
+				if( SQL_ERROR == Sql_Query(handle, "REPLACE INTO `%s` (`account_id`,`key`,`index`,`value`) VALUES ('%" PRIu32 "','%s','%" PRIu32 "','%" PRId64 "')", schema_config.acc_reg_num_table, account_id, esc_key, index, int_value) )
+					Sql_ShowDebug(handle);
 			} else {
-				if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `account_id` = '%" PRIu32 "' AND `key` = '%s' AND `index` = '%" PRIu32 "' LIMIT 1", schema_config.acc_reg_num_table, account_id, esc_key, index) )
-					Sql_ShowDebug(sql_handle);
+				if( SQL_ERROR == Sql_Query(handle, "DELETE FROM `%s` WHERE `account_id` = '%" PRIu32 "' AND `key` = '%s' AND `index` = '%" PRIu32 "' LIMIT 1", schema_config.acc_reg_num_table, account_id, esc_key, index) )
+					Sql_ShowDebug(handle);
 			}
 		}
 	} else { /* char reg */
 		if( is_string ) {
 			if( string_value ) {
-				if( SQL_ERROR == Sql_Query(sql_handle, "REPLACE INTO `%s` (`char_id`,`key`,`index`,`value`) VALUES ('%" PRIu32 "','%s','%" PRIu32 "','%s')", schema_config.char_reg_str_table, char_id, esc_key, index, esc_val) )
-					Sql_ShowDebug(sql_handle);
+				if( SQL_ERROR == Sql_Query(handle, "REPLACE INTO `%s` (`char_id`,`key`,`index`,`value`) VALUES ('%" PRIu32 "','%s','%" PRIu32 "','%s')", schema_config.char_reg_str_table, char_id, esc_key, index, esc_val) )
+					Sql_ShowDebug(handle);
 			} else {
-				if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `char_id` = '%" PRIu32 "' AND `key` = '%s' AND `index` = '%" PRIu32 "' LIMIT 1", schema_config.char_reg_str_table, char_id, esc_key, index) )
-					Sql_ShowDebug(sql_handle);
+				if( SQL_ERROR == Sql_Query(handle, "DELETE FROM `%s` WHERE `char_id` = '%" PRIu32 "' AND `key` = '%s' AND `index` = '%" PRIu32 "' LIMIT 1", schema_config.char_reg_str_table, char_id, esc_key, index) )
+					Sql_ShowDebug(handle);
 			}
 		} else {
 			if( int_value ) {
-				if( SQL_ERROR == Sql_Query(sql_handle, "REPLACE INTO `%s` (`char_id`,`key`,`index`,`value`) VALUES ('%" PRIu32 "','%s','%" PRIu32 "','%" PRId64 "')", schema_config.char_reg_num_table, char_id, esc_key, index, int_value) )
-					Sql_ShowDebug(sql_handle);
+				if( SQL_ERROR == Sql_Query(handle, "REPLACE INTO `%s` (`char_id`,`key`,`index`,`value`) VALUES ('%" PRIu32 "','%s','%" PRIu32 "','%" PRId64 "')", schema_config.char_reg_num_table, char_id, esc_key, index, int_value) )
+					Sql_ShowDebug(handle);
 			} else {
-				if( SQL_ERROR == Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `char_id` = '%" PRIu32 "' AND `key` = '%s' AND `index` = '%" PRIu32 "' LIMIT 1", schema_config.char_reg_num_table, char_id, esc_key, index) )
-					Sql_ShowDebug(sql_handle);
+				if( SQL_ERROR == Sql_Query(handle, "DELETE FROM `%s` WHERE `char_id` = '%" PRIu32 "' AND `key` = '%s' AND `index` = '%" PRIu32 "' LIMIT 1", schema_config.char_reg_num_table, char_id, esc_key, index) )
+					Sql_ShowDebug(handle);
 			}
 		}
 	}
 }
 
 // Load account_reg from sql (type=2)
-int inter_accreg_fromsql(uint32 account_id, uint32 char_id, int fd, int type)
+// The reply packets are appended to out, since this also runs on the workers of sql_pool.
+int inter_accreg_fromsql(Sql* handle, uint32 account_id, uint32 char_id, std::vector<uint8>& out, int type)
 {
 	char* data;
 	size_t len;
 	unsigned int plen = 0;
+	size_t start;
+	uint8* buf;
 
 	switch( type ) {
 		case 3: //char reg
-			if( SQL_ERROR == Sql_Query(sql_handle, "SELECT `key`, `index`, `value` FROM `%s` WHERE `char_id`='%" PRIu32 "'", schema_config.char_reg_str_table, char_id) )
-				Sql_ShowDebug(sql_handle);
+			if( SQL_ERROR == Sql_Query(handle, "SELECT `key`, `index`, `value` FROM `%s` WHERE `char_id`='%" PRIu32 "'", schema_config.char_reg_str_table, char_id) )
+				Sql_ShowDebug(handle);
 			break;
 		case 2: //account reg
-			if( SQL_ERROR == Sql_Query(sql_handle, "SELECT `key`, `index`, `value` FROM `%s` WHERE `account_id`='%" PRIu32 "'", schema_config.acc_reg_str_table, account_id) )
-				Sql_ShowDebug(sql_handle);
+			if( SQL_ERROR == Sql_Query(handle, "SELECT `key`, `index`, `value` FROM `%s` WHERE `account_id`='%" PRIu32 "'", schema_config.acc_reg_str_table, account_id) )
+				Sql_ShowDebug(handle);
 			break;
 		case 1: //account2 reg
 			ShowError("inter_accreg_fromsql: Char server shouldn't handle type 1 registry values (##). That is the login server's job!\n");
@@ -639,14 +649,16 @@ int inter_accreg_fromsql(uint32 account_id, uint32 char_id, int fd, int type)
 			return 0;
 	}
 
-	WFIFOHEAD(fd, 60000 + 300);
-	WFIFOW(fd, 0) = 0x3804;
+	start = out.size();
+	out.resize( start + 60000 + 300 );
+	buf = &out[start];
+	WBUFW(buf, 0) = 0x3804;
 	// 0x2 = length, set prior to being sent
-	WFIFOL(fd, 4) = account_id;
-	WFIFOL(fd, 8) = char_id;
-	WFIFOB(fd, 12) = 0; // var type (only set when all vars have been sent, regardless of type)
-	WFIFOB(fd, 13) = 1; // is string type
-	WFIFOW(fd, 14) = 0; // count
+	WBUFL(buf, 4) = account_id;
+	WBUFL(buf, 8) = char_id;
+	WBUFB(buf, 12) = 0; // var type (only set when all vars have been sent, regardless of type)
+	WBUFB(buf, 13) = 1; // is string type
+	WBUFW(buf, 14) = 0; // count
 	plen = 16;
 
 	/**
@@ -655,62 +667,64 @@ int inter_accreg_fromsql(uint32 account_id, uint32 char_id, int fd, int type)
 	 * str type
 	 * { keyLength(B), key(<keyLength>), index(L), valLength(B), val(<valLength>) }
 	 **/
-	while ( SQL_SUCCESS == Sql_NextRow(sql_handle) ) {
-		Sql_GetData(sql_handle, 0, &data, NULL);
+	while ( SQL_SUCCESS == Sql_NextRow(handle) ) {
+		Sql_GetData(handle, 0, &data, NULL);
 		len = strlen(data)+1;
 
-		WFIFOB(fd, plen) = (unsigned char)len; // won't be higher; the column size is 32
+		WBUFB(buf, plen) = (unsigned char)len; // won't be higher; the column size is 32
 		plen += 1;
 
-		safestrncpy(WFIFOCP(fd,plen), data, len);
+		safestrncpy(WBUFCP(buf, plen), data, len);
 		plen += len;
 
-		Sql_GetData(sql_handle, 1, &data, NULL);
+		Sql_GetData(handle, 1, &data, NULL);
 
-		WFIFOL(fd, plen) = (uint32)atol(data);
+		WBUFL(buf, plen) = (uint32)atol(data);
 		plen += 4;
 
-		Sql_GetData(sql_handle, 2, &data, NULL);
+		Sql_GetData(handle, 2, &data, NULL);
 		len = strlen(data)+1;
 
-		WFIFOB(fd, plen) = (unsigned char)len; // won't be higher; the column size is 254
+		WBUFB(buf, plen) = (unsigned char)len; // won't be higher; the column size is 254
 		plen += 1;
 
-		safestrncpy(WFIFOCP(fd,plen), data, len);
+		safestrncpy(WBUFCP(buf, plen), data, len);
 		plen += len;
 
-		WFIFOW(fd, 14) += 1;
+		WBUFW(buf, 14) += 1;
 
 		if( plen > 60000 ) {
-			WFIFOW(fd, 2) = plen;
-			WFIFOSET(fd, plen);
+			WBUFW(buf, 2) = plen;
+			out.resize( start + plen );
 
 			// prepare follow up
-			WFIFOHEAD(fd, 60000 + 300);
-			WFIFOW(fd, 0) = 0x3804;
+			start = out.size();
+			out.resize( start + 60000 + 300 );
+			buf = &out[start];
+			WBUFW(buf, 0) = 0x3804;
 			// 0x2 = length, set prior to being sent
-			WFIFOL(fd, 4) = account_id;
-			WFIFOL(fd, 8) = char_id;
-			WFIFOB(fd, 12) = 0; // var type (only set when all vars have been sent, regardless of type)
-			WFIFOB(fd, 13) = 1; // is string type
-			WFIFOW(fd, 14) = 0; // count
+			WBUFL(buf, 4) = account_id;
+			WBUFL(buf, 8) = char_id;
+			WBUFB(buf, 12) = 0; // var type (only set when all vars have been sent, regardless of type)
+			WBUFB(buf, 13) = 1; // is string type
+			WBUFW(buf, 14) = 0; // count
 			plen = 16;
 		}
 	}
 
-	WFIFOW(fd, 2) = plen;
-	WFIFOSET(fd, plen);
+	WBUFW(buf, 2) = plen;
+	out.resize( start + plen );
 
-	Sql_FreeResult(sql_handle);
+	Sql_FreeResult(handle);
 
 	switch( type ) {
 		case 3: //char reg
-			if (SQL_ERROR == Sql_Query(sql_handle, "SELECT `key`, `index`, `value` FROM `%s` WHERE `char_id`='%" PRIu32 "'", schema_config.char_reg_num_table, char_id))
-				Sql_ShowDebug(sql_handle);
+			if (SQL_ERROR == Sql_Query(handle, "SELECT `key`, `index`, `value` FROM `%s` WHERE `char_id`='%" PRIu32 "'", schema_config.char_reg_num_table, char_id))
+				Sql_ShowDebug(handle);
 			break;
 		case 2: //account reg
-			if (SQL_ERROR == Sql_Query(sql_handle, "SELECT `key`, `index`, `value` FROM `%s` WHERE `account_id`='%" PRIu32 "'", schema_config.acc_reg_num_table, account_id))
-				Sql_ShowDebug(sql_handle);
+			if (SQL_ERROR == Sql_Query(handle, "SELECT `key`, `index`, `value` FROM `%s` WHERE `account_id`='%" PRIu32 "'", schema_config.acc_reg_num_table, account_id))
+				Sql_ShowDebug(handle);
 			break;
 #if 0 // This is already checked above.
 		case 1: //account2 reg
@@ -719,14 +733,16 @@ int inter_accreg_fromsql(uint32 account_id, uint32 char_id, int fd, int type)
 #endif // 0
 	}
 
-	WFIFOHEAD(fd, 60000 + 300);
-	WFIFOW(fd, 0) = 0x3804;
+	start = out.size();
+	out.resize( start + 60000 + 300 );
+	buf = &out[start];
+	WBUFW(buf, 0) = 0x3804;
 	// 0x2 = length, set prior to being sent
-	WFIFOL(fd, 4) = account_id;
-	WFIFOL(fd, 8) = char_id;
-	WFIFOB(fd, 12) = 0; // var type (only set when all vars have been sent, regardless of type)
-	WFIFOB(fd, 13) = 0; // is int type
-	WFIFOW(fd, 14) = 0; // count
+	WBUFL(buf, 4) = account_id;
+	WBUFL(buf, 8) = char_id;
+	WBUFB(buf, 12) = 0; // var type (only set when all vars have been sent, regardless of type)
+	WBUFB(buf, 13) = 0; // is int type
+	WBUFW(buf, 14) = 0; // count
 	plen = 16;
 
 	/**
@@ -735,50 +751,52 @@ int inter_accreg_fromsql(uint32 account_id, uint32 char_id, int fd, int type)
 	 * int type
 	 * { keyLength(B), key(<keyLength>), index(L), value(L) }
 	 **/
-	while ( SQL_SUCCESS == Sql_NextRow(sql_handle) ) {
-		Sql_GetData(sql_handle, 0, &data, NULL);
+	while ( SQL_SUCCESS == Sql_NextRow(handle) ) {
+		Sql_GetData(handle, 0, &data, NULL);
 		len = strlen(data)+1;
 
-		WFIFOB(fd, plen) = (unsigned char)len;/* won't be higher; the column size is 32 */
+		WBUFB(buf, plen) = (unsigned char)len;/* won't be higher; the column size is 32 */
 		plen += 1;
 
-		safestrncpy(WFIFOCP(fd,plen), data, len);
+		safestrncpy(WBUFCP(buf, plen), data, len);
 		plen += len;
 
-		Sql_GetData(sql_handle, 1, &data, NULL);
+		Sql_GetData(handle, 1, &data, NULL);
 
-		WFIFOL(fd, plen) = (uint32)atol(data);
+		WBUFL(buf, plen) = (uint32)atol(data);
 		plen += 4;
 
-		Sql_GetData(sql_handle, 2, &data, NULL);
+		Sql_GetData(handle, 2, &data, NULL);
 
-		WFIFOQ(fd, plen) = strtoll(data,NULL,10);
+		WBUFQ(buf, plen) = strtoll(data,NULL,10);
 		plen += 8;
 
-		WFIFOW(fd, 14) += 1;
+		WBUFW(buf, 14) += 1;
 
 		if( plen > 60000 ) {
-			WFIFOW(fd, 2) = plen;
-			WFIFOSET(fd, plen);
+			WBUFW(buf, 2) = plen;
+			out.resize( start + plen );
 
 			/* prepare follow up */
-			WFIFOHEAD(fd, 60000 + 300);
-			WFIFOW(fd, 0) = 0x3804;
+			start = out.size();
+			out.resize( start + 60000 + 300 );
+			buf = &out[start];
+			WBUFW(buf, 0) = 0x3804;
 			/* 0x2 = length, set prior to being sent */
-			WFIFOL(fd, 4) = account_id;
-			WFIFOL(fd, 8) = char_id;
-			WFIFOB(fd, 12) = 0;/* var type (only set when all vars have been sent, regardless of type) */
-			WFIFOB(fd, 13) = 0;/* is int type */
-			WFIFOW(fd, 14) = 0;/* count */
+			WBUFL(buf, 4) = account_id;
+			WBUFL(buf, 8) = char_id;
+			WBUFB(buf, 12) = 0;/* var type (only set when all vars have been sent, regardless of type) */
+			WBUFB(buf, 13) = 0;/* is int type */
+			WBUFW(buf, 14) = 0;/* count */
 			plen = 16;
 		}
 	}
 
-	WFIFOB(fd, 12) = type;
-	WFIFOW(fd, 2) = plen;
-	WFIFOSET(fd, plen);
+	WBUFB(buf, 12) = type;
+	WBUFW(buf, 2) = plen;
+	out.resize( start + plen );
 
-	Sql_FreeResult(sql_handle);
+	Sql_FreeResult(handle);
 	return 1;
 }
 
@@ -817,6 +835,8 @@ int inter_config_read(const char* cfgName)
 			safestrncpy(char_server_db,w2,sizeof(char_server_db));
 		else if(!strcmpi(w1,"default_codepage"))
 			safestrncpy(default_codepage,w2,sizeof(default_codepage));
+		else if(!strcmpi(w1,"char_server_sql_workers"))
+			char_server_sql_workers = cap_value(atoi(w2), 0, 32);
 		else if(!strcmpi(w1,"party_share_level"))
 			party_share_level = (unsigned int)atof(w2);
 		else if(!strcmpi(w1,"log_inter"))
@@ -949,6 +969,10 @@ int inter_init_sql(const char *file)
 			Sql_ShowDebug(sql_handle);
 	}
 
+	sql_pool = SqlPool_Create("char", char_server_sql_workers, sql_handle, char_server_id, char_server_pw, char_server_ip, (uint16)char_server_port, char_server_db, default_codepage);
+	if( sql_pool == NULL )
+		exit(EXIT_FAILURE);
+
 	wis_db = idb_alloc(DB_OPT_RELEASE_DATA);
 	interServerDb.load();
 	inter_guild_sql_init();
@@ -969,6 +993,9 @@ int inter_init_sql(const char *file)
 // finalize
 void inter_final(void)
 {
+	// Queued saves have to be written before the modules flush their caches
+	SqlPool_Wait(sql_pool);
+
 	wis_db->destroy(wis_db, NULL);
 
 	inter_guild_sql_final();
@@ -983,6 +1010,9 @@ void inter_final(void)
 	inter_clan_final();
 
 	if(geoip_cache) aFree(geoip_cache);
+
+	SqlPool_Free(sql_pool);
+	sql_pool = NULL;
 	
 	return;
 }
@@ -1055,9 +1085,20 @@ int mapif_wis_message(struct WisData *wd)
 }
 
 // Send the requested account_reg
+// The registry is loaded by sql_pool, keyed by account_id like the registry saves.
 int mapif_account_reg_reply(int fd, uint32 account_id, uint32 char_id, int type)
 {
-	inter_accreg_fromsql(account_id,char_id,fd,type);
+	std::shared_ptr<std::vector<uint8>> packets = std::make_shared<std::vector<uint8>>();
+	uint32 session_id = chmapif_session(fd);
+
+	SqlPool_Post( sql_pool, SqlPool_Key(SQLPOOL_KEY_ACCOUNT, account_id), [account_id, char_id, type, packets]( Sql* handle ){
+		inter_accreg_fromsql(handle, account_id, char_id, *packets, type);
+	}, [fd, session_id, packets](){
+		if( !chmapif_session_isactive(fd, session_id) )
+			return; // map-server disconnected
+		for( size_t offset = 0; offset < packets->size(); offset += RBUFW(packets->data(), offset + 2) )
+			chmapif_send(fd, packets->data() + offset, RBUFW(packets->data(), offset + 2));
+	} );
 	return 0;
 }
 
@@ -1255,7 +1296,18 @@ int mapif_parse_WisToGM(int fd)
 	return 0;
 }
 
+/// Registry value queued for saving
+struct s_registry_save {
+	std::string key;
+	uint32 index;
+	int64 int_value;
+	std::string string_value;
+	bool has_string;
+	bool is_string;
+};
+
 // Save account_reg into sql (type=2)
+// Local and character registries are saved by sql_pool, keyed by account_id.
 int mapif_parse_Registry(int fd)
 {
 	uint32 account_id = RFIFOL(fd, 4), char_id = RFIFOL(fd, 8);
@@ -1264,6 +1316,7 @@ int mapif_parse_Registry(int fd)
 	if( count ) {
 		int cursor = 14, i;
 		bool isLoginActive = session_isActive(login_fd);
+		std::shared_ptr<std::vector<s_registry_save>> entries = std::make_shared<std::vector<s_registry_save>>();
 
 		if( isLoginActive )
 			chlogif_upd_global_accreg(account_id,char_id);
@@ -1271,43 +1324,56 @@ int mapif_parse_Registry(int fd)
 		for(i = 0; i < count; i++) {
 			size_t lenkey = RFIFOB( fd, cursor );
 			const char* src_key= RFIFOCP(fd, cursor + 1);
-			std::string key( src_key, lenkey );
+			s_registry_save entry = {};
+
+			entry.key = std::string( src_key, lenkey );
 			cursor += lenkey + 1;
 
-			uint32  index = RFIFOL(fd, cursor);
+			entry.index = RFIFOL(fd, cursor);
 			cursor += 4;
 
 			switch (RFIFOB(fd, cursor++)) {
 				// int
 				case 0:
-					inter_savereg( account_id, char_id, key.c_str(), index, RFIFOQ( fd, cursor ), nullptr, false );
+					entry.int_value = RFIFOQ( fd, cursor );
 					cursor += 8;
 					break;
 				case 1:
-					inter_savereg( account_id, char_id, key.c_str(), index, 0, nullptr, false );
 					break;
 				// str
 				case 2:
 				{
 					size_t len_val = RFIFOB( fd, cursor );
 					const char* src_val= RFIFOCP(fd, cursor + 1);
-					std::string sval( src_val, len_val );
+					entry.string_value = std::string( src_val, len_val );
+					entry.has_string = true;
+					entry.is_string = true;
 					cursor += len_val + 1;
-					inter_savereg( account_id, char_id, key.c_str(), index, 0, sval.c_str(), true );
 					break;
 				}
 				case 3:
-					inter_savereg( account_id, char_id, key.c_str(), index, 0, nullptr, true );
+					entry.is_string = true;
 					break;
 				default:
 					ShowError("mapif_parse_Registry: unknown type %d\n",RFIFOB(fd, cursor - 1));
 					return 1;
 			}
 
+			if( entry.key.compare( 0, 2, "##" ) == 0 ) // global account reg, handled by the login-server
+				inter_savereg( sql_handle, account_id, char_id, entry.key.c_str(), entry.index, entry.int_value, entry.has_string ? entry.string_value.c_str() : nullptr, entry.is_string );
+			else
+				entries->push_back( entry );
 		}
 
 		if (isLoginActive)
 			chlogif_prepsend_global_accreg();
+
+		if( !entries->empty() ){
+			SqlPool_Post( sql_pool, SqlPool_Key(SQLPOOL_KEY_ACCOUNT, account_id), [account_id, char_id, entries]( Sql* handle ){
+				for( s_registry_save& entry : *entries )
+					inter_savereg( handle, account_id, char_id, entry.key.c_str(), entry.index, entry.int_value, entry.has_string ? entry.string_value.c_str() : nullptr, entry.is_string );
+			}, nullptr );
+		}
 	}
 	return 0;
 }
@@ -7,10 +7,12 @@
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "../common/cbasetypes.hpp"
 #include "../common/database.hpp"
 #include "../common/sql.hpp"
+#include "../common/sqlpool.hpp"
 
 struct s_storage_table;
 
@@ -41,7 +43,8 @@ extern unsigned int party_share_level;
 
 extern Sql* sql_handle;
 extern Sql* lsql_handle;
+extern SqlPool* sql_pool;
 
-int inter_accreg_fromsql(uint32 account_id, uint32 char_id, int fd, int type);
+int inter_accreg_fromsql(Sql* handle, uint32 account_id, uint32 char_id, std::vector<uint8>& out, int type);
 
 #endif /* INTER_HPP */
@@ -0,0 +1,575 @@
+// Copyright (c) rAthena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#include "columnlog.hpp"
+
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+#include "showmsg.hpp"
+#include "strlib.hpp"
+
+#define COLUMNLOG_VERSION 1
+/// Largest block accepted by the reader, guards against damaged lengths
+#define COLUMNLOG_MAX_BLOCK (64*1024*1024)
+
+static const char columnlog_magic[4] = { 'R', 'A', 'C', 'L' };
+static const char columnlog_block_magic[4] = { 'C', 'L', 'B', 'K' };
+static const char columnlog_footer_magic[4] = { 'C', 'L', 'F', 'T' };
+static const char columnlog_end_magic[4] = { 'C', 'L', 'E', 'N' };
+
+/// Segment writer
+struct ColumnLog {
+	std::string path;
+	std::string table;
+	std::vector<s_columnlog_column> columns;
+	std::vector<int> indexed; // column of every indexed position
+	uint32 block_rows;
+	uint32 segment_blocks;
+
+	// current segment
+	FILE* fp;
+	uint32 blocks;
+	uint64 segment_rows;
+	std::vector<s_columnlog_range> segment_ranges;
+
+	// current block
+	std::vector<std::vector<uint8>> data; // encoded values per column
+	std::vector<int64> last; // previous value per column
+	std::vector<s_columnlog_range> ranges;
+	uint32 rows;
+	size_t column; // next column of the current row
+
+	// state before the current row, restored when the row is incomplete
+	std::vector<size_t> row_start;
+	std::vector<int64> row_last;
+	std::vector<s_columnlog_range> row_ranges;
+
+	// buffers reused for every block
+	std::vector<uint8> raw;
+	std::vector<uint8> compressed;
+};
+
+
+
+/*==========================================
+ * Encoding
+ *------------------------------------------*/
+
+static void columnlog_put32(std::vector<uint8>& out, uint32 value)
+{
+	for( int i = 0; i < 4; i++ )
+		out.push_back( (uint8)( value >> ( 8 * i ) ) );
+}
+
+static void columnlog_put64(std::vector<uint8>& out, uint64 value)
+{
+	for( int i = 0; i < 8; i++ )
+		out.push_back( (uint8)( value >> ( 8 * i ) ) );
+}
+
+static void columnlog_putvarint(std::vector<uint8>& out, uint64 value)
+{
+	while( value >= 0x80 ){
+		out.push_back( (uint8)( value | 0x80 ) );
+		value >>= 7;
+	}
+	out.push_back( (uint8)value );
+}
+
+static uint32 columnlog_get32(const uint8* p)
+{
+	return p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( (uint32)p[3] << 24 );
+}
+
+static uint64 columnlog_get64(const uint8* p)
+{
+	return columnlog_get32( p ) | ( (uint64)columnlog_get32( p + 4 ) << 32 );
+}
+
+/// Reads a varint, returns false when it runs past the end.
+static bool columnlog_getvarint(const uint8*& p, const uint8* end, uint64& value)
+{
+	int shift = 0;
+
+	value = 0;
+	while( p < end && shift < 64 ){
+		uint8 byte = *p++;
+
+		value |= (uint64)( byte & 0x7F ) << shift;
+		if( !( byte & 0x80 ) )
+			return true;
+		shift += 7;
+	}
+
+	return false;
+}
+
+static inline uint64 columnlog_zigzag(int64 value)
+{
+	return ( (uint64)value << 1 ) ^ (uint64)( value >> 63 );
+}
+
+static inline int64 columnlog_unzigzag(uint64 value)
+{
+	return (int64)( value >> 1 ) ^ -(int64)( value & 1 );
+}
+
+static void columnlog_reset_ranges(std::vector<s_columnlog_range>& ranges)
+{
+	for( s_columnlog_range& range : ranges ){
+		range.min = INT64_MAX;
+		range.max = INT64_MIN;
+	}
+}
+
+static void columnlog_merge_ranges(std::vector<s_columnlog_range>& dst, const std::vector<s_columnlog_range>& src)
+{
+	for( size_t i = 0; i < dst.size(); i++ ){
+		dst[i].min = i64min( dst[i].min, src[i].min );
+		dst[i].max = i64max( dst[i].max, src[i].max );
+	}
+}
+
+
+
+/*==========================================
+ * Writer
+ *------------------------------------------*/
+
+/// Starts a new segment file.
+static bool columnlog_open(ColumnLog* self)
+{
+	char stamp[32];
+	char filename[1024];
+	time_t now = time( NULL );
+	std::vector<uint8> header;
+	FILE* fp;
+
+	strftime( stamp, sizeof( stamp ), "%Y%m%d_%H%M%S", localtime( &now ) );
+	safesnprintf( filename, sizeof( filename ), "%s/%s_%s.clog", self->path.c_str(), self->table.c_str(), stamp );
+	for( int i = 1; ( fp = fopen( filename, "rb" ) ) != NULL; i++ ){
+		// never append to an existing segment
+		fclose( fp );
+		safesnprintf( filename, sizeof( filename ), "%s/%s_%s_%d.clog", self->path.c_str(), self->table.c_str(), stamp, i );
+	}
+
+	if( ( self->fp = fopen( filename, "wb" ) ) == NULL ){
+		ShowError( "ColumnLog: Could not create segment '%s'.\n", filename );
+		return false;
+	}
+
+	header.insert( header.end(), columnlog_magic, columnlog_magic + 4 );
+	header.push_back( COLUMNLOG_VERSION & 0xFF );
+	header.push_back( COLUMNLOG_VERSION >> 8 );
+	header.push_back( (uint8)self->table.size() );
+	header.insert( header.end(), self->table.begin(), self->table.end() );
+	header.push_back( (uint8)( self->columns.size() & 0xFF ) );
+	header.push_back( (uint8)( self->columns.size() >> 8 ) );
+	for( const s_columnlog_column& column : self->columns ){
+		header.push_back( column.type );
+		header.push_back( column.indexed ? 1 : 0 );
+		header.push_back( (uint8)column.name.size() );
+		header.insert( header.end(), column.name.begin(), column.name.end() );
+	}
+	fwrite( header.data(), 1, header.size(), self->fp );
+
+	self->blocks = 0;
+	self->segment_rows = 0;
+	columnlog_reset_ranges( self->segment_ranges );
+	return true;
+}
+
+/// Writes the footer and closes the current segment.
+static void columnlog_close(ColumnLog* self)
+{
+	std::vector<uint8> footer;
+
+	if( self->fp == NULL )
+		return;
+
+	footer.insert( footer.end(), columnlog_footer_magic, columnlog_footer_magic + 4 );
+	columnlog_put32( footer, self->blocks );
+	columnlog_put64( footer, self->segment_rows );
+	for( const s_columnlog_range& range : self->segment_ranges ){
+		columnlog_put64( footer, (uint64)range.min );
+		columnlog_put64( footer, (uint64)range.max );
+	}
+	columnlog_put32( footer, (uint32)footer.size() );
+	footer.insert( footer.end(), columnlog_end_magic, columnlog_end_magic + 4 );
+	fwrite( footer.data(), 1, footer.size(), self->fp );
+	fclose( self->fp );
+	self->fp = NULL;
+}
+
+/// Compresses the current block and appends it to the segment.
+static void columnlog_write_block(ColumnLog* self)
+{
+	std::vector<uint8> header;
+	uLongf length;
+
+	if( self->rows == 0 )
+		return;
+
+	if( self->fp == NULL && !columnlog_open( self ) ){
+		ShowError( "ColumnLog: %u rows of '%s' were lost.\n", self->rows, self->table.c_str() );
+	}else{
+		self->raw.clear();
+		for( const std::vector<uint8>& data : self->data ){
+			columnlog_put32( self->raw, (uint32)data.size() );
+			self->raw.insert( self->raw.end(), data.begin(), data.end() );
+		}
+
+		length = compressBound( (uLong)self->raw.size() );
+		self->compressed.resize( length );
+		if( compress2( self->compressed.data(), &length, self->raw.data(), (uLong)self->raw.size(), Z_BEST_SPEED ) != Z_OK ){
+			ShowError( "ColumnLog: Compression failed, %u rows of '%s' were lost.\n", self->rows, self->table.c_str() );
+		}else{
+			header.insert( header.end(), columnlog_block_magic, columnlog_block_magic + 4 );
+			columnlog_put32( header, self->rows );
+			columnlog_put32( header, (uint32)self->raw.size() );
+			columnlog_put32( header, (uint32)length );
+			for( const s_columnlog_range& range : self->ranges ){
+				columnlog_put64( header, (uint64)range.min );
+				columnlog_put64( header, (uint64)range.max );
+			}
+			fwrite( header.data(), 1, header.size(), self->fp );
+			fwrite( self->compressed.data(), 1, length, self->fp );
+			fflush( self->fp );
+
+			self->blocks++;
+			self->segment_rows += self->rows;
+			columnlog_merge_ranges( self->segment_ranges, self->ranges );
+
+			if( self->blocks >= self->segment_blocks )
+				columnlog_close( self );
+		}
+	}
+
+	for( std::vector<uint8>& data : self->data )
+		data.clear();
+	for( int64& last : self->last )
+		last = 0;
+	columnlog_reset_ranges( self->ranges );
+	self->rows = 0;
+}
+
+/// Creates a writer that appends rows to segments <path>/<table>_<date>_<time>.clog
+ColumnLog* ColumnLog_Create(const char* path, const char* table, const std::vector<s_columnlog_column>& columns, uint32 block_rows, uint32 segment_blocks)
+{
+	ColumnLog* self = new ColumnLog();
+
+	self->path = path;
+	self->table = table;
+	self->columns = columns;
+	self->block_rows = umax( block_rows, 1 );
+	self->segment_blocks = umax( segment_blocks, 1 );
+	self->fp = NULL;
+	self->blocks = 0;
+	self->segment_rows = 0;
+	self->rows = 0;
+	self->column = 0;
+
+	for( size_t i = 0; i < columns.size(); i++ )
+		if( columns[i].indexed && columns[i].type == COLUMNLOG_INT )
+			self->indexed.push_back( (int)i );
+
+	self->data.resize( columns.size() );
+	self->last.resize( columns.size(), 0 );
+	self->row_start.resize( columns.size(), 0 );
+	self->ranges.resize( self->indexed.size() );
+	self->segment_ranges.resize( self->indexed.size() );
+	columnlog_reset_ranges( self->ranges );
+	columnlog_reset_ranges( self->segment_ranges );
+
+	return self;
+}
+
+/// Remembers the state before the current row, so an incomplete row can be rolled back.
+static void columnlog_begin_row(ColumnLog* self)
+{
+	for( size_t i = 0; i < self->data.size(); i++ )
+		self->row_start[i] = self->data[i].size();
+	self->row_last = self->last;
+	self->row_ranges = self->ranges;
+}
+
+/// Appends the next integer value of the current row.
+void ColumnLog_PutInt(ColumnLog* self, int64 value)
+{
+	if( self->column == 0 )
+		columnlog_begin_row( self );
+
+	size_t column = self->column++;
+
+	if( column >= self->columns.size() || self->columns[column].type != COLUMNLOG_INT ){
+		ShowDebug( "ColumnLog_PutInt: Column %d of '%s' is not an integer.\n", (int)column, self->table.c_str() );
+		return;
+	}
+
+	columnlog_putvarint( self->data[column], columnlog_zigzag( value - self->last[column] ) );
+	self->last[column] = value;
+
+	if( self->columns[column].indexed ){
+		for( size_t i = 0; i < self->indexed.size(); i++ ){
+			if( self->indexed[i] == (int)column ){
+				self->ranges[i].min = i64min( self->ranges[i].min, value );
+				self->ranges[i].max = i64max( self->ranges[i].max, value );
+				break;
+			}
+		}
+	}
+}
+
+/// Appends the next string value of the current row.
+void ColumnLog_PutString(ColumnLog* self, const char* value, size_t max)
+{
+	if( self->column == 0 )
+		columnlog_begin_row( self );
+
+	size_t column = self->column++;
+	size_t length = safestrnlen( value, max );
+
+	if( column >= self->columns.size() || self->columns[column].type != COLUMNLOG_STRING ){
+		ShowDebug( "ColumnLog_PutString: Column %d of '%s' is not a string.\n", (int)column, self->table.c_str() );
+		return;
+	}
+
+	columnlog_putvarint( self->data[column], length );
+	self->data[column].insert( self->data[column].end(), value, value + length );
+}
+
+/// Completes the current row, writes the block when it is full.
+void ColumnLog_EndRow(ColumnLog* self)
+{
+	if( self->column != self->columns.size() ){
+		ShowDebug( "ColumnLog_EndRow: Row of '%s' has %d of %d columns, the row is discarded.\n", self->table.c_str(), (int)self->column, (int)self->columns.size() );
+		if( self->column > 0 ){
+			for( size_t i = 0; i < self->data.size(); i++ )
+				self->data[i].resize( self->row_start[i] );
+			self->last = self->row_last;
+			self->ranges = self->row_ranges;
+		}
+		self->column = 0;
+		return;
+	}
+
+	self->column = 0;
+	if( ++self->rows >= self->block_rows )
+		columnlog_write_block( self );
+}
+
+/// Writes the rows of the unfinished block.
+void ColumnLog_Flush(ColumnLog* self)
+{
+	columnlog_write_block( self );
+}
+
+/// Writes the remaining rows, closes the segment and frees the writer.
+void ColumnLog_Free(ColumnLog* self)
+{
+	if( self == NULL )
+		return;
+
+	columnlog_write_block( self );
+	columnlog_close( self );
+	delete self;
+}
+
+
+
+/*==========================================
+ * Reader
+ *------------------------------------------*/
+
+/// Opens a segment and reads its header and footer.
+bool ColumnLog_OpenSegment(const char* filename, s_columnlog_segment& segment)
+{
+	uint8 buf[256];
+	long header_end;
+	long size;
+	uint16 count;
+
+	segment.columns.clear();
+	segment.indexed.clear();
+	segment.ranges.clear();
+	segment.has_footer = false;
+	segment.blocks = 0;
+	segment.rows = 0;
+
+	if( ( segment.fp = fopen( filename, "rb" ) ) == NULL )
+		return false;
+
+	if( fread( buf, 1, 7, segment.fp ) != 7 || memcmp( buf, columnlog_magic, 4 ) != 0 || ( buf[4] | ( buf[5] << 8 ) ) != COLUMNLOG_VERSION ){
+		ShowError( "ColumnLog: '%s' is not a column log segment.\n", filename );
+		ColumnLog_CloseSegment( segment );
+		return false;
+	}
+
+	if( fread( buf, 1, buf[6], segment.fp ) != buf[6] ){
+		ColumnLog_CloseSegment( segment );
+		return false;
+	}
+	segment.table.assign( (char*)buf, buf[6] == 0 ? 0 : strnlen( (char*)buf, buf[6] ) );
+
+	if( fread( buf, 1, 2, segment.fp ) != 2 ){
+		ColumnLog_CloseSegment( segment );
+		return false;
+	}
+	count = buf[0] | ( buf[1] << 8 );
+
+	for( uint16 i = 0; i < count; i++ ){
+		s_columnlog_column column;
+
+		if( fread( buf, 1, 3, segment.fp ) != 3 ){
+			ColumnLog_CloseSegment( segment );
+			return false;
+		}
+		column.type = (e_columnlog_type)buf[0];
+		column.indexed = ( buf[1] != 0 );
+		uint8 length = buf[2];
+		if( fread( buf, 1, length, segment.fp ) != length ){
+			ColumnLog_CloseSegment( segment );
+			return false;
+		}
+		column.name.assign( (char*)buf, length );
+		if( column.indexed && column.type == COLUMNLOG_INT )
+			segment.indexed.push_back( (int)segment.columns.size() );
+		segment.columns.push_back( column );
+	}
+	header_end = ftell( segment.fp );
+
+	// footer, missing when the server did not shut down cleanly
+	fseek( segment.fp, 0, SEEK_END );
+	size = ftell( segment.fp );
+	segment.data_end = size;
+	if( size - header_end >= 8 ){
+		fseek( segment.fp, size - 8, SEEK_SET );
+		if( fread( buf, 1, 8, segment.fp ) == 8 && memcmp( buf + 4, columnlog_end_magic, 4 ) == 0 ){
+			uint32 length = columnlog_get32( buf );
+			size_t expected = 4 + 4 + 8 + 16 * segment.indexed.size();
+
+			if( length == expected && (long)( length + 8 ) <= size - header_end ){
+				std::vector<uint8> footer( length );
+
+				fseek( segment.fp, size - 8 - length, SEEK_SET );
+				if( fread( footer.data(), 1, length, segment.fp ) == length && memcmp( footer.data(), columnlog_footer_magic, 4 ) == 0 ){
+					segment.has_footer = true;
+					segment.blocks = columnlog_get32( &footer[4] );
+					segment.rows = columnlog_get64( &footer[8] );
+					segment.ranges.resize( segment.indexed.size() );
+					for( size_t i = 0; i < segment.indexed.size(); i++ ){
+						segment.ranges[i].min = (int64)columnlog_get64( &footer[16 + 16 * i] );
+						segment.ranges[i].max = (int64)columnlog_get64( &footer[24 + 16 * i] );
+					}
+					segment.data_end = size - 8 - length;
+				}
+			}
+		}
+	}
+
+	fseek( segment.fp, header_end, SEEK_SET );
+	return true;
+}
+
+/// Reads the header of the next block.
+bool ColumnLog_NextBlock(s_columnlog_segment& segment, s_columnlog_block& block)
+{
+	std::vector<uint8> header( 16 + 16 * segment.indexed.size() );
+
+	if( segment.fp == NULL || ftell( segment.fp ) >= segment.data_end )
+		return false;
+
+	if( fread( header.data(), 1, header.size(), segment.fp ) != header.size() || memcmp( header.data(), columnlog_block_magic, 4 ) != 0 )
+		return false;
+
+	block.rows = columnlog_get32( &header[4] );
+	block.raw_length = columnlog_get32( &header[8] );
+	block.compressed_length = columnlog_get32( &header[12] );
+	block.ranges.resize( segment.indexed.size() );
+	for( size_t i = 0; i < segment.indexed.size(); i++ ){
+		block.ranges[i].min = (int64)columnlog_get64( &header[16 + 16 * i] );
+		block.ranges[i].max = (int64)columnlog_get64( &header[24 + 16 * i] );
+	}
+	block.offset = ftell( segment.fp );
+
+	// block that was cut off by a crash
+	return block.offset + (long)block.compressed_length <= segment.data_end;
+}
+
+/// Decompresses and decodes the columns of the current block.
+bool ColumnLog_ReadBlock(s_columnlog_segment& segment, s_columnlog_block& block)
+{
+	std::vector<uint8> compressed;
+	std::vector<uint8> raw;
+	uLongf length = block.raw_length;
+	const uint8* p;
+	const uint8* end;
+
+	// damaged lengths must not allocate more than the segment can hold
+	if( block.raw_length > COLUMNLOG_MAX_BLOCK || block.compressed_length > COLUMNLOG_MAX_BLOCK )
+		return false;
+	if( block.offset < 0 || (long)block.compressed_length > segment.data_end - block.offset )
+		return false;
+
+	compressed.resize( block.compressed_length );
+	raw.resize( block.raw_length );
+	block.ints.assign( segment.columns.size(), std::vector<int64>() );
+	block.strings.assign( segment.columns.size(), std::vector<std::string>() );
+
+	fseek( segment.fp, block.offset, SEEK_SET );
+	if( fread( compressed.data(), 1, compressed.size(), segment.fp ) != compressed.size() )
+		return false;
+	if( uncompress( raw.data(), &length, compressed.data(), (uLong)compressed.size() ) != Z_OK || length != block.raw_length )
+		return false;
+
+	p = raw.data();
+	end = p + raw.size();
+	for( size_t i = 0; i < segment.columns.size(); i++ ){
+		const uint8* column_end;
+		int64 last = 0;
+
+		if( end - p < 4 )
+			return false;
+		column_end = p + 4 + columnlog_get32( p );
+		p += 4;
+		if( column_end > end )
+			return false;
+
+		for( uint32 row = 0; row < block.rows; row++ ){
+			uint64 value;
+
+			if( !columnlog_getvarint( p, column_end, value ) )
+				return false;
+
+			if( segment.columns[i].type == COLUMNLOG_INT ){
+				last += columnlog_unzigzag( value );
+				block.ints[i].push_back( last );
+			}else{
+				if( (uint64)( column_end - p ) < value )
+					return false;
+				block.strings[i].emplace_back( (const char*)p, (size_t)value );
+				p += value;
+			}
+		}
+		p = column_end;
+	}
+
+	return true;
+}
+
+/// Moves past the current block without decompressing it.
+void ColumnLog_SkipBlock(s_columnlog_segment& segment, s_columnlog_block& block)
+{
+	fseek( segment.fp, block.offset + block.compressed_length, SEEK_SET );
+}
+
+/// Closes a segment.
+void ColumnLog_CloseSegment(s_columnlog_segment& segment)
+{
+	if( segment.fp != NULL ){
+		fclose( segment.fp );
+		segment.fp = NULL;
+	}
+}
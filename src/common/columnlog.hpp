@@ -0,0 +1,114 @@
+// Copyright (c) rAthena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#ifndef COLUMNLOG_HPP
+#define COLUMNLOG_HPP
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "cbasetypes.hpp"
+
+// Column-oriented log segments
+//
+// A segment file starts with a header describing its table and columns,
+// followed by blocks of up to block_rows rows. A block stores its rows
+// column by column (integers as zigzag encoded deltas, strings length
+// prefixed) and is compressed with zlib. Every block header carries the
+// min/max of the indexed columns, a footer written when the segment is
+// closed carries them for the whole segment, so readers can skip data
+// without decompressing it.
+// Segments are append-only, a segment without footer (crash) stays readable.
+
+/// Column types
+enum e_columnlog_type : uint8 {
+	COLUMNLOG_INT = 0,
+	COLUMNLOG_STRING,
+};
+
+/// Column description
+struct s_columnlog_column {
+	std::string name;
+	e_columnlog_type type;
+	bool indexed; // min/max are kept for this column (integers only)
+};
+
+/// Min/max of an indexed column
+struct s_columnlog_range {
+	int64 min;
+	int64 max;
+};
+
+struct ColumnLog;// Segment writer (private access)
+typedef struct ColumnLog ColumnLog;
+
+/// Creates a writer that appends rows to segments <path>/<table>_<date>_<time>.clog
+/// Blocks are written every block_rows rows, a new segment is started every segment_blocks blocks.
+///
+/// @return Writer, rows are kept in memory until the first block is written
+ColumnLog* ColumnLog_Create(const char* path, const char* table, const std::vector<s_columnlog_column>& columns, uint32 block_rows, uint32 segment_blocks);
+
+/// Appends the next integer value of the current row.
+void ColumnLog_PutInt(ColumnLog* self, int64 value);
+
+/// Appends the next string value of the current row.
+void ColumnLog_PutString(ColumnLog* self, const char* value, size_t max);
+
+/// Completes the current row, writes the block when it is full.
+void ColumnLog_EndRow(ColumnLog* self);
+
+/// Writes the rows of the unfinished block.
+void ColumnLog_Flush(ColumnLog* self);
+
+/// Writes the remaining rows, closes the segment and frees the writer.
+void ColumnLog_Free(ColumnLog* self);
+
+
+/// Segment opened for reading
+struct s_columnlog_segment {
+	FILE* fp;
+	std::string table;
+	std::vector<s_columnlog_column> columns;
+	std::vector<int> indexed; // column of every indexed position
+	bool has_footer;
+	uint32 blocks; // from the footer
+	uint64 rows; // from the footer
+	std::vector<s_columnlog_range> ranges; // from the footer, per indexed column
+	long data_end; // offset where the blocks end
+};
+
+/// Block read from a segment
+struct s_columnlog_block {
+	uint32 rows;
+	uint32 raw_length;
+	uint32 compressed_length;
+	std::vector<s_columnlog_range> ranges; // per indexed column
+	long offset; // offset of the compressed data
+	std::vector<std::vector<int64>> ints; // per column, empty for string columns
+	std::vector<std::vector<std::string>> strings; // per column, empty for integer columns
+};
+
+/// Opens a segment and reads its header and footer.
+///
+/// @return true on success
+bool ColumnLog_OpenSegment(const char* filename, s_columnlog_segment& segment);
+
+/// Reads the header of the next block.
+/// Either ColumnLog_ReadBlock or ColumnLog_SkipBlock has to follow.
+///
+/// @return false at the end of the segment
+bool ColumnLog_NextBlock(s_columnlog_segment& segment, s_columnlog_block& block);
+
+/// Decompresses and decodes the columns of the current block.
+///
+/// @return false if the block is damaged
+bool ColumnLog_ReadBlock(s_columnlog_segment& segment, s_columnlog_block& block);
+
+/// Moves past the current block without decompressing it.
+void ColumnLog_SkipBlock(s_columnlog_segment& segment, s_columnlog_block& block);
+
+/// Closes a segment.
+void ColumnLog_CloseSegment(s_columnlog_segment& segment);
+
+#endif /* COLUMNLOG_HPP */
@@ -3,8 +3,261 @@
 
 #include "database.hpp"
 
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+
 #include "showmsg.hpp"
 
+#ifdef YAML_DB_SNAPSHOTS
+// Binary snapshots of parsed YAML documents
+//
+// A snapshot starts with a header carrying the size and FNV-1a hash of the
+// YAML file it was made from and the hash of the nodes, followed by the nodes of the document:
+// a type byte, then for scalars the length and the bytes, for sequences the
+// number of children and the children, for maps the number of pairs and
+// key/value nodes. Lengths and counts are stored as varints.
+// A snapshot that does not match its file is ignored and rewritten.
+
+static const char yaml_snapshot_magic[4] = { 'R', 'A', 'Y', 'S' };
+#define YAML_SNAPSHOT_VERSION 1
+#define YAML_SNAPSHOT_MAXDEPTH 128
+
+enum e_yaml_snapshot_node : uint8 {
+	YAML_SNAPSHOT_NULL = 0,
+	YAML_SNAPSHOT_SCALAR,
+	YAML_SNAPSHOT_SEQUENCE,
+	YAML_SNAPSHOT_MAP,
+};
+
+struct s_yaml_snapshot_header {
+	char magic[4];
+	uint32 version;
+	uint64 size; // of the YAML file
+	uint64 hash; // of the YAML file
+	uint64 nodes_hash;
+};
+
+static std::string yaml_snapshot_path( const std::string& path ){
+	return path + ".bin";
+}
+
+static bool yaml_snapshot_readfile( const std::string& path, std::string& out ){
+	std::ifstream file( path, std::ios::in | std::ios::binary );
+
+	if( !file ){
+		return false;
+	}
+
+	std::ostringstream content;
+
+	content << file.rdbuf();
+	out = content.str();
+
+	return !file.bad();
+}
+
+static uint64 yaml_snapshot_hash( const char* data, size_t length ){
+	uint64 hash = 14695981039346656037ULL;
+
+	for( size_t i = 0; i < length; i++ ){
+		hash ^= (uint8)data[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+static void yaml_snapshot_putvarint( std::string& out, uint64 value ){
+	while( value >= 0x80 ){
+		out.push_back( (char)( ( value & 0x7F ) | 0x80 ) );
+		value >>= 7;
+	}
+
+	out.push_back( (char)value );
+}
+
+static bool yaml_snapshot_getvarint( const char*& p, const char* end, uint64& value ){
+	value = 0;
+
+	for( int shift = 0; shift < 64; shift += 7 ){
+		if( p >= end ){
+			return false;
+		}
+
+		uint8 c = (uint8)*p++;
+
+		value |= (uint64)( c & 0x7F ) << shift;
+
+		if( !( c & 0x80 ) ){
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void yaml_snapshot_putnode( std::string& out, const YAML::Node& node ){
+	switch( node.Type() ){
+		case YAML::NodeType::Scalar:
+			out.push_back( (char)YAML_SNAPSHOT_SCALAR );
+			yaml_snapshot_putvarint( out, node.Scalar().size() );
+			out.append( node.Scalar() );
+			break;
+		case YAML::NodeType::Sequence:
+			out.push_back( (char)YAML_SNAPSHOT_SEQUENCE );
+			yaml_snapshot_putvarint( out, node.size() );
+			for( const YAML::Node& child : node ){
+				yaml_snapshot_putnode( out, child );
+			}
+			break;
+		case YAML::NodeType::Map:
+			out.push_back( (char)YAML_SNAPSHOT_MAP );
+			yaml_snapshot_putvarint( out, node.size() );
+			for( const auto& pair : node ){
+				yaml_snapshot_putnode( out, pair.first );
+				yaml_snapshot_putnode( out, pair.second );
+			}
+			break;
+		default:
+			out.push_back( (char)YAML_SNAPSHOT_NULL );
+			break;
+	}
+}
+
+static bool yaml_snapshot_getnode( const char*& p, const char* end, YAML::Node& node, int depth ){
+	uint64 count;
+
+	if( p >= end || depth > YAML_SNAPSHOT_MAXDEPTH ){
+		return false;
+	}
+
+	switch( (uint8)*p++ ){
+		case YAML_SNAPSHOT_NULL:
+			node = YAML::Node( YAML::NodeType::Null );
+			return true;
+		case YAML_SNAPSHOT_SCALAR:
+			if( !yaml_snapshot_getvarint( p, end, count ) || count > (uint64)( end - p ) ){
+				return false;
+			}
+			node = YAML::Node( std::string( p, (size_t)count ) );
+			p += count;
+			return true;
+		case YAML_SNAPSHOT_SEQUENCE:
+			// Every child takes at least one byte
+			if( !yaml_snapshot_getvarint( p, end, count ) || count > (uint64)( end - p ) ){
+				return false;
+			}
+			node = YAML::Node( YAML::NodeType::Sequence );
+			for( uint64 i = 0; i < count; i++ ){
+				YAML::Node child;
+
+				if( !yaml_snapshot_getnode( p, end, child, depth + 1 ) ){
+					return false;
+				}
+				node.push_back( child );
+			}
+			return true;
+		case YAML_SNAPSHOT_MAP:
+			if( !yaml_snapshot_getvarint( p, end, count ) || count > (uint64)( end - p ) / 2 ){
+				return false;
+			}
+			node = YAML::Node( YAML::NodeType::Map );
+			for( uint64 i = 0; i < count; i++ ){
+				YAML::Node key, value;
+
+				if( !yaml_snapshot_getnode( p, end, key, depth + 1 ) || !yaml_snapshot_getnode( p, end, value, depth + 1 ) ){
+					return false;
+				}
+				node.force_insert( key, value );
+			}
+			return true;
+		default:
+			return false;
+	}
+}
+
+/**
+ * Loads the snapshot of a YAML file
+ * @param path: YAML file
+ * @param content: Content of the YAML file
+ * @param hash: Hash of the content
+ * @param rootNode: Document of the snapshot
+ * @return true if a snapshot of the content was loaded
+ */
+static bool yaml_snapshot_load( const std::string& path, const std::string& content, uint64 hash, YAML::Node& rootNode ){
+	std::string snapshot;
+	s_yaml_snapshot_header header;
+
+	if( !yaml_snapshot_readfile( yaml_snapshot_path( path ), snapshot ) || snapshot.size() < sizeof( header ) ){
+		return false;
+	}
+
+	memcpy( &header, snapshot.data(), sizeof( header ) );
+
+	if( memcmp( header.magic, yaml_snapshot_magic, sizeof( header.magic ) ) != 0 || header.version != YAML_SNAPSHOT_VERSION || header.size != content.size() || header.hash != hash ){
+		return false;
+	}
+
+	const char* p = snapshot.data() + sizeof( header );
+	const char* end = snapshot.data() + snapshot.size();
+
+	if( header.nodes_hash != yaml_snapshot_hash( p, end - p ) || !yaml_snapshot_getnode( p, end, rootNode, 0 ) || p != end ){
+		ShowWarning( "Ignoring damaged snapshot '" CL_WHITE "%s" CL_RESET "'.\n", yaml_snapshot_path( path ).c_str() );
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Writes the snapshot of a YAML file.
+ * The snapshot is written to a temporary file first, so other servers never read a partial snapshot.
+ * @param path: YAML file
+ * @param content: Content of the YAML file
+ * @param hash: Hash of the content
+ * @param rootNode: Parsed document
+ */
+static void yaml_snapshot_save( const std::string& path, const std::string& content, uint64 hash, const YAML::Node& rootNode ){
+	std::string snapshot;
+	s_yaml_snapshot_header header;
+
+	memcpy( header.magic, yaml_snapshot_magic, sizeof( header.magic ) );
+	header.version = YAML_SNAPSHOT_VERSION;
+	header.size = content.size();
+	header.hash = hash;
+
+	snapshot.append( sizeof( header ), '\0' );
+	yaml_snapshot_putnode( snapshot, rootNode );
+	header.nodes_hash = yaml_snapshot_hash( snapshot.data() + sizeof( header ), snapshot.size() - sizeof( header ) );
+	memcpy( &snapshot[0], &header, sizeof( header ) );
+
+	std::string finalPath = yaml_snapshot_path( path );
+	std::string tmpPath = finalPath + ".tmp";
+	std::ofstream file( tmpPath, std::ios::out | std::ios::binary | std::ios::trunc );
+
+	if( !file ){
+		return; // read-only database folder, keep parsing the YAML
+	}
+
+	file.write( snapshot.data(), snapshot.size() );
+	file.close();
+
+	if( file.fail() ){
+		remove( tmpPath.c_str() );
+		return;
+	}
+
+#ifdef WIN32
+	remove( finalPath.c_str() );
+#endif
+	if( rename( tmpPath.c_str(), finalPath.c_str() ) != 0 ){
+		remove( tmpPath.c_str() );
+	}
+}
+#endif
+
 bool YamlDatabase::nodeExists( const YAML::Node& node, const std::string& name ){
 	try{
 		if( node[name] ){
@@ -93,9 +346,33 @@ bool YamlDatabase::reload(){
 
 bool YamlDatabase::load(const std::string& path) {
 	YAML::Node rootNode;
+	bool fromSnapshot = false;
+#ifdef YAML_DB_SNAPSHOTS
+	std::string content;
+	uint64 hash = 0;
+#endif
 
 	try {
+#ifdef YAML_DB_SNAPSHOTS
+		if( !yaml_snapshot_readfile( path, content ) ){
+			throw YAML::BadFile();
+		}
+
+		hash = yaml_snapshot_hash( content.data(), content.size() );
+
+		if( this->useSnapshots() ){
+			fromSnapshot = yaml_snapshot_load( path, content, hash, rootNode );
+		}else{
+			// A snapshot written before the database opted out
+			remove( yaml_snapshot_path( path ).c_str() );
+		}
+
+		if( !fromSnapshot ){
+			rootNode = YAML::Load( content );
+		}
+#else
 		rootNode = YAML::LoadFile(path);
+#endif
 	}
 	catch(YAML::Exception &e) {
 		ShowError("Failed to read %s database file from '" CL_WHITE "%s" CL_RESET "'.\n", this->type.c_str(), path.c_str());
@@ -105,6 +382,7 @@ bool YamlDatabase::load(const std::string& path) {
 
 	// Required here already for header error reporting
 	this->currentFile = path;
+	this->currentFileSnapshot = fromSnapshot;
 
 	if (!this->verifyCompatibility(rootNode)){
 		ShowError("Failed to verify compatibility with %s database file from '" CL_WHITE "%s" CL_RESET "'.\n", this->type.c_str(), this->currentFile.c_str());
@@ -121,8 +399,17 @@ bool YamlDatabase::load(const std::string& path) {
 		}
 	}
 
+	uint32 warnings = this->invalidWarnings;
+
 	this->parse( rootNode );
 
+#ifdef YAML_DB_SNAPSHOTS
+	// Files with errors are parsed from the YAML again, to report the lines
+	if( this->useSnapshots() && !fromSnapshot && this->invalidWarnings == warnings ){
+		yaml_snapshot_save( path, content, hash, rootNode );
+	}
+#endif
+
 	this->parseImports( rootNode );
 
 	return true;
@@ -289,6 +576,17 @@ void YamlDatabase::invalidWarning( const YAML::Node &node, const char* fmt, ...
 
 	va_end(ap);
 
+	this->invalidWarnings++;
+
+#ifdef YAML_DB_SNAPSHOTS
+	if( this->currentFileSnapshot ){
+		// Snapshots do not know the lines, the next start parses the YAML again
+		remove( yaml_snapshot_path( this->currentFile ).c_str() );
+		ShowError( "Occurred in file '" CL_WHITE "%s" CL_RESET "', the line is reported on the next start.\n", this->currentFile.c_str() );
+		return;
+	}
+#endif
+
 	ShowError( "Occurred in file '" CL_WHITE "%s" CL_RESET "' on line %d and column %d.\n", this->currentFile.c_str(), node.Mark().line + 1, node.Mark().column );
 
 #ifdef DEBUG
@@ -300,6 +598,20 @@ void YamlDatabase::invalidWarning( const YAML::Node &node, const char* fmt, ...
 #endif
 }
 
+/**
+ * Counts a script of the current file that failed to parse, the script parser already reported it.
+ * Like any other error, it keeps the file from being stored as a snapshot.
+ */
+void YamlDatabase::invalidScript(){
+	this->invalidWarnings++;
+
+#ifdef YAML_DB_SNAPSHOTS
+	if( this->currentFileSnapshot ){
+		remove( yaml_snapshot_path( this->currentFile ).c_str() );
+	}
+#endif
+}
+
 std::string YamlDatabase::getCurrentFile(){
 	return this->currentFile;
 }
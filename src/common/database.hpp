@@ -21,6 +21,8 @@ private:
 	uint16 version;
 	uint16 minimumVersion;
 	std::string currentFile;
+	bool currentFileSnapshot; // currentFile was loaded from its binary snapshot
+	uint32 invalidWarnings;
 
 	bool verifyCompatibility( const YAML::Node& rootNode );
 	bool load( const std::string& path );
@@ -34,6 +36,7 @@ protected:
 	bool nodeExists( const YAML::Node& node, const std::string& name );
 	bool nodesExist( const YAML::Node& node, std::initializer_list<const std::string> names );
 	void invalidWarning( const YAML::Node &node, const char* fmt, ... );
+	void invalidScript();
 	std::string getCurrentFile();
 
 	// Conversion functions
@@ -55,6 +58,8 @@ public:
 		this->type = type_;
 		this->version = version_;
 		this->minimumVersion = minimumVersion_;
+		this->currentFileSnapshot = false;
+		this->invalidWarnings = 0;
 	}
 
 	YamlDatabase( const std::string& type_, uint16 version_ ) : YamlDatabase( type_, version_, version_ ){
@@ -64,6 +69,12 @@ public:
 	bool load();
 	bool reload();
 
+	/// Databases that pass the lines of their nodes to other parsers (Mark()) return false,
+	/// since the nodes of a binary snapshot have no lines
+	virtual bool useSnapshots(){
+		return true;
+	}
+
 	// Functions that need to be implemented for each type
 	virtual void clear() = 0;
 	virtual const std::string getDefaultLocation() = 0;
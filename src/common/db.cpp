@@ -10,6 +10,10 @@
  *  (5) Public functions
  *
  *  The databases are structured as a hashtable of RED-BLACK trees.
+ *  Databases with DB_OPT_OPEN_ADDRESSING use an open addressing hashtable
+ *  with linear probing and Robin Hood insertion instead, which grows with the
+ *  number of entries. Its slots point to entries that are kept in a list in
+ *  insertion order, so the entries do not move when the table grows.
  *
  *  <B>Properties of the RED-BLACK trees being used:</B>
  *  1. The value of any node is greater than the value of its left child and
@@ -47,6 +51,7 @@
  *  - create a db that organizes itself by splaying
  *
  *  HISTORY:
+ *    2026/10/19 - Added the open addressing backend (DB_OPT_OPEN_ADDRESSING)
  *    2013/08/25 - Added int64/uint64 support for keys [Ind/Hercules]
  *    2013/04/27 - Added ERS to speed up iterator memory allocation [Ind/Hercules]
  *    2012/03/09 - Added enum for data types (int, uint, void*)
@@ -87,6 +92,8 @@
  *  DBNColor        - Enumeration of colors of the nodes.                    *
  *  DBNode          - Structure of a node in RED-BLACK trees.                *
  *  struct db_free  - Structure that holds a deleted node to be freed.       *
+ *  DBOANode        - Entry of an open addressing database.                  *
+ *  struct dboa_slot - Slot of the open addressing hashtable.                *
  *  DBMap_impl      - Structure of the database.                             *
  *  stats           - Statistics about the database system.                  *
 \*****************************************************************************/
@@ -110,6 +117,21 @@
  */
 #define HASH_SIZE (256+27)
 
+/**
+ * Initial number of slots of an open addressing database, power of 2.
+ * @private
+ * @see DBMap_impl#slots
+ */
+#define DBOA_MIN_SLOTS 16
+
+/**
+ * Maximum load of an open addressing hashtable in percent, it doubles its
+ * size when an insertion would exceed it.
+ * @private
+ * @see DBMap_impl#slots
+ */
+#define DBOA_MAX_LOAD 80
+
 /**
  * The color of individual nodes.
  * @private
@@ -157,6 +179,46 @@ struct db_free {
 	DBNode **root;
 };
 
+/**
+ * An entry of an open addressing database.
+ * The entries are linked in insertion order, which is the order of iteration.
+ * @param prev Previous entry
+ * @param next Next entry
+ * @param free_next Next deleted entry waiting to be freed
+ * @param key Key of this database entry
+ * @param data Data of this database entry
+ * @param hash Mixed hash of the key
+ * @param deleted If the entry is deleted
+ * @private
+ * @see DBMap_impl#slots
+ */
+typedef struct dboa_node {
+	// Insertion order
+	struct dboa_node *prev;
+	struct dboa_node *next;
+	struct dboa_node *free_next;
+	// Node data
+	DBKey key;
+	DBData data;
+	// Other
+	uint32 hash;
+	unsigned deleted : 1;
+} DBOANode;
+
+/**
+ * A slot of the open addressing hashtable.
+ * Keeps the hash next to the entry pointer so most of the slots of a probe
+ * are rejected without reading the entry.
+ * @param hash Mixed hash of the key of the entry
+ * @param node Entry or NULL if the slot is empty
+ * @private
+ * @see DBMap_impl#slots
+ */
+struct dboa_slot {
+	uint32 hash;
+	DBOANode *node;
+};
+
 /**
  * Complete database structure.
  * @param vtable Interface of the database
@@ -176,6 +238,13 @@ struct db_free {
  * @param item_count Number of items in the database
  * @param maxlen Maximum length of strings in DB_STRING and DB_ISTRING databases
  * @param global_lock Global lock of the database
+ * @param slots Open addressing hashtable, NULL until the first insertion
+ * @param slot_shift Shift of the mixed hash to get the home slot (32 - log2 of the table size)
+ * @param slot_count Number of entries in the open addressing hashtable (including deleted entries)
+ * @param first First entry of an open addressing database
+ * @param last Last entry of an open addressing database
+ * @param free_nodes Deleted entries of an open addressing database to be freed
+ * @param oa_cache Last entry fetched from an open addressing database
  * @private
  * @see #db_alloc(const char*,int,DBType,DBOptions,unsigned short)
  */
@@ -202,6 +271,14 @@ typedef struct DBMap_impl {
 	uint32 item_count;
 	unsigned short maxlen;
 	unsigned global_lock : 1;
+	// Open addressing
+	struct dboa_slot *slots;
+	uint32 slot_shift;
+	uint32 slot_count;
+	DBOANode *first;
+	DBOANode *last;
+	DBOANode *free_nodes;
+	DBOANode *oa_cache;
 } DBMap_impl;
 
 /**
@@ -210,6 +287,7 @@ typedef struct DBMap_impl {
  * @param db Parent database
  * @param ht_index Current index of the hashtable
  * @param node Current node
+ * @param oa_node Current entry of an open addressing database
  * @private
  * @see #DBIterator
  * @see #DBMap_impl
@@ -221,6 +299,7 @@ typedef struct DBIterator_impl {
 	DBMap_impl* db;
 	int ht_index;
 	DBNode *node;
+	DBOANode *oa_node;
 } DBIterator_impl;
 
 #if defined(DB_ENABLE_STATS)
@@ -348,9 +427,18 @@ struct eri *db_alloc_ers;
  *  db_dup_key_free    - Free the duplicated key.                            *
  *  db_free_add        - Add a node to the free_list of a database.          *
  *  db_free_remove     - Remove a node from the free_list of a database.     *
+ *  db_oa_hash         - Mixed hash of an open addressing key.               *
+ *  db_oa_find         - Find an entry of an open addressing database.       *
+ *  db_oa_insert_slot  - Put an entry in the open addressing hashtable.      *
+ *  db_oa_erase_slot   - Remove an entry from the open addressing hashtable. *
+ *  db_oa_grow         - Double the size of the open addressing hashtable.   *
+ *  db_oa_add          - Allocate an entry of an open addressing database.   *
+ *  db_oa_free_add     - Mark an open addressing entry as deleted.           *
+ *  db_oa_free_remove  - Mark an open addressing entry as not deleted.       *
+ *  db_oa_free_nodes   - Free the deleted open addressing entries.           *
  *  db_free_lock       - Increment the free_lock of a database.              *
  *  db_free_unlock     - Decrement the free_lock of a database.              *
- *         If it was the last lock, frees the nodes in free_list.            *
+ *         If it was the last lock, frees the deleted nodes.                 *
  *         NOTE: Keeps the database trees balanced.                          *
 \*****************************************************************************/
 
@@ -781,6 +869,251 @@ static void db_free_remove(DBMap_impl* db, DBNode *node)
 	db->item_count++;
 }
 
+/**
+ * Returns the mixed hash of a key for an open addressing database.
+ * The default hashers of the numeric databases return the key itself, the
+ * multiplication spreads consecutive ids over the whole hashtable.
+ * @param db Target database
+ * @param key Key to be hashed
+ * @return Mixed hash of the key
+ * @private
+ * @see DBOANode#hash
+ */
+static uint32 db_oa_hash(DBMap_impl* db, DBKey key)
+{
+	return (uint32)((db->hash(key, db->maxlen) * UINT64_C(0x9E3779B97F4A7C15)) >> 32);
+}
+
+/**
+ * Finds the entry of a key in an open addressing database.
+ * NOTE: Deleted entries are returned as well.
+ * @param db Target database
+ * @param key Key of the entry
+ * @param hash Mixed hash of the key
+ * @return Entry or NULL if not found
+ * @private
+ * @see #db_oa_hash(DBMap_impl*,DBKey)
+ */
+static DBOANode* db_oa_find(DBMap_impl* db, DBKey key, uint32 hash)
+{
+	uint32 mask, i, dist;
+
+	if (db->slots == NULL)
+		return NULL;
+
+	mask = UINT32_MAX >> db->slot_shift;
+	for (i = hash >> db->slot_shift, dist = 0; ; i = (i + 1)&mask, dist++) {
+		struct dboa_slot *slot = &db->slots[i];
+
+		if (slot->node == NULL)
+			return NULL;
+		if (((i - (slot->hash >> db->slot_shift))&mask) < dist)
+			return NULL; // the key would have taken the slot of this entry
+		if (slot->hash == hash && db->cmp(key, slot->node->key, db->maxlen) == 0)
+			return slot->node;
+	}
+}
+
+/**
+ * Puts an entry in the hashtable of an open addressing database.
+ * An entry that is further away from its home slot takes the slot of an
+ * entry that is closer to its own (Robin Hood), which keeps the probes short.
+ * NOTE: The hashtable must have a free slot.
+ * @param db Target database
+ * @param node Entry being put
+ * @private
+ * @see #db_oa_find(DBMap_impl*,DBKey,uint32)
+ */
+static void db_oa_insert_slot(DBMap_impl* db, DBOANode *node)
+{
+	uint32 mask = UINT32_MAX >> db->slot_shift;
+	uint32 i, dist;
+	struct dboa_slot entry;
+
+	entry.hash = node->hash;
+	entry.node = node;
+	for (i = node->hash >> db->slot_shift, dist = 0; ; i = (i + 1)&mask, dist++) {
+		struct dboa_slot *slot = &db->slots[i];
+		uint32 slot_dist;
+
+		if (slot->node == NULL) {
+			*slot = entry;
+			return;
+		}
+		slot_dist = (i - (slot->hash >> db->slot_shift))&mask;
+		if (slot_dist < dist) { // swap, continue with the displaced entry
+			struct dboa_slot displaced = *slot;
+
+			*slot = entry;
+			entry = displaced;
+			dist = slot_dist;
+		}
+	}
+}
+
+/**
+ * Removes an entry from the hashtable of an open addressing database.
+ * The following entries are shifted back, so no tombstones are needed.
+ * @param db Target database
+ * @param node Entry being removed
+ * @private
+ */
+static void db_oa_erase_slot(DBMap_impl* db, DBOANode *node)
+{
+	uint32 mask = UINT32_MAX >> db->slot_shift;
+	uint32 i = node->hash >> db->slot_shift;
+	uint32 next;
+
+	while (db->slots[i].node != node)
+		i = (i + 1)&mask;
+	for (next = (i + 1)&mask; db->slots[next].node != NULL; next = (next + 1)&mask) {
+		if (((next - (db->slots[next].hash >> db->slot_shift))&mask) == 0)
+			break; // in its home slot
+		db->slots[i] = db->slots[next];
+		i = next;
+	}
+	db->slots[i].node = NULL;
+	db->slot_count--;
+}
+
+/**
+ * Doubles the size of the hashtable of an open addressing database or
+ * allocates it.
+ * The entries do not move, only the slots are rebuilt.
+ * @param db Target database
+ * @private
+ */
+static void db_oa_grow(DBMap_impl* db)
+{
+	DBOANode *node;
+
+	if (db->slots == NULL) {
+		db->slot_shift = 32;
+		while ((UINT64_C(1) << (32 - db->slot_shift)) < DBOA_MIN_SLOTS)
+			db->slot_shift--;
+	} else {
+		if (db->slot_shift == 1) {
+			ShowFatalError("db_oa_grow: hashtable overflow\n"
+					"Database allocated at %s:%d\n",
+					db->alloc_file, db->alloc_line);
+			exit(EXIT_FAILURE);
+		}
+		aFree(db->slots);
+		db->slot_shift--;
+	}
+	db->slots = (struct dboa_slot*)aCalloc((size_t)(UINT32_MAX >> db->slot_shift) + 1, sizeof(struct dboa_slot));
+	for (node = db->first; node; node = node->next)
+		db_oa_insert_slot(db, node);
+}
+
+/**
+ * Allocates a new entry in an open addressing database.
+ * The entry is appended to the insertion order, key and data are not set.
+ * @param db Target database
+ * @param hash Mixed hash of the key
+ * @return New entry
+ * @private
+ */
+static DBOANode* db_oa_add(DBMap_impl* db, uint32 hash)
+{
+	DBOANode *node;
+
+	if (db->slots == NULL || (uint64)(db->slot_count + 1)*100 > ((uint64)(UINT32_MAX >> db->slot_shift) + 1)*DBOA_MAX_LOAD)
+		db_oa_grow(db);
+	DB_COUNTSTAT(db_node_alloc);
+	node = ers_alloc(db->nodes, DBOANode);
+	node->hash = hash;
+	node->deleted = 0;
+	node->free_next = NULL;
+	node->next = NULL;
+	node->prev = db->last;
+	if (db->last)
+		db->last->next = node;
+	else
+		db->first = node;
+	db->last = node;
+	db_oa_insert_slot(db, node);
+	db->slot_count++;
+	db->item_count++;
+	return node;
+}
+
+/**
+ * Marks an entry of an open addressing database as deleted.
+ * The entry is freed by the last unlock of the database.
+ * If the key isn't duplicated, the key is duplicated and released.
+ * @param db Target database
+ * @param node Target entry
+ * @private
+ * @see #db_free_add(DBMap_impl*,DBNode*,DBNode**)
+ * @see #db_oa_free_nodes(DBMap_impl*)
+ */
+static void db_oa_free_add(DBMap_impl* db, DBOANode *node)
+{
+	if (!(db->options&DB_OPT_DUP_KEY)) { // Make sure we have a key until the entry is freed
+		DBKey old_key = node->key;
+
+		node->key = db_dup_key(db, node->key);
+		db->release(old_key, node->data, DB_RELEASE_KEY);
+	}
+	node->deleted = 1;
+	node->free_next = db->free_nodes;
+	db->free_nodes = node;
+	db->item_count--;
+}
+
+/**
+ * Marks a deleted entry of an open addressing database as not deleted.
+ * NOTE: Frees the duplicated key of the entry.
+ * @param db Target database
+ * @param node Target entry
+ * @private
+ * @see #db_free_remove(DBMap_impl*,DBNode*)
+ */
+static void db_oa_free_remove(DBMap_impl* db, DBOANode *node)
+{
+	DBOANode **prev;
+
+	for (prev = &db->free_nodes; *prev; prev = &(*prev)->free_next) {
+		if (*prev == node) {
+			*prev = node->free_next;
+			break;
+		}
+	}
+	db_dup_key_free(db, node->key);
+	node->free_next = NULL;
+	node->deleted = 0;
+	db->item_count++;
+}
+
+/**
+ * Frees the deleted entries of an open addressing database.
+ * NOTE: Frees the duplicated keys of the entries.
+ * @param db Target database
+ * @private
+ * @see #db_free_unlock(DBMap_impl*)
+ */
+static void db_oa_free_nodes(DBMap_impl* db)
+{
+	while (db->free_nodes) {
+		DBOANode *node = db->free_nodes;
+
+		db->free_nodes = node->free_next;
+		db_oa_erase_slot(db, node);
+		if (node->prev)
+			node->prev->next = node->next;
+		else
+			db->first = node->next;
+		if (node->next)
+			node->next->prev = node->prev;
+		else
+			db->last = node->prev;
+		db_dup_key_free(db, node->key);
+		DB_COUNTSTAT(db_node_free);
+		ers_free(db->nodes, node);
+	}
+}
+
 /**
  * Increment the free_lock of the database.
  * @param db Target database
@@ -826,6 +1159,11 @@ static void db_free_unlock(DBMap_impl* db)
 	if (db->free_lock)
 		return; // Not last lock
 
+	if (db->options&DB_OPT_OPEN_ADDRESSING) {
+		db_oa_free_nodes(db);
+		return;
+	}
+
 	for (i = 0; i < db->free_count ; i++) {
 		db_rebalance_erase(db->free_list[i].node, db->free_list[i].root);
 		db_dup_key_free(db, db->free_list[i].node->key);
@@ -1192,6 +1530,7 @@ static void db_release_both(DBKey key, DBData data, DBRelease which)
  *  dbit_obj_remove  - Remove the current entry from the database.           *
  *  dbit_obj_destroy - Destroys the iterator, unlocking the database and     *
  *           freeing used memory.                                            *
+ *  dbit_oa_*        - Same as dbit_obj_* for open addressing databases.     *
  *  db_obj_iterator - Return a new database iterator.                         *
  *  db_obj_exists   - Checks if an entry exists.                             *
  *  db_obj_get      - Get the data identified by the key.                    *
@@ -1212,6 +1551,15 @@ static void db_release_both(DBKey key, DBData data, DBRelease which)
  *  db_obj_size     - Return the size of the database.                       *
  *  db_obj_type     - Return the type of the database.                       *
  *  db_obj_options  - Return the options of the database.                    *
+ *  db_oa_exists    - Checks if an entry exists (open addressing).           *
+ *  db_oa_get       - Get the data of the key (open addressing).             *
+ *  db_oa_vgetall   - Get the matched entries (open addressing).             *
+ *  db_oa_vensure   - Get the data identified by the key, creating if it     *
+ *           doesn't exist yet (open addressing).                            *
+ *  db_oa_put       - Put data identified by the key (open addressing).      *
+ *  db_oa_remove    - Remove an entry (open addressing).                     *
+ *  db_oa_vforeach  - Apply a function to every entry (open addressing).     *
+ *  db_oa_vclear    - Remove all entries (open addressing).                  *
 \*****************************************************************************/
 
 /**
@@ -1477,6 +1825,161 @@ void dbit_obj_destroy(DBIterator* self)
 	ers_free(db_iterator_ers,self);
 }
 
+/**
+ * Fetches the first entry in an open addressing database.
+ * NOTE: ht_index is -1 before the first entry, 1 after the last entry and 0
+ * when the iterator is on an entry.
+ * @param self Iterator
+ * @param out_key Key of the entry
+ * @return Data of the entry
+ * @protected
+ * @see DBIterator#first
+ */
+static DBData* dbit_oa_first(DBIterator* self, DBKey* out_key)
+{
+	DBIterator_impl* it = (DBIterator_impl*)self;
+
+	DB_COUNTSTAT(dbit_first);
+	// position before the first entry
+	it->ht_index = -1;
+	it->oa_node = NULL;
+	// get next entry
+	return self->next(self, out_key);
+}
+
+/**
+ * Fetches the last entry in an open addressing database.
+ * @param self Iterator
+ * @param out_key Key of the entry
+ * @return Data of the entry
+ * @protected
+ * @see DBIterator#last
+ */
+static DBData* dbit_oa_last(DBIterator* self, DBKey* out_key)
+{
+	DBIterator_impl* it = (DBIterator_impl*)self;
+
+	DB_COUNTSTAT(dbit_last);
+	// position after the last entry
+	it->ht_index = 1;
+	it->oa_node = NULL;
+	// get previous entry
+	return self->prev(self, out_key);
+}
+
+/**
+ * Fetches the next entry in an open addressing database, in insertion order.
+ * @param self Iterator
+ * @param out_key Key of the entry
+ * @return Data of the entry
+ * @protected
+ * @see DBIterator#next
+ */
+static DBData* dbit_oa_next(DBIterator* self, DBKey* out_key)
+{
+	DBIterator_impl* it = (DBIterator_impl*)self;
+	DBOANode *node;
+
+	DB_COUNTSTAT(dbit_next);
+	if (it->ht_index < 0)
+		node = it->db->first;
+	else if (it->oa_node)
+		node = it->oa_node->next;
+	else
+		node = NULL;
+	while (node && node->deleted)
+		node = node->next;
+
+	it->oa_node = node;
+	if (node == NULL) {
+		it->ht_index = 1;
+		return NULL; // not found
+	}
+	it->ht_index = 0;
+	if (out_key)
+		memcpy(out_key, &node->key, sizeof(DBKey));
+	return &node->data;
+}
+
+/**
+ * Fetches the previous entry in an open addressing database, in insertion order.
+ * @param self Iterator
+ * @param out_key Key of the entry
+ * @return Data of the entry
+ * @protected
+ * @see DBIterator#prev
+ */
+static DBData* dbit_oa_prev(DBIterator* self, DBKey* out_key)
+{
+	DBIterator_impl* it = (DBIterator_impl*)self;
+	DBOANode *node;
+
+	DB_COUNTSTAT(dbit_prev);
+	if (it->ht_index > 0)
+		node = it->db->last;
+	else if (it->oa_node)
+		node = it->oa_node->prev;
+	else
+		node = NULL;
+	while (node && node->deleted)
+		node = node->prev;
+
+	it->oa_node = node;
+	if (node == NULL) {
+		it->ht_index = -1;
+		return NULL; // not found
+	}
+	it->ht_index = 0;
+	if (out_key)
+		memcpy(out_key, &node->key, sizeof(DBKey));
+	return &node->data;
+}
+
+/**
+ * Returns true if the fetched entry of an open addressing database exists.
+ * @param self Iterator
+ * @return true if the entry exists
+ * @protected
+ * @see DBIterator#exists
+ */
+static bool dbit_oa_exists(DBIterator* self)
+{
+	DBIterator_impl* it = (DBIterator_impl*)self;
+
+	DB_COUNTSTAT(dbit_exists);
+	return (it->oa_node && !it->oa_node->deleted);
+}
+
+/**
+ * Removes the current entry from an open addressing database.
+ * @param self Iterator
+ * @param out_data Data of the removed entry.
+ * @return 1 if entry was removed, 0 otherwise
+ * @protected
+ * @see DBIterator#remove
+ */
+static int dbit_oa_remove(DBIterator* self, DBData *out_data)
+{
+	DBIterator_impl* it = (DBIterator_impl*)self;
+	DBOANode *node;
+	int retval = 0;
+
+	DB_COUNTSTAT(dbit_remove);
+	node = it->oa_node;
+	if( node && !node->deleted )
+	{
+		DBMap_impl* db = it->db;
+		if( db->oa_cache == node )
+			db->oa_cache = NULL;
+		db->release(node->key, node->data, DB_RELEASE_DATA);
+		if( out_data )
+			memcpy(out_data, &node->data, sizeof(DBData));
+		retval = 1;
+		db_oa_free_add(db, node);
+	}
+	return retval;
+}
+
 /**
  * Returns a new iterator for this database.
  * The iterator keeps the database locked until it is destroyed.
@@ -1494,17 +1997,27 @@ static DBIterator* db_obj_iterator(DBMap* self)
 	DB_COUNTSTAT(db_iterator);
 	it = ers_alloc(db_iterator_ers, struct DBIterator_impl);
 	/* Interface of the iterator **/
-	it->vtable.first   = dbit_obj_first;
-	it->vtable.last    = dbit_obj_last;
-	it->vtable.next    = dbit_obj_next;
-	it->vtable.prev    = dbit_obj_prev;
-	it->vtable.exists  = dbit_obj_exists;
-	it->vtable.remove  = dbit_obj_remove;
+	if (db->options&DB_OPT_OPEN_ADDRESSING) {
+		it->vtable.first   = dbit_oa_first;
+		it->vtable.last    = dbit_oa_last;
+		it->vtable.next    = dbit_oa_next;
+		it->vtable.prev    = dbit_oa_prev;
+		it->vtable.exists  = dbit_oa_exists;
+		it->vtable.remove  = dbit_oa_remove;
+	} else {
+		it->vtable.first   = dbit_obj_first;
+		it->vtable.last    = dbit_obj_last;
+		it->vtable.next    = dbit_obj_next;
+		it->vtable.prev    = dbit_obj_prev;
+		it->vtable.exists  = dbit_obj_exists;
+		it->vtable.remove  = dbit_obj_remove;
+	}
 	it->vtable.destroy = dbit_obj_destroy;
 	/* Initial state (before the first entry) */
 	it->db = db;
 	it->ht_index = -1;
 	it->node = NULL;
+	it->oa_node = NULL;
 	/* Lock the database */
 	db_free_lock(db);
 	return &it->vtable;
@@ -2340,6 +2853,385 @@ static DBOptions db_obj_options(DBMap* self)
 	return options;
 }
 
+/**
+ * Returns true if the entry exists in an open addressing database.
+ * @param self Interface of the database
+ * @param key Key that identifies the entry
+ * @return true is the entry exists
+ * @protected
+ * @see DBMap#exists
+ */
+static bool db_oa_exists(DBMap* self, DBKey key)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	DBOANode *node;
+
+	DB_COUNTSTAT(db_exists);
+	if (db == NULL) return false; // nullpo candidate
+	if (!(db->options&DB_OPT_ALLOW_NULL_KEY) && db_is_key_null(db->type, key)) {
+		return false; // nullpo candidate
+	}
+
+	if (db->oa_cache && db->cmp(key, db->oa_cache->key, db->maxlen) == 0)
+		return true; // cache hit
+
+	node = db_oa_find(db, key, db_oa_hash(db, key));
+	if (node == NULL || node->deleted)
+		return false;
+	db->oa_cache = node;
+	return true;
+}
+
+/**
+ * Get the data of the entry identified by the key in an open addressing database.
+ * @param self Interface of the database
+ * @param key Key that identifies the entry
+ * @return Data of the entry or NULL if not found
+ * @protected
+ * @see DBMap#get
+ */
+static DBData* db_oa_get(DBMap* self, DBKey key)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	DBOANode *node;
+
+	DB_COUNTSTAT(db_get);
+	if (db == NULL) return NULL; // nullpo candidate
+	if (!(db->options&DB_OPT_ALLOW_NULL_KEY) && db_is_key_null(db->type, key)) {
+		ShowError("db_get: Attempted to retrieve non-allowed NULL key for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return NULL; // nullpo candidate
+	}
+
+	if (db->oa_cache && db->cmp(key, db->oa_cache->key, db->maxlen) == 0)
+		return &db->oa_cache->data; // cache hit
+
+	node = db_oa_find(db, key, db_oa_hash(db, key));
+	if (node == NULL || node->deleted)
+		return NULL;
+	db->oa_cache = node;
+	return &node->data;
+}
+
+/**
+ * Get the data of the entries of an open addressing database matched by <code>match</code>.
+ * Entries added by <code>match</code> are not matched.
+ * @param self Interface of the database
+ * @param buf Buffer to put the data of the matched entries
+ * @param max Maximum number of data entries to be put into buf
+ * @param match Function that matches the database entries
+ * @param ... Extra arguments for match
+ * @return The number of entries that matched
+ * @protected
+ * @see DBMap#vgetall
+ */
+static unsigned int db_oa_vgetall(DBMap* self, DBData **buf, unsigned int max, DBMatcher match, va_list args)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	DBOANode *node;
+	DBOANode *last;
+	unsigned int ret = 0;
+
+	DB_COUNTSTAT(db_vgetall);
+	if (db == NULL) return 0; // nullpo candidate
+	if (match == NULL) return 0; // nullpo candidate
+
+	db_free_lock(db);
+	for (node = db->first, last = db->last; node; node = node->next) {
+		if (!(node->deleted)) {
+			va_list argscopy;
+			va_copy(argscopy, args);
+			if (match(node->key, node->data, argscopy) == 0) {
+				if (buf && ret < max)
+					buf[ret] = &node->data;
+				ret++;
+			}
+			va_end(argscopy);
+		}
+		if (node == last)
+			break;
+	}
+	db_free_unlock(db);
+	return ret;
+}
+
+/**
+ * Get the data of the entry identified by the key in an open addressing database.
+ * If the entry does not exist, an entry is added with the data returned by
+ * <code>create</code>.
+ * @param self Interface of the database
+ * @param key Key that identifies the entry
+ * @param create Function used to create the data if the entry doesn't exist
+ * @param args Extra arguments for create
+ * @return Data of the entry
+ * @protected
+ * @see DBMap#vensure
+ */
+static DBData* db_oa_vensure(DBMap* self, DBKey key, DBCreateData create, va_list args)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	DBOANode *node;
+	uint32 hash;
+	DBData *data = NULL;
+
+	DB_COUNTSTAT(db_vensure);
+	if (db == NULL) return NULL; // nullpo candidate
+	if (create == NULL) {
+		ShowError("db_ensure: Create function is NULL for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return NULL; // nullpo candidate
+	}
+	if (!(db->options&DB_OPT_ALLOW_NULL_KEY) && db_is_key_null(db->type, key)) {
+		ShowError("db_ensure: Attempted to use non-allowed NULL key for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return NULL; // nullpo candidate
+	}
+
+	if (db->oa_cache && db->cmp(key, db->oa_cache->key, db->maxlen) == 0)
+		return &db->oa_cache->data; // cache hit
+
+	db_free_lock(db);
+	hash = db_oa_hash(db, key);
+	node = db_oa_find(db, key, hash);
+	// Create entry if necessary
+	if (node == NULL || node->deleted) {
+		va_list argscopy;
+		if (db->item_count == UINT32_MAX) {
+			ShowError("db_vensure: item_count overflow, aborting item insertion.\n"
+					"Database allocated at %s:%d",
+					db->alloc_file, db->alloc_line);
+			db_free_unlock(db);
+			return NULL;
+		}
+		if (node == NULL)
+			node = db_oa_add(db, hash);
+		else
+			db_oa_free_remove(db, node);
+		// put key and data in the entry
+		if (db->options&DB_OPT_DUP_KEY) {
+			node->key = db_dup_key(db, key);
+			if (db->options&DB_OPT_RELEASE_KEY)
+				db->release(key, node->data, DB_RELEASE_KEY);
+		} else {
+			node->key = key;
+		}
+		va_copy(argscopy, args);
+		node->data = create(key, argscopy);
+		va_end(argscopy);
+	}
+	data = &node->data;
+	db->oa_cache = node;
+	db_free_unlock(db);
+	return data;
+}
+
+/**
+ * Put the data identified by the key in an open addressing database.
+ * Puts the previous data in out_data, if out_data is not NULL. (unless data has been released)
+ * NOTE: Uses the new key, the old one is released. A replaced entry keeps its position in the insertion order.
+ * @param self Interface of the database
+ * @param key Key that identifies the data
+ * @param data Data to be put in the database
+ * @param out_data Previous data if the entry exists
+ * @return 1 if if the entry already exists, 0 otherwise
+ * @protected
+ * @see DBMap#put
+ */
+static int db_oa_put(DBMap* self, DBKey key, DBData data, DBData *out_data)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	DBOANode *node;
+	int retval = 0;
+	uint32 hash;
+
+	DB_COUNTSTAT(db_put);
+	if (db == NULL) return 0; // nullpo candidate
+	if (db->global_lock) {
+		ShowError("db_put: Database is being destroyed, aborting entry insertion.\n"
+				"Database allocated at %s:%d\n",
+				db->alloc_file, db->alloc_line);
+		return 0; // nullpo candidate
+	}
+	if (!(db->options&DB_OPT_ALLOW_NULL_KEY) && db_is_key_null(db->type, key)) {
+		ShowError("db_put: Attempted to use non-allowed NULL key for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return 0; // nullpo candidate
+	}
+	if (!(db->options&DB_OPT_ALLOW_NULL_DATA) && (data.type == DB_DATA_PTR && data.u.ptr == NULL)) {
+		ShowError("db_put: Attempted to use non-allowed NULL data for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return 0; // nullpo candidate
+	}
+
+	if (db->item_count == UINT32_MAX) {
+		ShowError("db_put: item_count overflow, aborting item insertion.\n"
+				"Database allocated at %s:%d",
+				db->alloc_file, db->alloc_line);
+		return 0;
+	}
+	// search for an equal entry
+	db_free_lock(db);
+	hash = db_oa_hash(db, key);
+	node = db_oa_find(db, key, hash);
+	if (node == NULL) { // allocate a new entry
+		node = db_oa_add(db, hash);
+	} else if (node->deleted) {
+		db_oa_free_remove(db, node);
+	} else { // equal entry, replace
+		db->release(node->key, node->data, DB_RELEASE_BOTH);
+		if (out_data)
+			memcpy(out_data, &node->data, sizeof(*out_data));
+		retval = 1;
+	}
+	// put key and data in the entry
+	if (db->options&DB_OPT_DUP_KEY) {
+		node->key = db_dup_key(db, key);
+		if (db->options&DB_OPT_RELEASE_KEY)
+			db->release(key, data, DB_RELEASE_KEY);
+	} else {
+		node->key = key;
+	}
+	node->data = data;
+	db->oa_cache = node;
+	db_free_unlock(db);
+	return retval;
+}
+
+/**
+ * Remove an entry from an open addressing database.
+ * Puts the previous data in out_data, if out_data is not NULL. (unless data has been released)
+ * NOTE: The key (of the database) is released in {@link #db_oa_free_add(DBMap_impl*,DBOANode*)}.
+ * @param self Interface of the database
+ * @param key Key that identifies the entry
+ * @param out_data Previous data if the entry exists
+ * @return 1 if if the entry already exists, 0 otherwise
+ * @protected
+ * @see DBMap#remove
+ */
+static int db_oa_remove(DBMap* self, DBKey key, DBData *out_data)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	DBOANode *node;
+	int retval = 0;
+
+	DB_COUNTSTAT(db_remove);
+	if (db == NULL) return 0; // nullpo candidate
+	if (db->global_lock) {
+		ShowError("db_remove: Database is being destroyed. Aborting entry deletion.\n"
+				"Database allocated at %s:%d\n",
+				db->alloc_file, db->alloc_line);
+		return 0; // nullpo candidate
+	}
+	if (!(db->options&DB_OPT_ALLOW_NULL_KEY) && db_is_key_null(db->type, key)) {
+		ShowError("db_remove: Attempted to use non-allowed NULL key for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return 0; // nullpo candidate
+	}
+
+	db_free_lock(db);
+	node = db_oa_find(db, key, db_oa_hash(db, key));
+	if (node && !(node->deleted)) {
+		if (db->oa_cache == node)
+			db->oa_cache = NULL;
+		db->release(node->key, node->data, DB_RELEASE_DATA);
+		if (out_data)
+			memcpy(out_data, &node->data, sizeof(*out_data));
+		retval = 1;
+		db_oa_free_add(db, node);
+	}
+	db_free_unlock(db);
+	return retval;
+}
+
+/**
+ * Apply <code>func</code> to every entry in an open addressing database.
+ * Entries added by <code>func</code> are skipped.
+ * Returns the sum of values returned by func.
+ * @param self Interface of the database
+ * @param func Function to be applied
+ * @param args Extra arguments for func
+ * @return Sum of the values returned by func
+ * @protected
+ * @see DBMap#vforeach
+ */
+static int db_oa_vforeach(DBMap* self, DBApply func, va_list args)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	int sum = 0;
+	DBOANode *node;
+	DBOANode *last;
+
+	DB_COUNTSTAT(db_vforeach);
+	if (db == NULL) return 0; // nullpo candidate
+	if (func == NULL) {
+		ShowError("db_foreach: Passed function is NULL for db allocated at %s:%d\n",db->alloc_file, db->alloc_line);
+		return 0; // nullpo candidate
+	}
+
+	db_free_lock(db);
+	for (node = db->first, last = db->last; node; node = node->next) {
+		if (!(node->deleted)) {
+			va_list argscopy;
+			va_copy(argscopy, args);
+			sum += func(node->key, &node->data, argscopy);
+			va_end(argscopy);
+		}
+		if (node == last)
+			break;
+	}
+	db_free_unlock(db);
+	return sum;
+}
+
+/**
+ * Removes all entries from an open addressing database.
+ * Before deleting an entry, func is applied to it.
+ * Releases the key and the data.
+ * The hashtable is freed, the database is empty while func is applied.
+ * @param self Interface of the database
+ * @param func Function to be applied to every entry before deleting
+ * @param args Extra arguments for func
+ * @return Sum of values returned by func
+ * @protected
+ * @see DBMap#vclear
+ */
+static int db_oa_vclear(DBMap* self, DBApply func, va_list args)
+{
+	DBMap_impl* db = (DBMap_impl*)self;
+	int sum = 0;
+	DBOANode *node;
+
+	DB_COUNTSTAT(db_vclear);
+	if (db == NULL) return 0; // nullpo candidate
+
+	db_free_lock(db);
+	node = db->first;
+	aFree(db->slots);
+	db->slots = NULL;
+	db->slot_count = 0;
+	db->first = NULL;
+	db->last = NULL;
+	db->free_nodes = NULL;
+	db->oa_cache = NULL;
+	db->item_count = 0;
+	while (node) {
+		DBOANode *next = node->next;
+
+		if (node->deleted) {
+			db_dup_key_free(db, node->key);
+		} else {
+			if (func)
+			{
+				va_list argscopy;
+				va_copy(argscopy, args);
+				sum += func(node->key, &node->data, argscopy);
+				va_end(argscopy);
+			}
+			db->release(node->key, node->data, DB_RELEASE_BOTH);
+			node->deleted = 1;
+		}
+		DB_COUNTSTAT(db_node_free);
+		ers_free(db->nodes, node);
+		node = next;
+	}
+	db_free_unlock(db);
+	return sum;
+}
+
 /*****************************************************************************\
  *  (5) Section with public functions.
  *  db_fix_options     - Apply database type restrictions to the options.
@@ -2538,18 +3430,29 @@ DBMap* db_alloc(const char *file, const char *func, int line, DBType type, DBOpt
 	options = db_fix_options(type, options);
 	/* Interface of the database */
 	db->vtable.iterator = db_obj_iterator;
-	db->vtable.exists   = db_obj_exists;
-	db->vtable.get      = db_obj_get;
 	db->vtable.getall   = db_obj_getall;
-	db->vtable.vgetall  = db_obj_vgetall;
 	db->vtable.ensure   = db_obj_ensure;
-	db->vtable.vensure  = db_obj_vensure;
-	db->vtable.put      = db_obj_put;
-	db->vtable.remove   = db_obj_remove;
 	db->vtable.foreach  = db_obj_foreach;
-	db->vtable.vforeach = db_obj_vforeach;
 	db->vtable.clear    = db_obj_clear;
-	db->vtable.vclear   = db_obj_vclear;
+	if (options&DB_OPT_OPEN_ADDRESSING) {
+		db->vtable.exists   = db_oa_exists;
+		db->vtable.get      = db_oa_get;
+		db->vtable.vgetall  = db_oa_vgetall;
+		db->vtable.vensure  = db_oa_vensure;
+		db->vtable.put      = db_oa_put;
+		db->vtable.remove   = db_oa_remove;
+		db->vtable.vforeach = db_oa_vforeach;
+		db->vtable.vclear   = db_oa_vclear;
+	} else {
+		db->vtable.exists   = db_obj_exists;
+		db->vtable.get      = db_obj_get;
+		db->vtable.vgetall  = db_obj_vgetall;
+		db->vtable.vensure  = db_obj_vensure;
+		db->vtable.put      = db_obj_put;
+		db->vtable.remove   = db_obj_remove;
+		db->vtable.vforeach = db_obj_vforeach;
+		db->vtable.vclear   = db_obj_vclear;
+	}
 	db->vtable.destroy  = db_obj_destroy;
 	db->vtable.vdestroy = db_obj_vdestroy;
 	db->vtable.size     = db_obj_size;
@@ -2565,7 +3468,7 @@ DBMap* db_alloc(const char *file, const char *func, int line, DBType type, DBOpt
 	db->free_lock = 0;
 	/* Other */
 	snprintf(ers_name, 50, "db_alloc:nodes:%s:%s:%d",func,file,line);
-	db->nodes = ers_new(sizeof(struct dbn),ers_name,ERS_DBN_OPTIONS);
+	db->nodes = ers_new((options&DB_OPT_OPEN_ADDRESSING) ? sizeof(DBOANode) : sizeof(struct dbn),ers_name,ERS_DBN_OPTIONS);
 	db->cmp = db_default_cmp(type);
 	db->hash = db_default_hash(type);
 	db->release = db_default_release(type, options);
@@ -2577,6 +3480,13 @@ DBMap* db_alloc(const char *file, const char *func, int line, DBType type, DBOpt
 	db->item_count = 0;
 	db->maxlen = maxlen;
 	db->global_lock = 0;
+	db->slots = NULL;
+	db->slot_shift = 32;
+	db->slot_count = 0;
+	db->first = NULL;
+	db->last = NULL;
+	db->free_nodes = NULL;
+	db->oa_cache = NULL;
 
 	if( db->maxlen == 0 && (type == DB_STRING || type == DB_ISTRING) )
 		db->maxlen = UINT16_MAX;
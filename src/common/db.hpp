@@ -121,6 +121,15 @@ typedef enum DBType {
  * @param DB_OPT_RELEASE_BOTH Releases both key and data.
  * @param DB_OPT_ALLOW_NULL_KEY Allow NULL keys in the database.
  * @param DB_OPT_ALLOW_NULL_DATA Allow NULL data in the database.
+ * @param DB_OPT_OPEN_ADDRESSING Stores the entries in an open addressing
+ *          hashtable that grows with the number of entries instead of the
+ *          fixed hashtable of RED-BLACK trees. Meant for large databases that
+ *          are mostly read by key (id_db, charid_db, ...).
+ *          Entries are iterated in insertion order. Entries removed during an
+ *          iteration are skipped, entries added during an iteration are
+ *          fetched by iterators but not by foreach and getall.
+ *          The data pointers returned by get and ensure stay valid until the
+ *          entry is removed.
  * @public
  * @see #db_fix_options(DBType,DBOptions)
  * @see #db_default_release(DBType,DBOptions)
@@ -134,6 +143,7 @@ typedef enum DBOptions {
 	DB_OPT_RELEASE_BOTH    = DB_OPT_RELEASE_KEY|DB_OPT_RELEASE_DATA,
 	DB_OPT_ALLOW_NULL_KEY  = 0x08,
 	DB_OPT_ALLOW_NULL_DATA = 0x10,
+	DB_OPT_OPEN_ADDRESSING = 0x20,
 } DBOptions;
 
 /**
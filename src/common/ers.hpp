@@ -40,7 +40,12 @@
 #ifndef ERS_HPP
 #define ERS_HPP
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "cbasetypes.hpp"
+#include "malloc.hpp" // CREATE, RECREATE, aFree
+#include "showmsg.hpp" // ShowError, ShowFatalError, ShowWarning
 
 /*****************************************************************************\
  *  (1) All public parts of the Entry Reusage System.                        *
@@ -177,4 +182,183 @@ void ers_report(void);
 void ers_final(void);
 #endif /* DISABLE_ERS / not DISABLE_ERS */
 
+/*****************************************************************************\
+ *  (2) Typed object pools.                                                  *
+ *  ObjectPool            - Pool of objects of one type with handles.        *
+ *  OBJECTPOOL_INDEX_BITS - Bits of the slot index in a handle.              *
+\*****************************************************************************/
+
+/**
+ * Bits of a handle used by the slot index, the rest hold the generation.
+ * A pool holds at most 2^OBJECTPOOL_INDEX_BITS objects.
+ */
+#define OBJECTPOOL_INDEX_BITS 20
+#define OBJECTPOOL_INDEX_MASK ((1U << OBJECTPOOL_INDEX_BITS) - 1)
+
+/**
+ * Pool of objects of type T stored in chunks of 2^ChunkBits slots.
+ * Objects are handed out zeroed and are not constructed (like aCalloc), so
+ * T has to be a plain struct.
+ * Freed slots are reused first, so the objects stay packed in the chunks and
+ * foreach visits them in memory order.
+ * Every object has a 32-bit handle made of its slot index and the generation
+ * of the slot. The generation changes whenever the slot is allocated or
+ * freed, so a handle resolves to NULL once its object is freed instead of
+ * dangling. The generation kept in a handle wraps after 2048 reuses of the
+ * same slot. 0 is never a valid handle.
+ * Not thread-safe.
+ */
+template <typename T, uint32 ChunkBits = 8> class ObjectPool {
+private:
+	/// Placed before every object
+	struct s_slot_head {
+		uint32 index;
+		uint32 generation; ///< Odd while the object is in use
+		uint32 next_free; ///< Next free slot + 1, 0 for none
+	};
+
+	static const size_t slot_align = alignof(T) > alignof(s_slot_head) ? alignof(T) : alignof(s_slot_head);
+	static const size_t head_size = (sizeof(s_slot_head) + slot_align - 1) / slot_align * slot_align;
+	static const size_t slot_size = (head_size + sizeof(T) + slot_align - 1) / slot_align * slot_align;
+	static const uint32 chunk_slots = 1U << ChunkBits;
+
+	const char* name;
+	unsigned char** chunks;
+	uint32 chunk_count;
+	uint32 chunk_max;
+	uint32 slot_count; ///< Slots taken from the chunks
+	uint32 free_first; ///< First free slot + 1, 0 for none
+	uint32 used;
+
+	s_slot_head* slot(uint32 index) const {
+		return (s_slot_head*)(this->chunks[index >> ChunkBits] + (size_t)(index & (chunk_slots - 1)) * slot_size);
+	}
+
+	static s_slot_head* head(const T* obj) {
+		return (s_slot_head*)((unsigned char*)obj - head_size);
+	}
+
+	static T* object(s_slot_head* head) {
+		return (T*)((unsigned char*)head + head_size);
+	}
+
+public:
+	ObjectPool(const char* name) : name(name), chunks(NULL), chunk_count(0), chunk_max(0), slot_count(0), free_first(0), used(0) {
+	}
+
+	~ObjectPool() {
+		this->clear();
+	}
+
+	/**
+	 * Allocates a zeroed object.
+	 * @return Object, never NULL
+	 */
+	T* alloc() {
+		s_slot_head* head;
+
+		if( this->free_first ) {
+			head = this->slot(this->free_first - 1);
+			this->free_first = head->next_free;
+		} else {
+			if( this->slot_count > OBJECTPOOL_INDEX_MASK ) {
+				ShowFatalError("ObjectPool '%s': more than %u objects.\n", this->name, OBJECTPOOL_INDEX_MASK + 1);
+				exit(EXIT_FAILURE);
+			}
+			if( this->slot_count == this->chunk_count << ChunkBits ) {
+				if( this->chunk_count == this->chunk_max ) {
+					this->chunk_max = this->chunk_max * 4 + 3;
+					RECREATE(this->chunks, unsigned char*, this->chunk_max);
+				}
+				CREATE(this->chunks[this->chunk_count], unsigned char, slot_size * chunk_slots);
+				this->chunk_count++;
+			}
+			head = this->slot(this->slot_count);
+			head->index = this->slot_count++;
+		}
+
+		head->generation++;
+		this->used++;
+		memset(object(head), 0, sizeof(T));
+		return object(head);
+	}
+
+	/**
+	 * Frees an object allocated from this pool.
+	 * Handles of the object stop resolving.
+	 */
+	void free(T* obj) {
+		s_slot_head* head = ObjectPool::head(obj);
+
+		if( !(head->generation & 1) ) {
+			ShowError("ObjectPool '%s': object %p is already free.\n", this->name, obj);
+			return;
+		}
+		head->generation++;
+		head->next_free = this->free_first;
+		this->free_first = head->index + 1;
+		this->used--;
+	}
+
+	/// Returns the handle of an object in use.
+	uint32 handle(const T* obj) const {
+		s_slot_head* head = ObjectPool::head(obj);
+
+		return (head->generation << OBJECTPOOL_INDEX_BITS) | head->index;
+	}
+
+	/// Returns the object of a handle or NULL if it was freed.
+	T* get(uint32 handle) const {
+		uint32 index = handle & OBJECTPOOL_INDEX_MASK;
+		s_slot_head* head;
+
+		if( index >= this->slot_count )
+			return NULL;
+		head = this->slot(index);
+		if( !(head->generation & 1) || (head->generation << OBJECTPOOL_INDEX_BITS) != (handle & ~OBJECTPOOL_INDEX_MASK) )
+			return NULL;
+		return object(head);
+	}
+
+	/// Returns the number of objects in use.
+	uint32 count() const {
+		return this->used;
+	}
+
+	/**
+	 * Applies func to every object in use, in memory order.
+	 * Stops iterating if func returns -1.
+	 * Objects may be freed by func. Objects allocated by func may or may not
+	 * be visited.
+	 */
+	template <typename F> void foreach(F func) {
+		for( uint32 i = 0; i < this->slot_count; i++ ) {
+			s_slot_head* head = this->slot(i);
+
+			if( (head->generation & 1) && func(object(head)) == -1 )
+				break;
+		}
+	}
+
+	/**
+	 * Releases the memory of the pool.
+	 * A warning is shown if objects are still in use, they become invalid.
+	 */
+	void clear() {
+		if( this->used > 0 )
+			ShowWarning("Memory leak detected at ObjectPool '%s', %u objects not freed.\n", this->name, this->used);
+
+		for( uint32 i = 0; i < this->chunk_count; i++ )
+			aFree(this->chunks[i]);
+		if( this->chunks != NULL )
+			aFree(this->chunks);
+		this->chunks = NULL;
+		this->chunk_count = 0;
+		this->chunk_max = 0;
+		this->slot_count = 0;
+		this->free_first = 0;
+		this->used = 0;
+	}
+};
+
 #endif /* ERS_HPP */
@@ -3,10 +3,25 @@
 
 #include "malloc.hpp"
 
+#include <atomic>
+#include <mutex>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#ifdef USE_MEMMGR
+#ifdef WIN32
+	#include "winapi.hpp"
+#else
+	#include <sys/mman.h>
+	#include <unistd.h>
+
+	#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+		#define MAP_ANONYMOUS MAP_ANON
+	#endif
+#endif
+#endif
+
 #include "core.hpp"
 #include "showmsg.hpp"
 
@@ -134,212 +149,657 @@ void aFree_(void *p, const char *file, int line, const char *func)
 
 /*
  * Memory manager
- *     able to handle malloc and free efficiently
- *     Since the complex processing, I might be slightly heavier.
  *
- * (I'm sorry for the poor description ^ ^;) such as data structures
- *		Divided into "blocks" of a plurality of memory, "unit" of a plurality of blocks further
- *      I have to divide. Size of the unit, a plurality of distribution equal to the capacity of one block
- *      That's what you have. For example, if one unit of 32KB, one block 1 Yu 32Byte
- *      Knit, or are able to gather 1024, gathered 512 units 64Byte
- *      I can be or have. (Excluding padding, the unit_head)
+ * Small allocations are rounded up to one of MEMMGR_CLASSES size classes:
+ * steps of 16 bytes up to 256 bytes, then four steps per power of two up to
+ * MEMMGR_SMALL_MAX bytes. The units of a class are cut from slabs of
+ * MEMMGR_SLAB_SIZE bytes, which are taken from arenas of MEMMGR_ARENA_SIZE
+ * bytes mapped from the system (backed by transparent huge pages where the
+ * system supports them). A slab keeps its class, memory is not returned to
+ * the system.
+ * Slabs are aligned to their size and start with their class, so the class
+ * of a pointer is found without a header.
+ *
+ * Every thread keeps a cache of free units per class, so allocating and
+ * freeing does not lock. The cache refills from and spills over to the
+ * central free list of the class in batches. A unit can be freed by another
+ * thread than the one that allocated it.
+ *
+ * Medium allocations up to MEMMGR_MEDIUM_MAX bytes are taken from malloc and
+ * start with a memmgr_medium header, so they can grow in place. Larger
+ * allocations are mapped from the system one by one and start with a
+ * memmgr_large header at an aligned address, like a slab. The chunks of
+ * MEMMGR_SLAB_SIZE bytes holding slabs and large allocations are marked in
+ * a page map, every other pointer is a medium allocation.
  *
- *     Lead-linked list (block_prev, block_next) in each other is the same size block
- *       Linked list (hash_prev, hash_nect) even among such one in the block with the figure
- *       I like to have. Thus, reuse of memory no longer needed can be performed efficiently.
+ * With LOG_MEMMGR or DEBUG_MEMMGR every small unit starts with a unit_head
+ * holding the file, line and size of the allocation for the leak report.
+ * DEBUG_MEMMGR also puts a canary after the data and fills free units to
+ * detect overflows and writes to freed memory.
  */
 
-/* Alignment of the block */
-#define BLOCK_ALIGNMENT1	16
-#define BLOCK_ALIGNMENT2	64
-
-/* Amount of data entering a block */
-#define BLOCK_DATA_COUNT1	128
-#define BLOCK_DATA_COUNT2	608
-
-/* The size of the block: 16*128 + 64*576 = 40KB */
-#define BLOCK_DATA_SIZE1	( BLOCK_ALIGNMENT1 * BLOCK_DATA_COUNT1 )
-#define BLOCK_DATA_SIZE2	( BLOCK_ALIGNMENT2 * BLOCK_DATA_COUNT2 )
-#define BLOCK_DATA_SIZE		( BLOCK_DATA_SIZE1 + BLOCK_DATA_SIZE2 )
-
-/* The number of blocks to be allocated at a time. */
-#define BLOCK_ALLOC		104
-
-/* block */
-struct block {
-	struct block* block_next;		/* Then the allocated area */
-	struct block* unfill_prev;		/* The previous area not filled */
-	struct block* unfill_next;		/* The next area not filled */
-	unsigned short unit_size;		/* The size of the unit */
-	unsigned short unit_hash;		/* The hash of the unit */
-	unsigned short unit_count;		/* The number of units */
-	unsigned short unit_used;		/* The number of used units */
-	unsigned short unit_unfill;		/* The number of unused units */
-	unsigned short unit_maxused;	/* The maximum value of units used */
-	char   data[ BLOCK_DATA_SIZE ];
-};
+#define MEMMGR_SLAB_SIZE	(256*1024)
+#define MEMMGR_CHUNK_BITS	18	/* log2(MEMMGR_SLAB_SIZE) */
+#define MEMMGR_ARENA_SIZE	(2*1024*1024)
+#define MEMMGR_SMALL_MAX	16384
+#define MEMMGR_MEDIUM_MAX	(1024*1024)
+#define MEMMGR_CLASSES		40
+#define MEMMGR_LARGE		0xFFFFFFFF	/* Class of large allocations */
+/* Bytes moved between a thread cache and a central free list at a time */
+#define MEMMGR_BATCH_SIZE	(64*1024)
+
+#if defined(LOG_MEMMGR) || defined(DEBUG_MEMMGR)
+#define MEMMGR_HEADER
+#endif
 
+#ifdef MEMMGR_HEADER
 struct unit_head {
-	struct block   *block;
-	const  char*   file;
-	unsigned short line;
-	unsigned short size;
-	long           checksum;
+	const char* file;	/* NULL while the unit is free */
+	uint32 line;
+	uint32 size;
+};
+#define UNIT_HEAD_SIZE	16
+#else
+#define UNIT_HEAD_SIZE	0
+#endif
+
+#ifdef DEBUG_MEMMGR
+#define UNIT_TAIL_SIZE	sizeof(long)
+#else
+#define UNIT_TAIL_SIZE	0
+#endif
+
+/* Start of every slab */
+struct memmgr_slab {
+	uint32 size_class;	/* Class of the units or MEMMGR_LARGE */
+	uint32 unit_size;	/* Size of the units */
+	uint32 unit_count;	/* Number of units */
+};
+#define SLAB_HEAD_SIZE	64
+
+/* Start of every large allocation */
+struct memmgr_large {
+	struct memmgr_slab slab;	/* slab.size_class is MEMMGR_LARGE */
+	uint32 line;
+	const char* file;
+	size_t size;	/* Requested size */
+	void* base;	/* Mapping of the system */
+	size_t length;	/* Length of the mapping */
+	struct memmgr_large* prev;
+	struct memmgr_large* next;
+};
+#define LARGE_HEAD_SIZE	128
+
+/* Start of every medium allocation */
+struct memmgr_medium {
+	size_t size;	/* Requested size */
+#ifdef MEMMGR_HEADER
+	const char* file;
+	uint32 line;
+	struct memmgr_medium* prev;
+	struct memmgr_medium* next;
+#endif
 };
+#ifdef MEMMGR_HEADER
+#define MEDIUM_HEAD_SIZE	48
+#else
+#define MEDIUM_HEAD_SIZE	16
+#endif
 
-static struct block* hash_unfill[BLOCK_DATA_COUNT1 + BLOCK_DATA_COUNT2 + 1];
-static struct block* block_first, *block_last, block_head;
+/* Page map: one leaf covers 2^(MEMMGR_PAGEMAP_LEAF_BITS + MEMMGR_CHUNK_BITS) bytes of 48-bit addresses */
+#define MEMMGR_PAGEMAP_LEAF_BITS	16
+#define MEMMGR_PAGEMAP_ROOT_BITS	(48 - MEMMGR_CHUNK_BITS - MEMMGR_PAGEMAP_LEAF_BITS)
 
-/* Data for areas that do not use the memory be turned */
-struct unit_head_large {
-	size_t                  size;
-	struct unit_head_large* prev;
-	struct unit_head_large* next;
-	struct unit_head        unit_head;
+/* Memory mapped from the system to cut slabs from */
+struct memmgr_arena {
+	char* slabs;	/* First slab */
+	int slab_used;	/* Number of slabs cut */
+	struct memmgr_arena* next;
 };
 
-static struct unit_head_large *unit_head_large_first = NULL;
+/* Free units of a class shared by all threads */
+struct memmgr_central {
+	std::mutex lock;
+	void* free;	/* Free units, linked through the first bytes of their data */
+	size_t count;
+};
 
-static struct block* block_malloc(unsigned short hash);
-static void          block_free(struct block* p);
-static size_t        memmgr_usage_bytes;
+/* Free units of the classes owned by a thread */
+struct memmgr_cache {
+	void* free[MEMMGR_CLASSES];
+	uint32 count[MEMMGR_CLASSES];
+	ptrdiff_t usage;	/* Bytes allocated since the last report to memmgr_usage_bytes */
+	bool owned;	/* Released by a memmgr_cache_owner when the thread ends */
+};
 
-#define block2unit(p, n) ((struct unit_head*)(&(p)->data[ p->unit_size * (n) ]))
-#define memmgr_assert(v) do { if(!(v)) { ShowError("Memory manager: assertion '" #v "' failed!\n"); } } while(0)
+static struct memmgr_central memmgr_central_list[MEMMGR_CLASSES];
+static thread_local struct memmgr_cache memmgr_thread_cache;
 
-static unsigned short size2hash( size_t size )
+static std::mutex memmgr_arena_lock;
+static struct memmgr_arena* memmgr_arena_first = NULL;
+static struct memmgr_large* memmgr_large_first = NULL;	/* Protected by memmgr_arena_lock */
+#ifdef MEMMGR_HEADER
+static struct memmgr_medium* memmgr_medium_first = NULL;	/* Protected by memmgr_arena_lock */
+#endif
+/* Leaves are set while holding memmgr_arena_lock and never freed */
+static std::atomic<std::atomic<uint8>*> memmgr_pagemap[1 << MEMMGR_PAGEMAP_ROOT_BITS];
+static std::atomic<ptrdiff_t> memmgr_usage_bytes(0);
+
+#define unit2data(u) ((char*)(u) + UNIT_HEAD_SIZE)
+#define data2unit(p) ((char*)(p) - UNIT_HEAD_SIZE)
+#define unit_next(u) (*(void**)unit2data(u))
+#define slab2unit(s, n) ((char*)(s) + SLAB_HEAD_SIZE + (size_t)(s)->unit_size * (n))
+#define ptr2slab(p) ((struct memmgr_slab*)((uintptr_t)(p) & ~(uintptr_t)(MEMMGR_SLAB_SIZE - 1)))
+#define large2data(l) ((char*)(l) + LARGE_HEAD_SIZE)
+#define medium2data(m) ((char*)(m) + MEDIUM_HEAD_SIZE)
+#define data2medium(p) ((struct memmgr_medium*)((char*)(p) - MEDIUM_HEAD_SIZE))
+
+/* Returns true if the pointer is in a slab or large allocation, false for medium allocations */
+static inline bool memmgr_owns( void* ptr )
 {
-	if( size <= BLOCK_DATA_SIZE1 ) {
-		return (unsigned short)(size + BLOCK_ALIGNMENT1 - 1) / BLOCK_ALIGNMENT1;
-	} else if( size <= BLOCK_DATA_SIZE ){
-		return (unsigned short)(size - BLOCK_DATA_SIZE1 + BLOCK_ALIGNMENT2 - 1) / BLOCK_ALIGNMENT2
-				+ BLOCK_DATA_COUNT1;
-	} else {
-		return 0xffff;	// If it exceeds the block length hash I do not
-	}
+	uintptr_t chunk = (uintptr_t)ptr >> MEMMGR_CHUNK_BITS;
+	std::atomic<uint8>* leaf;
+
+	if( (chunk >> MEMMGR_PAGEMAP_LEAF_BITS) >= ((uintptr_t)1 << MEMMGR_PAGEMAP_ROOT_BITS) )
+		return false;
+	leaf = memmgr_pagemap[chunk >> MEMMGR_PAGEMAP_LEAF_BITS].load(std::memory_order_acquire);
+	// a chunk changes only while no pointer into it is in use, relaxed is enough
+	return leaf != NULL && leaf[chunk & ((1 << MEMMGR_PAGEMAP_LEAF_BITS) - 1)].load(std::memory_order_relaxed) != 0;
 }
 
-static size_t hash2size( unsigned short hash )
+/* Marks the chunks of aligned memory in the page map, memmgr_arena_lock has to be held */
+static void memmgr_pagemap_set( void* ptr, size_t length, uint8 value )
 {
-	if( hash <= BLOCK_DATA_COUNT1) {
-		return hash * BLOCK_ALIGNMENT1;
-	} else {
-		return (hash - BLOCK_DATA_COUNT1) * BLOCK_ALIGNMENT2 + BLOCK_DATA_SIZE1;
+	uintptr_t chunk = (uintptr_t)ptr >> MEMMGR_CHUNK_BITS;
+	uintptr_t last = ((uintptr_t)ptr + length - 1) >> MEMMGR_CHUNK_BITS;
+
+	for( ; chunk <= last; chunk++ ) {
+		std::atomic<std::atomic<uint8>*>* root = &memmgr_pagemap[chunk >> MEMMGR_PAGEMAP_LEAF_BITS];
+		std::atomic<uint8>* leaf = root->load(std::memory_order_relaxed);
+
+		if( leaf == NULL ) {
+			if( (leaf = (std::atomic<uint8>*)CALLOC(1 << MEMMGR_PAGEMAP_LEAF_BITS, sizeof(std::atomic<uint8>), __FILE__, __LINE__, __func__)) == NULL ) {
+				ShowFatalError("Memory manager::memmgr_pagemap_set failed (allocating %d bytes).\n", 1 << MEMMGR_PAGEMAP_LEAF_BITS);
+				exit(EXIT_FAILURE);
+			}
+			root->store(leaf, std::memory_order_release);
+		}
+		leaf[chunk & ((1 << MEMMGR_PAGEMAP_LEAF_BITS) - 1)].store(value, std::memory_order_relaxed);
 	}
 }
 
-void* _mmalloc(size_t size, const char *file, int line, const char *func )
+/* Returns the class of a unit of the size, 0 < size <= MEMMGR_SMALL_MAX */
+static inline uint32 size2class( size_t size )
 {
-	struct block *block;
-	short size_hash = size2hash( size );
-	struct unit_head *head;
+	uint32 p = 8;
 
-	if (((long) size) < 0) {
-		ShowError("_mmalloc: %" PRIuPTR "\n", size);
+	if( size <= 256 )
+		return (uint32)((size + 15) / 16) - 1;
+	while( (size - 1) >> (p + 1) )
+		p++;
+	return 16 + (p - 8) * 4 + (uint32)(((size - 1) - ((size_t)1 << p)) >> (p - 2));
+}
+
+/* Returns the unit size of the class */
+static inline size_t class2size( uint32 size_class )
+{
+	uint32 p;
+
+	if( size_class < 16 )
+		return (size_t)(size_class + 1) * 16;
+	p = 8 + (size_class - 16) / 4;
+	return ((size_t)1 << p) + (size_t)((size_class - 16) % 4 + 1) * ((size_t)1 << (p - 2));
+}
+
+/* Returns the number of units moved between a cache and the central list at a time */
+static inline uint32 class2batch( uint32 size_class )
+{
+	size_t batch = MEMMGR_BATCH_SIZE / class2size(size_class);
+
+	if( batch < 4 )
+		return 4;
+	if( batch > 128 )
+		return 128;
+	return (uint32)batch;
+}
+
+/* Maps memory aligned to alignment (a power of two) from the system */
+static void* memmgr_map( size_t length, size_t alignment, void** base, size_t* base_length )
+{
+#ifdef WIN32
+	char* p = (char*)VirtualAlloc(NULL, length + alignment, MEM_RESERVE, PAGE_NOACCESS);
+	char* aligned;
+
+	if( p == NULL )
 		return NULL;
-	}
-	
-	if(size == 0) {
+	aligned = (char*)(((uintptr_t)p + alignment - 1) & ~(uintptr_t)(alignment - 1));
+	if( VirtualAlloc(aligned, length, MEM_COMMIT, PAGE_READWRITE) == NULL ) {
+		VirtualFree(p, 0, MEM_RELEASE);
 		return NULL;
 	}
-	memmgr_usage_bytes += size;
+	*base = p;
+	*base_length = length + alignment;
+	return aligned;
+#else
+	size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+	char* p;
+	char* aligned;
+	size_t tail;
+
+	length = (length + page_size - 1) & ~(page_size - 1);
+	p = (char*)mmap(NULL, length + alignment, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if( p == MAP_FAILED )
+		return NULL;
+	aligned = (char*)(((uintptr_t)p + alignment - 1) & ~(uintptr_t)(alignment - 1));
+	// return the parts before and after the aligned memory
+	if( aligned > p )
+		munmap(p, aligned - p);
+	tail = (p + length + alignment) - (aligned + length);
+	if( tail )
+		munmap(aligned + length, tail);
+	*base = aligned;
+	*base_length = length;
+	return aligned;
+#endif
+}
 
-	/* To ensure the area that exceeds the length of the block, using malloc () to */
-	/* At that time, the distinction by assigning NULL to unit_head.block */
-	if(hash2size(size_hash) > BLOCK_DATA_SIZE - sizeof(struct unit_head)) {
-		struct unit_head_large* p = (struct unit_head_large*)MALLOC(sizeof(struct unit_head_large)+size,file,line,func);
-		if(p != NULL) {
-			p->size            = size;
-			p->unit_head.block = NULL;
-			p->unit_head.size  = 0;
-			p->unit_head.file  = file;
-			p->unit_head.line  = line;
-			p->prev = NULL;
-			if (unit_head_large_first == NULL)
-				p->next = NULL;
-			else {
-				unit_head_large_first->prev = p;
-				p->next = unit_head_large_first;
+static void memmgr_unmap( void* base, size_t base_length )
+{
+#ifdef WIN32
+	VirtualFree(base, 0, MEM_RELEASE);
+#else
+	munmap(base, base_length);
+#endif
+}
+
+/* Cuts a new slab for the class */
+static struct memmgr_slab* memmgr_slab_new( uint32 size_class )
+{
+	struct memmgr_slab* slab;
+
+	{
+		std::lock_guard<std::mutex> lock( memmgr_arena_lock );
+		struct memmgr_arena* arena = memmgr_arena_first;
+
+		if( arena == NULL || arena->slab_used == MEMMGR_ARENA_SIZE / MEMMGR_SLAB_SIZE ) {
+			void* base;
+			size_t length;
+
+			arena = (struct memmgr_arena*)MALLOC(sizeof(struct memmgr_arena), __FILE__, __LINE__, __func__);
+			if( arena == NULL || (arena->slabs = (char*)memmgr_map(MEMMGR_ARENA_SIZE, MEMMGR_ARENA_SIZE, &base, &length)) == NULL ) {
+				ShowFatalError("Memory manager::memmgr_slab_new failed (mapping %d bytes).\n", MEMMGR_ARENA_SIZE);
+				exit(EXIT_FAILURE);
 			}
-			unit_head_large_first = p;
-			*(long*)((char*)p + sizeof(struct unit_head_large) - sizeof(long) + size) = FREED_POINTER;
-			return (char *)p + sizeof(struct unit_head_large) - sizeof(long);
-		} else {
-			ShowFatalError("Memory manager::memmgr_alloc failed (allocating %" PRIuPTR  "+%" PRIuPTR " bytes at %s:%d).\n", sizeof(struct unit_head_large), size, file, line);
-			exit(EXIT_FAILURE);
+#ifdef MADV_HUGEPAGE
+			madvise(arena->slabs, MEMMGR_ARENA_SIZE, MADV_HUGEPAGE);
+#endif
+			memmgr_pagemap_set(arena->slabs, MEMMGR_ARENA_SIZE, 1);
+			arena->slab_used = 0;
+			arena->next = memmgr_arena_first;
+			memmgr_arena_first = arena;
 		}
+		slab = (struct memmgr_slab*)(arena->slabs + (size_t)arena->slab_used * MEMMGR_SLAB_SIZE);
+		arena->slab_used++;
 	}
 
-	/* When a block of the same size is not ensured, to ensure a new */
-	if(hash_unfill[size_hash]) {
-		block = hash_unfill[size_hash];
-	} else {
-		block = block_malloc(size_hash);
+	slab->size_class = size_class;
+	slab->unit_size = (uint32)class2size(size_class);
+	slab->unit_count = (MEMMGR_SLAB_SIZE - SLAB_HEAD_SIZE) / slab->unit_size;
+#ifdef DEBUG_MEMMGR
+	{
+		uint32 i;
+		for( i = 0; i < slab->unit_count; i++ ) {
+			memset(slab2unit(slab, i), 0xfd, slab->unit_size);
+			((struct unit_head*)slab2unit(slab, i))->file = NULL;
+		}
 	}
+#endif
+	return slab;
+}
 
-	if( block->unit_unfill == 0xFFFF ) {
-		// there are no more free space that
-		memmgr_assert(block->unit_used <  block->unit_count);
-		memmgr_assert(block->unit_used == block->unit_maxused);
-		head = block2unit(block, block->unit_maxused);
-		block->unit_used++;
-		block->unit_maxused++;
-	} else {
-		head = block2unit(block, block->unit_unfill);
-		block->unit_unfill = head->size;
-		block->unit_used++;
+/* Reports the usage of the thread cache */
+static inline void memmgr_cache_usage( struct memmgr_cache* cache )
+{
+	if( cache->usage ) {
+		memmgr_usage_bytes.fetch_add(cache->usage, std::memory_order_relaxed);
+		cache->usage = 0;
 	}
+}
 
-	if( block->unit_unfill == 0xFFFF && block->unit_maxused >= block->unit_count) {
-		// Since I ran out of the unit, removed from the list unfill
-		if( block->unfill_prev == &block_head) {
-			hash_unfill[ size_hash ] = block->unfill_next;
-		} else {
-			block->unfill_prev->unfill_next = block->unfill_next;
-		}
-		if( block->unfill_next ) {
-			block->unfill_next->unfill_prev = block->unfill_prev;
+/* Moves count units from the head of the cache to the central list */
+static void memmgr_cache_spill( struct memmgr_cache* cache, uint32 size_class, uint32 count )
+{
+	struct memmgr_central* central = &memmgr_central_list[size_class];
+	void* first = cache->free[size_class];
+	void* last = first;
+	uint32 i;
+
+	for( i = 1; i < count; i++ )
+		last = unit_next(last);
+	cache->free[size_class] = unit_next(last);
+	cache->count[size_class] -= count;
+
+	std::lock_guard<std::mutex> lock( central->lock );
+	unit_next(last) = central->free;
+	central->free = first;
+	central->count += count;
+}
+
+/* Returns the units of a thread cache to the central lists */
+static void memmgr_cache_release( void )
+{
+	struct memmgr_cache* cache = &memmgr_thread_cache;
+	uint32 i;
+
+	for( i = 0; i < MEMMGR_CLASSES; i++ ) {
+		if( cache->count[i] )
+			memmgr_cache_spill(cache, i, cache->count[i]);
+	}
+	memmgr_cache_usage(cache);
+}
+
+/* Releases the cache of a thread when the thread ends */
+struct memmgr_cache_owner {
+	~memmgr_cache_owner() {
+		memmgr_cache_release();
+	}
+};
+
+/* Registers the release of the cache before it takes its first unit, by allocating or freeing */
+static void memmgr_cache_own( struct memmgr_cache* cache )
+{
+	static thread_local struct memmgr_cache_owner owner;
+
+	(void)owner;
+	cache->owned = true;
+}
+
+/* Fills the empty cache of the class from the central list or a new slab */
+static void memmgr_cache_refill( struct memmgr_cache* cache, uint32 size_class )
+{
+	struct memmgr_central* central = &memmgr_central_list[size_class];
+	struct memmgr_slab* slab;
+	uint32 batch = class2batch(size_class);
+	uint32 i;
+
+	if( !cache->owned )
+		memmgr_cache_own(cache);
+	memmgr_cache_usage(cache);
+
+	{
+		std::lock_guard<std::mutex> lock( central->lock );
+
+		if( central->count ) {
+			void* first = central->free;
+			void* last = first;
+
+			if( batch > central->count )
+				batch = (uint32)central->count;
+			for( i = 1; i < batch; i++ )
+				last = unit_next(last);
+			central->free = unit_next(last);
+			central->count -= batch;
+			unit_next(last) = NULL;
+			cache->free[size_class] = first;
+			cache->count[size_class] = batch;
+			return;
 		}
-		block->unfill_prev = NULL;
 	}
 
+	slab = memmgr_slab_new(size_class);
+	for( i = slab->unit_count; i > 0; i-- ) {
+		void* unit = slab2unit(slab, i - 1);
+
+		unit_next(unit) = cache->free[size_class];
+		cache->free[size_class] = unit;
+	}
+	cache->count[size_class] = slab->unit_count;
+}
+
+static void* memmgr_large_alloc( size_t size, const char *file, int line, const char *func )
+{
+	struct memmgr_large* large;
+	void* base;
+	size_t length;
+
+	// whole chunks, no medium allocation of malloc can share a chunk of the page map
+	length = (LARGE_HEAD_SIZE + size + UNIT_TAIL_SIZE + MEMMGR_SLAB_SIZE - 1) & ~(size_t)(MEMMGR_SLAB_SIZE - 1);
+	large = (struct memmgr_large*)memmgr_map(length, MEMMGR_SLAB_SIZE, &base, &length);
+	if( large == NULL ) {
+		ShowFatalError("Memory manager::memmgr_alloc failed (allocating %d+%" PRIuPTR " bytes at %s:%d).\n", LARGE_HEAD_SIZE, size, file, line);
+		exit(EXIT_FAILURE);
+	}
+
+	large->slab.size_class = MEMMGR_LARGE;
+	large->file = file;
+	large->line = line;
+	large->size = size;
+	large->base = base;
+	large->length = length;
+	large->prev = NULL;
+#ifdef DEBUG_MEMMGR
+	memset(large2data(large), 0xcd, size);
+	*(long*)(large2data(large) + size) = FREED_POINTER;
+#endif
+
+	{
+		std::lock_guard<std::mutex> lock( memmgr_arena_lock );
+
+		memmgr_pagemap_set(base, length, 1);
+		large->next = memmgr_large_first;
+		if( memmgr_large_first )
+			memmgr_large_first->prev = large;
+		memmgr_large_first = large;
+	}
+	memmgr_usage_bytes.fetch_add(size, std::memory_order_relaxed);
+	return large2data(large);
+}
+
+static void memmgr_large_free( struct memmgr_large* large, const char *file, int line, const char *func )
+{
+#ifdef DEBUG_MEMMGR
+	if( *(long*)(large2data(large) + large->size) != FREED_POINTER ) {
+		ShowError("Memory manager: args of aFree 0x%p is overflowed pointer %s line %d\n", large2data(large), file, line);
+		return;
+	}
+#endif
+
+	{
+		std::lock_guard<std::mutex> lock( memmgr_arena_lock );
+
+		if( large->prev )
+			large->prev->next = large->next;
+		else
+			memmgr_large_first = large->next;
+		if( large->next )
+			large->next->prev = large->prev;
+		// before the memory can be mapped again, e.g. by malloc
+		memmgr_pagemap_set(large->base, large->length, 0);
+	}
+	memmgr_usage_bytes.fetch_sub(large->size, std::memory_order_relaxed);
+	memmgr_unmap(large->base, large->length);
+}
+
+#ifdef MEMMGR_HEADER
+/* Links a medium allocation into memmgr_medium_first, memmgr_arena_lock has to be held */
+static void memmgr_medium_link( struct memmgr_medium* medium )
+{
+	medium->prev = NULL;
+	medium->next = memmgr_medium_first;
+	if( memmgr_medium_first )
+		memmgr_medium_first->prev = medium;
+	memmgr_medium_first = medium;
+}
+
+/* Unlinks a medium allocation from memmgr_medium_first, memmgr_arena_lock has to be held */
+static void memmgr_medium_unlink( struct memmgr_medium* medium )
+{
+	if( medium->prev )
+		medium->prev->next = medium->next;
+	else
+		memmgr_medium_first = medium->next;
+	if( medium->next )
+		medium->next->prev = medium->prev;
+}
+#endif
+
+static void* memmgr_medium_alloc( size_t size, const char *file, int line, const char *func )
+{
+	struct memmgr_medium* medium = (struct memmgr_medium*)MALLOC(MEDIUM_HEAD_SIZE + size + UNIT_TAIL_SIZE, file, line, func);
+
+	if( medium == NULL ) {
+		ShowFatalError("Memory manager::memmgr_alloc failed (allocating %d+%" PRIuPTR " bytes at %s:%d).\n", MEDIUM_HEAD_SIZE, size, file, line);
+		exit(EXIT_FAILURE);
+	}
+
+	medium->size = size;
+#ifdef MEMMGR_HEADER
+	medium->file = file;
+	medium->line = line;
+	{
+		std::lock_guard<std::mutex> lock( memmgr_arena_lock );
+
+		memmgr_medium_link(medium);
+	}
+#endif
+#ifdef DEBUG_MEMMGR
+	memset(medium2data(medium), 0xcd, size);
+	*(long*)(medium2data(medium) + size) = FREED_POINTER;
+#endif
+	memmgr_thread_cache.usage += size;
+	return medium2data(medium);
+}
+
+/* Resizes a medium allocation, in place if malloc can */
+static void* memmgr_medium_realloc( struct memmgr_medium* medium, size_t size, const char *file, int line, const char *func )
+{
+	size_t old_size = medium->size;
+
+#ifdef MEMMGR_HEADER
+	std::lock_guard<std::mutex> lock( memmgr_arena_lock );
+
+	memmgr_medium_unlink(medium);
+#endif
+	medium = (struct memmgr_medium*)REALLOC(medium, MEDIUM_HEAD_SIZE + size + UNIT_TAIL_SIZE, file, line, func);
+	if( medium == NULL ) {
+		ShowFatalError("Memory manager::memmgr_realloc failed (allocating %d+%" PRIuPTR " bytes at %s:%d).\n", MEDIUM_HEAD_SIZE, size, file, line);
+		exit(EXIT_FAILURE);
+	}
+	medium->size = size;
+#ifdef MEMMGR_HEADER
+	medium->file = file;
+	medium->line = line;
+	memmgr_medium_link(medium);
+#endif
+#ifdef DEBUG_MEMMGR
+	memset(medium2data(medium) + old_size, 0xcd, size - old_size);
+	*(long*)(medium2data(medium) + size) = FREED_POINTER;
+#endif
+	memmgr_thread_cache.usage += (ptrdiff_t)size - (ptrdiff_t)old_size;
+	return medium2data(medium);
+}
+
+static void memmgr_medium_free( struct memmgr_medium* medium, const char *file, int line, const char *func )
+{
+#ifdef DEBUG_MEMMGR
+	if( *(long*)(medium2data(medium) + medium->size) != FREED_POINTER ) {
+		ShowError("Memory manager: args of aFree 0x%p is overflowed pointer %s line %d\n", medium2data(medium), file, line);
+		return;
+	}
+#endif
+#ifdef MEMMGR_HEADER
+	{
+		std::lock_guard<std::mutex> lock( memmgr_arena_lock );
+
+		memmgr_medium_unlink(medium);
+	}
+#endif
+	memmgr_thread_cache.usage -= medium->size;
+	FREE(medium, file, line, func);
+}
+
+void* _mmalloc(size_t size, const char *file, int line, const char *func )
+{
+	struct memmgr_cache* cache = &memmgr_thread_cache;
+	uint32 size_class;
+	char* unit;
+
+	if (((long) size) < 0) {
+		ShowError("_mmalloc: %" PRIuPTR "\n", size);
+		return NULL;
+	}
+
+	if(size == 0) {
+		return NULL;
+	}
+
+	if( size > MEMMGR_MEDIUM_MAX )
+		return memmgr_large_alloc(size, file, line, func);
+	if( size + UNIT_HEAD_SIZE + UNIT_TAIL_SIZE > MEMMGR_SMALL_MAX )
+		return memmgr_medium_alloc(size, file, line, func);
+
+	size_class = size2class(size + UNIT_HEAD_SIZE + UNIT_TAIL_SIZE);
+	if( cache->free[size_class] == NULL )
+		memmgr_cache_refill(cache, size_class);
+	unit = (char*)cache->free[size_class];
+	cache->free[size_class] = unit_next(unit);
+	cache->count[size_class]--;
+	cache->usage += class2size(size_class);
+
 #ifdef DEBUG_MEMMGR
 	{
-		size_t i, sz = hash2size( size_hash );
-		for( i=0; i<sz; i++ )
+		size_t i, sz = class2size(size_class) - UNIT_HEAD_SIZE;
+		for( i = sizeof(void*); i < sz; i++ )
 		{
-			if( ((unsigned char*)head)[ sizeof(struct unit_head) - sizeof(long) + i] != 0xfd )
+			if( ((unsigned char*)unit2data(unit))[i] != 0xfd )
 			{
-				if( head->line != 0xfdfd )
-				{
-					ShowError("Memory manager: freed-data is changed. (freed in %s line %d)\n", head->file,head->line);
-				}
-				else
-				{
-					ShowError("Memory manager: not-allocated-data is changed.\n");
-				}
+				ShowError("Memory manager: freed-data is changed. (%" PRIuPTR " bytes unit at 0x%p)\n", class2size(size_class), unit2data(unit));
 				break;
 			}
 		}
-		memset( (char *)head + sizeof(struct unit_head) - sizeof(long), 0xcd, sz );
+		memset(unit2data(unit), 0xcd, sz);
+		*(long*)(unit2data(unit) + size) = FREED_POINTER;
 	}
 #endif
-
-	head->block = block;
-	head->file  = file;
-	head->line  = line;
-	head->size  = (unsigned short)size;
-	*(long*)((char*)head + sizeof(struct unit_head) - sizeof(long) + size) = FREED_POINTER;
-	return (char *)head + sizeof(struct unit_head) - sizeof(long);
+#ifdef MEMMGR_HEADER
+	((struct unit_head*)unit)->file = file;
+	((struct unit_head*)unit)->line = line;
+	((struct unit_head*)unit)->size = (uint32)size;
+#endif
+	return unit2data(unit);
 }
 
 void* _mcalloc(size_t num, size_t size, const char *file, int line, const char *func )
 {
-	void *p = _mmalloc(num * size,file,line,func);
-	memset(p,0,num * size);
+	void *p;
+
+	if( size && num > SIZE_MAX / size ) {
+		ShowError("_mcalloc: %" PRIuPTR " * %" PRIuPTR "\n", num, size);
+		return NULL;
+	}
+	p = _mmalloc(num * size,file,line,func);
+	if( p != NULL )
+		memset(p,0,num * size);
 	return p;
 }
 
+/* Returns the usable size of an allocation */
+static size_t memmgr_size( void* ptr )
+{
+	struct memmgr_slab* slab;
+
+	if( !memmgr_owns(ptr) )
+		return data2medium(ptr)->size;
+	slab = ptr2slab(ptr);
+	if( slab->size_class == MEMMGR_LARGE )
+		return ((struct memmgr_large*)slab)->size;
+#ifdef MEMMGR_HEADER
+	return ((struct unit_head*)data2unit(ptr))->size;
+#else
+	return slab->unit_size;
+#endif
+}
+
 void* _mrealloc(void *memblock, size_t size, const char *file, int line, const char *func )
 {
 	size_t old_size;
@@ -347,14 +807,25 @@ void* _mrealloc(void *memblock, size_t size, const char *file, int line, const c
 		return _mmalloc(size,file,line,func);
 	}
 
-	old_size = ((struct unit_head *)((char *)memblock - sizeof(struct unit_head) + sizeof(long)))->size;
-	if( old_size == 0 ) {
-		old_size = ((struct unit_head_large *)((char *)memblock - sizeof(struct unit_head_large) + sizeof(long)))->size;
-	}
-	if(old_size > size) {
+	old_size = memmgr_size(memblock);
+	if(old_size >= size) {
 		// Size reduction - return> as it is (negligence)
 		return memblock;
-	}  else {
+	} else if( !memmgr_owns(memblock) && size <= MEMMGR_MEDIUM_MAX ) {
+		return memmgr_medium_realloc(data2medium(memblock), size, file, line, func);
+	} else if( memmgr_owns(memblock) && ptr2slab(memblock)->size_class == MEMMGR_LARGE
+		&& LARGE_HEAD_SIZE + size + UNIT_TAIL_SIZE <= ((struct memmgr_large*)ptr2slab(memblock))->length ) {
+		// the page rounding of the mapping leaves room
+		struct memmgr_large* large = (struct memmgr_large*)ptr2slab(memblock);
+
+		memmgr_usage_bytes.fetch_add(size - large->size, std::memory_order_relaxed);
+#ifdef DEBUG_MEMMGR
+		memset(large2data(large) + large->size, 0xcd, size - large->size);
+		*(long*)(large2data(large) + size) = FREED_POINTER;
+#endif
+		large->size = size;
+		return memblock;
+	} else {
 		// Size Large
 		void *p = _mmalloc(size,file,line,func);
 		if(p != NULL) {
@@ -379,153 +850,67 @@ char* _mstrdup(const char *p, const char *file, int line, const char *func )
 
 void _mfree(void *ptr, const char *file, int line, const char *func )
 {
-	struct unit_head *head;
+	struct memmgr_cache* cache = &memmgr_thread_cache;
+	struct memmgr_slab* slab;
+	uint32 size_class;
+	char* unit;
 
 	if (ptr == NULL)
-		return; 
-
-	head = (struct unit_head *)((char *)ptr - sizeof(struct unit_head) + sizeof(long));
-	if(head->size == 0) {
-		/* area that is directly secured by malloc () */
-		struct unit_head_large *head_large = (struct unit_head_large *)((char *)ptr - sizeof(struct unit_head_large) + sizeof(long));
-		if(
-			*(long*)((char*)head_large + sizeof(struct unit_head_large) - sizeof(long) + head_large->size)
-			!= FREED_POINTER)
-		{
-			ShowError("Memory manager: args of aFree 0x%p is overflowed pointer %s line %d\n", ptr, file, line);
-		} else {
-			head->size = 0xFFFF;
-			if(head_large->prev) {
-				head_large->prev->next = head_large->next;
-			} else {
-				unit_head_large_first  = head_large->next;
-			}
-			if(head_large->next) {
-				head_large->next->prev = head_large->prev;
-			}
-			memmgr_usage_bytes -= head_large->size;
-#ifdef DEBUG_MEMMGR
-			// set freed memory to 0xfd
-			memset(ptr, 0xfd, head_large->size);
-#endif
-			FREE(head_large,file,line,func);
-		}
-	} else {
-		/* Release unit */
-		struct block *block = head->block;
-		if( (size_t)((char*)head - (char*)block) > sizeof(struct block) ) {
-			ShowError("Memory manager: args of aFree 0x%p is invalid pointer %s line %d\n", ptr, file, line);
-		} else if(head->block == NULL) {
-			ShowError("Memory manager: args of aFree 0x%p is freed pointer %s:%d@%s\n", ptr, file, line, func);
-		} else if(*(long*)((char*)head + sizeof(struct unit_head) - sizeof(long) + head->size) != FREED_POINTER) {
-			ShowError("Memory manager: args of aFree 0x%p is overflowed pointer %s line %d\n", ptr, file, line);
-		} else {
-			memmgr_usage_bytes -= head->size;
-			head->block         = NULL;
-#ifdef DEBUG_MEMMGR
-			memset(ptr, 0xfd, block->unit_size - sizeof(struct unit_head) + sizeof(long) );
-			head->file = file;
-			head->line = line;
-#endif
-			memmgr_assert( block->unit_used > 0 );
-			if(--block->unit_used == 0) {
-				/* Release of the block */
-				block_free(block);
-			} else {
-				if( block->unfill_prev == NULL) {
-					// add to unfill list
-					if( hash_unfill[ block->unit_hash ] ) {
-						hash_unfill[ block->unit_hash ]->unfill_prev = block;
-					}
-					block->unfill_prev = &block_head;
-					block->unfill_next = hash_unfill[ block->unit_hash ];
-					hash_unfill[ block->unit_hash ] = block;
-				}
-				head->size     = block->unit_unfill;
-				block->unit_unfill = (unsigned short)(((uintptr_t)head - (uintptr_t)block->data) / block->unit_size);
-			}
-		}
-	}
-}
+		return;
 
-/* Allocating blocks */
-static struct block* block_malloc(unsigned short hash)
-{
-	struct block *p;
-	if(hash_unfill[0] != NULL) {
-		/* Space for the block has already been secured */
-		p = hash_unfill[0];
-		hash_unfill[0] = hash_unfill[0]->unfill_next;
-	} else {
-		int i;
-		/* Newly allocated space for the block */
-		p = (struct block*)MALLOC(sizeof(struct block) * (BLOCK_ALLOC), __FILE__, __LINE__, __func__ );
-		if(p == NULL) {
-			ShowFatalError("Memory manager::block_alloc failed.\n");
-			exit(EXIT_FAILURE);
-		}
-
-		if(block_first == NULL) {
-			/* First ensure */
-			block_first = p;
-		} else {
-			block_last->block_next = p;
-		}
-		block_last = &p[BLOCK_ALLOC - 1];
-		block_last->block_next = NULL;
-		/* Linking the block */
-		for(i=0;i<BLOCK_ALLOC;i++) {
-			if(i != 0) {
-				// I do not add the link p [0], so we will use
-				p[i].unfill_next = hash_unfill[0];
-				hash_unfill[0]   = &p[i];
-				p[i].unfill_prev = NULL;
-				p[i].unit_used = 0;
-			}
-			if(i != BLOCK_ALLOC -1) {
-				p[i].block_next = &p[i+1];
-			}
-		}
+	if( !memmgr_owns(ptr) ) {
+		memmgr_medium_free(data2medium(ptr), file, line, func);
+		return;
+	}
+	slab = ptr2slab(ptr);
+	if( slab->size_class == MEMMGR_LARGE ) {
+		memmgr_large_free((struct memmgr_large*)slab, file, line, func);
+		return;
 	}
 
-	// Add to unfill
-	memmgr_assert(hash_unfill[ hash ] == NULL);
-	hash_unfill[ hash ] = p;
-	p->unfill_prev  = &block_head;
-	p->unfill_next  = NULL;
-	p->unit_size    = (unsigned short)(hash2size( hash ) + sizeof(struct unit_head));
-	p->unit_hash    = hash;
-	p->unit_count   = BLOCK_DATA_SIZE / p->unit_size;
-	p->unit_used    = 0;
-	p->unit_unfill  = 0xFFFF;
-	p->unit_maxused = 0;
+	size_class = slab->size_class;
+	unit = data2unit(ptr);
 #ifdef DEBUG_MEMMGR
-	memset( p->data, 0xfd, sizeof(p->data) );
+	if( size_class >= MEMMGR_CLASSES || unit < slab2unit(slab, 0) || (size_t)(unit - slab2unit(slab, 0)) % slab->unit_size ) {
+		ShowError("Memory manager: args of aFree 0x%p is invalid pointer %s line %d\n", ptr, file, line);
+		return;
+	}
 #endif
-	return p;
-}
+#ifdef MEMMGR_HEADER
+	{
+		struct unit_head* head = (struct unit_head*)unit;
 
-static void block_free(struct block* p)
-{
-	if( p->unfill_prev ) {
-		if( p->unfill_prev == &block_head) {
-			hash_unfill[ p->unit_hash ] = p->unfill_next;
-		} else {
-			p->unfill_prev->unfill_next = p->unfill_next;
+		if( head->file == NULL ) {
+			ShowError("Memory manager: args of aFree 0x%p is freed pointer %s:%d@%s\n", ptr, file, line, func);
+			return;
 		}
-		if( p->unfill_next ) {
-			p->unfill_next->unfill_prev = p->unfill_prev;
+#ifdef DEBUG_MEMMGR
+		if( *(long*)((char*)ptr + head->size) != FREED_POINTER ) {
+			ShowError("Memory manager: args of aFree 0x%p is overflowed pointer %s line %d\n", ptr, file, line);
+			return;
 		}
-		p->unfill_prev = NULL;
+		memset(ptr, 0xfd, slab->unit_size - UNIT_HEAD_SIZE);
+#endif
+		head->file = NULL;
 	}
+#endif
 
-	p->unfill_next = hash_unfill[0];
-	hash_unfill[0] = p;
+	if( !cache->owned )
+		memmgr_cache_own(cache);
+	unit_next(unit) = cache->free[size_class];
+	cache->free[size_class] = unit;
+	cache->usage -= slab->unit_size;
+	if( ++cache->count[size_class] >= 2 * class2batch(size_class) )
+		memmgr_cache_spill(cache, size_class, class2batch(size_class));
 }
 
 size_t memmgr_usage (void)
 {
-	return memmgr_usage_bytes / 1024;
+	ptrdiff_t usage;
+
+	memmgr_cache_usage(&memmgr_thread_cache);
+	usage = memmgr_usage_bytes.load(std::memory_order_relaxed);
+	return usage > 0 ? (size_t)usage / 1024 : 0;
 }
 
 #ifdef LOG_MEMMGR
@@ -561,100 +946,121 @@ static void memmgr_log (char *buf)
 
 /// Returns true if the memory location is active.
 /// Active means it is allocated and points to a usable part.
+/// Without unit headers every unit of a slab and every pointer outside of
+/// the slabs and large allocations (a medium allocation) counts as active.
 ///
 /// @param ptr Pointer to the memory
 /// @return true if the memory is active
 bool memmgr_verify(void* ptr)
 {
-	struct block* block = block_first;
-	struct unit_head_large* large = unit_head_large_first;
+	std::lock_guard<std::mutex> lock( memmgr_arena_lock );
+	struct memmgr_arena* arena = memmgr_arena_first;
+	struct memmgr_large* large = memmgr_large_first;
 
 	if( ptr == NULL )
 		return false;// never valid
 
 	// search small blocks
-	while( block )
+	while( arena )
 	{
-		if( (char*)ptr >= (char*)block && (char*)ptr < ((char*)block) + sizeof(struct block) )
-		{// found memory block
-			if( block->unit_used && (char*)ptr >= block->data )
-			{// memory block is being used and ptr points to a sub-unit
-				size_t i = (size_t)((char*)ptr - block->data)/block->unit_size;
-				struct unit_head* head = block2unit(block, i);
-				if( i < block->unit_maxused && head->block != NULL )
-				{// memory unit is allocated, check if ptr points to the usable part
-					return ( (char*)ptr >= ((char*)head) + sizeof(struct unit_head) - sizeof(long)
-						&& (char*)ptr < ((char*)head) + sizeof(struct unit_head) - sizeof(long) + head->size );
-				}
-			}
-			return false;
+		if( (char*)ptr >= arena->slabs && (char*)ptr < arena->slabs + (size_t)arena->slab_used * MEMMGR_SLAB_SIZE )
+		{// found slab
+			struct memmgr_slab* slab = ptr2slab(ptr);
+			size_t i;
+			char* unit;
+
+			if( (char*)ptr < slab2unit(slab, 0) )
+				return false;
+			i = (size_t)((char*)ptr - slab2unit(slab, 0)) / slab->unit_size;
+			if( i >= slab->unit_count )
+				return false;
+			unit = slab2unit(slab, i);
+#ifdef MEMMGR_HEADER
+			// memory unit is allocated, check if ptr points to the usable part
+			return ( ((struct unit_head*)unit)->file != NULL && (char*)ptr >= unit2data(unit)
+				&& (char*)ptr < unit2data(unit) + ((struct unit_head*)unit)->size );
+#else
+			return ( (char*)ptr >= unit2data(unit) );
+#endif
 		}
-		block = block->block_next;
+		arena = arena->next;
 	}
 
 	// search large blocks
 	while( large )
 	{
-		if( (char*)ptr >= (char*)large && (char*)ptr < ((char*)large) + large->size )
+		if( (char*)ptr >= (char*)large && (char*)ptr < large2data(large) + large->size )
 		{// found memory block, check if ptr points to the usable part
-			return ( (char*)ptr >= ((char*)large) + sizeof(struct unit_head_large) - sizeof(long)
-				&& (char*)ptr < ((char*)large) + sizeof(struct unit_head_large) - sizeof(long) + large->size );
+			return ( (char*)ptr >= large2data(large) );
 		}
 		large = large->next;
 	}
+
+#ifdef MEMMGR_HEADER
+	// search medium blocks
+	for( struct memmgr_medium* medium = memmgr_medium_first; medium != NULL; medium = medium->next )
+	{
+		if( (char*)ptr >= (char*)medium && (char*)ptr < medium2data(medium) + medium->size )
+			return ( (char*)ptr >= medium2data(medium) );
+	}
 	return false;
+#else
+	return !memmgr_owns(ptr);
+#endif
 }
 
 static void memmgr_final (void)
 {
-	struct block *block = block_first;
-	struct unit_head_large *large = unit_head_large_first;
-
 #ifdef LOG_MEMMGR
+	std::lock_guard<std::mutex> lock( memmgr_arena_lock );
+	struct memmgr_arena* arena;
+	struct memmgr_large* large;
 	int count = 0;
-#endif /* LOG_MEMMGR */
 
-	while (block) {
-		if (block->unit_used) {
-			int i;
-			for (i = 0; i < block->unit_maxused; i++) {
-				struct unit_head *head = block2unit(block, i);
-				if(head->block != NULL) {
-					char* ptr = (char *)head + sizeof(struct unit_head) - sizeof(long);
-#ifdef LOG_MEMMGR
+	// units of the slabs are not released, the process is ending
+	for( arena = memmgr_arena_first; arena != NULL; arena = arena->next ) {
+		int i;
+
+		for( i = 0; i < arena->slab_used; i++ ) {
+			struct memmgr_slab* slab = (struct memmgr_slab*)(arena->slabs + (size_t)i * MEMMGR_SLAB_SIZE);
+			uint32 j;
+
+			for( j = 0; j < slab->unit_count; j++ ) {
+				struct unit_head* head = (struct unit_head*)slab2unit(slab, j);
+
+				if( head->file != NULL ) {
 					char buf[1024];
 					sprintf (buf,
 						"%04d : %s line %d size %lu address 0x%p\n", ++count,
-						head->file, head->line, (unsigned long)head->size, ptr);
+						head->file, head->line, (unsigned long)head->size, unit2data(head));
 					memmgr_log (buf);
-#endif /* LOG_MEMMGR */
-					// get block pointer and free it [celest]
-					_mfree(ptr, ALC_MARK);
 				}
 			}
 		}
-		block = block->block_next;
 	}
 
-	while(large) {
-		struct unit_head_large *large2;
-#ifdef LOG_MEMMGR
+	for( large = memmgr_large_first; large != NULL; large = large->next ) {
 		char buf[1024];
 		sprintf (buf,
 			"%04d : %s line %d size %lu address 0x%p\n", ++count,
-			large->unit_head.file, large->unit_head.line, (unsigned long)large->size, &large->unit_head.checksum);
+			large->file, large->line, (unsigned long)large->size, large2data(large));
 		memmgr_log (buf);
-#endif /* LOG_MEMMGR */
-		large2 = large->next;
-		FREE(large,file,line,func);
-		large = large2;
 	}
-#ifdef LOG_MEMMGR
+
+	for( struct memmgr_medium* medium = memmgr_medium_first; medium != NULL; medium = medium->next ) {
+		char buf[1024];
+		sprintf (buf,
+			"%04d : %s line %d size %lu address 0x%p\n", ++count,
+			medium->file, medium->line, (unsigned long)medium->size, medium2data(medium));
+		memmgr_log (buf);
+	}
+
 	if(count == 0) {
 		ShowInfo("Memory manager: No memory leaks found.\n");
 	} else {
-		ShowWarning("Memory manager: Memory leaks found and fixed.\n");
+		ShowWarning("Memory manager: Memory leaks found, see %s.\n", memmer_logfile);
 		fclose(log_fp);
+		log_fp = NULL;
 	}
 #endif /* LOG_MEMMGR */
 }
@@ -664,7 +1070,6 @@ static void memmgr_init (void)
 #ifdef LOG_MEMMGR
 	sprintf(memmer_logfile, "log/%s.leaks", SERVER_NAME);
 	ShowStatus("Memory manager initialised: " CL_WHITE "%s" CL_RESET "\n", memmer_logfile);
-	memset(hash_unfill, 0, sizeof(hash_unfill));
 #endif /* LOG_MEMMGR */
 }
 #endif /* USE_MEMMGR */
@@ -20,8 +20,8 @@
 #define UINT_MAX 4294967295U
 #endif
 
-// Global variable
-static unsigned int *pX;
+// Block being processed, per thread so the login-server workers can hash in parallel
+static thread_local unsigned int *pX;
 
 // String Table
 static const unsigned int T[] = {
@@ -3,6 +3,7 @@
 
 #include "showmsg.hpp"
 
+#include <mutex>
 #include <stdlib.h> // atexit
 #include <time.h>
 
@@ -662,6 +663,10 @@ int	FPRINTF(FILE *file, const char *fmt, ...)
 
 char timestamp_format[20] = ""; //For displaying Timestamps
 
+/// Messages are also shown by worker threads (SqlPool), one message is written at a time.
+/// Recursive, since showing a message can show another one.
+static std::recursive_mutex showmsg_mutex;
+
 int _vShowMessage(enum msg_type flag, const char *string, va_list ap)
 {
 	va_list apcopy;
@@ -669,6 +674,7 @@ int _vShowMessage(enum msg_type flag, const char *string, va_list ap)
 #if defined(DEBUGLOGMAP) || defined(DEBUGLOGCHAR) || defined(DEBUGLOGLOGIN)
 	FILE *fp;
 #endif
+	std::lock_guard<std::recursive_mutex> lock(showmsg_mutex);
 	
 	if (!string || *string == '\0') {
 		ShowError("Empty string passed to _vShowMessage().\n");
@@ -1055,13 +1055,18 @@ int do_sockets(t_tick next)
 //////////////////////////////
 // IP rules and DDoS protection
 
-typedef struct _connect_history {
-	struct _connect_history* next;
-	uint32 ip;
-	t_tick tick;
-	int count;
-	unsigned ddos : 1;
-} ConnectHistory;
+/// Token bucket of an ip or of an ip prefix.
+/// A bucket holds up to ddos_count connections and refills at ddos_count per ddos_interval,
+/// the tokens are scaled by ddos_interval so refilling needs no division.
+typedef struct _connect_bucket {
+	uint32 ip;          // ip, masked to the prefix
+	uint8 bits;         // length of the prefix, 0 if the slot is free
+	bool ddos;          // flagged until ddos_autoreset has passed since tick
+	t_tick tick;        // last connection
+	int64 tokens;       // connections left * ddos_interval
+	uint32 accepted;    // since the last report
+	uint32 rejected;    // since the last report
+} ConnectBucket;
 
 typedef struct _access_control {
 	uint32 ip;
@@ -1083,9 +1088,204 @@ static int access_debug    = 0;
 static int ddos_count      = 10;
 static int ddos_interval   = 3*1000;
 static int ddos_autoreset  = 10*60*1000;
-/// Connection history, an array of linked lists.
-/// The array's index for any ip is ip&0xFFFF
-static ConnectHistory* connect_history[0x10000];
+static int ddos_prefix_bits  = 24;
+static int ddos_prefix_count = 0;
+static int ddos_report_interval = 5*60*1000;
+
+/// Connection history, an open addressing table with linear probing.
+/// Once CONNECT_TABLE_MAXLOAD slots are used, new ips replace the least recently seen
+/// bucket of their probe window, so the table stays bounded during floods from many ips.
+#define CONNECT_TABLE_SIZE 0x10000 // power of two
+#define CONNECT_TABLE_MAXLOAD (CONNECT_TABLE_SIZE/4*3)
+#define CONNECT_TABLE_PROBES 16 // slots searched for a bucket to replace
+#define CONNECT_SWEEP_CHECK 2 // slots inspected for expiration on every connection
+#define CONNECT_SWEEP_TIMER 1024 // slots inspected for expiration every second
+#define CONNECT_REPORT_TOP 5 // prefixes with the most rejections in the report
+static ConnectBucket connect_table[CONNECT_TABLE_SIZE];
+static int connect_table_count = 0;
+static int connect_sweep_pos = 0;
+static uint32 connect_accepted = 0;
+static uint32 connect_rejected = 0;
+
+/// Home slot of an ip prefix in connect_table.
+static inline int connect_hash(uint32 ip, uint8 bits)
+{
+	uint32 h = ip ^ ( (uint32)bits * 0x9E3779B9U );
+
+	h ^= h >> 16;
+	h *= 0x85EBCA6BU;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35U;
+	h ^= h >> 16;
+	return (int)( h & ( CONNECT_TABLE_SIZE - 1 ) );
+}
+
+/// Checks if the bucket can be forgotten.
+static inline bool connect_expired(ConnectBucket* bucket, t_tick tick)
+{
+	if( bucket->ddos )
+		return DIFF_TICK(tick, bucket->tick) > ddos_autoreset;
+	return DIFF_TICK(tick, bucket->tick) > ddos_interval*3;
+}
+
+/// Frees a slot, moving the following buckets of its cluster back so lookups need no tombstones.
+static void connect_remove(int slot)
+{
+	int next = slot;
+
+	connect_table[slot].bits = 0;
+	connect_table_count--;
+
+	for( ;; ) {
+		int home;
+
+		next = ( next + 1 ) & ( CONNECT_TABLE_SIZE - 1 );
+		if( connect_table[next].bits == 0 )
+			return;
+
+		home = connect_hash(connect_table[next].ip, connect_table[next].bits);
+		// move the bucket if the free slot lies between its home slot and its current slot
+		if( ( ( next - home ) & ( CONNECT_TABLE_SIZE - 1 ) ) >= ( ( next - slot ) & ( CONNECT_TABLE_SIZE - 1 ) ) ) {
+			connect_table[slot] = connect_table[next];
+			connect_table[next].bits = 0;
+			slot = next;
+		}
+	}
+}
+
+/// Inspects the next slots of the table and frees expired buckets.
+static void connect_check_sweep(int slots)
+{
+	t_tick tick = gettick();
+
+	while( slots-- > 0 ) {
+		ConnectBucket* bucket = &connect_table[connect_sweep_pos];
+
+		if( bucket->bits != 0 && connect_expired(bucket, tick) )
+			connect_remove(connect_sweep_pos); // the slot may have been refilled, check it again
+		else
+			connect_sweep_pos = ( connect_sweep_pos + 1 ) & ( CONNECT_TABLE_SIZE - 1 );
+	}
+}
+
+/// Finds or creates the bucket of an ip prefix.
+/// Returns NULL if the table is full and no bucket of the probe window can be replaced.
+/// @param held: bucket the caller still uses, it is never replaced (NULL for none)
+static ConnectBucket* connect_bucket(uint32 ip, uint8 bits, ConnectBucket* held)
+{
+	uint32 mask = ( bits >= 32 ) ? 0xFFFFFFFF : ~( 0xFFFFFFFF >> bits );
+	int slot = connect_hash(ip & mask, bits);
+	t_tick tick = gettick();
+	ConnectBucket* oldest = NULL;
+	ConnectBucket* bucket;
+	int probes;
+
+	ip &= mask;
+	for( probes = 0; ; probes++ ) {
+		bucket = &connect_table[slot];
+		if( bucket->bits == 0 )
+			break;
+		if( bucket->ip == ip && bucket->bits == bits )
+			return bucket;
+		if( probes < CONNECT_TABLE_PROBES && bucket != held && !bucket->ddos && ( oldest == NULL || DIFF_TICK(bucket->tick, oldest->tick) < 0 ) )
+			oldest = bucket;
+		slot = ( slot + 1 ) & ( CONNECT_TABLE_SIZE - 1 );
+	}
+
+	if( connect_table_count >= CONNECT_TABLE_MAXLOAD ) {
+		if( oldest == NULL )
+			return NULL;
+		bucket = oldest; // replaced in place, it lies on the probe path of the new ip
+	} else
+		connect_table_count++;
+
+	memset(bucket, 0, sizeof(ConnectBucket));
+	bucket->ip = ip;
+	bucket->bits = bits;
+	bucket->tick = tick;
+	bucket->tokens = (int64)( bits < 32 ? ddos_prefix_count : ddos_count ) * ddos_interval;
+	return bucket;
+}
+
+/// Refills the bucket and takes a token, an empty bucket is flagged as DDoS.
+/// A bucket without limit (count 0) only records the connection.
+/// Returns false if the bucket is empty or flagged as DDoS.
+static bool connect_take(ConnectBucket* bucket, int count)
+{
+	t_tick tick = gettick();
+	int64 capacity = (int64)count * ddos_interval;
+
+	if( bucket == NULL )
+		return true; // not tracked, table is full of attacks
+
+	if( bucket->ddos ) {
+		if( DIFF_TICK(tick, bucket->tick) <= ddos_autoreset )
+			return false;
+		bucket->ddos = false;
+		bucket->tokens = capacity;
+	}
+
+	if( count <= 0 ) {
+		bucket->tick = tick;
+		return true;
+	}
+
+	bucket->tokens = min(capacity, bucket->tokens + (int64)DIFF_TICK(tick, bucket->tick) * count);
+	bucket->tick = tick;
+	if( bucket->tokens < ddos_interval )
+	{// DDoS attack detected
+		bucket->ddos = true;
+		if( bucket->bits < 32 )
+			ShowWarning("connect_check: DDoS Attack detected from %d.%d.%d.%d/%d!\n", CONVIP(bucket->ip), bucket->bits);
+		else
+			ShowWarning("connect_check: DDoS Attack detected from %d.%d.%d.%d!\n", CONVIP(bucket->ip));
+		return false;
+	}
+	bucket->tokens -= ddos_interval;
+	return true;
+}
+
+/// Timer function.
+/// Deletes old connection history records, a part of the table every second.
+static TIMER_FUNC(connect_check_clear){
+	connect_check_sweep(CONNECT_SWEEP_TIMER);
+	return 0;
+}
+
+/// Timer function.
+/// Reports the accepted and rejected connections and the prefixes with the most rejections.
+static TIMER_FUNC(connect_check_report){
+	ConnectBucket* top[CONNECT_REPORT_TOP] = { NULL };
+	int i, j;
+
+	if( connect_rejected == 0 && !access_debug ) {
+		connect_accepted = 0;
+		return 0;
+	}
+
+	for( i = 0; i < CONNECT_TABLE_SIZE; i++ ) {
+		ConnectBucket* bucket = &connect_table[i];
+
+		if( bucket->bits == 0 || bucket->bits == 32 || bucket->rejected == 0 )
+			continue;
+		for( j = CONNECT_REPORT_TOP; j > 0 && ( top[j - 1] == NULL || top[j - 1]->rejected < bucket->rejected ); j-- ) {
+			if( j < CONNECT_REPORT_TOP )
+				top[j] = top[j - 1];
+		}
+		if( j < CONNECT_REPORT_TOP )
+			top[j] = bucket;
+	}
+
+	ShowInfo("connect_check: %u connections accepted, %u rejected in the last %d seconds, %d of %d ips and prefixes tracked.\n",
+		connect_accepted, connect_rejected, ddos_report_interval / 1000, connect_table_count, CONNECT_TABLE_SIZE);
+	for( i = 0; i < CONNECT_REPORT_TOP && top[i] != NULL; i++ )
+		ShowInfo("connect_check:   %d.%d.%d.%d/%d: %u accepted, %u rejected%s\n", CONVIP(top[i]->ip), top[i]->bits, top[i]->accepted, top[i]->rejected, top[i]->ddos ? " (DDoS)" : "");
+
+	for( i = 0; i < CONNECT_TABLE_SIZE; i++ )
+		connect_table[i].accepted = connect_table[i].rejected = 0;
+	connect_accepted = connect_rejected = 0;
+	return 0;
+}
 
 static int connect_check_(uint32 ip);
 
@@ -1105,7 +1305,9 @@ static int connect_check(uint32 ip)
 ///  1 or 2 : Connection Accepted
 static int connect_check_(uint32 ip)
 {
-	ConnectHistory* hist = connect_history[ip&0xFFFF];
+	ConnectBucket* bucket;
+	ConnectBucket* prefix = NULL;
+	bool ok;
 	int i;
 	int is_allowip = 0;
 	int is_denyip = 0;
@@ -1167,75 +1369,37 @@ static int connect_check_(uint32 ip)
 		break;
 	}
 
-	// Inspect connection history
-	while( hist ) {
-		if( ip == hist->ip )
-		{// IP found
-			if( hist->ddos )
-			{// flagged as DDoS
-				return (connect_ok == 2 ? 1 : 0);
-			} else if( DIFF_TICK(gettick(),hist->tick) < ddos_interval )
-			{// connection within ddos_interval
-				hist->tick = gettick();
-				if( hist->count++ >= ddos_count )
-				{// DDoS attack detected
-					hist->ddos = 1;
-					ShowWarning("connect_check: DDoS Attack detected from %d.%d.%d.%d!\n", CONVIP(ip));
-					return (connect_ok == 2 ? 1 : 0);
-				}
-				return connect_ok;
-			} else
-			{// not within ddos_interval, clear data
-				hist->tick  = gettick();
-				hist->count = 0;
-				return connect_ok;
-			}
-		}
-		hist = hist->next;
-	}
-	// IP not found, add to history
-	CREATE(hist, ConnectHistory, 1);
-	memset(hist, 0, sizeof(ConnectHistory));
-	hist->ip   = ip;
-	hist->tick = gettick();
-	hist->next = connect_history[ip&0xFFFF];
-	connect_history[ip&0xFFFF] = hist;
-	return connect_ok;
-}
+	if( connect_ok == 0 )
+		return 0;
 
-/// Timer function.
-/// Deletes old connection history records.
-static TIMER_FUNC(connect_check_clear){
-	int i;
-	int clear = 0;
-	int list  = 0;
-	ConnectHistory root;
-	ConnectHistory* prev_hist;
-	ConnectHistory* hist;
-
-	for( i=0; i < 0x10000 ; ++i ){
-		prev_hist = &root;
-		root.next = hist = connect_history[i];
-		while( hist ){
-			if( (!hist->ddos && DIFF_TICK(tick,hist->tick) > ddos_interval*3) ||
-					(hist->ddos && DIFF_TICK(tick,hist->tick) > ddos_autoreset) )
-			{// Remove connection history
-				prev_hist->next = hist->next;
-				aFree(hist);
-				hist = prev_hist->next;
-				clear++;
-			} else {
-				prev_hist = hist;
-				hist = hist->next;
-			}
-			list++;
-		}
-		connect_history[i] = root.next;
-	}
-	if( access_debug ){
-		ShowInfo("connect_check_clear: Cleared %d of %d from IP list.\n", clear, list);
+	connect_check_sweep(CONNECT_SWEEP_CHECK);
+
+	// Take a token from the ip, then from its prefix
+	bucket = connect_bucket(ip, 32, NULL);
+	if( ddos_prefix_bits > 0 && ddos_prefix_bits < 32 )
+		prefix = connect_bucket(ip, ddos_prefix_bits, bucket);
+
+	ok = connect_take(bucket, ddos_count);
+	if( ok && prefix != NULL )
+		ok = connect_take(prefix, ddos_prefix_count);
+
+	if( ok || connect_ok == 2 ) {
+		if( bucket != NULL )
+			bucket->accepted++;
+		if( prefix != NULL )
+			prefix->accepted++;
+		connect_accepted++;
+		if( !ok )
+			return 1; // flagged as DDoS, but unconditionally accepted
+	} else {
+		if( bucket != NULL )
+			bucket->rejected++;
+		if( prefix != NULL )
+			prefix->rejected++;
+		connect_rejected++;
+		return 0;
 	}
-	return list;
+	return connect_ok;
 }
 
 /// Parses the ip address and mask and puts it into acc.
@@ -1339,6 +1503,12 @@ int socket_config_read(const char* cfgName)
 			ddos_count = atoi(w2);
 		else if (!strcmpi(w1,"ddos_autoreset"))
 			ddos_autoreset = atoi(w2);
+		else if (!strcmpi(w1,"ddos_prefix_bits"))
+			ddos_prefix_bits = min(max(atoi(w2), 0), 32);
+		else if (!strcmpi(w1,"ddos_prefix_count"))
+			ddos_prefix_count = max(atoi(w2), 0);
+		else if (!strcmpi(w1,"ddos_report_interval"))
+			ddos_report_interval = max(atoi(w2), 0);
 		else if (!strcmpi(w1,"debug"))
 			access_debug = config_switch(w2);
 #ifdef SOCKET_EPOLL
@@ -1368,17 +1538,6 @@ void socket_final(void)
 {
 	int i;
 #ifndef MINICORE
-	ConnectHistory* hist;
-	ConnectHistory* next_hist;
-
-	for( i=0; i < 0x10000; ++i ){
-		hist = connect_history[i];
-		while( hist ){
-			next_hist = hist->next;
-			aFree(hist);
-			hist = next_hist;
-		}
-	}
 	if( access_allow )
 		aFree(access_allow);
 	if( access_deny )
@@ -1609,10 +1768,15 @@ void socket_init(void)
 	create_session(0, null_recv, null_send, null_parse); //FIXME this is causing leak
 
 #ifndef MINICORE
-	// Delete old connection history every 5 minutes
-	memset(connect_history, 0, sizeof(connect_history));
+	// Delete old connection history, a part of the table every second
+	memset(connect_table, 0, sizeof(connect_table));
+	connect_table_count = 0;
 	add_timer_func_list(connect_check_clear, "connect_check_clear");
-	add_timer_interval(gettick()+1000, connect_check_clear, 0, 0, 5*60*1000);
+	add_timer_interval(gettick()+1000, connect_check_clear, 0, 0, 1000);
+	if( ddos_report_interval > 0 ) {
+		add_timer_func_list(connect_check_report, "connect_check_report");
+		add_timer_interval(gettick()+ddos_report_interval, connect_check_report, 0, 0, ddos_report_interval);
+	}
 #endif
 
 	ShowInfo("Server supports up to '" CL_WHITE "%u" CL_RESET "' concurrent connections.\n", rlim_cur);
@@ -239,6 +239,18 @@ static int Sql_P_Keepalive(Sql* self)
 
 
 
+/// Removes the periodic keepalive ping of the connection.
+void Sql_DisableKeepalive(Sql* self)
+{
+	if( self && self->keepalive != INVALID_TIMER )
+	{
+		delete_timer(self->keepalive, Sql_P_KeepaliveTimer);
+		self->keepalive = INVALID_TIMER;
+	}
+}
+
+
+
 /// Escapes a string.
 size_t Sql_EscapeString(Sql* self, char *out_to, const char *from)
 {
@@ -454,6 +466,22 @@ void Sql_Free(Sql* self)
 
 
 
+/// Initializes the client library for the calling thread.
+void Sql_ThreadInit(void)
+{
+	mysql_thread_init();
+}
+
+
+
+/// Frees the data of the client library for the calling thread.
+void Sql_ThreadEnd(void)
+{
+	mysql_thread_end();
+}
+
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // Prepared Statements
 ///////////////////////////////////////////////////////////////////////////////
@@ -106,6 +106,12 @@ int Sql_Ping(Sql* self);
 
 
 
+/// Removes the periodic keepalive ping of the connection.
+/// Used for handles that are owned by another thread, which has to ping them itself.
+void Sql_DisableKeepalive(Sql* self);
+
+
+
 /// Escapes a string.
 /// The output buffer must be at least strlen(from)*2+1 in size.
 ///
@@ -213,6 +219,18 @@ void Sql_Free(Sql* self);
 
 
 
+/// Initializes the client library for the calling thread.
+/// Threads other than the main thread must call it before they use a handle.
+void Sql_ThreadInit(void);
+
+
+
+/// Frees the data of the client library for the calling thread.
+/// Threads that called Sql_ThreadInit must call it before they end.
+void Sql_ThreadEnd(void);
+
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // Prepared Statements
 ///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,324 @@
+// Copyright (c) rAthena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#include "sqlpool.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "showmsg.hpp"
+#include "timer.hpp"
+
+/// Interval in ms in which the callbacks of finished jobs are executed
+#define SQLPOOL_DRAIN_INTERVAL 10
+
+/// A queued job
+struct s_sqlpool_task {
+	uint64 key;
+	SqlPoolJob job;
+	SqlPoolCallback callback;
+};
+
+/// A finished job waiting for its callback
+struct s_sqlpool_done {
+	uint64 key;
+	SqlPoolCallback callback;
+};
+
+/// Worker thread with its own connection and queue
+struct s_sqlpool_worker {
+	SqlPool* pool;
+	Sql* handle;
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::deque<s_sqlpool_task> queue;
+	uint32 ping_interval; // seconds
+	bool stop;
+};
+
+/// Sql worker pool
+struct SqlPool {
+	std::string name;
+	Sql* fallback;
+	std::vector<s_sqlpool_worker*> workers;
+	std::mutex done_mutex;
+	std::condition_variable done_cond;
+	std::vector<s_sqlpool_done> done;
+	std::atomic<size_t> pending;
+	std::unordered_map<uint64, size_t> pending_keys; // main thread only
+	int drain_timer;
+};
+
+
+
+/// Main loop of a worker thread.
+///
+/// @private
+static void SqlPool_P_Worker(s_sqlpool_worker* worker)
+{
+	SqlPool* pool = worker->pool;
+
+	Sql_ThreadInit();
+
+	for(;;)
+	{
+		s_sqlpool_task task;
+
+		{
+			std::unique_lock<std::mutex> lock( worker->mutex );
+
+			if( !worker->cond.wait_for( lock, std::chrono::seconds( worker->ping_interval ), [worker]{ return !worker->queue.empty() || worker->stop; } ) )
+			{// idle for too long, keep the connection alive
+				lock.unlock();
+				Sql_Ping( worker->handle );
+				continue;
+			}
+
+			if( worker->queue.empty() )
+				break;// stop requested and nothing left to do
+
+			task = std::move( worker->queue.front() );
+			worker->queue.pop_front();
+		}
+
+		task.job( worker->handle );
+
+		{
+			std::lock_guard<std::mutex> lock( pool->done_mutex );
+
+			// Empty callbacks are queued as well, the main thread keeps track of pending jobs
+			pool->done.push_back( { task.key, std::move( task.callback ) } );
+		}
+		pool->done_cond.notify_all();
+	}
+
+	Sql_ThreadEnd();
+}
+
+
+
+/// Timer that hands finished jobs back to the main thread.
+///
+/// @private
+static TIMER_FUNC(SqlPool_P_DrainTimer){
+	SqlPool_Drain( (SqlPool*)data );
+	return 0;
+}
+
+
+
+/// Allocates a pool and connects its workers.
+SqlPool* SqlPool_Create(const char* name, int workers, Sql* fallback, const char* user, const char* passwd, const char* host, uint16 port, const char* db, const char* codepage)
+{
+	static bool timer_registered = false;
+	SqlPool* self = new SqlPool();
+
+	self->name = name;
+	self->fallback = fallback;
+	self->pending = 0;
+	self->drain_timer = INVALID_TIMER;
+
+	for( int i = 0; i < workers; i++ )
+	{
+		s_sqlpool_worker* worker = new s_sqlpool_worker();
+		uint32 timeout = 28800; // 8 hours
+
+		worker->pool = self;
+		worker->stop = false;
+		worker->handle = Sql_Malloc();
+
+		if( SQL_ERROR == Sql_Connect(worker->handle, user, passwd, host, port, db) )
+		{
+			ShowError("SqlPool '%s': worker %d couldn't connect with username = '%s', host = '%s', port = '%d', database = '%s'\n",
+				name, i, user, host, port, db);
+			Sql_ShowDebug(worker->handle);
+			Sql_Free(worker->handle);
+			delete worker;
+			SqlPool_Free(self);
+			return NULL;
+		}
+
+		if( codepage && *codepage && SQL_ERROR == Sql_SetEncoding(worker->handle, codepage) )
+			Sql_ShowDebug(worker->handle);
+
+		// The worker thread pings the connection itself
+		Sql_GetTimeout(worker->handle, &timeout);
+		if( timeout < 60 )
+			timeout = 60;
+		worker->ping_interval = timeout - 30; // 30-second reserve
+		Sql_DisableKeepalive(worker->handle);
+
+		self->workers.push_back( worker );
+	}
+
+	for( s_sqlpool_worker* worker : self->workers )
+		worker->thread = std::thread( SqlPool_P_Worker, worker );
+
+	if( !self->workers.empty() )
+	{
+		if( !timer_registered )
+		{
+			add_timer_func_list(SqlPool_P_DrainTimer, "SqlPool_P_DrainTimer");
+			timer_registered = true;
+		}
+		self->drain_timer = add_timer_interval(gettick() + SQLPOOL_DRAIN_INTERVAL, SqlPool_P_DrainTimer, 0, (intptr_t)self, SQLPOOL_DRAIN_INTERVAL);
+		ShowStatus("SqlPool '" CL_WHITE "%s" CL_RESET "' started with " CL_WHITE "%d" CL_RESET " worker(s).\n", name, workers);
+	}
+
+	return self;
+}
+
+
+
+/// Queues a job on the worker responsible for the key.
+void SqlPool_Post(SqlPool* self, uint64 key, SqlPoolJob job, SqlPoolCallback callback)
+{
+	if( self == NULL )
+		return;
+
+	if( self->workers.empty() )
+	{// synchronous mode
+		job( self->fallback );
+		if( callback )
+			callback();
+		return;
+	}
+
+	s_sqlpool_worker* worker = self->workers[(uint32)key % self->workers.size()];
+
+	self->pending++;
+	self->pending_keys[key]++;
+	{
+		std::lock_guard<std::mutex> lock( worker->mutex );
+
+		worker->queue.push_back( { key, std::move( job ), std::move( callback ) } );
+	}
+	worker->cond.notify_one();
+}
+
+
+
+/// Executes the callbacks of all finished jobs.
+size_t SqlPool_Drain(SqlPool* self)
+{
+	std::vector<s_sqlpool_done> done;
+
+	if( self == NULL )
+		return 0;
+
+	{
+		std::lock_guard<std::mutex> lock( self->done_mutex );
+
+		done.swap( self->done );
+	}
+
+	for( s_sqlpool_done& entry : done )
+	{
+		auto it = self->pending_keys.find( entry.key );
+
+		if( it != self->pending_keys.end() && --it->second == 0 )
+			self->pending_keys.erase( it );
+
+		if( entry.callback )
+			entry.callback();
+		self->pending--;
+	}
+
+	return done.size();
+}
+
+
+
+/// Blocks until every queued job has finished and its callback was executed.
+void SqlPool_Wait(SqlPool* self)
+{
+	if( self == NULL )
+		return;
+
+	while( self->pending > 0 )
+	{
+		{
+			std::unique_lock<std::mutex> lock( self->done_mutex );
+
+			self->done_cond.wait( lock, [self]{ return !self->done.empty(); } );
+		}
+		SqlPool_Drain( self );
+	}
+}
+
+
+
+/// Blocks until every job queued for the key has finished and its callback was executed.
+void SqlPool_WaitKey(SqlPool* self, uint64 key)
+{
+	if( self == NULL )
+		return;
+
+	while( self->pending_keys.find( key ) != self->pending_keys.end() )
+	{
+		{
+			std::unique_lock<std::mutex> lock( self->done_mutex );
+
+			self->done_cond.wait( lock, [self]{ return !self->done.empty(); } );
+		}
+		SqlPool_Drain( self );
+	}
+}
+
+
+
+/// Returns the number of jobs that are queued or waiting for their callback.
+size_t SqlPool_Pending(SqlPool* self)
+{
+	if( self == NULL )
+		return 0;
+	return self->pending;
+}
+
+
+
+/// Returns the number of worker threads.
+int SqlPool_Workers(SqlPool* self)
+{
+	if( self == NULL )
+		return 0;
+	return (int)self->workers.size();
+}
+
+
+
+/// Waits for all pending jobs, stops the workers and frees the pool.
+void SqlPool_Free(SqlPool* self)
+{
+	if( self == NULL )
+		return;
+
+	SqlPool_Wait( self );
+
+	for( s_sqlpool_worker* worker : self->workers )
+	{
+		{
+			std::lock_guard<std::mutex> lock( worker->mutex );
+
+			worker->stop = true;
+		}
+		worker->cond.notify_one();
+		if( worker->thread.joinable() )
+			worker->thread.join();
+		Sql_Free( worker->handle );
+		delete worker;
+	}
+
+	if( self->drain_timer != INVALID_TIMER )
+		delete_timer( self->drain_timer, SqlPool_P_DrainTimer );
+
+	delete self;
+}
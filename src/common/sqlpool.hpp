@@ -0,0 +1,81 @@
+// Copyright (c) rAthena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#ifndef SQLPOOL_HPP
+#define SQLPOOL_HPP
+
+#include <functional>
+
+#include "cbasetypes.hpp"
+#include "sql.hpp"
+
+// Asynchronous SQL execution
+//
+// A pool owns a fixed number of worker threads, each with its own Sql
+// connection. Jobs are posted with a key (see SqlPool_Key) and every job with
+// the same key is executed by the same worker, so the order of requests for
+// one entity is preserved.
+// When a job has finished its callback is queued and later executed on the
+// main thread by SqlPool_Drain, which the pool schedules with a timer.
+//
+// Jobs must only use the handle they are given and data they own; they must
+// not touch sessions, timers or DBMaps. Everything else belongs in the callback.
+
+/// Job executed on a worker thread with the worker's connection.
+typedef std::function<void( Sql* handle )> SqlPoolJob;
+/// Completion executed on the main thread after the job has finished.
+typedef std::function<void( void )> SqlPoolCallback;
+
+struct SqlPool;// Sql worker pool (private access)
+typedef struct SqlPool SqlPool;
+
+/// Kind of the id in a key, so the ids of different kinds never share a key.
+enum e_sqlpool_key : uint8 {
+	SQLPOOL_KEY_ACCOUNT = 1, // account_id
+	SQLPOOL_KEY_CHAR,        // char_id
+	SQLPOOL_KEY_GUILD,       // guild_id
+	SQLPOOL_KEY_USERID,      // hash of a user name
+};
+
+/// Returns the key of an id of the kind.
+static inline uint64 SqlPool_Key(enum e_sqlpool_key kind, uint32 id)
+{
+	return ( (uint64)kind << 32 ) | id;
+}
+
+/// Allocates a pool and connects its workers.
+/// With zero workers no thread is started and jobs run inline with the fallback handle.
+///
+/// @return SqlPool handle or NULL if a connection could not be established
+SqlPool* SqlPool_Create(const char* name, int workers, Sql* fallback, const char* user, const char* passwd, const char* host, uint16 port, const char* db, const char* codepage);
+
+/// Queues a job on the worker responsible for the key.
+/// The callback is optional.
+void SqlPool_Post(SqlPool* self, uint64 key, SqlPoolJob job, SqlPoolCallback callback);
+
+/// Executes the callbacks of all finished jobs.
+/// Must be called from the main thread.
+///
+/// @return Number of callbacks executed
+size_t SqlPool_Drain(SqlPool* self);
+
+/// Blocks until every queued job has finished and its callback was executed.
+/// Must not be called from a callback.
+void SqlPool_Wait(SqlPool* self);
+
+/// Blocks until every job queued for the key has finished and its callback was executed.
+/// Used before synchronous queries that must see the result of queued jobs.
+/// Callbacks of other keys that finished in the meantime are executed as well.
+/// Must not be called from a callback.
+void SqlPool_WaitKey(SqlPool* self, uint64 key);
+
+/// Returns the number of jobs that are queued or waiting for their callback.
+size_t SqlPool_Pending(SqlPool* self);
+
+/// Returns the number of worker threads.
+int SqlPool_Workers(SqlPool* self);
+
+/// Waits for all pending jobs, stops the workers and frees the pool.
+void SqlPool_Free(SqlPool* self);
+
+#endif /* SQLPOOL_HPP */
@@ -74,6 +74,19 @@
 // overflows, which is approximately every ~49 days.
 //#define DEPRECATED_WINDOWS_SUPPORT
 
+/// Uncomment to keep the id databases of the map-server (id_db, pc_db, mobid_db, charid_db,
+/// regen_db, skillunit_db, auth_db, ...) in open addressing hashtables that grow with the
+/// number of units, instead of the fixed size hashtable of RED-BLACK trees.
+/// Lookups by id are faster on servers with many units, the databases are then iterated
+/// in insertion order. See DB_OPT_OPEN_ADDRESSING in src/common/db.hpp.
+//#define MAP_DB_OPEN_ADDRESSING
+
+/// Comment to disable the binary snapshots of the YAML databases.
+/// When a YAML database file was loaded without errors, its parsed document is stored
+/// in <file>.bin and read from there on the next start instead of parsing the YAML again,
+/// as long as the content of the file did not change.
+#define YAML_DB_SNAPSHOTS
+
 /**
  * No settings past this point
  **/
@@ -4,18 +4,48 @@
 #include "account.hpp"
 
 #include <algorithm> //min / max
+#include <list>
+#include <memory>
 #include <stdlib.h>
 #include <string.h>
+#include <string>
+#include <unordered_map>
 
 #include "../common/malloc.hpp"
 #include "../common/mmo.hpp"
 #include "../common/showmsg.hpp"
 #include "../common/socket.hpp"
 #include "../common/sql.hpp"
+#include "../common/sqlpool.hpp"
 #include "../common/strlib.hpp"
+#include "../common/timer.hpp"
+#include "../common/utils.hpp"
 
 /// global defines
 
+/// cached account
+struct s_account_cache_entry {
+	struct mmo_account acc;
+	t_tick expire;
+};
+
+typedef std::list<s_account_cache_entry> account_cache_list;
+typedef std::list<std::pair<std::string, t_tick>> account_missing_list;
+
+/// accounts and unknown userids kept in memory
+struct s_account_cache {
+	account_cache_list accounts; // most recently used first
+	std::unordered_map<uint32, account_cache_list::iterator> by_id;
+	std::unordered_map<std::string, account_cache_list::iterator> by_userid;
+	account_missing_list missing; // oldest first
+	std::unordered_map<std::string, account_missing_list::iterator> missing_by_userid;
+	// statistics
+	uint64 hits;
+	uint64 missing_hits;
+	uint64 misses;
+	uint64 evictions;
+};
+
 /// internal structure
 typedef struct AccountDB_SQL {
 	AccountDB vtable;    // public interface
@@ -26,6 +56,12 @@ typedef struct AccountDB_SQL {
 	char   db_password[32];
 	char   db_database[32];
 	char   codepage[32];
+	int    sql_workers; // amount of connections for asynchronous requests
+	SqlPool* pool;      // workers of load_str_async and save_async
+	int    cache_size;  // maximum amount of cached accounts, 0 disables the cache
+	int    cache_time;  // seconds an account stays cached
+	int    missing_time; // seconds an unknown userid stays cached, 0 disables it
+	struct s_account_cache* cache;
 	// other settings
 	bool case_sensitive;
 	//table name
@@ -52,12 +88,22 @@ static bool account_db_sql_remove(AccountDB* self, const uint32 account_id);
 static bool account_db_sql_save(AccountDB* self, const struct mmo_account* acc);
 static bool account_db_sql_load_num(AccountDB* self, struct mmo_account* acc, const uint32 account_id);
 static bool account_db_sql_load_str(AccountDB* self, struct mmo_account* acc, const char* userid);
+static void account_db_sql_load_str_async(AccountDB* self, const char* userid, AccountDBCheck check, AccountDBCallback callback);
+static void account_db_sql_save_async(AccountDB* self, const struct mmo_account* acc);
+static std::string account_db_sql_cache_key(AccountDB_SQL* db, const char* userid);
+static bool account_db_sql_cache_get(AccountDB_SQL* db, struct mmo_account* acc, uint32 account_id, const char* userid);
+static bool account_db_sql_cache_missing(AccountDB_SQL* db, const char* userid);
+static void account_db_sql_cache_put(AccountDB_SQL* db, const struct mmo_account* acc, bool replace);
+static void account_db_sql_cache_put_missing(AccountDB_SQL* db, const char* userid);
+static void account_db_sql_cache_remove(AccountDB_SQL* db, account_cache_list::iterator it);
 static AccountDBIterator* account_db_sql_iterator(AccountDB* self);
 static void account_db_sql_iter_destroy(AccountDBIterator* self);
 static bool account_db_sql_iter_next(AccountDBIterator* self, struct mmo_account* acc);
 
-static bool mmo_auth_fromsql(AccountDB_SQL* db, struct mmo_account* acc, uint32 account_id);
-static bool mmo_auth_tosql(AccountDB_SQL* db, const struct mmo_account* acc, bool is_new);
+static bool mmo_auth_fromsql(AccountDB_SQL* db, Sql* sql_handle, struct mmo_account* acc, uint32 account_id);
+static bool mmo_auth_fromsql_str(AccountDB_SQL* db, Sql* sql_handle, struct mmo_account* acc, const char* userid, bool* not_found);
+static bool mmo_auth_tosql(AccountDB_SQL* db, Sql* sql_handle, const struct mmo_account* acc, bool is_new);
+static bool mmo_auth_tosql_login(AccountDB_SQL* db, Sql* sql_handle, const struct mmo_account* acc, time_t now);
 
 /// public constructor
 AccountDB* account_db_sql(void) {
@@ -73,10 +119,14 @@ AccountDB* account_db_sql(void) {
 	db->vtable.remove       = &account_db_sql_remove;
 	db->vtable.load_num     = &account_db_sql_load_num;
 	db->vtable.load_str     = &account_db_sql_load_str;
+	db->vtable.load_str_async = &account_db_sql_load_str_async;
+	db->vtable.save_async   = &account_db_sql_save_async;
 	db->vtable.iterator     = &account_db_sql_iterator;
 
 	// initialize to default values
 	db->accounts = NULL;
+	db->pool = NULL;
+	db->cache = new s_account_cache();
 	// local sql settings
 	safestrncpy(db->db_hostname, "127.0.0.1", sizeof(db->db_hostname));
 	db->db_port = 3306;
@@ -84,6 +134,10 @@ AccountDB* account_db_sql(void) {
 	safestrncpy(db->db_password, "ragnarok", sizeof(db->db_password));
 	safestrncpy(db->db_database, "ragnarok", sizeof(db->db_database));
 	safestrncpy(db->codepage, "", sizeof(db->codepage));
+	db->sql_workers = 0;
+	db->cache_size = 0;
+	db->cache_time = 30;
+	db->missing_time = 0;
 	// other settings
 	db->case_sensitive = false;
 	safestrncpy(db->account_db, "login", sizeof(db->account_db));
@@ -134,6 +188,14 @@ static bool account_db_sql_init(AccountDB* self) {
 	if( codepage[0] != '\0' && SQL_ERROR == Sql_SetEncoding(sql_handle, codepage) )
 		Sql_ShowDebug(sql_handle);
 
+	db->pool = SqlPool_Create("login", db->sql_workers, sql_handle, username, password, hostname, port, database, codepage);
+	if( db->pool == NULL )
+	{
+		Sql_Free(db->accounts);
+		db->accounts = NULL;
+		return false;
+	}
+
 	return true;
 }
 
@@ -144,8 +206,11 @@ static bool account_db_sql_init(AccountDB* self) {
 static void account_db_sql_destroy(AccountDB* self){
 	AccountDB_SQL* db = (AccountDB_SQL*)self;
 
+	SqlPool_Free(db->pool);
+	db->pool = NULL;
 	Sql_Free(db->accounts);
 	db->accounts = NULL;
+	delete db->cache;
 	aFree(db);
 }
 
@@ -181,6 +246,9 @@ static bool account_db_sql_get_property(AccountDB* self, const char* key, char*
 		if( strcmpi(key, "db") == 0 )
 			safesnprintf(buf, buflen, "%s", db->db_database);
 		else
+		if( strcmpi(key, "sql_workers") == 0 )
+			safesnprintf(buf, buflen, "%d", db->sql_workers);
+		else
 		if( strcmpi(key, "account_db") == 0 )
 			safesnprintf(buf, buflen, "%s", db->account_db);
 		else
@@ -202,6 +270,15 @@ static bool account_db_sql_get_property(AccountDB* self, const char* key, char*
 		else
 		if( strcmpi(key, "case_sensitive") == 0 )
 			safesnprintf(buf, buflen, "%d", (db->case_sensitive ? 1 : 0));
+		else
+		if( strcmpi(key, "account_cache_size") == 0 )
+			safesnprintf(buf, buflen, "%d", db->cache_size);
+		else
+		if( strcmpi(key, "account_cache_time") == 0 )
+			safesnprintf(buf, buflen, "%d", db->cache_time);
+		else
+		if( strcmpi(key, "account_missing_cache_time") == 0 )
+			safesnprintf(buf, buflen, "%d", db->missing_time);
 		else
 			return false;// not found
 		return true;
@@ -240,6 +317,9 @@ static bool account_db_sql_set_property(AccountDB* self, const char* key, const
 		if( strcmpi(key, "db") == 0 )
 			safestrncpy(db->db_database, value, sizeof(db->db_database));
 		else
+		if( strcmpi(key, "sql_workers") == 0 )
+			db->sql_workers = cap_value(atoi(value), 0, 32);
+		else
 		if( strcmpi(key, "account_db") == 0 )
 			safestrncpy(db->account_db, value, sizeof(db->account_db));
 		else
@@ -261,6 +341,15 @@ static bool account_db_sql_set_property(AccountDB* self, const char* key, const
 		else
 		if( strcmpi(key, "case_sensitive") == 0 )
 			db->case_sensitive = (config_switch(value)==1);
+		else
+		if( strcmpi(key, "account_cache_size") == 0 )
+			db->cache_size = max(atoi(value), 0);
+		else
+		if( strcmpi(key, "account_cache_time") == 0 )
+			db->cache_time = max(atoi(value), 1);
+		else
+		if( strcmpi(key, "account_missing_cache_time") == 0 )
+			db->missing_time = max(atoi(value), 0);
 		else
 			return false;// not found
 		return true;
@@ -320,7 +409,11 @@ static bool account_db_sql_create(AccountDB* self, struct mmo_account* acc) {
 
 	// insert the data into the database
 	acc->account_id = account_id;
-	return mmo_auth_tosql(db, acc, true);
+	if( !mmo_auth_tosql(db, sql_handle, acc, true) )
+		return false;
+
+	account_db_sql_cache_put(db, acc, true);
+	return true;
 }
 
 /**
@@ -333,6 +426,10 @@ static bool account_db_sql_remove(AccountDB* self, const uint32 account_id) {
 	AccountDB_SQL* db = (AccountDB_SQL*)self;
 	Sql* sql_handle = db->accounts;
 	bool result = false;
+	auto it = db->cache->by_id.find(account_id);
+
+	if( it != db->cache->by_id.end() )
+		account_db_sql_cache_remove(db, it->second);
 
 	if( SQL_SUCCESS != Sql_QueryStr(sql_handle, "START TRANSACTION")
 	||  SQL_SUCCESS != Sql_Query(sql_handle, "DELETE FROM `%s` WHERE `account_id` = %d", db->account_db, account_id)
@@ -355,11 +452,18 @@ static bool account_db_sql_remove(AccountDB* self, const uint32 account_id) {
  */
 static bool account_db_sql_save(AccountDB* self, const struct mmo_account* acc) {
 	AccountDB_SQL* db = (AccountDB_SQL*)self;
-	return mmo_auth_tosql(db, acc, false);
+
+	if( !mmo_auth_tosql(db, db->accounts, acc, false) )
+		return false;
+
+	account_db_sql_cache_put(db, acc, true);
+	return true;
 }
 
 /**
  * Retrieve data from db and store it in the provided data structure.
+ *  Always reads the database, the callers modify the account and save the whole row,
+ *  a cached copy would revert the changes made meanwhile by other programs.
  *  Filled data structure is done by delegation to mmo_auth_fromsql.
  * @param self: pointer to db
  * @param acc: pointer of mmo_account to fill
@@ -368,13 +472,18 @@ static bool account_db_sql_save(AccountDB* self, const struct mmo_account* acc)
  */
 static bool account_db_sql_load_num(AccountDB* self, struct mmo_account* acc, const uint32 account_id) {
 	AccountDB_SQL* db = (AccountDB_SQL*)self;
-	return mmo_auth_fromsql(db, acc, account_id);
+
+	if( !mmo_auth_fromsql(db, db->accounts, acc, account_id) )
+		return false;
+
+	account_db_sql_cache_put(db, acc, true);
+	return true;
 }
 
 /**
- * Retrieve data from db and store it in the provided data structure.
- *  Doesn't actually retrieve data yet: escapes and checks userid, then transforms it to accid for fetching.
- *  Filled data structure is done by delegation to account_db_sql_load_num.
+ * Retrieve data from the cache or db and store it in the provided data structure.
+ *  Userids that don't exist are remembered as well.
+ *  Filled data structure is done by delegation to mmo_auth_fromsql_str.
  * @param self: pointer to db
  * @param acc: pointer of mmo_account to fill
  * @param userid: name of user account
@@ -382,38 +491,282 @@ static bool account_db_sql_load_num(AccountDB* self, struct mmo_account* acc, co
  */
 static bool account_db_sql_load_str(AccountDB* self, struct mmo_account* acc, const char* userid) {
 	AccountDB_SQL* db = (AccountDB_SQL*)self;
-	Sql* sql_handle = db->accounts;
-	char esc_userid[2*NAME_LENGTH+1];
-	uint32 account_id;
-	char* data;
+	bool not_found = false;
 
-	Sql_EscapeString(sql_handle, esc_userid, userid);
+	if( account_db_sql_cache_get(db, acc, 0, userid) )
+		return true;
+	if( account_db_sql_cache_missing(db, userid) )
+		return false;
 
-	// get the list of account IDs for this user ID
-	if( SQL_ERROR == Sql_Query(sql_handle, "SELECT `account_id` FROM `%s` WHERE `userid`= %s '%s'",
-		db->account_db, (db->case_sensitive ? "BINARY" : ""), esc_userid) )
-	{
-		Sql_ShowDebug(sql_handle);
+	if( !mmo_auth_fromsql_str(db, db->accounts, acc, userid, &not_found) ) {
+		if( not_found )
+			account_db_sql_cache_put_missing(db, userid);
 		return false;
 	}
 
-	if( Sql_NumRows(sql_handle) > 1 )
-	{// serious problem - duplicit account
-		ShowError("account_db_sql_load_str: multiple accounts found when retrieving data for account '%s'!\n", userid);
-		Sql_FreeResult(sql_handle);
+	account_db_sql_cache_put(db, acc, true);
+	return true;
+}
+
+/**
+ * Worker key of a user account.
+ *  Requests for the same userid always go to the same worker, so a save is never overtaken by the next load.
+ * @param db: pointer to db
+ * @param userid: name of user account
+ * @return key for SqlPool_Post
+ */
+static uint64 account_db_sql_key(AccountDB_SQL* db, const char* userid) {
+	uint32 key = 2166136261U;
+
+	for( ; *userid != '\0'; userid++ ) {
+		key ^= (uint8)( db->case_sensitive ? *userid : TOLOWER(*userid) );
+		key *= 16777619U;
+	}
+
+	return SqlPool_Key(SQLPOOL_KEY_USERID, key);
+}
+
+/**
+ * Retrieve data from the cache or from db on a worker connection.
+ *  The check is executed on the worker if the account was found,
+ *  the callback on the main thread with the account (NULL if not found) and the result of the check.
+ *  Cached accounts and userids that are known not to exist complete immediately.
+ * @param self: pointer to db
+ * @param userid: name of user account
+ * @param check: check of the account data, optional
+ * @param callback: completion
+ */
+static void account_db_sql_load_str_async(AccountDB* self, const char* userid, AccountDBCheck check, AccountDBCallback callback) {
+	AccountDB_SQL* db = (AccountDB_SQL*)self;
+	std::shared_ptr<struct mmo_account> acc = std::make_shared<struct mmo_account>();
+	std::shared_ptr<bool> found = std::make_shared<bool>( false );
+	std::shared_ptr<bool> not_found = std::make_shared<bool>( false );
+	std::shared_ptr<int> result = std::make_shared<int>( 0 );
+	std::string name = userid;
+
+	if( account_db_sql_cache_get(db, acc.get(), 0, userid) ) {
+		callback( acc.get(), check ? check( acc.get() ) : 0 );
+		return;
+	}
+	if( account_db_sql_cache_missing(db, userid) ) {
+		callback( NULL, 0 );
+		return;
+	}
+
+	SqlPool_Post( db->pool, account_db_sql_key(db, userid), [db, acc, found, not_found, result, name, check]( Sql* handle ){
+		if( !mmo_auth_fromsql_str(db, handle, acc.get(), name.c_str(), not_found.get()) )
+			return;
+		*found = true;
+		if( check )
+			*result = check( acc.get() );
+	}, [db, acc, found, not_found, result, name, callback](){
+		// the main thread may have written the account meanwhile, keep its copy
+		if( *found )
+			account_db_sql_cache_put(db, acc.get(), false);
+		else if( *not_found && db->cache->by_userid.find(account_db_sql_cache_key(db, name.c_str())) == db->cache->by_userid.end() )
+			account_db_sql_cache_put_missing(db, name.c_str());
+		callback( *found ? acc.get() : NULL, *result );
+	} );
+}
+
+/**
+ * Record a login of an existing account on a worker connection.
+ *  Only the login fields are written, so a save of the main thread that is executed
+ *  before the worker gets to it (ban, group change, ...) is never overwritten.
+ * @param self: pointer to db
+ * @param acc: pointer of mmo_account to save, copied
+ */
+static void account_db_sql_save_async(AccountDB* self, const struct mmo_account* acc) {
+	AccountDB_SQL* db = (AccountDB_SQL*)self;
+	std::shared_ptr<struct mmo_account> copy = std::make_shared<struct mmo_account>( *acc );
+	time_t now = time(NULL);
+
+	account_db_sql_cache_put(db, acc, true);
+	SqlPool_Post( db->pool, account_db_sql_key(db, acc->userid), [db, copy, now]( Sql* handle ){
+		mmo_auth_tosql_login(db, handle, copy.get(), now);
+	}, nullptr );
+}
+
+/**
+ * Key of a userid in the cache, lowercase unless userids are case sensitive.
+ * @param db: pointer to db
+ * @param userid: name of user account
+ * @return key
+ */
+static std::string account_db_sql_cache_key(AccountDB_SQL* db, const char* userid) {
+	std::string key = userid;
+
+	if( !db->case_sensitive )
+		std::transform(key.begin(), key.end(), key.begin(), [](char c){ return (char)TOLOWER(c); });
+
+	return key;
+}
+
+/**
+ * Copy a cached account, by account_id or by userid if it isn't NULL.
+ *  Expired entries are dropped.
+ * @param db: pointer to db
+ * @param acc: pointer of mmo_account to fill
+ * @param account_id: id of user account
+ * @param userid: name of user account or NULL
+ * @return true if the account was cached
+ */
+static bool account_db_sql_cache_get(AccountDB_SQL* db, struct mmo_account* acc, uint32 account_id, const char* userid) {
+	struct s_account_cache* cache = db->cache;
+	account_cache_list::iterator it;
+
+	if( db->cache_size == 0 )
 		return false;
+
+	if( userid != NULL ) {
+		auto found = cache->by_userid.find(account_db_sql_cache_key(db, userid));
+		if( found == cache->by_userid.end() )
+			return false;
+		it = found->second;
+	} else {
+		auto found = cache->by_id.find(account_id);
+		if( found == cache->by_id.end() )
+			return false;
+		it = found->second;
 	}
 
-	if( SQL_SUCCESS != Sql_NextRow(sql_handle) )
-	{// no such entry
-		Sql_FreeResult(sql_handle);
+	if( DIFF_TICK(gettick(), it->expire) >= 0 ) {
+		account_db_sql_cache_remove(db, it);
 		return false;
 	}
 
-	Sql_GetData(sql_handle, 0, &data, NULL);
-	account_id = atoi(data);
+	cache->accounts.splice(cache->accounts.begin(), cache->accounts, it);
+	memcpy(acc, &it->acc, sizeof(struct mmo_account));
+	cache->hits++;
+	return true;
+}
+
+/**
+ * Check if a userid is known not to exist, after the account was not found in the cache.
+ *  Expired entries are dropped.
+ * @param db: pointer to db
+ * @param userid: name of user account
+ * @return true if the userid is cached as unknown
+ */
+static bool account_db_sql_cache_missing(AccountDB_SQL* db, const char* userid) {
+	struct s_account_cache* cache = db->cache;
+	t_tick tick = gettick();
 
-	return account_db_sql_load_num(self, acc, account_id);
+	if( db->cache_size == 0 || db->missing_time == 0 )
+		return false;
+
+	while( !cache->missing.empty() && DIFF_TICK(tick, cache->missing.front().second) >= 0 ) {
+		cache->missing_by_userid.erase(cache->missing.front().first);
+		cache->missing.pop_front();
+	}
+
+	if( cache->missing_by_userid.find(account_db_sql_cache_key(db, userid)) == cache->missing_by_userid.end() ) {
+		cache->misses++;
+		return false;
+	}
+
+	cache->missing_hits++;
+	return true;
+}
+
+/**
+ * Write an account to the cache, evicting the least recently used ones.
+ *  An account that is already cached keeps its expiration, so changes made by other programs
+ *  are picked up at the latest cache_time seconds after it was read.
+ * @param db: pointer to db
+ * @param acc: account data
+ * @param replace: whether to overwrite a cached copy of the account
+ */
+static void account_db_sql_cache_put(AccountDB_SQL* db, const struct mmo_account* acc, bool replace) {
+	struct s_account_cache* cache = db->cache;
+	t_tick expire = gettick() + db->cache_time * 1000;
+	std::string key;
+
+	if( db->cache_size == 0 )
+		return;
+
+	key = account_db_sql_cache_key(db, acc->userid);
+
+	auto missing = cache->missing_by_userid.find(key);
+	if( missing != cache->missing_by_userid.end() ) {
+		cache->missing.erase(missing->second);
+		cache->missing_by_userid.erase(missing);
+	}
+
+	auto found = cache->by_id.find(acc->account_id);
+	if( found != cache->by_id.end() ) {
+		if( !replace )
+			return;
+		expire = found->second->expire;
+		account_db_sql_cache_remove(db, found->second);
+	}
+
+	while( !cache->accounts.empty() && cache->accounts.size() >= (size_t)db->cache_size ) {
+		account_db_sql_cache_remove(db, std::prev(cache->accounts.end()));
+		cache->evictions++;
+	}
+
+	cache->accounts.push_front({ *acc, expire });
+	cache->by_id[acc->account_id] = cache->accounts.begin();
+	cache->by_userid[key] = cache->accounts.begin();
+}
+
+/**
+ * Remember a userid that doesn't exist.
+ * @param db: pointer to db
+ * @param userid: name of user account
+ */
+static void account_db_sql_cache_put_missing(AccountDB_SQL* db, const char* userid) {
+	struct s_account_cache* cache = db->cache;
+	std::string key;
+
+	if( db->cache_size == 0 || db->missing_time == 0 )
+		return;
+
+	key = account_db_sql_cache_key(db, userid);
+	if( cache->missing_by_userid.find(key) != cache->missing_by_userid.end() )
+		return;
+
+	while( !cache->missing.empty() && cache->missing.size() >= (size_t)db->cache_size ) {
+		cache->missing_by_userid.erase(cache->missing.front().first);
+		cache->missing.pop_front();
+	}
+
+	cache->missing.push_back({ key, gettick() + db->missing_time * 1000 });
+	cache->missing_by_userid[key] = std::prev(cache->missing.end());
+}
+
+/**
+ * Drop a cached account.
+ * @param db: pointer to db
+ * @param it: position of the account in the cache
+ */
+static void account_db_sql_cache_remove(AccountDB_SQL* db, account_cache_list::iterator it) {
+	struct s_account_cache* cache = db->cache;
+
+	cache->by_id.erase(it->acc.account_id);
+	cache->by_userid.erase(account_db_sql_cache_key(db, it->acc.userid));
+	cache->accounts.erase(it);
+}
+
+/**
+ * Show the statistics of the account cache.
+ * @param self: pointer to db
+ */
+void account_db_sql_cache_stats(AccountDB* self) {
+	AccountDB_SQL* db = (AccountDB_SQL*)self;
+	struct s_account_cache* cache = db->cache;
+	uint64 lookups = cache->hits + cache->missing_hits + cache->misses;
+
+	if( db->cache_size == 0 ) {
+		ShowInfo("Account cache: disabled (login_account_cache_size: 0).\n");
+		return;
+	}
+
+	ShowInfo("Account cache: " CL_WHITE "%" PRIuPTR CL_RESET "/%d accounts for %d seconds, " CL_WHITE "%" PRIuPTR CL_RESET " unknown userids for %d seconds.\n",
+		cache->accounts.size(), db->cache_size, db->cache_time, cache->missing.size(), db->missing_time);
+	ShowInfo("Account cache: " CL_WHITE "%.1f%%" CL_RESET " hit rate over %" PRIu64 " lookups (%" PRIu64 " accounts, %" PRIu64 " unknown userids, %" PRIu64 " misses), %" PRIu64 " evictions.\n",
+		lookups ? 100. * ( cache->hits + cache->missing_hits ) / lookups : 0., lookups, cache->hits, cache->missing_hits, cache->misses, cache->evictions);
 }
 
 /**
@@ -471,7 +824,7 @@ static bool account_db_sql_iter_next(AccountDBIterator* self, struct mmo_account
 	{// get account data
 		uint32 account_id;
 		account_id = atoi(data);
-		if( mmo_auth_fromsql(db, acc, account_id) )
+		if( mmo_auth_fromsql(db, sql_handle, acc, account_id) )
 		{
 			iter->last_account_id = account_id;
 			Sql_FreeResult(sql_handle);
@@ -485,12 +838,12 @@ static bool account_db_sql_iter_next(AccountDBIterator* self, struct mmo_account
 /**
  * Fetch a struct mmo_account from sql.
  * @param db: pointer to db
+ * @param sql_handle: connection to use
  * @param acc: pointer of mmo_account to fill
  * @param account_id: id of user account to take data from
  * @return true if successful, false if something has failed
  */
-static bool mmo_auth_fromsql(AccountDB_SQL* db, struct mmo_account* acc, uint32 account_id) {
-	Sql* sql_handle = db->accounts;
+static bool mmo_auth_fromsql(AccountDB_SQL* db, Sql* sql_handle, struct mmo_account* acc, uint32 account_id) {
 	char* data;
 
 	// retrieve login entry for the specified account
@@ -537,15 +890,61 @@ static bool mmo_auth_fromsql(AccountDB_SQL* db, struct mmo_account* acc, uint32
 	return true;
 }
 
+/**
+ * Fetch a struct mmo_account from sql by userid.
+ *  Escapes and checks userid, then transforms it to accid for fetching.
+ * @param db: pointer to db
+ * @param sql_handle: connection to use
+ * @param acc: pointer of mmo_account to fill
+ * @param userid: name of user account
+ * @param not_found: set to true if the query succeeded without finding the account, can be NULL
+ * @return true if successful, false if something has failed
+ */
+static bool mmo_auth_fromsql_str(AccountDB_SQL* db, Sql* sql_handle, struct mmo_account* acc, const char* userid, bool* not_found) {
+	char esc_userid[2*NAME_LENGTH+1];
+	uint32 account_id;
+	char* data;
+
+	Sql_EscapeString(sql_handle, esc_userid, userid);
+
+	// get the list of account IDs for this user ID
+	if( SQL_ERROR == Sql_Query(sql_handle, "SELECT `account_id` FROM `%s` WHERE `userid`= %s '%s'",
+		db->account_db, (db->case_sensitive ? "BINARY" : ""), esc_userid) )
+	{
+		Sql_ShowDebug(sql_handle);
+		return false;
+	}
+
+	if( Sql_NumRows(sql_handle) > 1 )
+	{// serious problem - duplicit account
+		ShowError("account_db_sql_load_str: multiple accounts found when retrieving data for account '%s'!\n", userid);
+		Sql_FreeResult(sql_handle);
+		return false;
+	}
+
+	if( SQL_SUCCESS != Sql_NextRow(sql_handle) )
+	{// no such entry
+		Sql_FreeResult(sql_handle);
+		if( not_found != NULL )
+			*not_found = true;
+		return false;
+	}
+
+	Sql_GetData(sql_handle, 0, &data, NULL);
+	account_id = atoi(data);
+
+	return mmo_auth_fromsql(db, sql_handle, acc, account_id);
+}
+
 /**
  * Save a struct mmo_account in sql.
  * @param db: pointer to db
+ * @param sql_handle: connection to use
  * @param acc: pointer of mmo_account to save
  * @param is_new: if it's a new entry or should we update
  * @return true if successful, false if something has failed
  */
-static bool mmo_auth_tosql(AccountDB_SQL* db, const struct mmo_account* acc, bool is_new) {
-	Sql* sql_handle = db->accounts;
+static bool mmo_auth_tosql(AccountDB_SQL* db, Sql* sql_handle, const struct mmo_account* acc, bool is_new) {
 	SqlStmt* stmt = SqlStmt_Malloc(sql_handle);
 	bool result = false;
 
@@ -641,6 +1040,36 @@ static bool mmo_auth_tosql(AccountDB_SQL* db, const struct mmo_account* acc, boo
 	return result;
 }
 
+/**
+ * Save the login fields of a struct mmo_account in sql.
+ *  A ban that has expired at the time of the login is lifted, a ban issued since then is kept.
+ * @param db: pointer to db
+ * @param sql_handle: connection to use
+ * @param acc: pointer of mmo_account to save
+ * @param now: time of the login
+ * @return true if successful, false if something has failed
+ */
+static bool mmo_auth_tosql_login(AccountDB_SQL* db, Sql* sql_handle, const struct mmo_account* acc, time_t now) {
+	SqlStmt* stmt = SqlStmt_Malloc(sql_handle);
+	uint32 login_time = (uint32)now;
+	bool result = true;
+
+	if( SQL_SUCCESS != SqlStmt_Prepare(stmt,
+		"UPDATE `%s` SET `logincount`=`logincount`+1, `lastlogin`=?, `last_ip`=?, `unban_time`=IF(`unban_time` <= ?, 0, `unban_time`) WHERE `account_id` = '%d'",
+		db->account_db, acc->account_id)
+	||  SQL_SUCCESS != SqlStmt_BindParam(stmt, 0, acc->lastlogin[0]?SQLDT_STRING:SQLDT_NULL,    (void*)&acc->lastlogin,       strlen(acc->lastlogin))
+	||  SQL_SUCCESS != SqlStmt_BindParam(stmt, 1, SQLDT_STRING,    (void*)&acc->last_ip,         strlen(acc->last_ip))
+	||  SQL_SUCCESS != SqlStmt_BindParam(stmt, 2, SQLDT_UINT32,    (void*)&login_time,           sizeof(login_time))
+	||  SQL_SUCCESS != SqlStmt_Execute(stmt)
+	) {
+		SqlStmt_ShowDebug(stmt);
+		result = false;
+	}
+	SqlStmt_Free(stmt);
+
+	return result;
+}
+
 void mmo_save_global_accreg(AccountDB* self, int fd, uint32 account_id, uint32 char_id) {
 	Sql* sql_handle = ((AccountDB_SQL*)self)->accounts;
 	AccountDB_SQL* db = (AccountDB_SQL*)self;
@@ -4,6 +4,8 @@
 #ifndef ACCOUNT_HPP
 #define ACCOUNT_HPP
 
+#include <functional>
+
 #include "../common/cbasetypes.hpp"
 #include "../common/mmo.hpp" // ACCOUNT_REG2_NUM
 #include "../config/core.hpp"
@@ -54,6 +56,13 @@ struct AccountDBIterator {
 };
 
 
+/// Check of AccountDB::load_str_async, executed on a worker thread.
+/// Must only use the account and data it owns.
+typedef std::function<int( const struct mmo_account* acc )> AccountDBCheck;
+/// Completion of AccountDB::load_str_async, executed on the main thread.
+/// acc is NULL if the account was not found, result is the value of the check.
+typedef std::function<void( struct mmo_account* acc, int result )> AccountDBCallback;
+
 struct AccountDB {
 	/// Initializes this database, making it ready for use.
 	/// Call this after setting the properties.
@@ -125,6 +134,25 @@ struct AccountDB {
 	/// @return true if successful
 	bool (*load_str)(AccountDB* self, struct mmo_account* acc, const char* userid);
 
+	/// Finds an account with userid on a worker connection.
+	/// The check runs on the worker, the callback on the main thread.
+	/// Without workers both are executed before this returns.
+	///
+	/// @param self Database
+	/// @param userid Target username
+	/// @param check Check of the account data, optional
+	/// @param callback Completion
+	void (*load_str_async)(AccountDB* self, const char* userid, AccountDBCheck check, AccountDBCallback callback);
+
+	/// Records a login of an existing account on a worker connection.
+	/// Only logincount, lastlogin, last_ip and an expired unban_time are written,
+	/// so it never overwrites the other fields saved meanwhile with save.
+	/// Executed after the pending load_str_async of the same userid and before the following ones.
+	///
+	/// @param self Database
+	/// @param acc Account data, copied
+	void (*save_async)(AccountDB* self, const struct mmo_account* acc);
+
 	/// Returns a new forward iterator.
 	///
 	/// @param self Database
@@ -134,5 +162,6 @@ struct AccountDB {
 
 void mmo_send_global_accreg(AccountDB* self, int fd, uint32 account_id, uint32 char_id);
 void mmo_save_global_accreg(AccountDB* self, int fd, uint32 account_id, uint32 char_id);
+void account_db_sql_cache_stats(AccountDB* self);
 
 #endif /* ACCOUNT_HPP */
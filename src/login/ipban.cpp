@@ -3,8 +3,11 @@
 
 #include "ipban.hpp"
 
+#include <deque>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unordered_map>
 
 #include "../common/cbasetypes.hpp"
 #include "../common/showmsg.hpp"
@@ -27,65 +30,221 @@ static char   ipban_table[32] = "ipbanlist";
 // globals
 static Sql* sql_handle = NULL;
 static int cleanup_timer_id = INVALID_TIMER;
+static int refresh_timer_id = INVALID_TIMER;
 static bool ipban_inited = false;
 
+// Active bans by prefix length (/8, /16, /24, /32).
+// Maps the banned prefix (ip with the remaining bits cleared) to the end of the ban.
+// Rebuilt from `ipbanlist` by ipban_refresh, bans of this server are added when inserted.
+static std::unordered_map<uint32, time_t> ipban_index[4];
+static const uint32 ipban_masks[4] = { 0xFF000000, 0xFFFF0000, 0xFFFFFF00, 0xFFFFFFFF };
+
+// Times of the recent failed login attempts per ip, oldest first.
+// Only the attempts within dynamic_pass_failure_ban_interval are kept, at most dynamic_pass_failure_ban_limit.
+static std::unordered_map<uint32, std::deque<time_t>> ipban_failures;
+// Every attempt of ipban_failures in the order it was recorded, to prune the ips whose attempts expired.
+static std::deque<std::pair<uint32, time_t>> ipban_failures_order;
+
 //early declaration
 TIMER_FUNC(ipban_cleanup);
+TIMER_FUNC(ipban_refresh);
+
+/**
+ * Adds a ban to the in-memory index.
+ * @param ip: banned prefix
+ * @param level: 0 for /8 to 3 for /32
+ * @param rtime: end of the ban
+ */
+static void ipban_index_add(uint32 ip, int level, time_t rtime) {
+	time_t& entry = ipban_index[level][ip & ipban_masks[level]];
+
+	if( entry < rtime )
+		entry = rtime;
+}
+
+/**
+ * Parses an entry of `ipbanlist`, 'a.*.*.*', 'a.b.*.*', 'a.b.c.*' or 'a.b.c.d'.
+ * @param list: entry to parse
+ * @param ip: banned prefix
+ * @param level: 0 for /8 to 3 for /32
+ * @return true if the entry is valid
+ */
+static bool ipban_parse(const char* list, uint32* ip, int* level) {
+	uint32 octets = 0;
+	int i;
+
+	for( i = 0; i < 4 && *list != '*'; i++ ) {
+		char* end;
+		unsigned long value = strtoul(list, &end, 10);
+
+		if( end == list || value > 255 )
+			return false;
+		octets |= (uint32)value << (24 - 8 * i);
+		list = end;
+		if( i < 3 && *list++ != '.' )
+			return false;
+	}
+	if( i == 0 )
+		return false;// '*.*.*.*' is not a ban
+	*level = i - 1;
+
+	for( ; i < 4; i++ ) {
+		if( *list++ != '*' || ( i < 3 && *list++ != '.' ) )
+			return false;
+	}
+
+	*ip = octets;
+	return( *list == '\0' );
+}
+
+/**
+ * Drops the attempts that left the interval of the dynamic ban.
+ * @param attempts: failed attempts of an ip
+ * @param now: current time
+ */
+static void ipban_failures_expire(std::deque<time_t>& attempts, time_t now) {
+	time_t start = now - (time_t)login_config.dynamic_pass_failure_ban_interval * 60;
+
+	while( !attempts.empty() && ( attempts.front() <= start || attempts.size() > login_config.dynamic_pass_failure_ban_limit ) )
+		attempts.pop_front();
+}
+
+/**
+ * Forgets the ips whose attempts all left the interval of the dynamic ban.
+ *  Only the attempts recorded before the interval are inspected, so this is cheap enough for every failure.
+ * @param now: current time
+ */
+static void ipban_failures_prune(time_t now) {
+	time_t start = now - (time_t)login_config.dynamic_pass_failure_ban_interval * 60;
+
+	while( !ipban_failures_order.empty() && ipban_failures_order.front().second <= start ) {
+		auto it = ipban_failures.find(ipban_failures_order.front().first);
+
+		ipban_failures_order.pop_front();
+		if( it == ipban_failures.end() )
+			continue;// banned meanwhile
+		ipban_failures_expire(it->second, now);
+		if( it->second.empty() )
+			ipban_failures.erase(it);
+	}
+}
+
+/**
+ * Records a failed attempt of the login log in the in-memory counters.
+ * Used to restore the counters on start.
+ * @param ip: ip of the attempt
+ * @param attempt: time of the attempt
+ */
+static void ipban_failures_load(uint32 ip, time_t attempt) {
+	std::deque<time_t>& attempts = ipban_failures[ip];
+
+	attempts.push_back(attempt);
+	ipban_failures_order.emplace_back(ip, attempt);
+	ipban_failures_expire(attempts, time(NULL));
+}
 
 /**
  * Check if ip is in the active bans list.
+ * Uses the in-memory index, `ipbanlist` is only read by ipban_refresh.
  * @param ip: ipv4 ip to check if ban
- * @return true if found or error, false if not in list
+ * @return true if found, false if not in list
  */
 bool ipban_check(uint32 ip) {
-	uint8* p = (uint8*)&ip;
-	char* data = NULL;
-	int matches;
+	time_t now;
 
 	if( !login_config.ipban )
 		return false;// ipban disabled
 
-	if( SQL_ERROR == Sql_Query(sql_handle, "SELECT count(*) FROM `%s` WHERE `rtime` > NOW() AND (`list` = '%u.*.*.*' OR `list` = '%u.%u.*.*' OR `list` = '%u.%u.%u.*' OR `list` = '%u.%u.%u.%u')",
-		ipban_table, p[3], p[3], p[2], p[3], p[2], p[1], p[3], p[2], p[1], p[0]) )
-	{
-		Sql_ShowDebug(sql_handle);
-		// close connection because we can't verify their connectivity.
-		return true;
-	}
+	now = time(NULL);
+	for( int i = 0; i < 4; i++ ) {
+		if( ipban_index[i].empty() )
+			continue;
 
-	if( SQL_ERROR == Sql_NextRow(sql_handle) )
-		return true;// Shouldn't happen, but just in case...
+		auto it = ipban_index[i].find(ip & ipban_masks[i]);
 
-	Sql_GetData(sql_handle, 0, &data, NULL);
-	matches = atoi(data);
-	Sql_FreeResult(sql_handle);
+		if( it != ipban_index[i].end() && it->second > now )
+			return true;
+	}
 
-	return( matches > 0 );
+	return false;
 }
 
 /**
  * Log a failed attempt.
  *  Also bans the user if too many failed attempts are made.
+ *  The attempts are counted in memory, the login log keeps them persistent.
  * @param ip: ipv4 ip to record the failure
  */
 void ipban_log(uint32 ip) {
-	unsigned long failures;
+	time_t now;
 
 	if( !login_config.ipban )
 		return;// ipban disabled
 
-	failures = loginlog_failedattempts(ip, login_config.dynamic_pass_failure_ban_interval);// how many times failed account? in one ip.
+	now = time(NULL);
+	ipban_failures_prune(now);
+
+	std::deque<time_t>& attempts = ipban_failures[ip];
+
+	attempts.push_back(now);
+	ipban_failures_order.emplace_back(ip, now);
+	ipban_failures_expire(attempts, now);
 
 	// if over the limit, add a temporary ban entry
-	if( failures >= login_config.dynamic_pass_failure_ban_limit )
+	if( attempts.size() >= login_config.dynamic_pass_failure_ban_limit )
 	{
 		uint8* p = (uint8*)&ip;
 		if( SQL_ERROR == Sql_Query(sql_handle, "INSERT INTO `%s`(`list`,`btime`,`rtime`,`reason`) VALUES ('%u.%u.%u.*', NOW() , NOW() +  INTERVAL %d MINUTE ,'Password error ban')",
 			ipban_table, p[3], p[2], p[1], login_config.dynamic_pass_failure_ban_duration) )
 			Sql_ShowDebug(sql_handle);
+
+		ipban_index_add(ip, 2, now + (time_t)login_config.dynamic_pass_failure_ban_duration * 60);
+		ipban_failures.erase(ip);
 	}
 }
 
+/**
+ * Timered function to reload the active bans from `ipbanlist`.
+ *  Picks up bans added by other tools, removed bans disappear.
+ *  Performed each ipban_refresh_interval.
+ * @param tid: timer id
+ * @param tick: tick of execution
+ * @param id: unused
+ * @param data: unused
+ * @return 0
+ */
+TIMER_FUNC(ipban_refresh){
+	time_t now = time(NULL);
+	char* value;
+
+	if( !login_config.ipban )
+		return 0;// ipban disabled
+
+	if( SQL_ERROR == Sql_Query(sql_handle, "SELECT `list`, UNIX_TIMESTAMP(`rtime`) FROM `%s` WHERE `rtime` > NOW()", ipban_table) )
+		Sql_ShowDebug(sql_handle);// keep the current index
+	else {
+		for( int i = 0; i < 4; i++ )
+			ipban_index[i].clear();
+
+		while( SQL_SUCCESS == Sql_NextRow(sql_handle) ) {
+			uint32 ip;
+			int level;
+			time_t rtime;
+
+			Sql_GetData(sql_handle, 1, &value, NULL);
+			rtime = (time_t)strtoll(value, NULL, 10);
+			Sql_GetData(sql_handle, 0, &value, NULL);
+			if( ipban_parse(value, &ip, &level) )
+				ipban_index_add(ip, level, rtime);
+		}
+		Sql_FreeResult(sql_handle);
+	}
+
+	ipban_failures_prune(now);
+
+	return 0;
+}
+
 /**
  * Timered function to remove expired bans.
  *  Request all characters to update their registered ip and transmit their new ip.
@@ -165,6 +324,9 @@ bool ipban_config_read(const char* key, const char* value) {
 		else
 		if( strcmpi(key, "dynamic_pass_failure_ban_duration") == 0 )
 			login_config.dynamic_pass_failure_ban_duration = atoi(value);
+		else
+		if( strcmpi(key, "refresh_interval") == 0 )
+			login_config.ipban_refresh_interval = atoi(value);
 		else
 			return false;// not found
 		return true;
@@ -224,6 +386,17 @@ void ipban_init(void) {
 		cleanup_timer_id = add_timer_interval(gettick()+10, ipban_cleanup, 0, 0, login_config.ipban_cleanup_interval*1000);
 	} else // make sure it gets cleaned up on login-server start regardless of interval-based cleanups
 		ipban_cleanup(0,0,0,0);
+
+	// load the active bans and the recent failed attempts into memory
+	ipban_refresh(0,0,0,0);
+	if( login_config.dynamic_pass_failure_ban )
+		loginlog_failedattempts_load(login_config.dynamic_pass_failure_ban_interval, ipban_failures_load);
+
+	if( login_config.ipban_refresh_interval > 0 )
+	{
+		add_timer_func_list(ipban_refresh, "ipban_refresh");
+		refresh_timer_id = add_timer_interval(gettick()+login_config.ipban_refresh_interval*1000, ipban_refresh, 0, 0, login_config.ipban_refresh_interval*1000);
+	}
 }
 
 /**
@@ -238,8 +411,16 @@ void ipban_final(void) {
 		// release data
 		delete_timer(cleanup_timer_id, ipban_cleanup);
 
+	if( login_config.ipban_refresh_interval > 0 )
+		delete_timer(refresh_timer_id, ipban_refresh);
+
 	ipban_cleanup(0,0,0,0); // always clean up on login-server stop
 
+	for( int i = 0; i < 4; i++ )
+		ipban_index[i].clear();
+	ipban_failures.clear();
+	ipban_failures_order.clear();
+
 	// close connections
 	Sql_Free(sql_handle);
 	sql_handle = NULL;
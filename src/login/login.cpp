@@ -272,26 +272,14 @@ int login_mmo_auth_new(const char* userid, const char* pass, const char sex, con
 }
 
 /**
- * Check/authentication of a connection.
- * @param sd: string (atm:md5key or dbpass)
- * @param isServer: string (atm:md5key or dbpass)
- * @return :
- *	-1: success
- *	0: unregistered id;
- *	1: incorrect pass;
- *	2: expired id
- *	3: blacklisted (or registration limit exceeded if new acc);
- *	5: invalid client_version|hash;
- *	6: banned
- *	x: acc state (TODO document me deeper)
+ * Checks done before the account is looked up: DNS blacklist and account creation with _M/_F.
+ * @param sd: login session
+ * @param ip: ip of the session
+ * @return -1 to continue, otherwise the result of login_mmo_auth
  */
-int login_mmo_auth(struct login_session_data* sd, bool isServer) {
-	struct mmo_account acc;
+static int login_mmo_auth_precheck(struct login_session_data* sd, const char* ip) {
 	int len;
 
-	char ip[16];
-	ip2str(session[sd->fd]->client_addr, ip);
-
 	// DNS Blacklist check
 	if( login_config.use_dnsbl ) {
 		char r_ip[16];
@@ -330,31 +318,44 @@ int login_mmo_auth(struct login_session_data* sd, bool isServer) {
 		}
 	}
 
-	if( !accounts->load_str(accounts, &acc, sd->userid) ) {
+	return -1;
+}
+
+/**
+ * Checks done after the account was looked up and the password compared, updates the session and the account.
+ * @param sd: login session
+ * @param acc: account of the session, NULL if it was not found
+ * @param password_ok: whether the password matches
+ * @param isServer: whether it is a char-server
+ * @param ip: ip of the session
+ * @return the result of login_mmo_auth
+ */
+static int login_mmo_auth_accept(struct login_session_data* sd, struct mmo_account* acc, bool password_ok, bool isServer, const char* ip) {
+	if( acc == NULL ) {
 		ShowNotice("Unknown account (account: %s, ip: %s)\n", sd->userid, ip);
 		return 0; // 0 = Unregistered ID
 	}
 
-	if( !login_check_password(sd->md5key, sd->passwdenc, sd->passwd, acc.pass) ) {
+	if( !password_ok ) {
 		ShowNotice("Invalid password (account: '%s', ip: %s)\n", sd->userid, ip);
 		return 1; // 1 = Incorrect Password
 	}
 
-	if( acc.expiration_time != 0 && acc.expiration_time < time(NULL) ) {
+	if( acc->expiration_time != 0 && acc->expiration_time < time(NULL) ) {
 		ShowNotice("Connection refused (account: %s, expired ID, ip: %s)\n", sd->userid, ip);
 		return 2; // 2 = This ID is expired
 	}
 
-	if( acc.unban_time != 0 && acc.unban_time > time(NULL) ) {
+	if( acc->unban_time != 0 && acc->unban_time > time(NULL) ) {
 		char tmpstr[24];
-		timestamp2string(tmpstr, sizeof(tmpstr), acc.unban_time, login_config.date_format);
+		timestamp2string(tmpstr, sizeof(tmpstr), acc->unban_time, login_config.date_format);
 		ShowNotice("Connection refused (account: %s, banned until %s, ip: %s)\n", sd->userid, tmpstr, ip);
 		return 6; // 6 = Your are Prohibited to log in until %s
 	}
 
-	if( acc.state != 0 ) {
-		ShowNotice("Connection refused (account: %s, state: %d, ip: %s)\n", sd->userid, acc.state, ip);
-		return acc.state - 1;
+	if( acc->state != 0 ) {
+		ShowNotice("Connection refused (account: %s, state: %d, ip: %s)\n", sd->userid, acc->state, ip);
+		return acc->state - 1;
 	}
 
 	if( login_config.client_hash_check && !isServer ) {
@@ -362,7 +363,7 @@ int login_mmo_auth(struct login_session_data* sd, bool isServer) {
 		bool match = false;
 
 		for( node = login_config.client_hash_nodes; node; node = node->next ) {
-			if( acc.group_id < node->group_id )
+			if( acc->group_id < node->group_id )
 				continue;
 			if( *node->hash == '\0' // Allowed to login without hash
 			 || (sd->has_client_hash && memcmp(node->hash, sd->client_hash, 16) == 0 ) // Correct hash
@@ -389,23 +390,23 @@ int login_mmo_auth(struct login_session_data* sd, bool isServer) {
 		}
 	}
 
-	ShowNotice("Authentication accepted (account: %s, id: %d, ip: %s)\n", sd->userid, acc.account_id, ip);
+	ShowNotice("Authentication accepted (account: %s, id: %d, ip: %s)\n", sd->userid, acc->account_id, ip);
 
 	// update session data
-	sd->account_id = acc.account_id;
+	sd->account_id = acc->account_id;
 	sd->login_id1 = rnd() + 1;
 	sd->login_id2 = rnd() + 1;
-	safestrncpy(sd->lastlogin, acc.lastlogin, sizeof(sd->lastlogin));
-	sd->sex = acc.sex;
-	sd->group_id = acc.group_id;
+	safestrncpy(sd->lastlogin, acc->lastlogin, sizeof(sd->lastlogin));
+	sd->sex = acc->sex;
+	sd->group_id = acc->group_id;
 
 	// update account data
-	timestamp2string(acc.lastlogin, sizeof(acc.lastlogin), time(NULL), "%Y-%m-%d %H:%M:%S");
-	safestrncpy(acc.last_ip, ip, sizeof(acc.last_ip));
-	acc.unban_time = 0;
-	acc.logincount++;
+	timestamp2string(acc->lastlogin, sizeof(acc->lastlogin), time(NULL), "%Y-%m-%d %H:%M:%S");
+	safestrncpy(acc->last_ip, ip, sizeof(acc->last_ip));
+	acc->unban_time = 0;
+	acc->logincount++;
 
-	accounts->save(accounts, &acc);
+	accounts->save_async(accounts, acc);
 
 	if( sd->sex != 'S' && sd->account_id < START_ACCOUNT_NUM )
 		ShowWarning("Account %s has account id %d! Account IDs must be over %d to work properly!\n", sd->userid, sd->account_id, START_ACCOUNT_NUM);
@@ -413,6 +414,81 @@ int login_mmo_auth(struct login_session_data* sd, bool isServer) {
 	return -1; // account OK
 }
 
+/**
+ * Check/authentication of a connection.
+ * @param sd: string (atm:md5key or dbpass)
+ * @param isServer: string (atm:md5key or dbpass)
+ * @return :
+ *	-1: success
+ *	0: unregistered id;
+ *	1: incorrect pass;
+ *	2: expired id
+ *	3: blacklisted (or registration limit exceeded if new acc);
+ *	5: invalid client_version|hash;
+ *	6: banned
+ *	x: acc state (TODO document me deeper)
+ */
+int login_mmo_auth(struct login_session_data* sd, bool isServer) {
+	struct mmo_account acc;
+	bool found;
+	int result;
+
+	char ip[16];
+	ip2str(session[sd->fd]->client_addr, ip);
+
+	if( (result = login_mmo_auth_precheck(sd, ip)) != -1 )
+		return result;
+
+	found = accounts->load_str(accounts, &acc, sd->userid);
+
+	return login_mmo_auth_accept(sd, found ? &acc : NULL, found && login_check_password(sd->md5key, sd->passwdenc, sd->passwd, acc.pass), isServer, ip);
+}
+
+/**
+ * Check/authentication of a client connection on the account workers.
+ *  The account lookup and the password comparison run on a worker connection,
+ *  the remaining checks of login_mmo_auth run on the main thread afterwards.
+ * @param sd: client session
+ * @param func: completion, called with the result of login_mmo_auth
+ */
+void login_mmo_auth_async(struct login_session_data* sd, void (*func)(struct login_session_data* sd, int result)) {
+	static uint32 last_serial = 0;
+	uint32 serial;
+	int fd = sd->fd;
+	int result;
+	std::string md5key = sd->md5key;
+	std::string passwd = sd->passwd;
+	int passwdenc = sd->passwdenc;
+
+	char ip[16];
+	ip2str(session[fd]->client_addr, ip);
+
+	if( (result = login_mmo_auth_precheck(sd, ip)) != -1 ) {
+		func(sd, result);
+		return;
+	}
+
+	if( ++last_serial == 0 ) // 0 means not pending
+		++last_serial;
+	serial = last_serial;
+	sd->auth_serial = serial;
+
+	accounts->load_str_async(accounts, sd->userid, [md5key, passwd, passwdenc]( const struct mmo_account* acc ){
+		return login_check_password(md5key.c_str(), passwdenc, passwd.c_str(), acc->pass) ? 1 : 0;
+	}, [fd, serial, func]( struct mmo_account* acc, int password_ok ){
+		struct login_session_data* sd;
+		char ip[16];
+
+		// the session may have been closed while the request was pending
+		if( !session_isActive(fd) || (sd = (struct login_session_data*)session[fd]->session_data) == NULL || sd->auth_serial != serial )
+			return;
+
+		sd->auth_serial = 0;
+		ip2str(session[fd]->client_addr, ip);
+		func(sd, login_mmo_auth_accept(sd, acc, password_ok != 0, false, ip));
+	} );
+}
+
 /**
  * Sub function of login_check_password.
  *  Checking if password matches the one in db hashed with client md5key.
@@ -715,6 +791,7 @@ void login_set_defaults() {
 	login_config.login_ip = INADDR_ANY;
 	login_config.login_port = 6900;
 	login_config.ipban_cleanup_interval = 60;
+	login_config.ipban_refresh_interval = 30;
 	login_config.ip_sync_interval = 0;
 	login_config.log_login = true;
 	safestrncpy(login_config.date_format, "%Y-%m-%d %H:%M:%S", sizeof(login_config.date_format));
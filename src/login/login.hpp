@@ -44,6 +44,7 @@ struct login_session_data {
 	uint8 client_hash[16];		///hash of client
 	int has_client_hash;		///client ha sent an hash
 
+	uint32 auth_serial;		///pending asynchronous authentication, 0 if none
 	int fd;				///socket of client
 };
 
@@ -70,6 +71,7 @@ struct Login_Config {
 	uint32 login_ip;                                /// the address to bind to
 	uint16 login_port;                              /// the port to bind to
 	unsigned int ipban_cleanup_interval;            /// interval (in seconds) to clean up expired IP bans
+	unsigned int ipban_refresh_interval;            /// interval (in seconds) to reload the IP bans into memory
 	unsigned int ip_sync_interval;                  /// interval (in minutes) to execute a DNS/IP update (for dynamic IPs)
 	bool log_login;                                 /// whether to log login server actions or not
 	char date_format[32];                           /// date format used in messages
@@ -222,6 +224,15 @@ int login_mmo_auth_new(const char* userid, const char* pass, const char sex, con
  */
 int login_mmo_auth(struct login_session_data* sd, bool isServer);
 
+/**
+ * Check/authentication of a client connection on the account workers.
+ *  The session is pending until func is called on the main thread with the result of login_mmo_auth,
+ *  func is not called if the session was closed in the meantime.
+ * @param sd: client session
+ * @param func: completion
+ */
+void login_mmo_auth_async(struct login_session_data* sd, void (*func)(struct login_session_data* sd, int result));
+
 int login_get_usercount( int users );
 
 #endif /* LOGIN_HPP */
@@ -232,6 +232,18 @@ static void logclif_auth_failed(struct login_session_data* sd, int result) {
 #endif	
 }
 
+/**
+ * Completion of the authentication of a client, see login_mmo_auth_async.
+ * @param sd: player session
+ * @param result: result of login_mmo_auth
+ */
+static void logclif_auth_result(struct login_session_data* sd, int result) {
+	if( result == -1 )
+		logclif_auth_ok(sd);
+	else
+		logclif_auth_failed(sd, result);
+}
+
 /**
  * Received a keepalive packet to maintain connection.
  * 0x200 <account.userid>.24B.
@@ -288,7 +300,6 @@ static int logclif_parse_reqauth(int fd, struct login_session_data *sd, int comm
 	||  (command == 0x0825 && (packet_len < 4 || packet_len < RFIFOW(fd, 2))) )
 		return 0;
 	else {
-		int result;
 		char username[NAME_LENGTH];
 		char password[PASSWD_LENGTH];
 		unsigned char passhash[16];
@@ -351,12 +362,7 @@ static int logclif_parse_reqauth(int fd, struct login_session_data *sd, int comm
 			return 0;
 		}
 
-		result = login_mmo_auth(sd, false);
-
-		if( result == -1 )
-			logclif_auth_ok(sd);
-		else
-			logclif_auth_failed(sd, result);
+		login_mmo_auth_async(sd, logclif_auth_result);
 	}
 	return 1;
 }
@@ -502,6 +508,9 @@ int logclif_parse(int fd) {
 		uint16 command = RFIFOW(fd,0);
 		int next=1;
 
+		if( sd->auth_serial != 0 )
+			break; // authentication pending, parse the following packets once it is done
+
 		switch( command )
 		{
 		// New alive packet: used to verify if client is always alive.
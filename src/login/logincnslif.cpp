@@ -13,6 +13,7 @@
 #include "../common/strlib.hpp"
 #include "../common/timer.hpp"
 
+#include "account.hpp"
 #include "login.hpp"
 
 /**
@@ -120,6 +121,8 @@ int cnslif_parse(const char* buf){
 				ShowInfo("Reloading config file \"%s\"\n", login_config.loginconf_name);
 				login_config_read(login_config.loginconf_name, false);
 			}
+			else if( strcmpi("cachestats", command) == 0 )
+				account_db_sql_cache_stats(login_get_accounts_db());
 		}
 		if( strcmpi("create",type) == 0 )
 		{
@@ -145,6 +148,7 @@ int cnslif_parse(const char* buf){
 		ShowInfo("\t server:shutdown => Stops the server.\n");
 		ShowInfo("\t server:alive => Checks if the server is running.\n");
 		ShowInfo("\t server:reloadconf => Reload config file: \"%s\"\n", login_config.loginconf_name);
+		ShowInfo("\t server:cachestats => Shows the hit rate of the account cache.\n");
 		ShowInfo("\t create:<username> <password> <sex:M|F> => Creates a new account.\n");
 	}
 	return 1;
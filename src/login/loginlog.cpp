@@ -34,29 +34,31 @@ static bool enabled = false;
 
 
 /**
- * Get the number of failed login attempts by the ip in the last minutes.
- * @param ip: ip to search attempt from
+ * Loads the failed login attempts of the last minutes, oldest first.
  * @param minutes: intervall to search
- * @return number of failed attempts
+ * @param func: called with the ip and time of every attempt
  */
-unsigned long loginlog_failedattempts(uint32 ip, unsigned int minutes) {
-	unsigned long failures = 0;
-
+void loginlog_failedattempts_load(unsigned int minutes, void (*func)(uint32 ip, time_t time)) {
 	if( !enabled )
-		return 0;
+		return;
 
-	if( SQL_ERROR == Sql_Query(sql_handle, "SELECT count(*) FROM `%s` WHERE `ip` = '%s' AND (`rcode` = '0' OR `rcode` = '1') AND `time` > NOW() - INTERVAL %d MINUTE",
-		log_login_db, ip2str(ip,NULL), minutes) )// how many times failed account? in one ip.
+	if( SQL_ERROR == Sql_Query(sql_handle, "SELECT `ip`, UNIX_TIMESTAMP(`time`) FROM `%s` WHERE (`rcode` = '0' OR `rcode` = '1') AND `time` > NOW() - INTERVAL %d MINUTE ORDER BY `time`",
+		log_login_db, minutes) )
+	{
 		Sql_ShowDebug(sql_handle);
+		return;
+	}
 
-	if( SQL_SUCCESS == Sql_NextRow(sql_handle) )
+	while( SQL_SUCCESS == Sql_NextRow(sql_handle) )
 	{
-		char* data;
-		Sql_GetData(sql_handle, 0, &data, NULL);
-		failures = strtoul(data, NULL, 10);
-		Sql_FreeResult(sql_handle);
+		char* ip;
+		char* attempt;
+
+		Sql_GetData(sql_handle, 0, &ip, NULL);
+		Sql_GetData(sql_handle, 1, &attempt, NULL);
+		func(str2ip(ip), (time_t)strtoll(attempt, NULL, 10));
 	}
-	return failures;
+	Sql_FreeResult(sql_handle);
 }
 
 
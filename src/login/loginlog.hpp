@@ -5,16 +5,16 @@
 #define LOGINLOG_HPP
 
 #include <memory>
+#include <time.h>
 
 #include "../common/cbasetypes.hpp"
 
 /**
- * Get the number of failed login attempts by the ip in the last minutes.
- * @param ip: ip to search attempt from
+ * Loads the failed login attempts of the last minutes, oldest first.
  * @param minutes: intervall to search
- * @return number of failed attempts
+ * @param func: called with the ip and time of every attempt
  */
-unsigned long loginlog_failedattempts(uint32 ip, unsigned int minutes);
+void loginlog_failedattempts_load(unsigned int minutes, void (*func)(uint32 ip, time_t time));
 
 /**
  * Records an event in the login log.
@@ -193,6 +193,10 @@ uint64 AchievementDatabase::parseBodyNode(const YAML::Node &node){
 		}
 
 		achievement->condition = parse_script( condition.c_str(), this->getCurrentFile().c_str(), node["Condition"].Mark().line + 1, SCRIPT_IGNORE_EXTERNAL_BRACKETS );
+
+		if( achievement->condition == nullptr ){
+			this->invalidScript();
+		}
 	}else{
 		achievement->condition = nullptr;
 	}
@@ -283,6 +287,10 @@ uint64 AchievementDatabase::parseBodyNode(const YAML::Node &node){
 			}
 
 			achievement->rewards.script = parse_script( script.c_str(), this->getCurrentFile().c_str(), achievement_id, SCRIPT_IGNORE_EXTERNAL_BRACKETS );
+
+			if( achievement->rewards.script == nullptr && !script.empty() ){
+				this->invalidScript();
+			}
 		}else{
 			achievement->rewards.script = nullptr;
 		}
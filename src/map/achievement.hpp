@@ -105,6 +105,9 @@ public:
 	void clear();
 	const std::string getDefaultLocation();
 	uint64 parseBodyNode( const YAML::Node& node );
+	bool useSnapshots(){
+		return false; // Conditions are parsed with the line of their node
+	}
 
 	// Additional
 	bool mobexists(uint32 mob_id);
@@ -45,6 +45,7 @@
 #include "mercenary.hpp"
 #include "mob.hpp"
 #include "npc.hpp"
+#include "packets.hpp"
 #include "party.hpp"
 #include "pc.hpp"
 #include "pc_groups.hpp"
@@ -10122,6 +10123,33 @@ ACMD_FUNC(camerainfo){
 	return 0;
 }
 
+/**
+ * Displays the walk packets a player received through the move batch
+ * and the ones that were throttled.
+ * Usage: @movestats {<char name/ID>}
+ */
+ACMD_FUNC(movestats)
+{
+	struct map_session_data* pl_sd = sd;
+
+	memset(atcmd_player_name, '\0', sizeof(atcmd_player_name));
+
+	if( message && *message && sscanf(message, "%23[^\n]", atcmd_player_name) > 0 ) {
+		if( (pl_sd = map_nick2sd(atcmd_player_name,true)) == NULL && (pl_sd = map_charid2sd(atoi(atcmd_player_name))) == NULL ) {
+			clif_displaymessage(fd, msg_txt(sd,3)); // Character not found.
+			return -1;
+		}
+	}
+
+	if( !battle_config.move_batch )
+		clif_displaymessage(fd, msg_txt(sd,1505)); // Walk packets are not batched (move_batch is off).
+
+	sprintf(atcmd_output, msg_txt(sd,1506), pl_sd->status.name, pl_sd->move_stats.batched, pl_sd->move_stats.throttled,
+		(unsigned int)(pl_sd->move_stats.throttled * sizeof(struct PACKET_ZC_NOTIFY_MOVE))); // '%s' received %u batched walk packets, %u were throttled (%u bytes saved).
+	clif_displaymessage(fd, atcmd_output);
+	return 0;
+}
+
 ACMD_FUNC(resurrect) {
 	nullpo_retr(-1, sd);
 
@@ -10432,6 +10460,7 @@ void atcommand_basecommands(void) {
 		ACMD_DEFR(changedress, ATCMD_NOCONSOLE|ATCMD_NOAUTOTRADE),
 		ACMD_DEFR(camerainfo, ATCMD_NOCONSOLE|ATCMD_NOAUTOTRADE),
 		ACMD_DEFR(resurrect, ATCMD_NOCONSOLE),
+		ACMD_DEF(movestats),
 	};
 	AtCommandInfo* atcommand;
 	int i;
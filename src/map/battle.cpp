@@ -588,6 +588,204 @@ int64 battle_attr_fix(struct block_list *src, struct block_list *target, int64 d
 	return damage;
 }
 
+/**
+ * Calculates the card bonuses of an attacker against a target.
+ * Only depends on the bonuses of the attacker and the kind of target, see battle_calc_cardfix_atk_cached.
+ * @param attack_type BF_WEAPON or BF_MAGIC
+ * @param sd Attacker
+ * @param tstatus Target status data
+ * @param t_class Target class
+ * @param t_race2 Target Race2
+ * @param nk Skill's nk
+ * @param rh_ele Right-hand weapon element
+ * @param left Left hand flag, see battle_calc_cardfix
+ * @param flag Misc value of skill & damage flags
+ * @return cardfix on a base of 1000
+ */
+static short battle_calc_cardfix_atk(int attack_type, struct map_session_data *sd, struct status_data *tstatus, int t_class, enum e_race2 t_race2, int nk, int rh_ele, int left, int flag)
+{
+	short cardfix = 1000;
+
+	if( attack_type == BF_MAGIC ) {
+		cardfix = cardfix * (100 + sd->magic_addrace[tstatus->race] + sd->magic_addrace[RC_ALL] + sd->magic_addrace2[t_race2]) / 100;
+		if( !(nk&NK_NO_ELEFIX) ) { // Affected by Element modifier bonuses
+			cardfix = cardfix * (100 + sd->magic_addele[tstatus->def_ele] + sd->magic_addele[ELE_ALL] +
+				sd->magic_addele_script[tstatus->def_ele] + sd->magic_addele_script[ELE_ALL]) / 100;
+			cardfix = cardfix * (100 + sd->magic_atk_ele[rh_ele] + sd->magic_atk_ele[ELE_ALL]) / 100;
+		}
+		cardfix = cardfix * (100 + sd->magic_addsize[tstatus->size] + sd->magic_addsize[SZ_ALL]) / 100;
+		cardfix = cardfix * (100 + sd->magic_addclass[tstatus->class_] + sd->magic_addclass[CLASS_ALL]) / 100;
+		for (const auto &it : sd->add_mdmg) {
+			if (it.id == t_class) {
+				cardfix = cardfix * (100 + it.val) / 100;
+				break;
+			}
+		}
+		return cardfix;
+	}
+
+	short cardfix_ = 1000;
+
+	if( sd->state.arrow_atk ) { // Ranged attack
+		cardfix = cardfix * (100 + sd->right_weapon.addrace[tstatus->race] + sd->arrow_addrace[tstatus->race] +
+			sd->right_weapon.addrace[RC_ALL] + sd->arrow_addrace[RC_ALL]) / 100;
+		if( !(nk&NK_NO_ELEFIX) ) { // Affected by Element modifier bonuses
+			int ele_fix = sd->right_weapon.addele[tstatus->def_ele] + sd->arrow_addele[tstatus->def_ele] +
+				sd->right_weapon.addele[ELE_ALL] + sd->arrow_addele[ELE_ALL];
+
+			for (const auto &it : sd->right_weapon.addele2) {
+				if (it.ele != tstatus->def_ele)
+					continue;
+				if (!(((it.flag)&flag)&BF_WEAPONMASK &&
+					((it.flag)&flag)&BF_RANGEMASK &&
+					((it.flag)&flag)&BF_SKILLMASK))
+					continue;
+				ele_fix += it.rate;
+			}
+			cardfix = cardfix * (100 + ele_fix) / 100;
+		}
+		cardfix = cardfix * (100 + sd->right_weapon.addsize[tstatus->size] + sd->arrow_addsize[tstatus->size] +
+			sd->right_weapon.addsize[SZ_ALL] + sd->arrow_addsize[SZ_ALL]) / 100;
+		cardfix = cardfix * (100 + sd->right_weapon.addrace2[t_race2]) / 100;
+		cardfix = cardfix * (100 + sd->right_weapon.addclass[tstatus->class_] + sd->arrow_addclass[tstatus->class_] +
+			sd->right_weapon.addclass[CLASS_ALL] + sd->arrow_addclass[CLASS_ALL]) / 100;
+	} else { // Melee attack
+		int skill = 0;
+
+		// Calculates each right & left hand weapon bonuses separatedly
+		if( !battle_config.left_cardfix_to_right ) {
+			// Right-handed weapon
+			cardfix = cardfix * (100 + sd->right_weapon.addrace[tstatus->race] + sd->right_weapon.addrace[RC_ALL]) / 100;
+			if( !(nk&NK_NO_ELEFIX) ) { // Affected by Element modifier bonuses
+				int ele_fix = sd->right_weapon.addele[tstatus->def_ele] + sd->right_weapon.addele[ELE_ALL];
+
+				for (const auto &it : sd->right_weapon.addele2) {
+					if (it.ele != tstatus->def_ele)
+						continue;
+					if (!(((it.flag)&flag)&BF_WEAPONMASK &&
+						((it.flag)&flag)&BF_RANGEMASK &&
+						((it.flag)&flag)&BF_SKILLMASK))
+						continue;
+					ele_fix += it.rate;
+				}
+				cardfix = cardfix * (100 + ele_fix) / 100;
+			}
+			cardfix = cardfix * (100 + sd->right_weapon.addsize[tstatus->size] + sd->right_weapon.addsize[SZ_ALL]) / 100;
+			cardfix = cardfix * (100 + sd->right_weapon.addrace2[t_race2]) / 100;
+			cardfix = cardfix * (100 + sd->right_weapon.addclass[tstatus->class_] + sd->right_weapon.addclass[CLASS_ALL]) / 100;
+
+			if( left&1 ) { // Left-handed weapon
+				cardfix_ = cardfix_ * (100 + sd->left_weapon.addrace[tstatus->race] + sd->left_weapon.addrace[RC_ALL]) / 100;
+				if( !(nk&NK_NO_ELEFIX) ) { // Affected by Element modifier bonuses
+					int ele_fix_lh = sd->left_weapon.addele[tstatus->def_ele] + sd->left_weapon.addele[ELE_ALL];
+
+					for (const auto &it : sd->left_weapon.addele2) {
+						if (it.ele != tstatus->def_ele)
+							continue;
+						if (!(((it.flag)&flag)&BF_WEAPONMASK &&
+							((it.flag)&flag)&BF_RANGEMASK &&
+							((it.flag)&flag)&BF_SKILLMASK))
+							continue;
+						ele_fix_lh += it.rate;
+					}
+					cardfix_ = cardfix_ * (100 + ele_fix_lh) / 100;
+				}
+				cardfix_ = cardfix_ * (100 + sd->left_weapon.addsize[tstatus->size] + sd->left_weapon.addsize[SZ_ALL]) / 100;
+				cardfix_ = cardfix_ * (100 + sd->left_weapon.addrace2[t_race2]) / 100;
+				cardfix_ = cardfix_ * (100 + sd->left_weapon.addclass[tstatus->class_] + sd->left_weapon.addclass[CLASS_ALL]) / 100;
+			}
+		}
+		// Calculates right & left hand weapon as unity
+		else {
+			//! CHECKME: If 'left_cardfix_to_right' is yes, doesn't need to check NK_NO_ELEFIX?
+			//if( !(nk&NK_NO_ELEFIX) ) { // Affected by Element modifier bonuses
+				int ele_fix = sd->right_weapon.addele[tstatus->def_ele] + sd->left_weapon.addele[tstatus->def_ele]
+							+ sd->right_weapon.addele[ELE_ALL] + sd->left_weapon.addele[ELE_ALL];
+
+				for (const auto &it : sd->right_weapon.addele2) {
+					if (it.ele != tstatus->def_ele)
+						continue;
+					if (!(((it.flag)&flag)&BF_WEAPONMASK &&
+						((it.flag)&flag)&BF_RANGEMASK &&
+						((it.flag)&flag)&BF_SKILLMASK))
+						continue;
+					ele_fix += it.rate;
+				}
+				for (const auto &it : sd->left_weapon.addele2) {
+					if (it.ele != tstatus->def_ele)
+						continue;
+					if (!(((it.flag)&flag)&BF_WEAPONMASK &&
+						((it.flag)&flag)&BF_RANGEMASK &&
+						((it.flag)&flag)&BF_SKILLMASK))
+						continue;
+					ele_fix += it.rate;
+				}
+				cardfix = cardfix * (100 + ele_fix) / 100;
+			//}
+			cardfix = cardfix * (100 + sd->right_weapon.addrace[tstatus->race] + sd->left_weapon.addrace[tstatus->race] +
+				sd->right_weapon.addrace[RC_ALL] + sd->left_weapon.addrace[RC_ALL]) / 100;
+			cardfix = cardfix * (100 + sd->right_weapon.addsize[tstatus->size] + sd->left_weapon.addsize[tstatus->size] +
+				sd->right_weapon.addsize[SZ_ALL] + sd->left_weapon.addsize[SZ_ALL]) / 100;
+			cardfix = cardfix * (100 + sd->right_weapon.addrace2[t_race2] + sd->left_weapon.addrace2[t_race2]) / 100;
+			cardfix = cardfix * (100 + sd->right_weapon.addclass[tstatus->class_] + sd->left_weapon.addclass[tstatus->class_] +
+				sd->right_weapon.addclass[CLASS_ALL] + sd->left_weapon.addclass[CLASS_ALL]) / 100;
+		}
+		if( sd->status.weapon == W_KATAR && (skill = pc_checkskill(sd,ASC_KATAR)) > 0 ) // Adv. Katar Mastery functions similar to a +%ATK card on official [helvetica]
+			cardfix = cardfix * (100 + (10 + 2 * skill)) / 100;
+	}
+
+	//! CHECKME: These right & left hand weapon ignores 'left_cardfix_to_right'?
+	for (const auto &it : sd->right_weapon.add_dmg) {
+		if (it.id == t_class) {
+			cardfix = cardfix * (100 + it.val) / 100;
+			break;
+		}
+	}
+	if( left&1 ) {
+		for (const auto &it : sd->left_weapon.add_dmg) {
+			if (it.id == t_class) {
+				cardfix_ = cardfix_ * (100 + it.val) / 100;
+				break;
+			}
+		}
+	}
+#ifndef RENEWAL
+	if( flag&BF_LONG )
+		cardfix = cardfix * (100 + sd->bonus.long_attack_atk_rate) / 100;
+#endif
+	return (left&1) ? cardfix_ : cardfix;
+}
+
+/**
+ * Looks up the card bonuses of an attacker against the kind of target in the attacker's cache.
+ * Splash skills and repeated hits against the same monster class only calculate them once.
+ * The cache is cleared by status_calc_pc, target changes (element, race, ...) are part of the key.
+ * @see battle_calc_cardfix_atk
+ */
+static short battle_calc_cardfix_atk_cached(int attack_type, struct map_session_data *sd, struct status_data *tstatus, int t_class, enum e_race2 t_race2, int nk, int rh_ele, int left, int flag)
+{
+	struct s_cardfix_cache::s_cardfix_key key;
+
+	if( t_class < 0 || t_class > UINT16_MAX )
+		return battle_calc_cardfix_atk(attack_type, sd, tstatus, t_class, t_race2, nk, rh_ele, left, flag);
+
+	memset(&key, 0, sizeof(key));
+	key.t_class = (uint16)t_class;
+	key.flag = (uint16)(flag&(BF_WEAPONMASK|BF_RANGEMASK|BF_SKILLMASK));
+	key.attack_type = (uint8)attack_type;
+	key.race = (uint8)tstatus->race;
+	key.race2 = (uint8)t_race2;
+	key.def_ele = (uint8)tstatus->def_ele;
+	key.size = (uint8)tstatus->size;
+	key.class_ = (uint8)tstatus->class_;
+	key.rh_ele = (uint8)rh_ele;
+	key.options = (uint8)((left&3) | (sd->state.arrow_atk ? 4 : 0) | ((nk&NK_NO_ELEFIX) ? 8 : 0) | (battle_config.left_cardfix_to_right ? 16 : 0));
+
+	return cardfix_cache_get(sd->cardfix_cache, key, [&]() {
+		return battle_calc_cardfix_atk(attack_type, sd, tstatus, t_class, t_race2, nk, rh_ele, left, flag);
+	});
+}
+
 /**
  * Calculates card bonuses damage adjustments.
  * @param attack_type @see enum e_battle_flag
@@ -639,20 +837,7 @@ int battle_calc_cardfix(int attack_type, struct block_list *src, struct block_li
 		case BF_MAGIC:
 			// Affected by attacker ATK bonuses
 			if( sd && !(nk&NK_NO_CARDFIX_ATK) ) {
-				cardfix = cardfix * (100 + sd->magic_addrace[tstatus->race] + sd->magic_addrace[RC_ALL] + sd->magic_addrace2[t_race2]) / 100;
-				if( !(nk&NK_NO_ELEFIX) ) { // Affected by Element modifier bonuses
-					cardfix = cardfix * (100 + sd->magic_addele[tstatus->def_ele] + sd->magic_addele[ELE_ALL] +
-						sd->magic_addele_script[tstatus->def_ele] + sd->magic_addele_script[ELE_ALL]) / 100;
-					cardfix = cardfix * (100 + sd->magic_atk_ele[rh_ele] + sd->magic_atk_ele[ELE_ALL]) / 100;
-				}
-				cardfix = cardfix * (100 + sd->magic_addsize[tstatus->size] + sd->magic_addsize[SZ_ALL]) / 100;
-				cardfix = cardfix * (100 + sd->magic_addclass[tstatus->class_] + sd->magic_addclass[CLASS_ALL]) / 100;
-				for (const auto &it : sd->add_mdmg) {
-					if (it.id == t_class) {
-						cardfix = cardfix * (100 + it.val) / 100;
-						break;
-					}
-				}
+				cardfix = battle_calc_cardfix_atk_cached(BF_MAGIC, sd, tstatus, t_class, t_race2, nk, rh_ele, left, flag);
 				APPLY_CARDFIX(damage, cardfix);
 			}
 
@@ -705,140 +890,8 @@ int battle_calc_cardfix(int attack_type, struct block_list *src, struct block_li
 		case BF_WEAPON:
 			// Affected by attacker ATK bonuses
 			if( sd && !(nk&NK_NO_CARDFIX_ATK) && (left&2) ) {
-				short cardfix_ = 1000;
-
-				if( sd->state.arrow_atk ) { // Ranged attack
-					cardfix = cardfix * (100 + sd->right_weapon.addrace[tstatus->race] + sd->arrow_addrace[tstatus->race] +
-						sd->right_weapon.addrace[RC_ALL] + sd->arrow_addrace[RC_ALL]) / 100;
-					if( !(nk&NK_NO_ELEFIX) ) { // Affected by Element modifier bonuses
-						int ele_fix = sd->right_weapon.addele[tstatus->def_ele] + sd->arrow_addele[tstatus->def_ele] +
-							sd->right_weapon.addele[ELE_ALL] + sd->arrow_addele[ELE_ALL];
-
-						for (const auto &it : sd->right_weapon.addele2) {
-							if (it.ele != tstatus->def_ele)
-								continue;
-							if (!(((it.flag)&flag)&BF_WEAPONMASK &&
-								((it.flag)&flag)&BF_RANGEMASK &&
-								((it.flag)&flag)&BF_SKILLMASK))
-								continue;
-							ele_fix += it.rate;
-						}
-						cardfix = cardfix * (100 + ele_fix) / 100;
-					}
-					cardfix = cardfix * (100 + sd->right_weapon.addsize[tstatus->size] + sd->arrow_addsize[tstatus->size] +
-						sd->right_weapon.addsize[SZ_ALL] + sd->arrow_addsize[SZ_ALL]) / 100;
-					cardfix = cardfix * (100 + sd->right_weapon.addrace2[t_race2]) / 100;
-					cardfix = cardfix * (100 + sd->right_weapon.addclass[tstatus->class_] + sd->arrow_addclass[tstatus->class_] +
-						sd->right_weapon.addclass[CLASS_ALL] + sd->arrow_addclass[CLASS_ALL]) / 100;
-				} else { // Melee attack
-					int skill = 0;
-
-					// Calculates each right & left hand weapon bonuses separatedly
-					if( !battle_config.left_cardfix_to_right ) {
-						// Right-handed weapon
-						cardfix = cardfix * (100 + sd->right_weapon.addrace[tstatus->race] + sd->right_weapon.addrace[RC_ALL]) / 100;
-						if( !(nk&NK_NO_ELEFIX) ) { // Affected by Element modifier bonuses
-							int ele_fix = sd->right_weapon.addele[tstatus->def_ele] + sd->right_weapon.addele[ELE_ALL];
-
-							for (const auto &it : sd->right_weapon.addele2) {
-								if (it.ele != tstatus->def_ele)
-									continue;
-								if (!(((it.flag)&flag)&BF_WEAPONMASK &&
-									((it.flag)&flag)&BF_RANGEMASK &&
-									((it.flag)&flag)&BF_SKILLMASK))
-									continue;
-								ele_fix += it.rate;
-							}
-							cardfix = cardfix * (100 + ele_fix) / 100;
-						}
-						cardfix = cardfix * (100 + sd->right_weapon.addsize[tstatus->size] + sd->right_weapon.addsize[SZ_ALL]) / 100;
-						cardfix = cardfix * (100 + sd->right_weapon.addrace2[t_race2]) / 100;
-						cardfix = cardfix * (100 + sd->right_weapon.addclass[tstatus->class_] + sd->right_weapon.addclass[CLASS_ALL]) / 100;
-
-						if( left&1 ) { // Left-handed weapon
-							cardfix_ = cardfix_ * (100 + sd->left_weapon.addrace[tstatus->race] + sd->left_weapon.addrace[RC_ALL]) / 100;
-							if( !(nk&NK_NO_ELEFIX) ) { // Affected by Element modifier bonuses
-								int ele_fix_lh = sd->left_weapon.addele[tstatus->def_ele] + sd->left_weapon.addele[ELE_ALL];
-
-								for (const auto &it : sd->left_weapon.addele2) {
-									if (it.ele != tstatus->def_ele)
-										continue;
-									if (!(((it.flag)&flag)&BF_WEAPONMASK &&
-										((it.flag)&flag)&BF_RANGEMASK &&
-										((it.flag)&flag)&BF_SKILLMASK))
-										continue;
-									ele_fix_lh += it.rate;
-								}
-								cardfix_ = cardfix_ * (100 + ele_fix_lh) / 100;
-							}
-							cardfix_ = cardfix_ * (100 + sd->left_weapon.addsize[tstatus->size] + sd->left_weapon.addsize[SZ_ALL]) / 100;
-							cardfix_ = cardfix_ * (100 + sd->left_weapon.addrace2[t_race2]) / 100;
-							cardfix_ = cardfix_ * (100 + sd->left_weapon.addclass[tstatus->class_] + sd->left_weapon.addclass[CLASS_ALL]) / 100;
-						}
-					}
-					// Calculates right & left hand weapon as unity
-					else {
-						//! CHECKME: If 'left_cardfix_to_right' is yes, doesn't need to check NK_NO_ELEFIX?
-						//if( !(nk&NK_NO_ELEFIX) ) { // Affected by Element modifier bonuses
-							int ele_fix = sd->right_weapon.addele[tstatus->def_ele] + sd->left_weapon.addele[tstatus->def_ele]
-										+ sd->right_weapon.addele[ELE_ALL] + sd->left_weapon.addele[ELE_ALL];
-
-							for (const auto &it : sd->right_weapon.addele2) {
-								if (it.ele != tstatus->def_ele)
-									continue;
-								if (!(((it.flag)&flag)&BF_WEAPONMASK &&
-									((it.flag)&flag)&BF_RANGEMASK &&
-									((it.flag)&flag)&BF_SKILLMASK))
-									continue;
-								ele_fix += it.rate;
-							}
-							for (const auto &it : sd->left_weapon.addele2) {
-								if (it.ele != tstatus->def_ele)
-									continue;
-								if (!(((it.flag)&flag)&BF_WEAPONMASK &&
-									((it.flag)&flag)&BF_RANGEMASK &&
-									((it.flag)&flag)&BF_SKILLMASK))
-									continue;
-								ele_fix += it.rate;
-							}
-							cardfix = cardfix * (100 + ele_fix) / 100;
-						//}
-						cardfix = cardfix * (100 + sd->right_weapon.addrace[tstatus->race] + sd->left_weapon.addrace[tstatus->race] +
-							sd->right_weapon.addrace[RC_ALL] + sd->left_weapon.addrace[RC_ALL]) / 100;
-						cardfix = cardfix * (100 + sd->right_weapon.addsize[tstatus->size] + sd->left_weapon.addsize[tstatus->size] +
-							sd->right_weapon.addsize[SZ_ALL] + sd->left_weapon.addsize[SZ_ALL]) / 100;
-						cardfix = cardfix * (100 + sd->right_weapon.addrace2[t_race2] + sd->left_weapon.addrace2[t_race2]) / 100;
-						cardfix = cardfix * (100 + sd->right_weapon.addclass[tstatus->class_] + sd->left_weapon.addclass[tstatus->class_] +
-							sd->right_weapon.addclass[CLASS_ALL] + sd->left_weapon.addclass[CLASS_ALL]) / 100;
-					}
-					if( sd->status.weapon == W_KATAR && (skill = pc_checkskill(sd,ASC_KATAR)) > 0 ) // Adv. Katar Mastery functions similar to a +%ATK card on official [helvetica]
-						cardfix = cardfix * (100 + (10 + 2 * skill)) / 100;
-				}
-
-				//! CHECKME: These right & left hand weapon ignores 'left_cardfix_to_right'?
-				for (const auto &it : sd->right_weapon.add_dmg) {
-					if (it.id == t_class) {
-						cardfix = cardfix * (100 + it.val) / 100;
-						break;
-					}
-				}
-				if( left&1 ) {
-					for (const auto &it : sd->left_weapon.add_dmg) {
-						if (it.id == t_class) {
-							cardfix_ = cardfix_ * (100 + it.val) / 100;
-							break;
-						}
-					}
-				}
-#ifndef RENEWAL
-				if( flag&BF_LONG )
-					cardfix = cardfix * (100 + sd->bonus.long_attack_atk_rate) / 100;
-#endif
-				if (left&1) {
-					APPLY_CARDFIX(damage, cardfix_);
-				} else {
-					APPLY_CARDFIX(damage, cardfix);
-				}
+				cardfix = battle_calc_cardfix_atk_cached(BF_WEAPON, sd, tstatus, t_class, t_race2, nk, rh_ele, left, flag);
+				APPLY_CARDFIX(damage, cardfix);
 			}
 			// Affected by target DEF bonuses
 			else if( tsd && !(nk&NK_NO_CARDFIX_DEF) && !(left&2) ) {
@@ -8574,6 +8627,11 @@ static const struct _battle_data {
 	{ "boss_nopc_move_rate",                &battle_config.boss_nopc_move_rate,             100,    0,    100,              },
 	{ "hom_idle_no_share",                  &battle_config.hom_idle_no_share,               0,      0,      INT_MAX,        },
 	{ "devotion_standup_fix",               &battle_config.devotion_standup_fix,            1,      0,      1,              },
+	{ "client_spawn_budget",                &battle_config.client_spawn_budget,             0,      0,      1000,           },
+	{ "move_batch",                         &battle_config.move_batch,                      0,      0,      1,              },
+	{ "move_throttle_range",                &battle_config.move_throttle_range,             0,      0,      100,            },
+	{ "move_throttle_interval",             &battle_config.move_throttle_interval,          1000,   0,      60000,          },
+	{ "move_throttle_maps",                 &battle_config.move_throttle_maps,              1,      0,      31,             },
 
 #include "../custom/battle_config_init.inc"
 };
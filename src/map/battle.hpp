@@ -665,6 +665,11 @@ struct Battle_Config
 	int boss_nopc_move_rate;
 	int hom_idle_no_share;
 	int devotion_standup_fix;
+	int client_spawn_budget;
+	int move_batch;
+	int move_throttle_range;
+	int move_throttle_interval;
+	int move_throttle_maps;
 
 #include "../custom/battle_config_struct.inc"
 };
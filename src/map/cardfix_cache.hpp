@@ -0,0 +1,53 @@
+// Copyright (c) rAthena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#ifndef CARDFIX_CACHE_HPP
+#define CARDFIX_CACHE_HPP
+
+#include <string.h>
+
+#include "../common/cbasetypes.hpp"
+
+/// Attacker card modifier against one kind of target, see battle_calc_cardfix
+#define CARDFIX_CACHE_SIZE 16
+struct s_cardfix_cache {
+	struct s_cardfix_key {
+		uint16 t_class; ///< Target class (mob id or job)
+		uint16 flag; ///< Damage flags that select bonuses (BF_WEAPONMASK|BF_RANGEMASK|BF_SKILLMASK)
+		uint8 attack_type, race, race2, def_ele, size, class_, rh_ele;
+		uint8 options; ///< Hands, arrow, element fix and left_cardfix_to_right
+	} key;
+	bool valid;
+	short cardfix;
+};
+
+/**
+ * Returns the cached modifier of the key, calculating and storing it on a miss.
+ * The cache is direct-mapped, a key replaces the entry of its slot.
+ * @param cache: Cache of the attacker
+ * @param key: Every input of the calculation that is not a bonus of the attacker, zero filled
+ * @param calc: Calculates the modifier of the key
+ * @return cardfix on a base of 1000
+ */
+template <typename F>
+short cardfix_cache_get(struct s_cardfix_cache cache[CARDFIX_CACHE_SIZE], const struct s_cardfix_cache::s_cardfix_key& key, F calc)
+{
+	uint32 hash = key.t_class * 31 + key.flag;
+
+	hash = hash * 31 + key.race * 7 + key.race2;
+	hash = hash * 31 + key.def_ele * 5 + key.size;
+	hash = hash * 31 + key.rh_ele * 3 + key.class_;
+	hash = hash * 31 + key.options * 2 + key.attack_type;
+
+	struct s_cardfix_cache* entry = &cache[(hash ^ (hash >> 7)) % CARDFIX_CACHE_SIZE];
+
+	if( !entry->valid || memcmp(&entry->key, &key, sizeof(key)) != 0 ) {
+		entry->key = key;
+		entry->cardfix = calc();
+		entry->valid = true;
+	}
+
+	return entry->cardfix;
+}
+
+#endif /* CARDFIX_CACHE_HPP */
@@ -1977,7 +1977,7 @@ void do_init_chrif(void) {
 		exit(EXIT_FAILURE);
 	}
 
-	auth_db = idb_alloc(DB_OPT_BASE);
+	auth_db = idb_alloc(MAP_ID_DB_OPTIONS);
 	auth_db_ers = ers_new(sizeof(struct auth_node),"chrif.cpp::auth_db_ers",ERS_OPT_NONE);
 
 	add_timer_func_list(check_connect_char_server, "check_connect_char_server");
@@ -3,6 +3,7 @@
 
 #include "clif.hpp"
 
+#include <algorithm>
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
@@ -44,6 +45,7 @@
 #include "mercenary.hpp"
 #include "mob.hpp"
 #include "npc.hpp"
+#include "packets.hpp"
 #include "party.hpp"
 #include "pc.hpp"
 #include "pc_groups.hpp"
@@ -64,6 +66,11 @@ static inline uint32 client_tick( t_tick tick ){
 /* for clif_clearunit_delayed */
 static struct eri *delay_clearunit_ers;
 
+/* for clif_spawn_queue_timer */
+#define SPAWN_QUEUE_INTERVAL 100
+/* for clif_move_batch_timer */
+#define MOVE_BATCH_INTERVAL 50
+
 struct s_packet_db packet_db[MAX_PACKET_DB + 1];
 int packet_db_ack[MAX_ACK_FUNC + 1];
 unsigned long color_table[COLOR_MAX];
@@ -851,6 +858,192 @@ void clif_clearflooritem(struct flooritem_data *fitem, int fd)
 }
 
 
+/// Walk packet waiting in the move batch
+struct s_move_batch_entry {
+	int id; ///< Moving unit, 0 if the packet was cancelled
+	int16 m, x, y; ///< Position of the unit when it started to walk
+	bool ally_only; ///< Unit is hidden, see clif_ally_only
+	bool throttled; ///< Not sent to observers further away than move_throttle_range
+	struct PACKET_ZC_NOTIFY_MOVE packet;
+};
+
+/// Walk packets of the current batch, see move_batch
+static std::vector<struct s_move_batch_entry> move_batch;
+
+/// Returns the bit of the map in move_throttle_maps.
+static int clif_move_throttle_maptype(int16 m)
+{
+	struct map_data* mapdata = map_getmapdata(m);
+
+	if( mapdata->flag[MF_BATTLEGROUND] )
+		return 16;
+	if( mapdata_flag_gvg2(mapdata) )
+		return 8;
+	if( mapdata->flag[MF_PVP] )
+		return 4;
+	if( mapdata->flag[MF_TOWN] )
+		return 2;
+	return 1;
+}
+
+/// Queues the walk packet of a unit for the next clif_move_batch_timer.
+/// A packet of the unit that is still waiting is replaced.
+static void clif_move_batch_push(struct unit_data* ud, struct PACKET_ZC_NOTIFY_MOVE* p, t_tick tick)
+{
+	struct block_list* bl = ud->bl;
+	struct s_move_batch_entry* entry;
+
+	if( ud->move_batch > 0 && ud->move_batch <= move_batch.size() && move_batch[ud->move_batch - 1].id == bl->id ) {
+		entry = &move_batch[ud->move_batch - 1];
+	} else {
+		move_batch.emplace_back();
+		ud->move_batch = move_batch.size();
+		entry = &move_batch.back();
+	}
+
+	entry->id = bl->id;
+	entry->m = bl->m;
+	entry->x = bl->x;
+	entry->y = bl->y;
+	entry->ally_only = clif_ally_only;
+	entry->throttled = false;
+	entry->packet = *p;
+
+	if( battle_config.move_throttle_range > 0 && battle_config.move_throttle_maps&clif_move_throttle_maptype(bl->m) ) {
+		if( DIFF_TICK(tick, ud->move_throttle_tick) < battle_config.move_throttle_interval )
+			entry->throttled = true;
+		else
+			ud->move_throttle_tick = tick;
+	}
+}
+
+/// Drops the waiting walk packet of a unit.
+/// Used before packets that replace the walk, like a position fix or the removal of the unit.
+static void clif_move_batch_cancel(struct block_list* bl)
+{
+	struct unit_data* ud = unit_bl2ud(bl);
+
+	if( ud == NULL || ud->move_batch == 0 )
+		return;
+
+	if( ud->move_batch <= move_batch.size() && move_batch[ud->move_batch - 1].id == bl->id )
+		move_batch[ud->move_batch - 1].id = 0;
+	ud->move_batch = 0;
+}
+
+/// Sends the waiting walk packet of a unit to its area right away.
+/// Used before the walk is sent directly to a new observer, who would otherwise get it again
+/// from the batch; the new observer does not know the unit yet and ignores this one.
+static void clif_move_batch_flush(struct block_list* bl)
+{
+	struct unit_data* ud = unit_bl2ud(bl);
+
+	if( ud == NULL || ud->move_batch == 0 )
+		return;
+
+	if( ud->move_batch <= move_batch.size() && move_batch[ud->move_batch - 1].id == bl->id ) {
+		struct s_move_batch_entry* entry = &move_batch[ud->move_batch - 1];
+
+		clif_ally_only = entry->ally_only;
+		clif_send((uint8*)&entry->packet, sizeof(entry->packet), bl, AREA_WOS);
+		clif_ally_only = false;
+		entry->id = 0;
+	}
+	ud->move_batch = 0;
+}
+
+/// Sends the walk packets of one map block to an observer in a single run.
+static int clif_move_batch_sub(struct block_list* bl, va_list ap)
+{
+	struct map_session_data* sd = (struct map_session_data*)bl;
+	struct s_move_batch_entry* begin = va_arg(ap, struct s_move_batch_entry*);
+	struct s_move_batch_entry* end = va_arg(ap, struct s_move_batch_entry*);
+	int fd = sd->fd;
+	bool reserved = false;
+
+	if( !fd || session[fd] == NULL )
+		return 0;
+
+	for( struct s_move_batch_entry* entry = begin; entry != end; entry++ ) {
+		int dx = abs(entry->x - sd->bl.x), dy = abs(entry->y - sd->bl.y);
+
+		if( entry->id == sd->bl.id || dx > AREA_SIZE || dy > AREA_SIZE )
+			continue;
+
+		if( entry->throttled && max(dx, dy) > battle_config.move_throttle_range ) {
+			sd->move_stats.throttled++;
+			continue;
+		}
+
+		if( entry->ally_only && !battle_config.update_enemy_position && !sd->special_state.intravision && !sd->sc.data[SC_INTRAVISION] ) {
+			struct block_list* src = map_id2bl(entry->id);
+
+			if( src == NULL || battle_check_target(src, &sd->bl, BCT_ENEMY) > 0 )
+				continue;
+		}
+
+		if( !reserved ) {// room for the rest of the block
+			WFIFOHEAD(fd, (end - entry) * sizeof(struct PACKET_ZC_NOTIFY_MOVE));
+			reserved = true;
+		}
+		memcpy(WFIFOP(fd, 0), &entry->packet, sizeof(struct PACKET_ZC_NOTIFY_MOVE));
+		WFIFOSET(fd, sizeof(struct PACKET_ZC_NOTIFY_MOVE));
+		sd->move_stats.batched++;
+	}
+
+	return 0;
+}
+
+/// Sends the walk packets collected since the last run, grouped by map block.
+static TIMER_FUNC(clif_move_batch_timer){
+	std::vector<struct s_move_batch_entry> batch;
+	size_t n = 0;
+
+	if( move_batch.empty() )
+		return 0;
+
+	batch.swap(move_batch);
+
+	for( size_t i = 0; i < batch.size(); i++ ) {
+		struct block_list* bl;
+		struct unit_data* ud;
+
+		if( batch[i].id == 0 || (bl = map_id2bl(batch[i].id)) == NULL )
+			continue;
+		if( (ud = unit_bl2ud(bl)) != NULL )
+			ud->move_batch = 0;
+		if( bl->prev == NULL || bl->m != batch[i].m )
+			continue;
+		batch[n++] = batch[i];
+	}
+	batch.resize(n);
+
+	std::sort(batch.begin(), batch.end(), []( const struct s_move_batch_entry& a, const struct s_move_batch_entry& b ){
+		if( a.m != b.m )
+			return a.m < b.m;
+		if( a.y / BLOCK_SIZE != b.y / BLOCK_SIZE )
+			return a.y / BLOCK_SIZE < b.y / BLOCK_SIZE;
+		return a.x / BLOCK_SIZE < b.x / BLOCK_SIZE;
+	});
+
+	for( size_t i = 0; i < batch.size(); ) {
+		size_t j = i + 1;
+		int16 bx = batch[i].x / BLOCK_SIZE, by = batch[i].y / BLOCK_SIZE;
+
+		while( j < batch.size() && batch[j].m == batch[i].m && batch[j].x / BLOCK_SIZE == bx && batch[j].y / BLOCK_SIZE == by )
+			j++;
+
+		map_foreachinallarea(clif_move_batch_sub, batch[i].m,
+			bx * BLOCK_SIZE - AREA_SIZE, by * BLOCK_SIZE - AREA_SIZE,
+			(bx + 1) * BLOCK_SIZE - 1 + AREA_SIZE, (by + 1) * BLOCK_SIZE - 1 + AREA_SIZE,
+			BL_PC, &batch[i], &batch[0] + j);
+		i = j;
+	}
+
+	return 0;
+}
+
+
 /// Makes a unit (char, npc, mob, homun) disappear to one client (ZC_NOTIFY_VANISH).
 /// 0080 <id>.L <type>.B
 /// type:
@@ -881,6 +1074,7 @@ void clif_clearunit_area(struct block_list* bl, clr_type type)
 	unsigned char buf[8];
 
 	nullpo_retv(bl);
+	clif_move_batch_cancel(bl);
 
 	WBUFW(buf,0) = 0x80;
 	WBUFL(buf,2) = bl->id;
@@ -974,65 +1168,212 @@ static int clif_setlevel(struct block_list* bl) {
 	return lv;
 }
 
+#if PACKETVER >= 20091103
+/// Fills the fields the spawn, idle and walking packets of a unit have in common.
+/// @return Length of the packet, the unused part of the name is not sent
+template <typename T>
+static int clif_set_unit_common(struct block_list* bl, T* p, int16 header)
+{
+	struct map_session_data* sd = BL_CAST(BL_PC, bl);
+	struct status_change* sc = status_get_sc(bl);
+	struct view_data* vd = status_get_viewdata(bl);
+
+	p->PacketType = header;
+	p->objecttype = clif_bl_type(bl);
+	p->AID = bl->id;
+#if PACKETVER >= 20131223
+	p->GID = (sd) ? sd->status.char_id : 0;	// GID/CCODE
+#endif
+	p->speed = status_get_speed(bl);
+	p->bodyState = (sc) ? sc->opt1 : 0;
+	p->healthState = (sc) ? sc->opt2 : 0;
+	p->effectState = (sc) ? sc->option : 0;
+	p->job = vd->class_;
+	p->head = vd->hair_style;
+	p->weapon = vd->weapon;
+	p->shield = vd->shield;
+	p->accessory = vd->head_bottom;
+	p->accessory2 = vd->head_top;
+	p->accessory3 = vd->head_mid;
+	p->headpalette = vd->hair_color;
+	p->bodypalette = vd->cloth_color;
+#if PACKETVER >= 20110111
+	p->robe = vd->robe;
+#endif
+	p->GUID = status_get_guild_id(bl);
+	p->GEmblemVer = status_get_emblem_id(bl);
+	p->honor = (sd) ? sd->status.manner : 0;
+	p->virtue = (sc) ? sc->opt3 : 0;
+	p->isPKModeON = (sd) ? sd->status.karma : 0;
+	p->sex = vd->sex;
+	p->xSize = p->ySize = (sd) ? 5 : 0;
+	p->clevel = clif_setlevel(bl);
+	p->font = (sd) ? sd->status.font : 0;
+#if PACKETVER >= 20120221
+	p->isBoss = ( bl->type == BL_MOB && (((TBL_MOB*)bl)->db->mexp > 0) ) ? 1 : 0;
+#endif
+#if PACKETVER >= 20150513
+	p->body = vd->body_style;
+#endif
+	safestrncpy(p->name, status_get_name(bl), NAME_LENGTH);
+	p->PacketLength = (int16)(sizeof(T) - NAME_LENGTH + strlen(p->name));
+
+	return p->PacketLength;
+}
+
+/// Fills the fields that change too often to be part of the cached appearance.
+/// opt3 is changed by many status changes that send no option update, so it is never cached.
+template <typename T>
+static void clif_set_unit_volatile(struct block_list* bl, T* p)
+{
+	struct map_session_data* sd = BL_CAST(BL_PC, bl);
+	struct status_change* sc = status_get_sc(bl);
+
+	p->headDir = (sd) ? sd->head_dir : 0;
+	p->virtue = (sc) ? sc->opt3 : 0;
+#if PACKETVER >= 20120221
+	if ( battle_config.monster_hp_bars_info && bl->type == BL_MOB && !map_getmapflag(bl->m, MF_HIDEMOBHPBAR) && (status_get_hp(bl) < status_get_max_hp(bl)) ) {
+		p->maxHP = status_get_max_hp(bl);
+		p->HP = status_get_hp(bl);
+	} else {
+		p->maxHP = -1;
+		p->HP = -1;
+	}
+#endif
+}
+
+/// Fills the standing position of a unit, guild flags show the emblem instead of headgears.
+template <typename T>
+static void clif_set_unit_standing(struct block_list* bl, T* p)
+{
+	WBUFPOS(p->PosDir, 0, bl->x, bl->y, unit_getdir(bl));
+
+	if( bl->type == BL_NPC && status_get_viewdata(bl)->class_ == JT_GUILD_FLAG )
+	{	//The hell, why flags work like this?
+		p->accessory = status_get_emblem_id(bl);
+		p->accessory2 = GetWord(status_get_guild_id(bl), 1);
+		p->accessory3 = GetWord(status_get_guild_id(bl), 0);
+	}
+}
+
+/// Appearance of a unit as it is sent in the standing packet.
+/// Everything but the position, state and the fields of clif_set_unit_volatile
+/// is encoded once and reused until clif_appearance_invalidate is called.
+struct s_unit_appearance {
+	bool valid;
+	struct PACKET_ZC_NOTIFY_STANDENTRY packet;
+};
+
+/// Offsets of the field groups in the standing packet, the spawn and walking packets are assembled from them
+#define UNIT_LOOK_OFFSET offsetof(struct PACKET_ZC_NOTIFY_STANDENTRY, accessory2)
+#define UNIT_LOOK_LENGTH (offsetof(struct PACKET_ZC_NOTIFY_STANDENTRY, PosDir) - UNIT_LOOK_OFFSET)
+#define UNIT_TAIL_OFFSET offsetof(struct PACKET_ZC_NOTIFY_STANDENTRY, clevel)
+
+/// Returns the cached appearance of a unit, encoding it if it has changed.
+/// Units without unit data get their appearance encoded into the buffer every time.
+static struct PACKET_ZC_NOTIFY_STANDENTRY* clif_appearance_get(struct block_list* bl, struct PACKET_ZC_NOTIFY_STANDENTRY* buffer)
+{
+	struct unit_data* ud = unit_bl2ud(bl);
+
+	if( ud == NULL ) {
+		clif_set_unit_common(bl, buffer, HEADER_ZC_NOTIFY_STANDENTRY);
+		return buffer;
+	}
+
+	if( ud->appearance == NULL )
+		CREATE(ud->appearance, struct s_unit_appearance, 1);
+	if( !ud->appearance->valid ) {
+		clif_set_unit_common(bl, &ud->appearance->packet, HEADER_ZC_NOTIFY_STANDENTRY);
+		ud->appearance->valid = true;
+	}
+
+	return &ud->appearance->packet;
+}
+#endif
+
+/// Marks the cached appearance of a unit as outdated.
+/// Has to be called whenever a field of clif_set_unit_common changes:
+/// view data, options (but opt3), guild, name, speed, level, manner or font.
+void clif_appearance_invalidate(struct block_list* bl)
+{
+#if PACKETVER >= 20091103
+	struct unit_data* ud;
+
+	nullpo_retv(bl);
+
+	if( (ud = unit_bl2ud(bl)) != NULL && ud->appearance != NULL )
+		ud->appearance->valid = false;
+#endif
+}
+
+/// Frees the cached appearance of a unit that is being removed.
+void clif_appearance_free(struct block_list* bl)
+{
+	struct unit_data* ud;
+
+	nullpo_retv(bl);
+
+	if( (ud = unit_bl2ud(bl)) != NULL && ud->appearance != NULL ) {
+		aFree(ud->appearance);
+		ud->appearance = NULL;
+	}
+}
+
 /*==========================================
  * Prepares 'unit standing/spawning' packet
  *------------------------------------------*/
 static int clif_set_unit_idle(struct block_list* bl, unsigned char* buffer, bool spawn)
 {
+#if PACKETVER >= 20091103
+	struct PACKET_ZC_NOTIFY_STANDENTRY tmp;
+	struct PACKET_ZC_NOTIFY_STANDENTRY* cache = clif_appearance_get(bl, &tmp);
+	int len;
+
+	if( spawn ) {
+		struct PACKET_ZC_NOTIFY_NEWENTRY* p = (struct PACKET_ZC_NOTIFY_NEWENTRY*)buffer;
+
+		// identical to the standing packet without the state
+		len = cache->PacketLength - 1;
+		memcpy(p, cache, offsetof(struct PACKET_ZC_NOTIFY_STANDENTRY, state));
+		memcpy(&p->clevel, &cache->clevel, cache->PacketLength - UNIT_TAIL_OFFSET);
+		p->PacketType = HEADER_ZC_NOTIFY_NEWENTRY;
+		p->PacketLength = len;
+		clif_set_unit_volatile(bl, p);
+		clif_set_unit_standing(bl, p);
+	} else {
+		struct PACKET_ZC_NOTIFY_STANDENTRY* p = (struct PACKET_ZC_NOTIFY_STANDENTRY*)buffer;
+
+		len = cache->PacketLength;
+		memcpy(p, cache, len);
+		clif_set_unit_volatile(bl, p);
+		clif_set_unit_standing(bl, p);
+		p->state = status_get_viewdata(bl)->dead_sit;
+	}
+
+	return len;
+#else
 	struct map_session_data* sd;
 	struct status_change* sc = status_get_sc(bl);
 	struct view_data* vd = status_get_viewdata(bl);
-
 	unsigned char *buf = WBUFP(buffer, 0);
-#if PACKETVER < 20091103
 	bool type = !pcdb_checkid(vd->class_);
-#endif
 	unsigned short offset = 0;
-#if PACKETVER >= 20091103
-	const char *name;
-#endif
 	sd = BL_CAST(BL_PC, bl);
 
-#if PACKETVER < 20091103
 	if(type)
 		WBUFW(buf,0) = spawn ? 0x7c : 0x78;
 	else
-#endif
 #if PACKETVER < 4
 		WBUFW(buf,0) = spawn ? 0x79 : 0x78;
 #elif PACKETVER < 7
 		WBUFW(buf,0) = spawn ? 0x1d9 : 0x1d8;
 #elif PACKETVER < 20080102
 		WBUFW(buf,0) = spawn ? 0x22b : 0x22a;
-#elif PACKETVER < 20091103
-		WBUFW(buf,0) = spawn ? 0x2ed : 0x2ee;
-#elif PACKETVER < 20101124
-		WBUFW(buf,0) = spawn ? 0x7f8 : 0x7f9;
-#elif PACKETVER < 20120221
-		WBUFW(buf,0) = spawn ? 0x858 : 0x857;
-#elif PACKETVER < 20131223
-		WBUFW(buf,0) = spawn ? 0x90f : 0x915;
-#elif PACKETVER < 20150513
-		WBUFW(buf,0) = spawn ? 0x9dc : 0x9dd;
 #else
-		WBUFW(buf,0) = spawn ? 0x9fe : 0x9ff;
+		WBUFW(buf,0) = spawn ? 0x2ed : 0x2ee;
 #endif
 
-#if PACKETVER >= 20091103
-	name = status_get_name(bl);
-#if PACKETVER < 20110111
-	WBUFW(buf,2) = (uint16)((spawn ? 62 : 63)+strlen(name));
-#elif PACKETVER < 20120221
-	WBUFW(buf,2) = (uint16)((spawn ? 64 : 65)+strlen(name));
-#elif PACKETVER < 20130807
-	WBUFW(buf,2) = (uint16)((spawn ? 77 : 78)+strlen(name));
-#else
-	WBUFW(buf,2) = (uint16)((spawn ? 79 : 80)+strlen(name));
-#endif
-	WBUFB(buf,4) = clif_bl_type(bl);
-	offset+=3;
-	buf = WBUFP(buffer,offset);
-#elif PACKETVER >= 20071106
+#if PACKETVER >= 20071106
 	if (type) { //Non-player packets
 		WBUFB(buf,2) = clif_bl_type(bl);
 		offset++;
@@ -1040,15 +1381,9 @@ static int clif_set_unit_idle(struct block_list* bl, unsigned char* buffer, bool
 	}
 #endif
 	WBUFL(buf, 2) = bl->id;
-#if PACKETVER >= 20131223
-	WBUFL(buf,6) = (sd) ? sd->status.char_id : 0;	// GID/CCODE
-	offset+=4;
-	buf = WBUFP(buffer,offset);
-#endif
 	WBUFW(buf, 6) = status_get_speed(bl);
 	WBUFW(buf, 8) = (sc)? sc->opt1 : 0;
 	WBUFW(buf,10) = (sc)? sc->opt2 : 0;
-#if PACKETVER < 20091103
 	if (type&&spawn) { //uses an older and different packet structure
 		WBUFW(buf,12) = (sc)? sc->option : 0;
 		WBUFW(buf,14) = vd->hair_style;
@@ -1057,12 +1392,7 @@ static int clif_set_unit_idle(struct block_list* bl, unsigned char* buffer, bool
 		WBUFW(buf,20) = vd->class_; //Pet armor (ignored by client)
 		WBUFW(buf,22) = vd->shield;
 	} else {
-#endif
-#if PACKETVER >= 20091103
-		WBUFL(buf,12) = (sc)? sc->option : 0;
-		offset+=2;
-		buf = WBUFP(buffer,offset);
-#elif PACKETVER >= 7
+#if PACKETVER >= 7
 		if (!type) {
 			WBUFL(buf,12) = (sc)? sc->option : 0;
 			offset+=2;
@@ -1082,9 +1412,7 @@ static int clif_set_unit_idle(struct block_list* bl, unsigned char* buffer, bool
 		WBUFW(buf,20) = vd->shield;
 		WBUFW(buf,22) = vd->head_bottom;
 #endif
-#if PACKETVER < 20091103
 	}
-#endif
 	WBUFW(buf,24) = vd->head_top;
 	WBUFW(buf,26) = vd->head_mid;
 
@@ -1098,7 +1426,6 @@ static int clif_set_unit_idle(struct block_list* bl, unsigned char* buffer, bool
 	WBUFW(buf,28) = vd->hair_color;
 	WBUFW(buf,30) = vd->cloth_color;
 	WBUFW(buf,32) = (sd)? sd->head_dir : 0;
-#if PACKETVER < 20091103
 	if (type&&spawn) { //End of packet 0x7c
 		WBUFB(buf,34) = (sd) ? sd->status.karma : 0; // karma
 		WBUFB(buf,35) = vd->sex;
@@ -1107,20 +1434,10 @@ static int clif_set_unit_idle(struct block_list* bl, unsigned char* buffer, bool
 		WBUFB(buf,40) = 0;
 		return packet_len(0x7c);
 	}
-#endif
-#if PACKETVER >= 20110111
-	WBUFW(buf,34) = vd->robe;
-	offset+= 2;
-	buf = WBUFP(buffer,offset);
-#endif
 	WBUFL(buf,34) = status_get_guild_id(bl);
 	WBUFW(buf,38) = status_get_emblem_id(bl);
 	WBUFW(buf,40) = (sd)? sd->status.manner : 0;
-#if PACKETVER >= 20091103
-	WBUFL(buf,42) = (sc)? sc->opt3 : 0;
-	offset+=2;
-	buf = WBUFP(buffer,offset);
-#elif PACKETVER >= 7
+#if PACKETVER >= 7
 	if (!type) {
 		WBUFL(buf,42) = (sc)? sc->opt3 : 0;
 		offset+=2;
@@ -1141,37 +1458,11 @@ static int clif_set_unit_idle(struct block_list* bl, unsigned char* buffer, bool
 		buf = WBUFP(buffer,offset);
 	}
 	WBUFW(buf,51) = clif_setlevel(bl);
-#if PACKETVER < 20091103
 	if (type) //End for non-player packet
 		return packet_len(WBUFW(buffer,0));
-#endif
 #if PACKETVER >= 20080102
 	WBUFW(buf,53) = (sd ? sd->status.font : 0);
 #endif
-#if PACKETVER >= 20120221
-	if ( battle_config.monster_hp_bars_info && bl->type == BL_MOB && !map_getmapflag(bl->m, MF_HIDEMOBHPBAR) && (status_get_hp(bl) < status_get_max_hp(bl)) ) {
-		WBUFL(buf,55) = status_get_max_hp(bl);		// maxHP
-		WBUFL(buf,59) = status_get_hp(bl);		// HP
-	} else {
-		WBUFL(buf,55) = -1;		// maxHP
-		WBUFL(buf,59) = -1;		// HP
-	}
-
-	WBUFB(buf,63) = ( bl->type == BL_MOB && (((TBL_MOB*)bl)->db->mexp > 0) ) ? 1 : 0;		// isBoss
-#endif
-#if PACKETVER >= 20150513
-	WBUFW(buf,64) = vd->body_style;		// body
-	offset+= 2;
-	buf = WBUFP(buffer,offset);
-#endif
-#if PACKETVER >= 20091103
-#if PACKETVER >= 20120221
-	safestrncpy(WBUFCP(buf,64), name, NAME_LENGTH);
-#else
-	safestrncpy(WBUFCP(buf,55), name, NAME_LENGTH);
-#endif
-	return WBUFW(buffer,2);
-#else
 	return packet_len(WBUFW(buffer,0));
 #endif
 }
@@ -1181,6 +1472,25 @@ static int clif_set_unit_idle(struct block_list* bl, unsigned char* buffer, bool
  *------------------------------------------*/
 static int clif_set_unit_walking(struct block_list* bl, struct unit_data* ud, unsigned char* buffer)
 {
+#if PACKETVER >= 20091103
+	struct PACKET_ZC_NOTIFY_MOVEENTRY* p = (struct PACKET_ZC_NOTIFY_MOVEENTRY*)buffer;
+	struct PACKET_ZC_NOTIFY_STANDENTRY tmp;
+	struct PACKET_ZC_NOTIFY_STANDENTRY* cache = clif_appearance_get(bl, &tmp);
+	int len = cache->PacketLength - UNIT_TAIL_OFFSET + offsetof(struct PACKET_ZC_NOTIFY_MOVEENTRY, clevel);
+
+	memcpy(p, cache, UNIT_LOOK_OFFSET);
+	memcpy(&p->accessory2, &cache->accessory2, UNIT_LOOK_LENGTH);
+	memcpy(&p->clevel, &cache->clevel, cache->PacketLength - UNIT_TAIL_OFFSET);
+	p->PacketType = HEADER_ZC_NOTIFY_MOVEENTRY;
+	p->PacketLength = len;
+	p->xSize = cache->xSize;
+	p->ySize = cache->ySize;
+	clif_set_unit_volatile(bl, p);
+	p->moveStartTime = client_tick(gettick());
+	WBUFPOS2(p->MoveData, 0, bl->x, bl->y, ud->to_x, ud->to_y, 8, 8);
+
+	return len;
+#else
 	struct map_session_data* sd;
 	struct status_change* sc = status_get_sc(bl);
 	struct view_data* vd = status_get_viewdata(bl);
@@ -1189,9 +1499,6 @@ static int clif_set_unit_walking(struct block_list* bl, struct unit_data* ud, un
 #if PACKETVER >= 7
 	unsigned short offset = 0;
 #endif
-#if PACKETVER >= 20091103
-	const char *name;
-#endif
 
 	sd = BL_CAST(BL_PC, bl);
 
@@ -1201,45 +1508,16 @@ static int clif_set_unit_walking(struct block_list* bl, struct unit_data* ud, un
 	WBUFW(buf, 0) = 0x1da;
 #elif PACKETVER < 20080102
 	WBUFW(buf, 0) = 0x22c;
-#elif PACKETVER < 20091103
-	WBUFW(buf, 0) = 0x2ec;
-#elif PACKETVER < 20101124
-	WBUFW(buf, 0) = 0x7f7;
-#elif PACKETVER < 20120221
-	WBUFW(buf, 0) = 0x856;
-#elif PACKETVER < 20131223
-	WBUFW(buf, 0) = 0x914;
-#elif PACKETVER < 20150513
-	WBUFW(buf, 0) = 0x9db;
 #else
-	WBUFW(buf, 0) = 0x9fd;
+	WBUFW(buf, 0) = 0x2ec;
 #endif
 
-#if PACKETVER >= 20091103
-	name = status_get_name(bl);
-#if PACKETVER < 20110111
-	WBUFW(buf, 2) = (uint16)(69+strlen(name));
-#elif PACKETVER < 20120221
-	WBUFW(buf, 2) = (uint16)(71+strlen(name));
-#elif PACKETVER < 20130807
-	WBUFW(buf, 2) = (uint16)(84+strlen(name));
-#else
-	WBUFW(buf, 2) = (uint16)(86+strlen(name));
-#endif
-	offset+=2;
-	buf = WBUFP(buffer,offset);
-#endif
 #if PACKETVER >= 20071106
 	WBUFB(buf, 2) = clif_bl_type(bl);
 	offset++;
 	buf = WBUFP(buffer,offset);
 #endif
 	WBUFL(buf, 2) = bl->id;
-#if PACKETVER >= 20131223
-	WBUFL(buf,6) = (sd) ? sd->status.char_id : 0;	// GID/CCODE
-	offset+=4;
-	buf = WBUFP(buffer,offset);
-#endif
 	WBUFW(buf, 6) = status_get_speed(bl);
 	WBUFW(buf, 8) = (sc)? sc->opt1 : 0;
 	WBUFW(buf,10) = (sc)? sc->opt2 : 0;
@@ -1267,11 +1545,6 @@ static int clif_set_unit_walking(struct block_list* bl, struct unit_data* ud, un
 	WBUFW(buf,32) = vd->hair_color;
 	WBUFW(buf,34) = vd->cloth_color;
 	WBUFW(buf,36) = (sd)? sd->head_dir : 0;
-#if PACKETVER >= 20110111
-	WBUFW(buf,38) = vd->robe;
-	offset+= 2;
-	buf = WBUFP(buffer,offset);
-#endif
 	WBUFL(buf,38) = status_get_guild_id(bl);
 	WBUFW(buf,42) = status_get_emblem_id(bl);
 	WBUFW(buf,44) = (sd)? sd->status.manner : 0;
@@ -1291,30 +1564,6 @@ static int clif_set_unit_walking(struct block_list* bl, struct unit_data* ud, un
 #if PACKETVER >= 20080102
 	WBUFW(buf,60) = (sd ? sd->status.font : 0);
 #endif
-#if PACKETVER >= 20120221
-	if ( battle_config.monster_hp_bars_info && !map_getmapflag(bl->m, MF_HIDEMOBHPBAR) && bl->type == BL_MOB && (status_get_hp(bl) < status_get_max_hp(bl)) ) {
-		WBUFL(buf,62) = status_get_max_hp(bl);		// maxHP
-		WBUFL(buf,66) = status_get_hp(bl);		// HP
-	} else {
-		WBUFL(buf,62) = -1;		// maxHP
-		WBUFL(buf,66) = -1;		// HP
-	}
-
-	WBUFB(buf,70) = ( bl->type == BL_MOB && (((TBL_MOB*)bl)->db->mexp > 0) ) ? 1 : 0;		// isBoss
-#endif
-#if PACKETVER >= 20150513
-	WBUFW(buf,71) = vd->body_style;		// body
-	offset+= 2;
-	buf = WBUFP(buffer,offset);
-#endif
-#if PACKETVER >= 20091103
-#if PACKETVER >= 20120221
-	safestrncpy(WBUFCP(buf,71), name, NAME_LENGTH);
-#else
-	safestrncpy(WBUFCP(buf,62), name, NAME_LENGTH);
-#endif
-	return WBUFW(buffer,2);
-#else
 	return packet_len(WBUFW(buffer,0));
 #endif
 }
@@ -1452,6 +1701,8 @@ int clif_spawn(struct block_list *bl)
 	if(bl->type == BL_NPC && !((TBL_NPC*)bl)->chat_id && (((TBL_NPC*)bl)->sc.option&OPTION_INVISIBLE))
 		return 0;
 
+	clif_appearance_invalidate(bl); // (re)spawns always send the current appearance
+	clif_move_batch_cancel(bl); // replaced by the spawn
 	len = clif_set_unit_idle(bl, buf, (bl->type == BL_NPC && vd->dead_sit ? false : true));
 	clif_send(buf, len, bl, AREA_WOS);
 	if (disguised(bl))
@@ -1714,11 +1965,12 @@ void clif_walkok(struct map_session_data *sd)
 {
 	int fd=sd->fd;
 
-	WFIFOHEAD(fd, packet_len(0x87));
-	WFIFOW(fd,0)=0x87;
-	WFIFOL(fd,2)=client_tick(gettick());
-	WFIFOPOS2(fd,6,sd->bl.x,sd->bl.y,sd->ud.to_x,sd->ud.to_y,8,8);
-	WFIFOSET(fd,packet_len(0x87));
+	WFIFOHEAD(fd, sizeof(struct PACKET_ZC_NOTIFY_PLAYERMOVE));
+	struct PACKET_ZC_NOTIFY_PLAYERMOVE* p = (struct PACKET_ZC_NOTIFY_PLAYERMOVE*)WFIFOP(fd,0);
+	p->PacketType = HEADER_ZC_NOTIFY_PLAYERMOVE;
+	p->moveStartTime = client_tick(gettick());
+	WBUFPOS2(p->MoveData,0,sd->bl.x,sd->bl.y,sd->ud.to_x,sd->ud.to_y,8,8);
+	WFIFOSET(fd, sizeof(struct PACKET_ZC_NOTIFY_PLAYERMOVE));
 }
 
 
@@ -1731,6 +1983,7 @@ static void clif_move2(struct block_list *bl, struct view_data *vd, struct unit_
 	if ((sc = status_get_sc(bl)) && sc->option&(OPTION_HIDE|OPTION_CLOAK|OPTION_INVISIBLE|OPTION_CHASEWALK))
 		clif_ally_only = true;
 
+	clif_move_batch_cancel(bl);
 	len = clif_set_unit_walking(bl,ud,buf);
 	clif_send(buf,len,bl,AREA_WOS);
 	if (disguised(bl))
@@ -1777,7 +2030,7 @@ static void clif_move2(struct block_list *bl, struct view_data *vd, struct unit_
 /// Note: unit must not be self
 void clif_move(struct unit_data *ud)
 {
-	unsigned char buf[16];
+	struct PACKET_ZC_NOTIFY_MOVE p;
 	struct view_data* vd;
 	struct block_list* bl = ud->bl;
 	struct status_change *sc = NULL;
@@ -1789,11 +2042,11 @@ void clif_move(struct unit_data *ud)
 	else if( vd->class_ == JT_INVISIBLE ){
 		// If the player was disguised we still need to update the disguised unit, since the main unit will be updated through clif_walkok
 		if(disguised(bl)) {
-			WBUFW(buf,0)=0x86;
-			WBUFL(buf,2)=-bl->id;
-			WBUFPOS2(buf,6,bl->x,bl->y,ud->to_x,ud->to_y,8,8);
-			WBUFL(buf,12)=client_tick(gettick());
-			clif_send(buf, packet_len(0x86), bl, SELF);
+			p.PacketType = HEADER_ZC_NOTIFY_MOVE;
+			p.GID = -bl->id;
+			WBUFPOS2(p.MoveData,0,bl->x,bl->y,ud->to_x,ud->to_y,8,8);
+			p.moveStartTime = client_tick(gettick());
+			clif_send((uint8*)&p, sizeof(p), bl, SELF);
 		}
 		return;
 	}
@@ -1815,14 +2068,17 @@ void clif_move(struct unit_data *ud)
 	if ((sc = status_get_sc(bl)) && sc->option&(OPTION_HIDE|OPTION_CLOAK|OPTION_INVISIBLE|OPTION_CHASEWALK))
 		clif_ally_only = true;
 
-	WBUFW(buf,0)=0x86;
-	WBUFL(buf,2)=bl->id;
-	WBUFPOS2(buf,6,bl->x,bl->y,ud->to_x,ud->to_y,8,8);
-	WBUFL(buf,12)=client_tick(gettick());
-	clif_send(buf, packet_len(0x86), bl, AREA_WOS);
+	p.PacketType = HEADER_ZC_NOTIFY_MOVE;
+	p.GID = bl->id;
+	WBUFPOS2(p.MoveData,0,bl->x,bl->y,ud->to_x,ud->to_y,8,8);
+	p.moveStartTime = client_tick(gettick());
+	if( battle_config.move_batch )
+		clif_move_batch_push(ud, &p, gettick());
+	else
+		clif_send((uint8*)&p, sizeof(p), bl, AREA_WOS);
 	if (disguised(bl)) {
-		WBUFL(buf,2)=-bl->id;
-		clif_send(buf, packet_len(0x86), bl, SELF);
+		p.GID = -bl->id;
+		clif_send((uint8*)&p, sizeof(p), bl, SELF);
 	}
 	clif_ally_only = false;
 }
@@ -1919,6 +2175,7 @@ void clif_fixpos(struct block_list *bl)
 {
 	unsigned char buf[10];
 	nullpo_retv(bl);
+	clif_move_batch_cancel(bl);
 
 	WBUFW(buf,0) = 0x88;
 	WBUFL(buf,2) = bl->id;
@@ -3116,17 +3373,32 @@ void clif_guild_xy_remove(struct map_session_data *sd)
 	clif_send(buf,packet_len(0x1eb),&sd->bl,GUILD_SAMEMAP_WOS);
 }
 
+/// Fills the HP bar of a character (ZC_NOTIFY_HP_TO_GROUPM).
+static void clif_set_hp_to_groupm(struct PACKET_ZC_NOTIFY_HP_TO_GROUPM* p, uint32 id, unsigned int hp, unsigned int maxhp)
+{
+	p->PacketType = HEADER_ZC_NOTIFY_HP_TO_GROUPM;
+	p->GID = id;
+#if PACKETVER < 20100126
+	if( maxhp > INT16_MAX )
+	{// To correctly display the %hp bar. [Skotlex]
+		p->hp = hp/(maxhp/100);
+		p->maxhp = 100;
+	} else {
+		p->hp = hp;
+		p->maxhp = maxhp;
+	}
+#else
+	p->hp = hp;
+	p->maxhp = maxhp;
+#endif
+}
+
 /*==========================================
  *
  *------------------------------------------*/
 static int clif_hpmeter_sub(struct block_list *bl, va_list ap)
 {
 	struct map_session_data *sd, *tsd;
-#if PACKETVER < 20100126
-	const int cmd = 0x106;
-#else
-	const int cmd = 0x80e;
-#endif
 
 	sd = va_arg(ap, struct map_session_data *);
 	tsd = (TBL_PC *)bl;
@@ -3139,23 +3411,7 @@ static int clif_hpmeter_sub(struct block_list *bl, va_list ap)
 
 	if( !pc_has_permission(tsd, PC_PERM_VIEW_HPMETER) )
 		return 0;
-	WFIFOHEAD(tsd->fd,packet_len(cmd));
-	WFIFOW(tsd->fd,0) = cmd;
-	WFIFOL(tsd->fd,2) = sd->status.account_id;
-#if PACKETVER < 20100126
-	if( sd->battle_status.max_hp > INT16_MAX )
-	{ //To correctly display the %hp bar. [Skotlex]
-		WFIFOW(tsd->fd,6) = sd->battle_status.hp/(sd->battle_status.max_hp/100);
-		WFIFOW(tsd->fd,8) = 100;
-	} else {
-		WFIFOW(tsd->fd,6) = sd->battle_status.hp;
-		WFIFOW(tsd->fd,8) = sd->battle_status.max_hp;
-	}
-#else
-	WFIFOL(tsd->fd,6) = sd->battle_status.hp;
-	WFIFOL(tsd->fd,10) = sd->battle_status.max_hp;
-#endif
-	WFIFOSET(tsd->fd,packet_len(cmd));
+	clif_hpmeter_single(tsd->fd, sd->status.account_id, sd->battle_status.hp, sd->battle_status.max_hp);
 	return 0;
 }
 
@@ -3455,6 +3711,8 @@ void clif_changestatus(struct map_session_data* sd,int type,int val)
 
 	nullpo_retv(sd);
 
+	clif_appearance_invalidate(&sd->bl);
+
 	WBUFW(buf,0)=0x1ab;
 	WBUFL(buf,2)=sd->bl.id;
 	WBUFW(buf,6)=type;
@@ -3505,6 +3763,7 @@ void clif_changelook(struct block_list *bl, int type, int val) {
 	sd = BL_CAST(BL_PC, bl);
 	sc = status_get_sc(bl);
 	vd = status_get_viewdata(bl);
+	clif_appearance_invalidate(bl);
 
 	if( vd ) //temp hack to let Warp Portal change appearance
 		switch(type) {
@@ -3944,6 +4203,7 @@ void clif_changeoption(struct block_list* bl)
 	sc = status_get_sc(bl);
 	if (!sc) return; //How can an option change if there's no sc?
 	sd = BL_CAST(BL_PC, bl);
+	clif_appearance_invalidate(bl);
 
 #if PACKETVER >= 7
 	WBUFW(buf,0) = 0x229;
@@ -3998,6 +4258,7 @@ void clif_changeoption2(struct block_list* bl)
 
 	sc = status_get_sc(bl);
 	if (!sc) return; //How can an option change if there's no sc?
+	clif_appearance_invalidate(bl);
 
 	WBUFW(buf,0) = 0x28a;
 	WBUFL(buf,2) = bl->id;
@@ -4657,6 +4918,8 @@ void clif_getareachar_unit(struct map_session_data* sd,struct block_list *bl)
 		return;
 
 	ud = unit_bl2ud(bl);
+	if( ud && ud->walktimer != INVALID_TIMER )
+		clif_move_batch_flush(bl);
 	len = ( ud && ud->walktimer != INVALID_TIMER ) ? clif_set_unit_walking(bl,ud,buf) : clif_set_unit_idle(bl,buf,false);
 	clif_send(buf,len,&sd->bl,SELF);
 
@@ -4794,20 +5057,10 @@ static int clif_hallucination_damage()
 ///     13 = multi-hit critical
 int clif_damage(struct block_list* src, struct block_list* dst, t_tick tick, int sdelay, int ddelay, int64 sdamage, int div, enum e_damage_type type, int64 sdamage2, bool spdamage)
 {
-	unsigned char buf[34];
+	struct PACKET_ZC_NOTIFY_ACT p;
 	struct status_change *sc;
 	int damage = (int)cap_value(sdamage,INT_MIN,INT_MAX);
 	int damage2 = (int)cap_value(sdamage2,INT_MIN,INT_MAX);
-#if PACKETVER < 20071113
-	const int cmd = 0x8a;
-	int offset = 0;
-#elif PACKETVER < 20131223
-	const int cmd = 0x2e1;
-	int offset = 2;
-#else
-	const int cmd = 0x8c8;
-	int offset = 3;
-#endif
 
 	nullpo_ret(src);
 	nullpo_ret(dst);
@@ -4822,54 +5075,43 @@ int clif_damage(struct block_list* src, struct block_list* dst, t_tick tick, int
 		}
 	}
 
-	WBUFW(buf,0) = cmd;
-	WBUFL(buf,2) = src->id;
-	WBUFL(buf,6) = dst->id;
-	WBUFL(buf,10) = client_tick(tick);
-	WBUFL(buf,14) = sdelay;
-	WBUFL(buf,18) = ddelay;
+	p.PacketType = HEADER_ZC_NOTIFY_ACT;
+	p.srcID = src->id;
+	p.targetID = dst->id;
+	p.serverTick = client_tick(tick);
+	p.srcSpeed = sdelay;
+	p.dmgSpeed = ddelay;
 	if (battle_config.hide_woe_damage && map_flag_gvg(src->m)) {
-#if PACKETVER < 20071113
-		WBUFW(buf,22) = damage ? div : 0;
-		WBUFW(buf,27+offset) = damage2 ? div : 0;
-#else
-		WBUFL(buf, 22) = damage ? div : 0;
-		WBUFL(buf, 27 + offset) = damage2 ? div : 0;
-#endif
+		p.damage = damage ? div : 0;
+		p.leftDamage = damage2 ? div : 0;
 	} else {
 #if PACKETVER < 20071113
-		WBUFW(buf,22) = min(damage, INT16_MAX);
-		WBUFW(buf,27+offset) = damage2;
+		p.damage = min(damage, INT16_MAX);
 #else
-		WBUFL(buf,22) = damage;
-		WBUFL(buf,27+offset) = damage2;
+		p.damage = damage;
 #endif
+		p.leftDamage = damage2;
 	}
 #if PACKETVER >= 20131223
-	WBUFB(buf,26) = (spdamage) ? 1 : 0; // IsSPDamage - Displays blue digits.
+	p.isSPDamage = (spdamage) ? 1 : 0; // IsSPDamage - Displays blue digits.
 #endif
-	WBUFW(buf,24+offset) = div;
-	WBUFB(buf,26+offset) = type;
+	p.count = div;
+	p.action = type;
 
 	if(disguised(dst)) {
-		clif_send(buf, packet_len(cmd), dst, AREA_WOS);
-		WBUFL(buf,6) = -dst->id;
-		clif_send(buf, packet_len(cmd), dst, SELF);
+		clif_send((uint8*)&p, sizeof(p), dst, AREA_WOS);
+		p.targetID = -dst->id;
+		clif_send((uint8*)&p, sizeof(p), dst, SELF);
 	} else
-		clif_send(buf, packet_len(cmd), dst, AREA);
+		clif_send((uint8*)&p, sizeof(p), dst, AREA);
 
 	if(disguised(src)) {
-		WBUFL(buf,2) = -src->id;
+		p.srcID = -src->id;
 		if (disguised(dst))
-			WBUFL(buf,6) = dst->id;
-#if PACKETVER < 20071113
-		if(damage > 0) WBUFW(buf,22) = -1;
-		if(damage2 > 0) WBUFW(buf,27) = -1;
-#else
-		if(damage > 0) WBUFL(buf,22) = -1;
-		if(damage2 > 0) WBUFL(buf,27+offset) = -1;
-#endif
-		clif_send(buf,packet_len(cmd),src,SELF);
+			p.targetID = dst->id;
+		if(damage > 0) p.damage = -1;
+		if(damage2 > 0) p.leftDamage = -1;
+		clif_send((uint8*)&p, sizeof(p), src, SELF);
 	}
 
 	if(src == dst) {
@@ -5145,6 +5387,104 @@ void clif_skillunit_update(struct block_list* bl)
 }
 
 
+/// Sessions with units in their spawn queue
+static std::vector<int> spawn_queue_sessions;
+
+/// Sends a unit that came into view of a player.
+/// With client_spawn_budget the unit is queued instead and sent by clif_spawn_queue_timer.
+static void clif_spawn_queue_push(struct map_session_data* sd, struct block_list* bl)
+{
+	if( battle_config.client_spawn_budget == 0 ) {
+		clif_getareachar_unit(sd, bl);
+		return;
+	}
+
+	if( std::find(sd->spawn_queue.begin(), sd->spawn_queue.end(), bl->id) != sd->spawn_queue.end() )
+		return;
+
+	sd->spawn_queue.push_back(bl->id);
+	if( !sd->state.spawn_queued ) {
+		sd->state.spawn_queued = true;
+		spawn_queue_sessions.push_back(sd->bl.id);
+	}
+}
+
+/// Removes a unit that went out of view before it was sent.
+/// @return true if the client never received the unit
+static bool clif_spawn_queue_cancel(struct map_session_data* sd, int id)
+{
+	if( sd->spawn_queue.empty() )
+		return false;
+
+	auto it = std::find(sd->spawn_queue.begin(), sd->spawn_queue.end(), id);
+
+	if( it == sd->spawn_queue.end() )
+		return false;
+
+	*it = sd->spawn_queue.back();
+	sd->spawn_queue.pop_back();
+	return true;
+}
+
+/// Sends the nearest queued units of a player within its budget.
+static void clif_spawn_queue_flush(struct map_session_data* sd)
+{
+	std::vector<std::pair<int, int>> units; // distance, id
+	size_t budget;
+
+	if( !session_isActive(sd->fd) ) {
+		sd->spawn_queue.clear();
+		return;
+	}
+
+	for( int id : sd->spawn_queue ) {
+		struct block_list* bl = map_id2bl(id);
+
+		// skip units that disappeared or went out of view in the meantime
+		if( bl == NULL || bl->prev == NULL || bl->m != sd->bl.m || abs(bl->x - sd->bl.x) > AREA_SIZE || abs(bl->y - sd->bl.y) > AREA_SIZE )
+			continue;
+
+		units.push_back(std::make_pair(distance_bl(&sd->bl, bl), id));
+	}
+	sd->spawn_queue.clear();
+
+	budget = units.size();
+	if( battle_config.client_spawn_budget > 0 && budget > (size_t)battle_config.client_spawn_budget ) {
+		budget = battle_config.client_spawn_budget;
+		std::nth_element(units.begin(), units.begin() + budget, units.end());
+		for( size_t i = budget; i < units.size(); i++ )
+			sd->spawn_queue.push_back(units[i].second);
+	}
+
+	for( size_t i = 0; i < budget; i++ ) {
+		struct block_list* bl = map_id2bl(units[i].second);
+
+		if( bl != NULL )
+			clif_getareachar_unit(sd, bl);
+	}
+}
+
+/// Sends the queued units of all players, see client_spawn_budget.
+static TIMER_FUNC(clif_spawn_queue_timer){
+	std::vector<int> sessions;
+
+	sessions.swap(spawn_queue_sessions);
+	for( int id : sessions ) {
+		struct map_session_data* sd = map_id2sd(id);
+
+		if( sd == NULL || !sd->state.spawn_queued )
+			continue;
+
+		clif_spawn_queue_flush(sd);
+		if( sd->spawn_queue.empty() )
+			sd->state.spawn_queued = false;
+		else
+			spawn_queue_sessions.push_back(id);
+	}
+
+	return 0;
+}
+
 /*==========================================
  *
  *------------------------------------------*/
@@ -5169,7 +5509,7 @@ static int clif_getareachar(struct block_list* bl,va_list ap)
 	default:
 		if(&sd->bl == bl)
 			break;
-		clif_getareachar_unit(sd,bl);
+		clif_spawn_queue_push(sd,bl);
 		break;
 	}
 	return 0;
@@ -5188,7 +5528,7 @@ int clif_outsight(struct block_list *bl,va_list ap)
 	sd = BL_CAST(BL_PC, bl);
 	tsd = BL_CAST(BL_PC, tbl);
 
-	if (tsd && tsd->fd) { //tsd has lost sight of the bl object.
+	if (tsd && tsd->fd && !clif_spawn_queue_cancel(tsd, bl->id)) { //tsd has lost sight of the bl object.
 		nullpo_ret(bl);
 		switch(bl->type){
 		case BL_PC:
@@ -5221,7 +5561,7 @@ int clif_outsight(struct block_list *bl,va_list ap)
 			break;
 		}
 	}
-	if (sd && sd->fd) { //sd is watching tbl go out of view.
+	if (sd && sd->fd && !clif_spawn_queue_cancel(sd, tbl->id)) { //sd is watching tbl go out of view.
 		nullpo_ret(tbl);
 		if(tbl->type == BL_SKILL) //Trap knocked out of sight
 			clif_clearchar_skillunit((struct skill_unit *)tbl,sd->fd);
@@ -5255,12 +5595,12 @@ int clif_insight(struct block_list *bl,va_list ap)
 			skill_getareachar_skillunit_visibilty_single((TBL_SKILL*)bl, &tsd->bl);
 			break;
 		default:
-			clif_getareachar_unit(tsd,bl);
+			clif_spawn_queue_push(tsd,bl);
 			break;
 		}
 	}
 	if (sd && sd->fd) { //Tell sd that tbl walked into his view
-		clif_getareachar_unit(sd,tbl);
+		clif_spawn_queue_push(sd,tbl);
 	}
 	return 0;
 }
@@ -7728,30 +8068,12 @@ void clif_party_xy_single(int fd, struct map_session_data *sd)
 /// 080e <account id>.L <hp>.L <max hp>.L (ZC_NOTIFY_HP_TO_GROUPM_R2)
 void clif_party_hp(struct map_session_data *sd)
 {
-	unsigned char buf[16];
-#if PACKETVER < 20100126
-	const int cmd = 0x106;
-#else
-	const int cmd = 0x80e;
-#endif
+	struct PACKET_ZC_NOTIFY_HP_TO_GROUPM p;
 
 	nullpo_retv(sd);
 
-	WBUFW(buf,0)=cmd;
-	WBUFL(buf,2)=sd->status.account_id;
-#if PACKETVER < 20100126
-	if (sd->battle_status.max_hp > INT16_MAX) { //To correctly display the %hp bar. [Skotlex]
-		WBUFW(buf,6) = sd->battle_status.hp/(sd->battle_status.max_hp/100);
-		WBUFW(buf,8) = 100;
-	} else {
-		WBUFW(buf,6) = sd->battle_status.hp;
-		WBUFW(buf,8) = sd->battle_status.max_hp;
-	}
-#else
-	WBUFL(buf,6) = sd->battle_status.hp;
-	WBUFL(buf,10) = sd->battle_status.max_hp;
-#endif
-	clif_send(buf,packet_len(cmd),&sd->bl,PARTY_AREA_WOS);
+	clif_set_hp_to_groupm(&p, sd->status.account_id, sd->battle_status.hp, sd->battle_status.max_hp);
+	clif_send((uint8*)&p, sizeof(p), &sd->bl, PARTY_AREA_WOS);
 }
 
 /// Notifies the party members of a character's death or revival.
@@ -7792,28 +8114,9 @@ void clif_party_job_and_level(struct map_session_data *sd){
  *------------------------------------------*/
 void clif_hpmeter_single(int fd, int id, unsigned int hp, unsigned int maxhp)
 {
-#if PACKETVER < 20100126
-	const int cmd = 0x106;
-#else
-	const int cmd = 0x80e;
-#endif
-	WFIFOHEAD(fd,packet_len(cmd));
-	WFIFOW(fd,0) = cmd;
-	WFIFOL(fd,2) = id;
-#if PACKETVER < 20100126
-	if( maxhp > INT16_MAX )
-	{// To correctly display the %hp bar. [Skotlex]
-		WFIFOW(fd,6) = hp/(maxhp/100);
-		WFIFOW(fd,8) = 100;
-	} else {
-		WFIFOW(fd,6) = hp;
-		WFIFOW(fd,8) = maxhp;
-	}
-#else
-	WFIFOL(fd,6) = hp;
-	WFIFOL(fd,10) = maxhp;
-#endif
-	WFIFOSET(fd, packet_len(cmd));
+	WFIFOHEAD(fd, sizeof(struct PACKET_ZC_NOTIFY_HP_TO_GROUPM));
+	clif_set_hp_to_groupm((struct PACKET_ZC_NOTIFY_HP_TO_GROUPM*)WFIFOP(fd,0), id, hp, maxhp);
+	WFIFOSET(fd, sizeof(struct PACKET_ZC_NOTIFY_HP_TO_GROUPM));
 }
 
 /// Notifies the client, that it's attack target is too far (ZC_ATTACK_FAILURE_FOR_DISTANCE).
@@ -8653,6 +8956,7 @@ void clif_guild_emblem_area(struct block_list* bl)
 	uint8 buf[12];
 
 	nullpo_retv(bl);
+	clif_appearance_invalidate(bl);
 
 	// TODO this packet doesn't force the update of ui components that have the emblem visible
 	//      (emblem in the flag npcs and emblem over the head in agit maps) [FlavioJS]
@@ -9517,6 +9821,9 @@ void clif_name( struct block_list* src, struct block_list *bl, send_target targe
 	nullpo_retv(src);
 	nullpo_retv(bl);
 
+	if( target != SELF ) // name, party or guild changed
+		clif_appearance_invalidate(bl);
+
 	WBUFW(buf,0) = cmd;
 	WBUFL(buf,2) = bl->id;
 
@@ -9664,6 +9971,7 @@ void clif_slide(struct block_list *bl, int x, int y)
 {
 	unsigned char buf[10];
 	nullpo_retv(bl);
+	clif_move_batch_cancel(bl);
 
 	WBUFW(buf, 0) = 0x01ff;
 	WBUFL(buf, 2) = bl->id;
@@ -17475,6 +17783,7 @@ void clif_font(struct map_session_data *sd)
 #if PACKETVER >= 20080102
 	unsigned char buf[8];
 	nullpo_retv(sd);
+	clif_appearance_invalidate(&sd->bl);
 	WBUFW(buf,0) = 0x2ef;
 	WBUFL(buf,2) = sd->bl.id;
 	WBUFW(buf,6) = sd->status.font;
@@ -18651,14 +18960,15 @@ void clif_snap( struct block_list *bl, short x, short y ) {
 /// 0977 <id>.L <HP>.L <maxHP>.L (ZC_HP_INFO).
 void clif_monster_hp_bar( struct mob_data* md, int fd ) {
 #if PACKETVER >= 20120404
-	WFIFOHEAD(fd,packet_len(0x977));
+	WFIFOHEAD(fd, sizeof(struct PACKET_ZC_HP_INFO));
+	struct PACKET_ZC_HP_INFO* p = (struct PACKET_ZC_HP_INFO*)WFIFOP(fd,0);
 
-	WFIFOW(fd,0)  = 0x977;
-	WFIFOL(fd,2)  = md->bl.id;
-	WFIFOL(fd,6)  = md->status.hp;
-	WFIFOL(fd,10) = md->status.max_hp;
+	p->PacketType = HEADER_ZC_HP_INFO;
+	p->GID = md->bl.id;
+	p->HP = md->status.hp;
+	p->maxHP = md->status.max_hp;
 
-	WFIFOSET(fd,packet_len(0x977));
+	WFIFOSET(fd, sizeof(struct PACKET_ZC_HP_INFO));
 #endif
 }
 
@@ -21076,6 +21386,13 @@ void packetdb_addpacket( uint16 cmd, uint16 length, void (*func)(int, struct map
 	va_end(argp);
 }
 
+/// Checks that a packet written from its struct in packets.hpp has the length of the packet database.
+static void packetdb_checklen( int16 cmd, size_t size, const char* name ){
+	if( packet_db[cmd].len != (short)size ){
+		ShowError( "packetdb_checklen: Packet 0x%04x (%s) has length %d in the packet database, but %d in packets.hpp.\n", cmd, name, packet_db[cmd].len, (int)size );
+	}
+}
+
 /*==========================================
  * Reads packets and setups its array reference
  *------------------------------------------*/
@@ -21086,6 +21403,16 @@ void packetdb_readdb(){
 #include "clif_packetdb.hpp"
 #include "clif_shuffle.hpp"
 
+#define packet_checklen(name) packetdb_checklen( HEADER_##name, sizeof( struct PACKET_##name ), #name )
+	packet_checklen( ZC_NOTIFY_MOVE );
+	packet_checklen( ZC_NOTIFY_PLAYERMOVE );
+	packet_checklen( ZC_NOTIFY_ACT );
+	packet_checklen( ZC_NOTIFY_HP_TO_GROUPM );
+#if PACKETVER >= 20120404
+	packet_checklen( ZC_HP_INFO );
+#endif
+#undef packet_checklen
+
 	ShowStatus("Using packet version: " CL_WHITE "%d" CL_RESET ".\n", PACKETVER);
 
 #ifdef PACKET_OBFUSCATION
@@ -21126,6 +21453,10 @@ void do_init_clif(void) {
 
 	add_timer_func_list(clif_clearunit_delayed_sub, "clif_clearunit_delayed_sub");
 	add_timer_func_list(clif_delayquit, "clif_delayquit");
+	add_timer_func_list(clif_spawn_queue_timer, "clif_spawn_queue_timer");
+	add_timer_func_list(clif_move_batch_timer, "clif_move_batch_timer");
+	add_timer_interval(gettick() + SPAWN_QUEUE_INTERVAL, clif_spawn_queue_timer, 0, 0, SPAWN_QUEUE_INTERVAL);
+	add_timer_interval(gettick() + MOVE_BATCH_INTERVAL, clif_move_batch_timer, 0, 0, MOVE_BATCH_INTERVAL);
 
 	delay_clearunit_ers = ers_new(sizeof(struct block_list),"clif.cpp::delay_clearunit_ers",ERS_OPT_CLEAR);
 }
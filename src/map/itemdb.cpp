@@ -26,6 +26,10 @@ static DBMap *itemdb_combo; /// Item Combo DB
 static DBMap *itemdb_group; /// Item Group DB
 static DBMap *itemdb_randomopt; /// Random option DB
 static DBMap *itemdb_randomopt_group; /// Random option group DB
+static DBMap *itemdb_retired; /// Item data of reloaded items that are not in the Item DB anymore, kept so pointers to them stay valid
+
+std::atomic<struct s_item_snapshot*> itemdb_snapshot(nullptr); /// Hot item fields, see itemdb_hot
+static struct s_item_snapshot* itemdb_snapshot_retired; /// Previous snapshot, freed by the next publish
 
 struct item_data *dummy_item; /// This is the default dummy item used for non-existant items. [Skotlex]
 
@@ -454,14 +458,113 @@ static void itemdb_create_dummy(void) {
 */
 static struct item_data *itemdb_create_item(unsigned short nameid) {
 	struct item_data *id;
-	CREATE(id, struct item_data, 1);
-	memset(id, 0, sizeof(struct item_data));
+
+	// Reuse the item data of a reload so the pointers held by players stay valid
+	if( ( id = (struct item_data*)uidb_get(itemdb_retired, nameid) ) != NULL )
+		uidb_remove(itemdb_retired, nameid);
+	else {
+		CREATE(id, struct item_data, 1);
+		memset(id, 0, sizeof(struct item_data));
+	}
 	id->nameid = nameid;
 	id->type = IT_ETC; //Etc item
 	uidb_put(itemdb, nameid, id);
 	return id;
 }
 
+/**
+* Copies the hot fields of an item
+* @param hot Destination
+* @param id Item data
+*/
+static void itemdb_hot_fill(struct s_item_hot* hot, struct item_data* id) {
+	hot->value_buy = id->value_buy;
+	hot->value_sell = id->value_sell;
+	hot->weight = id->weight;
+	hot->equip = id->equip;
+	hot->type = (uint8)id->type;
+	hot->flag = ITEMHOT_EXISTS;
+	if( itemdb_isequip2(id) )
+		hot->flag |= ITEMHOT_EQUIP;
+	if( id->isStackable() )
+		hot->flag |= ITEMHOT_STACKABLE;
+	if( id->flag.available )
+		hot->flag |= ITEMHOT_AVAILABLE;
+}
+
+/**
+* Frees a snapshot of the hot item fields
+* @param snapshot
+*/
+static void itemdb_snapshot_free(struct s_item_snapshot* snapshot) {
+	if( snapshot == NULL )
+		return;
+	aFree(snapshot->items);
+	aFree(snapshot);
+}
+
+/**
+* Builds a snapshot of the hot fields of all items and publishes it.
+* Must be called after changing type, weight, prices, equip or availability of an item.
+*/
+void itemdb_publish_snapshot(void) {
+	struct s_item_snapshot* snapshot;
+	struct item_data* id;
+	DBIterator* iter;
+	unsigned int count = dummy_item->nameid + 1;
+
+	iter = db_iterator(itemdb);
+	for( id = (struct item_data*)dbi_first(iter); dbi_exists(iter); id = (struct item_data*)dbi_next(iter) )
+		count = max(count, id->nameid + 1U);
+
+	CREATE(snapshot, struct s_item_snapshot, 1);
+	CREATE(snapshot->items, struct s_item_hot, count); // zeroed, items that do not exist have no ITEMHOT_EXISTS
+	snapshot->count = count;
+
+	for( id = (struct item_data*)dbi_first(iter); dbi_exists(iter); id = (struct item_data*)dbi_next(iter) )
+		itemdb_hot_fill(&snapshot->items[id->nameid], id);
+	dbi_destroy(iter);
+
+	// itemdb_search returns the dummy item for its id
+	itemdb_hot_fill(&snapshot->items[dummy_item->nameid], dummy_item);
+
+	// Readers that loaded the current snapshot may still use it until the next publish
+	itemdb_snapshot_free(itemdb_snapshot_retired);
+	itemdb_snapshot_retired = itemdb_snapshot.exchange(snapshot, std::memory_order_acq_rel);
+}
+
+/**
+* Updates the hot fields of a single item in the current snapshot.
+* Only for changes of an existing item at runtime (setiteminfo), the entry is patched in place.
+* @param id Item data
+*/
+void itemdb_update_snapshot(struct item_data* id) {
+	struct s_item_snapshot* snapshot = itemdb_snapshot.load(std::memory_order_acquire);
+
+	nullpo_retv(id);
+	if( snapshot == NULL || id->nameid >= snapshot->count ) {
+		itemdb_publish_snapshot();
+		return;
+	}
+	itemdb_hot_fill(&snapshot->items[id->nameid], id);
+}
+
+/**
+* Slow path of itemdb_hot for items that are not in the snapshot
+* @param nameid
+* @return Hot fields of the item data if the snapshot is outdated, otherwise of the dummy item
+*/
+const struct s_item_hot* itemdb_hot_missing(unsigned short nameid) {
+	static struct s_item_hot hot;
+	const struct s_item_snapshot* snapshot = itemdb_snapshot.load(std::memory_order_acquire);
+	struct item_data* id = itemdb_search(nameid); // Shows the warning for unknown items
+
+	if( id == dummy_item && snapshot != NULL )
+		return &snapshot->items[dummy_item->nameid];
+	itemdb_hot_fill(&hot, id);
+	return &hot;
+}
+
 /*==========================================
  * Loads an item from the db. If not found, it will return the dummy item.
  * @param nameid
@@ -1892,11 +1995,9 @@ static void itemdb_read(void) {
  *------------------------------------------*/
 
 /**
-* Destroys the item_data.
+* Frees the scripts and combos of the item_data.
 */
-static void destroy_item_data(struct item_data* self) {
-	if( self == NULL )
-		return;
+static void itemdb_clear_item_data(struct item_data* self) {
 	// free scripts
 	if( self->script )
 		script_free_code(self->script);
@@ -1916,6 +2017,15 @@ static void destroy_item_data(struct item_data* self) {
 		}
 		aFree(self->combos);
 	}
+}
+
+/**
+* Destroys the item_data.
+*/
+static void destroy_item_data(struct item_data* self) {
+	if( self == NULL )
+		return;
+	itemdb_clear_item_data(self);
 #if defined(DEBUG)
 	// trash item
 	memset(self, 0xDD, sizeof(struct item_data));
@@ -1935,6 +2045,23 @@ static int itemdb_final_sub(DBKey key, DBData *data, va_list ap)
 	return 0;
 }
 
+/**
+* Empties the item_data of an item and moves it to the retired items until it is loaded again.
+* @see DBApply
+*/
+static int itemdb_retire_sub(DBKey key, DBData *data, va_list ap)
+{
+	struct item_data *id = (struct item_data *)db_data2ptr(data);
+	unsigned short nameid = id->nameid;
+
+	itemdb_clear_item_data(id);
+	memset(id, 0, sizeof(struct item_data));
+	id->nameid = nameid;
+	id->type = IT_ETC;
+	uidb_put(itemdb_retired, nameid, id);
+	return 0;
+}
+
 /** NOTE:
 * In some OSs, like Raspbian, we aren't allowed to pass 0 in va_list.
 * So, itemdb_group_free2 is useful in some cases.
@@ -2004,13 +2131,14 @@ void itemdb_reload(void) {
 	itemdb_group->clear(itemdb_group, itemdb_group_free);
 	itemdb_randomopt->clear(itemdb_randomopt, itemdb_randomopt_free);
 	itemdb_randomopt_group->clear(itemdb_randomopt_group, itemdb_randomopt_group_free);
-	itemdb->clear(itemdb, itemdb_final_sub);
+	itemdb->clear(itemdb, itemdb_retire_sub);
 	db_clear(itemdb_combo);
 	if (battle_config.feature_roulette)
 		itemdb_roulette_free();
 
 	// read new data
 	itemdb_read();
+	itemdb_publish_snapshot();
 	cashshop_reloaddb();
 
 	if (battle_config.feature_roulette)
@@ -2050,6 +2178,10 @@ void do_final_itemdb(void) {
 	itemdb_randomopt->destroy(itemdb_randomopt, itemdb_randomopt_free);
 	itemdb_randomopt_group->destroy(itemdb_randomopt_group, itemdb_randomopt_group_free);
 	itemdb->destroy(itemdb, itemdb_final_sub);
+	itemdb_retired->destroy(itemdb_retired, itemdb_final_sub);
+	itemdb_snapshot_free(itemdb_snapshot.exchange(nullptr));
+	itemdb_snapshot_free(itemdb_snapshot_retired);
+	itemdb_snapshot_retired = NULL;
 	destroy_item_data(dummy_item);
 	if (battle_config.feature_roulette)
 		itemdb_roulette_free();
@@ -2064,8 +2196,10 @@ void do_init_itemdb(void) {
 	itemdb_group = uidb_alloc(DB_OPT_BASE);
 	itemdb_randomopt = uidb_alloc(DB_OPT_BASE);
 	itemdb_randomopt_group = uidb_alloc(DB_OPT_BASE);
+	itemdb_retired = uidb_alloc(DB_OPT_BASE);
 	itemdb_create_dummy();
 	itemdb_read();
+	itemdb_publish_snapshot();
 
 	if (battle_config.feature_roulette)
 		itemdb_parse_roulette_db();
@@ -4,6 +4,8 @@
 #ifndef ITEMDB_HPP
 #define ITEMDB_HPP
 
+#include <atomic>
+
 #include "../common/db.hpp"
 #include "../common/mmo.hpp" // ITEM_NAME_LENGTH
 
@@ -896,20 +898,61 @@ struct item_data* itemdb_search_aegisname( const char *str );
 int itemdb_searchname_array(struct item_data** data, int size, const char *str);
 struct item_data* itemdb_search(unsigned short nameid);
 struct item_data* itemdb_exists(unsigned short nameid);
+
+/// Flags of the hot item fields
+enum e_item_hot_flag : uint8 {
+	ITEMHOT_EXISTS    = 0x01,
+	ITEMHOT_EQUIP     = 0x02,
+	ITEMHOT_STACKABLE = 0x04,
+	ITEMHOT_AVAILABLE = 0x08,
+};
+
+/// Fields of an item that are read on every item operation, copied from item_data
+struct s_item_hot {
+	int value_buy;
+	int value_sell;
+	int weight;
+	int equip;
+	uint8 type;
+	uint8 flag; ///< e_item_hot_flag
+};
+
+/// Snapshot of the hot item fields, indexed by item id.
+/// A new snapshot is published when the item db is loaded or reloaded, the previous one stays
+/// valid until the next publish. Changes of a single item (setiteminfo) patch its entry in place.
+struct s_item_snapshot {
+	unsigned int count; ///< Number of entries, highest item id + 1
+	struct s_item_hot* items;
+};
+
+extern std::atomic<struct s_item_snapshot*> itemdb_snapshot;
+const struct s_item_hot* itemdb_hot_missing(unsigned short nameid);
+void itemdb_publish_snapshot(void);
+void itemdb_update_snapshot(struct item_data* id);
+
+/// Returns the hot fields of an item, or those of the dummy item if it does not exist
+static inline const struct s_item_hot* itemdb_hot(unsigned short nameid) {
+	const struct s_item_snapshot* snapshot = itemdb_snapshot.load(std::memory_order_acquire);
+
+	if( snapshot != NULL && nameid < snapshot->count && snapshot->items[nameid].flag&ITEMHOT_EXISTS )
+		return &snapshot->items[nameid];
+	return itemdb_hot_missing(nameid);
+}
+
 #define itemdb_name(n) itemdb_search(n)->name
 #define itemdb_jname(n) itemdb_search(n)->jname
-#define itemdb_type(n) itemdb_search(n)->type
+#define itemdb_type(n) itemdb_hot(n)->type
 #define itemdb_atk(n) itemdb_search(n)->atk
 #define itemdb_def(n) itemdb_search(n)->def
 #define itemdb_look(n) itemdb_search(n)->look
-#define itemdb_weight(n) itemdb_search(n)->weight
-#define itemdb_equip(n) itemdb_search(n)->equip
+#define itemdb_weight(n) itemdb_hot(n)->weight
+#define itemdb_equip(n) itemdb_hot(n)->equip
 #define itemdb_usescript(n) itemdb_search(n)->script
 #define itemdb_equipscript(n) itemdb_search(n)->script
 #define itemdb_wlv(n) itemdb_search(n)->wlv
 #define itemdb_range(n) itemdb_search(n)->range
 #define itemdb_slot(n) itemdb_search(n)->slot
-#define itemdb_available(n) (itemdb_search(n)->flag.available)
+#define itemdb_available(n) ((itemdb_hot(n)->flag&ITEMHOT_AVAILABLE) != 0)
 #define itemdb_traderight(n) (itemdb_search(n)->flag.trade_restriction)
 #define itemdb_viewid(n) (itemdb_search(n)->view_id)
 #define itemdb_autoequip(n) (itemdb_search(n)->flag.autoequip)
@@ -920,8 +963,8 @@ const char *itemdb_typename_ammo (enum e_item_ammo ammo);
 struct s_item_group_entry *itemdb_get_randgroupitem(uint16 group_id, uint8 sub_group);
 unsigned short itemdb_searchrandomid(uint16 group_id, uint8 sub_group);
 
-#define itemdb_value_buy(n) itemdb_search(n)->value_buy
-#define itemdb_value_sell(n) itemdb_search(n)->value_sell
+#define itemdb_value_buy(n) itemdb_hot(n)->value_buy
+#define itemdb_value_sell(n) itemdb_hot(n)->value_sell
 #define itemdb_canrefine(n) (!itemdb_search(n)->flag.no_refine)
 //Item trade restrictions [Skotlex]
 bool itemdb_isdropable_sub(struct item_data *itd, int gmlv, int unused);
@@ -946,10 +989,10 @@ bool itemdb_ishatched_egg(struct item* item);
 #define itemdb_canauction(item, gmlv) itemdb_isrestricted(item , gmlv, 0, itemdb_canauction_sub)
 
 bool itemdb_isequip2(struct item_data *id);
-#define itemdb_isequip(nameid) itemdb_isequip2(itemdb_search(nameid))
+#define itemdb_isequip(nameid) ((itemdb_hot(nameid)->flag&ITEMHOT_EQUIP) != 0)
 char itemdb_isidentified(unsigned short nameid);
 bool itemdb_isstackable2(struct item_data *id);
-#define itemdb_isstackable(nameid) itemdb_isstackable2(itemdb_search(nameid))
+#define itemdb_isstackable(nameid) ((itemdb_hot(nameid)->flag&ITEMHOT_STACKABLE) != 0)
 bool itemdb_isNoEquip(struct item_data *id, uint16 m);
 
 struct item_combo *itemdb_combo_exists(unsigned short combo_id);
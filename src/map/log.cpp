@@ -3,13 +3,22 @@
 
 #include "log.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <stdlib.h>
+#include <thread>
 
 #include "../common/cbasetypes.hpp"
+#include "../common/columnlog.hpp"
+#include "../common/malloc.hpp"
 #include "../common/nullpo.hpp"
 #include "../common/showmsg.hpp"
 #include "../common/sql.hpp" // SQL_INNODB
 #include "../common/strlib.hpp"
+#include "../common/timer.hpp"
+#include "../common/utils.hpp"
 
 #include "battle.hpp"
 #include "homunculus.hpp"
@@ -163,6 +172,515 @@ static bool should_log_item(unsigned short nameid, int amount, int refine)
 }
 
 
+/// sql log statements, queued rows of the same statement are inserted together
+enum e_log_stmt : uint8
+{
+	LOG_STMT_BRANCH = 0,
+	LOG_STMT_PICK,
+	LOG_STMT_ZENY,
+	LOG_STMT_MVPDROP,
+	LOG_STMT_COMMAND,
+	LOG_STMT_NPC,
+	LOG_STMT_NPC_PC,
+	LOG_STMT_CHAT,
+	LOG_STMT_CASH,
+	LOG_STMT_FEEDING,
+	LOG_STMT_MAX
+};
+
+/// what happens to an entry when the queue is full
+enum e_log_overflow
+{
+	LOG_OVERFLOW_DROP = 0, // discard the entry
+	LOG_OVERFLOW_WAIT,     // wait up to LOG_OVERFLOW_TIMEOUT for the log thread to free a slot, then insert it on the main thread
+	LOG_OVERFLOW_SYNC,     // insert the entry on the main thread
+};
+
+/// maximum length of the values of a single entry
+#define LOG_ROW_LENGTH 1024
+/// maximum length of a multi-row statement, stays below the default max_allowed_packet
+#define LOG_BATCH_LENGTH (512*1024)
+/// seconds between attempts to replay the journal while the database is unreachable
+#define LOG_JOURNAL_RETRY 5
+/// seconds after which an idle connection of the log thread is pinged
+#define LOG_PING_INTERVAL 600
+/// milliseconds the main thread waits for a free slot with LOG_OVERFLOW_WAIT
+#define LOG_OVERFLOW_TIMEOUT 50
+
+/// queued log entry
+struct s_log_row
+{
+	e_log_stmt stmt;
+	int64 time;
+	uint16 length;
+	char values[LOG_ROW_LENGTH];
+};
+
+/// asynchronous sql logging
+/// Entries are produced by the main thread only and consumed by the log thread,
+/// so the queue is a single producer/single consumer ring that needs no lock.
+static struct s_log_async
+{
+	Sql* handle; // connection of the log thread
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable cond; // wakes the log thread
+	std::condition_variable space; // wakes the main thread waiting for a free slot
+	s_log_row* queue;
+	size_t size;
+	std::atomic<size_t> head; // next entry to insert, advanced by the log thread
+	std::atomic<size_t> tail; // next free slot, advanced by the main thread
+	std::atomic<uint32> dropped;
+	bool stop;
+	bool running;
+	// log thread only
+	bool spilled; // journal holds statements that were not inserted yet
+	std::chrono::steady_clock::time_point retry;
+	std::chrono::steady_clock::time_point activity;
+} log_async;
+
+
+/// appends the insert statement up to VALUES
+static void log_sql_header(e_log_stmt stmt, StringBuf* buf)
+{
+	int i;
+
+	switch( stmt )
+	{
+		case LOG_STMT_BRANCH:
+			StringBuf_Printf(buf, LOG_QUERY " INTO `%s` (`branch_date`, `account_id`, `char_id`, `char_name`, `map`) VALUES ", log_config.log_branch);
+			break;
+		case LOG_STMT_PICK:
+			StringBuf_Printf(buf, LOG_QUERY " INTO `%s` (`time`, `char_id`, `type`, `nameid`, `amount`, `refine`, `map`, `unique_id`, `bound`", log_config.log_pick);
+			for (i = 0; i < MAX_SLOTS; ++i)
+				StringBuf_Printf(buf, ", `card%d`", i);
+			for (i = 0; i < MAX_ITEM_RDM_OPT; ++i) {
+				StringBuf_Printf(buf, ", `option_id%d`", i);
+				StringBuf_Printf(buf, ", `option_val%d`", i);
+				StringBuf_Printf(buf, ", `option_parm%d`", i);
+			}
+			StringBuf_AppendStr(buf, ") VALUES ");
+			break;
+		case LOG_STMT_ZENY:
+			StringBuf_Printf(buf, LOG_QUERY " INTO `%s` (`time`, `char_id`, `src_id`, `type`, `amount`, `map`) VALUES ", log_config.log_zeny);
+			break;
+		case LOG_STMT_MVPDROP:
+			StringBuf_Printf(buf, LOG_QUERY " INTO `%s` (`mvp_date`, `kill_char_id`, `monster_id`, `prize`, `mvpexp`, `map`) VALUES ", log_config.log_mvpdrop);
+			break;
+		case LOG_STMT_COMMAND:
+			StringBuf_Printf(buf, LOG_QUERY " INTO `%s` (`atcommand_date`, `account_id`, `char_id`, `char_name`, `map`, `command`) VALUES ", log_config.log_gm);
+			break;
+		case LOG_STMT_NPC:
+			StringBuf_Printf(buf, LOG_QUERY " INTO `%s` (`npc_date`, `char_name`, `map`, `mes`) VALUES ", log_config.log_npc);
+			break;
+		case LOG_STMT_NPC_PC:
+			StringBuf_Printf(buf, LOG_QUERY " INTO `%s` (`npc_date`, `account_id`, `char_id`, `char_name`, `map`, `mes`) VALUES ", log_config.log_npc);
+			break;
+		case LOG_STMT_CHAT:
+			StringBuf_Printf(buf, LOG_QUERY " INTO `%s` (`time`, `type`, `type_id`, `src_charid`, `src_accountid`, `src_map`, `src_map_x`, `src_map_y`, `dst_charname`, `message`) VALUES ", log_config.log_chat);
+			break;
+		case LOG_STMT_CASH:
+			StringBuf_Printf(buf, LOG_QUERY " INTO `%s` (`time`, `char_id`, `type`, `cash_type`, `amount`, `map`) VALUES ", log_config.log_cash);
+			break;
+		case LOG_STMT_FEEDING:
+			StringBuf_Printf(buf, LOG_QUERY " INTO `%s` (`time`, `char_id`, `target_id`, `target_class`, `type`, `intimacy`, `item_id`, `map`, `x`, `y`) VALUES ", log_config.log_feeding);
+			break;
+	}
+}
+
+
+/// appends a row, the values of an entry follow its timestamp
+static void log_sql_row(StringBuf* buf, bool first, int64 time, const char* values, size_t length)
+{
+	StringBuf_Printf(buf, "%s(FROM_UNIXTIME(%" PRId64 ")%.*s)", first ? "" : ",", time, (int)length, values);
+}
+
+
+/// appends a quoted and escaped string value
+static void log_sql_string(StringBuf* buf, const char* str, size_t max)
+{
+	char esc[CHAT_SIZE_MAX*2+1];
+
+	Sql_EscapeStringLen(logmysql_handle, esc, str, safestrnlen(str, zmin(max, CHAT_SIZE_MAX)));
+	StringBuf_Printf(buf, ",'%s'", esc);
+}
+
+
+/// inserts a single entry on the main thread
+static void log_sql_insert(e_log_stmt stmt, StringBuf* values)
+{
+	StringBuf buf;
+
+	StringBuf_Init(&buf);
+	log_sql_header(stmt, &buf);
+	log_sql_row(&buf, true, time(NULL), StringBuf_Value(values), StringBuf_Length(values));
+	if( SQL_ERROR == Sql_QueryStr(logmysql_handle, StringBuf_Value(&buf)) )
+		Sql_ShowDebug(logmysql_handle);
+	StringBuf_Destroy(&buf);
+}
+
+
+/// number of entries waiting for the log thread
+static size_t log_async_pending(void)
+{
+	return log_async.tail.load(std::memory_order_acquire) - log_async.head.load(std::memory_order_acquire);
+}
+
+
+/// queues an entry for the log thread, the values start with the column after the timestamp
+static void log_sql_push(e_log_stmt stmt, StringBuf* values)
+{
+	size_t length = StringBuf_Length(values);
+	size_t tail;
+
+	if( !log_async.running || length >= LOG_ROW_LENGTH )
+	{
+		log_sql_insert(stmt, values);
+		return;
+	}
+
+	tail = log_async.tail.load(std::memory_order_relaxed);
+	while( tail - log_async.head.load(std::memory_order_acquire) >= log_async.size )
+	{// queue is full
+		switch( log_config.async_overflow )
+		{
+			case LOG_OVERFLOW_WAIT:
+			{
+				std::unique_lock<std::mutex> lock(log_async.mutex);
+
+				log_async.cond.notify_one();
+				if( log_async.space.wait_for(lock, std::chrono::milliseconds(LOG_OVERFLOW_TIMEOUT), [tail]{
+					return tail - log_async.head.load(std::memory_order_acquire) < log_async.size;
+				}) )
+					continue;
+
+				// the log thread is stuck, do not stall the server any longer
+				lock.unlock();
+				log_sql_insert(stmt, values);
+				return;
+			}
+			case LOG_OVERFLOW_SYNC:
+				log_sql_insert(stmt, values);
+				return;
+			default:
+				log_async.dropped++;
+				return;
+		}
+	}
+
+	s_log_row& row = log_async.queue[tail % log_async.size];
+
+	row.stmt = stmt;
+	row.time = (int64)time(NULL);
+	row.length = (uint16)length;
+	memcpy(row.values, StringBuf_Value(values), length);
+	log_async.tail.store(tail + 1, std::memory_order_release);
+
+	if( tail + 1 - log_async.head.load(std::memory_order_acquire) >= (size_t)log_config.async_flush_rows )
+		log_async.cond.notify_one();
+}
+
+
+/// appends a statement to the journal (log thread)
+static bool log_journal_write(const char* query, uint32 length)
+{
+	FILE* fp;
+	bool ok;
+
+	if( log_config.async_journal[0] == '\0' || ( fp = fopen(log_config.async_journal, "ab") ) == NULL )
+		return false;
+
+	ok = ( fwrite(&length, sizeof(length), 1, fp) == 1 && fwrite(query, 1, length, fp) == length );
+	fclose(fp);
+	return ok;
+}
+
+
+/// executes the statements of the journal in order (log thread)
+/// Statements that could not be executed are kept in the journal.
+/// @return true when the journal was emptied
+static bool log_journal_replay(StringBuf* buf)
+{
+	char tmpname[sizeof(log_config.async_journal)+4];
+	FILE* fp;
+	FILE* rest;
+	uint32 length;
+	long offset;
+	int count = 0;
+
+	if( ( fp = fopen(log_config.async_journal, "rb") ) == NULL )
+		return true;
+
+	for(;;)
+	{
+		offset = ftell(fp);
+		if( fread(&length, sizeof(length), 1, fp) != 1 )
+		{// end of the journal
+			fclose(fp);
+			remove(log_config.async_journal);
+			if( count )
+				ShowStatus("Replayed " CL_WHITE "%d" CL_RESET " statements from the log journal '" CL_WHITE "%s" CL_RESET "'.\n", count, log_config.async_journal);
+			return true;
+		}
+
+		StringBuf_Clear(buf);
+		while( length > 0 )
+		{
+			char chunk[4096];
+			size_t n = fread(chunk, 1, zmin(length, sizeof(chunk)), fp);
+
+			if( n == 0 )
+				break;
+			StringBuf_Printf(buf, "%.*s", (int)n, chunk);
+			length -= (uint32)n;
+		}
+		if( length > 0 )
+		{
+			ShowError("log_journal_replay: Truncated statement in '%s', discarding the rest of the journal.\n", log_config.async_journal);
+			fclose(fp);
+			remove(log_config.async_journal);
+			return true;
+		}
+
+		if( SQL_SUCCESS == Sql_QueryStr(log_async.handle, StringBuf_Value(buf)) )
+		{
+			count++;
+			continue;
+		}
+		if( SQL_SUCCESS == Sql_Ping(log_async.handle) )
+		{// the statement itself is broken, retrying won't help
+			Sql_ShowDebug(log_async.handle);
+			continue;
+		}
+		break;
+	}
+
+	// database went away again, keep what has not been executed
+	safesnprintf(tmpname, sizeof(tmpname), "%s.tmp", log_config.async_journal);
+	if( ( rest = fopen(tmpname, "wb") ) != NULL )
+	{
+		char chunk[4096];
+		size_t n;
+
+		fseek(fp, offset, SEEK_SET);
+		while( ( n = fread(chunk, 1, sizeof(chunk), fp) ) > 0 )
+			fwrite(chunk, 1, n, rest);
+		fclose(rest);
+		fclose(fp);
+		remove(log_config.async_journal);
+		rename(tmpname, log_config.async_journal);
+	}
+	else
+		fclose(fp);
+
+	return false;
+}
+
+
+/// executes a multi-row statement, spills it to the journal while the database is unreachable (log thread)
+static void log_async_execute(StringBuf* buf, StringBuf* tmp, int rows)
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	log_async.activity = now;
+
+	if( log_async.spilled && now >= log_async.retry )
+	{
+		log_async.spilled = !log_journal_replay(tmp);
+		if( log_async.spilled )
+			log_async.retry = now + std::chrono::seconds(LOG_JOURNAL_RETRY);
+	}
+
+	if( !log_async.spilled )
+	{// the journal has to be empty, otherwise entries would be inserted out of order
+		if( SQL_SUCCESS == Sql_QueryStr(log_async.handle, StringBuf_Value(buf)) )
+			return;
+		if( SQL_SUCCESS == Sql_Ping(log_async.handle) )
+		{// the statement itself is broken, retrying won't help
+			Sql_ShowDebug(log_async.handle);
+			return;
+		}
+	}
+
+	if( log_journal_write(StringBuf_Value(buf), (uint32)StringBuf_Length(buf)) )
+	{
+		if( !log_async.spilled )
+		{
+			ShowWarning("Log database unreachable, spilling entries to '%s'.\n", log_config.async_journal);
+			log_async.spilled = true;
+			log_async.retry = now + std::chrono::seconds(LOG_JOURNAL_RETRY);
+		}
+		return;
+	}
+
+	ShowError("Log database unreachable, %d entries were lost.\n", rows);
+}
+
+
+/// tells a main thread waiting with LOG_OVERFLOW_WAIT that slots were freed (log thread)
+static void log_async_freed(void)
+{
+	if( log_config.async_overflow != LOG_OVERFLOW_WAIT )
+		return;
+
+	{// the waiter checks the queue under the lock, so it cannot miss the notification
+		std::lock_guard<std::mutex> lock(log_async.mutex);
+	}
+	log_async.space.notify_one();
+}
+
+
+/// inserts all queued entries, grouped by statement (log thread)
+static void log_async_flush(StringBuf* bufs, StringBuf* tmp)
+{
+	int rows[LOG_STMT_MAX] = {};
+	size_t head = log_async.head.load(std::memory_order_relaxed);
+	size_t tail = log_async.tail.load(std::memory_order_acquire);
+	int i;
+
+	for( ; head != tail; head++ )
+	{
+		const s_log_row& row = log_async.queue[head % log_async.size];
+		StringBuf* buf = &bufs[row.stmt];
+
+		if( rows[row.stmt] == 0 )
+		{
+			StringBuf_Clear(buf);
+			log_sql_header(row.stmt, buf);
+		}
+		log_sql_row(buf, rows[row.stmt] == 0, row.time, row.values, row.length);
+		rows[row.stmt]++;
+
+		if( StringBuf_Length(buf) >= LOG_BATCH_LENGTH || rows[row.stmt] >= log_config.async_flush_rows )
+		{
+			log_async_execute(buf, tmp, rows[row.stmt]);
+			rows[row.stmt] = 0;
+			log_async_freed();
+		}
+
+		// the slot has been copied and can be reused
+		log_async.head.store(head + 1, std::memory_order_release);
+	}
+	log_async_freed();
+
+	for( i = 0; i < LOG_STMT_MAX; i++ )
+		if( rows[i] )
+			log_async_execute(&bufs[i], tmp, rows[i]);
+}
+
+
+/// main loop of the log thread
+static void log_async_worker(void)
+{
+	StringBuf bufs[LOG_STMT_MAX];
+	StringBuf tmp;
+	uint32 dropped;
+	bool stop;
+	int i;
+
+	Sql_ThreadInit();
+	for( i = 0; i < LOG_STMT_MAX; i++ )
+		StringBuf_Init(&bufs[i]);
+	StringBuf_Init(&tmp);
+
+	do
+	{
+		{
+			std::unique_lock<std::mutex> lock(log_async.mutex);
+
+			log_async.cond.wait_for(lock, std::chrono::milliseconds(log_config.async_flush_interval), []{
+				return log_async.stop || log_async_pending() >= (size_t)log_config.async_flush_rows;
+			});
+			stop = log_async.stop;
+		}
+
+		if( log_async_pending() > 0 )
+			log_async_flush(bufs, &tmp);
+		else if( log_async.spilled && std::chrono::steady_clock::now() >= log_async.retry )
+		{// nothing new, try to catch up with the journal
+			log_async.spilled = !log_journal_replay(&tmp);
+			log_async.retry = std::chrono::steady_clock::now() + std::chrono::seconds(LOG_JOURNAL_RETRY);
+		}
+		else if( std::chrono::steady_clock::now() - log_async.activity >= std::chrono::seconds(LOG_PING_INTERVAL) )
+		{// keep the connection alive
+			Sql_Ping(log_async.handle);
+			log_async.activity = std::chrono::steady_clock::now();
+		}
+
+		if( ( dropped = log_async.dropped.exchange(0) ) > 0 )
+			ShowWarning("Log queue is full, %u entries were dropped.\n", dropped);
+	}
+	while( !stop || log_async_pending() > 0 );
+
+	for( i = 0; i < LOG_STMT_MAX; i++ )
+		StringBuf_Destroy(&bufs[i]);
+	StringBuf_Destroy(&tmp);
+	Sql_ThreadEnd();
+}
+
+
+/// column log writers, item and zeny logs
+static ColumnLog* log_columnar_pick = NULL;
+static ColumnLog* log_columnar_zeny = NULL;
+
+
+/// creates the column log writers
+static void log_columnar_init(void)
+{
+	std::vector<s_columnlog_column> columns;
+	char name[32];
+	int i;
+
+	// same columns as the picklog table, plus the account
+	columns = {
+		{ "time", COLUMNLOG_INT, true },
+		{ "char_id", COLUMNLOG_INT, true },
+		{ "account_id", COLUMNLOG_INT, true },
+		{ "type", COLUMNLOG_INT, false },
+		{ "nameid", COLUMNLOG_INT, true },
+		{ "amount", COLUMNLOG_INT, false },
+		{ "refine", COLUMNLOG_INT, false },
+		{ "map", COLUMNLOG_STRING, false },
+		{ "unique_id", COLUMNLOG_INT, false },
+		{ "bound", COLUMNLOG_INT, false },
+	};
+	for( i = 0; i < MAX_SLOTS; i++ ) {
+		safesnprintf(name, sizeof(name), "card%d", i);
+		columns.push_back({ name, COLUMNLOG_INT, false });
+	}
+	for( i = 0; i < MAX_ITEM_RDM_OPT; i++ ) {
+		safesnprintf(name, sizeof(name), "option_id%d", i);
+		columns.push_back({ name, COLUMNLOG_INT, false });
+		safesnprintf(name, sizeof(name), "option_val%d", i);
+		columns.push_back({ name, COLUMNLOG_INT, false });
+		safesnprintf(name, sizeof(name), "option_parm%d", i);
+		columns.push_back({ name, COLUMNLOG_INT, false });
+	}
+	log_columnar_pick = ColumnLog_Create(log_config.columnar_path, "pick", columns, log_config.columnar_block_rows, log_config.columnar_segment_blocks);
+
+	// same columns as the zenylog table, plus the accounts
+	columns = {
+		{ "time", COLUMNLOG_INT, true },
+		{ "char_id", COLUMNLOG_INT, true },
+		{ "account_id", COLUMNLOG_INT, true },
+		{ "src_id", COLUMNLOG_INT, true },
+		{ "src_account_id", COLUMNLOG_INT, false },
+		{ "type", COLUMNLOG_INT, false },
+		{ "amount", COLUMNLOG_INT, false },
+		{ "map", COLUMNLOG_STRING, false },
+	};
+	log_columnar_zeny = ColumnLog_Create(log_config.columnar_path, "zeny", columns, log_config.columnar_block_rows, log_config.columnar_segment_blocks);
+}
+
+
+/// writes the rows of unfinished blocks, so they don't stay in memory for too long
+static TIMER_FUNC(log_columnar_flush_timer){
+	ColumnLog_Flush(log_columnar_pick);
+	ColumnLog_Flush(log_columnar_zeny);
+	return 0;
+}
+
+
 /// logs items, that summon monsters
 void log_branch(struct map_session_data* sd)
 {
@@ -172,17 +690,15 @@ void log_branch(struct map_session_data* sd)
 		return;
 
 	if( log_config.sql_logs ) {
-		SqlStmt* stmt;
-		stmt = SqlStmt_Malloc(logmysql_handle);
-		if( SQL_SUCCESS != SqlStmt_Prepare(stmt, LOG_QUERY " INTO `%s` (`branch_date`, `account_id`, `char_id`, `char_name`, `map`) VALUES (NOW(), '%d', '%d', ?, '%s')", log_config.log_branch, sd->status.account_id, sd->status.char_id, mapindex_id2name(sd->mapindex) )
-		||  SQL_SUCCESS != SqlStmt_BindParam(stmt, 0, SQLDT_STRING, sd->status.name, strnlen(sd->status.name, NAME_LENGTH))
-		||  SQL_SUCCESS != SqlStmt_Execute(stmt) )
-		{
-			SqlStmt_ShowDebug(stmt);
-			SqlStmt_Free(stmt);
-			return;
-		}
-		SqlStmt_Free(stmt);
+		StringBuf buf;
+		StringBuf_Init(&buf);
+
+		StringBuf_Printf(&buf, ",'%d','%d'", sd->status.account_id, sd->status.char_id);
+		log_sql_string(&buf, sd->status.name, NAME_LENGTH);
+		StringBuf_Printf(&buf, ",'%s'", mapindex_id2name(sd->mapindex));
+		log_sql_push(LOG_STMT_BRANCH, &buf);
+
+		StringBuf_Destroy(&buf);
 	}
 	else
 	{
@@ -200,7 +716,7 @@ void log_branch(struct map_session_data* sd)
 }
 
 /// logs item transactions (generic)
-void log_pick(int id, int16 m, e_log_pick_type type, int amount, struct item* itm)
+static void log_pick(int id, uint32 account_id, int16 m, e_log_pick_type type, int amount, struct item* itm)
 {
 	nullpo_retv(itm);
 	if( ( log_config.enable_logs&type ) == 0 )
@@ -211,34 +727,44 @@ void log_pick(int id, int16 m, e_log_pick_type type, int amount, struct item* it
 	if( !should_log_item(itm->nameid, amount, itm->refine) )
 		return; //we skip logging this item set - it doesn't meet our logging conditions [Lupus]
 
-	if( log_config.sql_logs )
+	if( log_config.columnar )
+	{
+		int i;
+
+		ColumnLog_PutInt(log_columnar_pick, (int64)time(NULL));
+		ColumnLog_PutInt(log_columnar_pick, id);
+		ColumnLog_PutInt(log_columnar_pick, account_id);
+		ColumnLog_PutInt(log_columnar_pick, log_picktype2char(type));
+		ColumnLog_PutInt(log_columnar_pick, itm->nameid);
+		ColumnLog_PutInt(log_columnar_pick, amount);
+		ColumnLog_PutInt(log_columnar_pick, itm->refine);
+		ColumnLog_PutString(log_columnar_pick, map_getmapdata(m)->name, MAP_NAME_LENGTH_EXT);
+		ColumnLog_PutInt(log_columnar_pick, itm->unique_id);
+		ColumnLog_PutInt(log_columnar_pick, itm->bound);
+		for (i = 0; i < MAX_SLOTS; i++)
+			ColumnLog_PutInt(log_columnar_pick, itm->card[i]);
+		for (i = 0; i < MAX_ITEM_RDM_OPT; i++) {
+			ColumnLog_PutInt(log_columnar_pick, itm->option[i].id);
+			ColumnLog_PutInt(log_columnar_pick, itm->option[i].value);
+			ColumnLog_PutInt(log_columnar_pick, itm->option[i].param);
+		}
+		ColumnLog_EndRow(log_columnar_pick);
+	}
+	else if( log_config.sql_logs )
 	{
 		int i;
-		SqlStmt* stmt = SqlStmt_Malloc(logmysql_handle);
 		StringBuf buf;
 		StringBuf_Init(&buf);
 
-		StringBuf_Printf(&buf, "%s INTO `%s` (`time`, `char_id`, `type`, `nameid`, `amount`, `refine`, `map`, `unique_id`, `bound`", LOG_QUERY, log_config.log_pick);
-		for (i = 0; i < MAX_SLOTS; ++i)
-			StringBuf_Printf(&buf, ", `card%d`", i);
-		for (i = 0; i < MAX_ITEM_RDM_OPT; ++i) {
-			StringBuf_Printf(&buf, ", `option_id%d`", i);
-			StringBuf_Printf(&buf, ", `option_val%d`", i);
-			StringBuf_Printf(&buf, ", `option_parm%d`", i);
-		}
-		StringBuf_Printf(&buf, ") VALUES(NOW(),'%u','%c','%d','%d','%d','%s','%" PRIu64 "','%d'",
+		StringBuf_Printf(&buf, ",'%u','%c','%d','%d','%d','%s','%" PRIu64 "','%d'",
 			id, log_picktype2char(type), itm->nameid, amount, itm->refine, map_getmapdata(m)->name[0] ? map_getmapdata(m)->name : "", itm->unique_id, itm->bound);
 
 		for (i = 0; i < MAX_SLOTS; i++)
 			StringBuf_Printf(&buf, ",'%d'", itm->card[i]);
 		for (i = 0; i < MAX_ITEM_RDM_OPT; i++)
 			StringBuf_Printf(&buf, ",'%d','%d','%d'", itm->option[i].id, itm->option[i].value, itm->option[i].param);
-		StringBuf_Printf(&buf, ")");
+		log_sql_push(LOG_STMT_PICK, &buf);
 
-		if (SQL_SUCCESS != SqlStmt_PrepareStr(stmt, StringBuf_Value(&buf)) || SQL_SUCCESS != SqlStmt_Execute(stmt))
-			SqlStmt_ShowDebug(stmt);
-
-		SqlStmt_Free(stmt);
 		StringBuf_Destroy(&buf);
 	}
 	else
@@ -260,7 +786,7 @@ void log_pick(int id, int16 m, e_log_pick_type type, int amount, struct item* it
 void log_pick_pc(struct map_session_data* sd, e_log_pick_type type, int amount, struct item* itm)
 {
 	nullpo_retv(sd);
-	log_pick(sd->status.char_id, sd->bl.m, type, amount, itm);
+	log_pick(sd->status.char_id, sd->status.account_id, sd->bl.m, type, amount, itm);
 }
 
 
@@ -268,7 +794,7 @@ void log_pick_pc(struct map_session_data* sd, e_log_pick_type type, int amount,
 void log_pick_mob(struct mob_data* md, e_log_pick_type type, int amount, struct item* itm)
 {
 	nullpo_retv(md);
-	log_pick(md->mob_id, md->bl.m, type, amount, itm);
+	log_pick(md->mob_id, 0, md->bl.m, type, amount, itm);
 }
 
 /// logs zeny transactions
@@ -279,14 +805,28 @@ void log_zeny(struct map_session_data* sd, e_log_pick_type type, struct map_sess
 	if( !log_config.zeny || ( log_config.zeny != 1 && abs(amount) < log_config.zeny ) )
 		return;
 
-	if( log_config.sql_logs )
+	if( log_config.columnar )
 	{
-		if( SQL_ERROR == Sql_Query(logmysql_handle, LOG_QUERY " INTO `%s` (`time`, `char_id`, `src_id`, `type`, `amount`, `map`) VALUES (NOW(), '%d', '%d', '%c', '%d', '%s')",
-			log_config.log_zeny, sd->status.char_id, src_sd->status.char_id, log_picktype2char(type), amount, mapindex_id2name(sd->mapindex)) )
-		{
-			Sql_ShowDebug(logmysql_handle);
-			return;
-		}
+		ColumnLog_PutInt(log_columnar_zeny, (int64)time(NULL));
+		ColumnLog_PutInt(log_columnar_zeny, sd->status.char_id);
+		ColumnLog_PutInt(log_columnar_zeny, sd->status.account_id);
+		ColumnLog_PutInt(log_columnar_zeny, src_sd->status.char_id);
+		ColumnLog_PutInt(log_columnar_zeny, src_sd->status.account_id);
+		ColumnLog_PutInt(log_columnar_zeny, log_picktype2char(type));
+		ColumnLog_PutInt(log_columnar_zeny, amount);
+		ColumnLog_PutString(log_columnar_zeny, mapindex_id2name(sd->mapindex), MAP_NAME_LENGTH_EXT);
+		ColumnLog_EndRow(log_columnar_zeny);
+	}
+	else if( log_config.sql_logs )
+	{
+		StringBuf buf;
+		StringBuf_Init(&buf);
+
+		StringBuf_Printf(&buf, ", '%d', '%d', '%c', '%d', '%s'",
+			sd->status.char_id, src_sd->status.char_id, log_picktype2char(type), amount, mapindex_id2name(sd->mapindex));
+		log_sql_push(LOG_STMT_ZENY, &buf);
+
+		StringBuf_Destroy(&buf);
 	}
 	else
 	{
@@ -314,12 +854,14 @@ void log_mvpdrop(struct map_session_data* sd, int monster_id, unsigned int* log_
 
 	if( log_config.sql_logs )
 	{
-		if( SQL_ERROR == Sql_Query(logmysql_handle, LOG_QUERY " INTO `%s` (`mvp_date`, `kill_char_id`, `monster_id`, `prize`, `mvpexp`, `map`) VALUES (NOW(), '%d', '%d', '%hu', '%u', '%s') ",
-			log_config.log_mvpdrop, sd->status.char_id, monster_id, (unsigned short)log_mvp[0], log_mvp[1], mapindex_id2name(sd->mapindex)) )
-		{
-			Sql_ShowDebug(logmysql_handle);
-			return;
-		}
+		StringBuf buf;
+		StringBuf_Init(&buf);
+
+		StringBuf_Printf(&buf, ", '%d', '%d', '%hu', '%u', '%s'",
+			sd->status.char_id, monster_id, (unsigned short)log_mvp[0], log_mvp[1], mapindex_id2name(sd->mapindex));
+		log_sql_push(LOG_STMT_MVPDROP, &buf);
+
+		StringBuf_Destroy(&buf);
 	}
 	else
 	{
@@ -348,19 +890,16 @@ void log_atcommand(struct map_session_data* sd, const char* message)
 
 	if( log_config.sql_logs )
 	{
-		SqlStmt* stmt;
+		StringBuf buf;
+		StringBuf_Init(&buf);
 
-		stmt = SqlStmt_Malloc(logmysql_handle);
-		if( SQL_SUCCESS != SqlStmt_Prepare(stmt, LOG_QUERY " INTO `%s` (`atcommand_date`, `account_id`, `char_id`, `char_name`, `map`, `command`) VALUES (NOW(), '%d', '%d', ?, '%s', ?)", log_config.log_gm, sd->status.account_id, sd->status.char_id, mapindex_id2name(sd->mapindex) )
-		||  SQL_SUCCESS != SqlStmt_BindParam(stmt, 0, SQLDT_STRING, sd->status.name, strnlen(sd->status.name, NAME_LENGTH))
-		||  SQL_SUCCESS != SqlStmt_BindParam(stmt, 1, SQLDT_STRING, (char*)message, safestrnlen(message, 255))
-		||  SQL_SUCCESS != SqlStmt_Execute(stmt) )
-		{
-			SqlStmt_ShowDebug(stmt);
-			SqlStmt_Free(stmt);
-			return;
-		}
-		SqlStmt_Free(stmt);
+		StringBuf_Printf(&buf, ", '%d', '%d'", sd->status.account_id, sd->status.char_id);
+		log_sql_string(&buf, sd->status.name, NAME_LENGTH);
+		StringBuf_Printf(&buf, ", '%s'", mapindex_id2name(sd->mapindex));
+		log_sql_string(&buf, message, 255);
+		log_sql_push(LOG_STMT_COMMAND, &buf);
+
+		StringBuf_Destroy(&buf);
 	}
 	else
 	{
@@ -386,18 +925,15 @@ void log_npc( struct npc_data* nd, const char* message ){
 
 	if( log_config.sql_logs )
 	{
-		SqlStmt* stmt;
-		stmt = SqlStmt_Malloc(logmysql_handle);
-		if( SQL_SUCCESS != SqlStmt_Prepare(stmt, LOG_QUERY " INTO `%s` (`npc_date`, `char_name`, `map`, `mes`) VALUES (NOW(), ?, '%s', ?)", log_config.log_npc, map_mapid2mapname(nd->bl.m) )
-		||  SQL_SUCCESS != SqlStmt_BindParam(stmt, 0, SQLDT_STRING, nd->name, strnlen(nd->name, NAME_LENGTH))
-		||  SQL_SUCCESS != SqlStmt_BindParam(stmt, 1, SQLDT_STRING, (char*)message, safestrnlen(message, 255))
-		||  SQL_SUCCESS != SqlStmt_Execute(stmt) )
-		{
-			SqlStmt_ShowDebug(stmt);
-			SqlStmt_Free(stmt);
-			return;
-		}
-		SqlStmt_Free(stmt);
+		StringBuf buf;
+		StringBuf_Init(&buf);
+
+		log_sql_string(&buf, nd->name, NAME_LENGTH);
+		StringBuf_Printf(&buf, ", '%s'", map_mapid2mapname(nd->bl.m));
+		log_sql_string(&buf, message, 255);
+		log_sql_push(LOG_STMT_NPC, &buf);
+
+		StringBuf_Destroy(&buf);
 	}
 	else
 	{
@@ -424,18 +960,16 @@ void log_npc(struct map_session_data* sd, const char* message)
 
 	if( log_config.sql_logs )
 	{
-		SqlStmt* stmt;
-		stmt = SqlStmt_Malloc(logmysql_handle);
-		if( SQL_SUCCESS != SqlStmt_Prepare(stmt, LOG_QUERY " INTO `%s` (`npc_date`, `account_id`, `char_id`, `char_name`, `map`, `mes`) VALUES (NOW(), '%d', '%d', ?, '%s', ?)", log_config.log_npc, sd->status.account_id, sd->status.char_id, mapindex_id2name(sd->mapindex) )
-		||  SQL_SUCCESS != SqlStmt_BindParam(stmt, 0, SQLDT_STRING, sd->status.name, strnlen(sd->status.name, NAME_LENGTH))
-		||  SQL_SUCCESS != SqlStmt_BindParam(stmt, 1, SQLDT_STRING, (char*)message, safestrnlen(message, 255))
-		||  SQL_SUCCESS != SqlStmt_Execute(stmt) )
-		{
-			SqlStmt_ShowDebug(stmt);
-			SqlStmt_Free(stmt);
-			return;
-		}
-		SqlStmt_Free(stmt);
+		StringBuf buf;
+		StringBuf_Init(&buf);
+
+		StringBuf_Printf(&buf, ", '%d', '%d'", sd->status.account_id, sd->status.char_id);
+		log_sql_string(&buf, sd->status.name, NAME_LENGTH);
+		StringBuf_Printf(&buf, ", '%s'", mapindex_id2name(sd->mapindex));
+		log_sql_string(&buf, message, 255);
+		log_sql_push(LOG_STMT_NPC_PC, &buf);
+
+		StringBuf_Destroy(&buf);
 	}
 	else
 	{
@@ -467,19 +1001,15 @@ void log_chat(e_log_chat_type type, int type_id, int src_charid, int src_accid,
 	}
 
 	if( log_config.sql_logs ) {
-		SqlStmt* stmt;
+		StringBuf buf;
+		StringBuf_Init(&buf);
 
-		stmt = SqlStmt_Malloc(logmysql_handle);
-		if( SQL_SUCCESS != SqlStmt_Prepare(stmt, LOG_QUERY " INTO `%s` (`time`, `type`, `type_id`, `src_charid`, `src_accountid`, `src_map`, `src_map_x`, `src_map_y`, `dst_charname`, `message`) VALUES (NOW(), '%c', '%d', '%d', '%d', '%s', '%d', '%d', ?, ?)", log_config.log_chat, log_chattype2char(type), type_id, src_charid, src_accid, mapname, x, y)
-		||  SQL_SUCCESS != SqlStmt_BindParam(stmt, 0, SQLDT_STRING, (char*)dst_charname, safestrnlen(dst_charname, NAME_LENGTH))
-		||  SQL_SUCCESS != SqlStmt_BindParam(stmt, 1, SQLDT_STRING, (char*)message, safestrnlen(message, CHAT_SIZE_MAX))
-		||  SQL_SUCCESS != SqlStmt_Execute(stmt) )
-		{
-			SqlStmt_ShowDebug(stmt);
-			SqlStmt_Free(stmt);
-			return;
-		}
-		SqlStmt_Free(stmt);
+		StringBuf_Printf(&buf, ", '%c', '%d', '%d', '%d', '%s', '%d', '%d'", log_chattype2char(type), type_id, src_charid, src_accid, mapname, x, y);
+		log_sql_string(&buf, dst_charname, NAME_LENGTH);
+		log_sql_string(&buf, message, CHAT_SIZE_MAX);
+		log_sql_push(LOG_STMT_CHAT, &buf);
+
+		StringBuf_Destroy(&buf);
 	}
 	else
 	{
@@ -504,12 +1034,14 @@ void log_cash( struct map_session_data* sd, e_log_pick_type type, e_log_cash_typ
 		return;
 
 	if( log_config.sql_logs ){
-		if( SQL_ERROR == Sql_Query( logmysql_handle, LOG_QUERY " INTO `%s` ( `time`, `char_id`, `type`, `cash_type`, `amount`, `map` ) VALUES ( NOW(), '%d', '%c', '%c', '%d', '%s' )",
-			log_config.log_cash, sd->status.char_id, log_picktype2char( type ), log_cashtype2char( cash_type ), amount, mapindex_id2name( sd->mapindex ) ) )
-		{
-			Sql_ShowDebug( logmysql_handle );
-			return;
-		}
+		StringBuf buf;
+		StringBuf_Init( &buf );
+
+		StringBuf_Printf( &buf, ", '%d', '%c', '%c', '%d', '%s'",
+			sd->status.char_id, log_picktype2char( type ), log_cashtype2char( cash_type ), amount, mapindex_id2name( sd->mapindex ) );
+		log_sql_push( LOG_STMT_CASH, &buf );
+
+		StringBuf_Destroy( &buf );
 	}else{
 		char timestring[255];
 		time_t curtime;
@@ -557,12 +1089,14 @@ void log_feeding(struct map_session_data *sd, e_log_feeding_type type, unsigned
 	}
 
 	if (log_config.sql_logs) {
-		if (SQL_ERROR == Sql_Query(logmysql_handle, LOG_QUERY " INTO `%s` (`time`, `char_id`, `target_id`, `target_class`, `type`, `intimacy`, `item_id`, `map`, `x`, `y`) VALUES ( NOW(), '%" PRIu32 "', '%" PRIu32 "', '%hu', '%c', '%" PRIu32 "', '%hu', '%s', '%hu', '%hu' )",
-			log_config.log_feeding, sd->status.char_id, target_id, target_class, log_feedingtype2char(type), intimacy, nameid, mapindex_id2name(sd->mapindex), sd->bl.x, sd->bl.y))
-		{
-			Sql_ShowDebug(logmysql_handle);
-			return;
-		}
+		StringBuf buf;
+		StringBuf_Init(&buf);
+
+		StringBuf_Printf(&buf, ", '%" PRIu32 "', '%" PRIu32 "', '%hu', '%c', '%" PRIu32 "', '%hu', '%s', '%hu', '%hu'",
+			sd->status.char_id, target_id, target_class, log_feedingtype2char(type), intimacy, nameid, mapindex_id2name(sd->mapindex), sd->bl.x, sd->bl.y);
+		log_sql_push(LOG_STMT_FEEDING, &buf);
+
+		StringBuf_Destroy(&buf);
 	} else {
 		char timestring[255];
 		time_t curtime;
@@ -577,6 +1111,87 @@ void log_feeding(struct map_session_data *sd, e_log_feeding_type type, unsigned
 	}
 }
 
+/// starts the column log writers and the log thread for sql logs
+void do_init_log(void)
+{
+	FILE* fp;
+
+	if( log_config.columnar )
+	{
+		log_columnar_init();
+		add_timer_func_list(log_columnar_flush_timer, "log_columnar_flush_timer");
+		add_timer_interval(gettick() + log_config.columnar_flush_interval * 1000, log_columnar_flush_timer, 0, 0, log_config.columnar_flush_interval * 1000);
+	}
+
+	if( !log_config.sql_logs || !log_config.async )
+		return;
+
+	log_async.handle = Sql_Malloc();
+	if( SQL_ERROR == Sql_Connect(log_async.handle, log_db_id, log_db_pw, log_db_ip, log_db_port, log_db_db) )
+	{
+		ShowError("do_init_log: Log thread couldn't connect to database '%s', logging synchronously.\n", log_db_db);
+		Sql_ShowDebug(log_async.handle);
+		Sql_Free(log_async.handle);
+		log_async.handle = NULL;
+		return;
+	}
+	if( strlen(default_codepage) > 0 && SQL_ERROR == Sql_SetEncoding(log_async.handle, default_codepage) )
+		Sql_ShowDebug(log_async.handle);
+	// the log thread pings its connection itself
+	Sql_DisableKeepalive(log_async.handle);
+
+	log_async.size = log_config.async_queue_size;
+	log_async.queue = (s_log_row*)aCalloc(log_async.size, sizeof(s_log_row));
+	log_async.head = 0;
+	log_async.tail = 0;
+	log_async.dropped = 0;
+	log_async.stop = false;
+	log_async.activity = std::chrono::steady_clock::now();
+	log_async.retry = log_async.activity;
+
+	// entries that could not be inserted before the last shutdown
+	if( log_config.async_journal[0] != '\0' && ( fp = fopen(log_config.async_journal, "rb") ) != NULL )
+	{
+		log_async.spilled = true;
+		fclose(fp);
+	}
+	else
+		log_async.spilled = false;
+
+	log_async.running = true;
+	log_async.thread = std::thread(log_async_worker);
+
+	ShowStatus("Logging to database in the background (queue " CL_WHITE "%d" CL_RESET ", batches of " CL_WHITE "%d" CL_RESET " every " CL_WHITE "%d" CL_RESET "ms).\n",
+		log_config.async_queue_size, log_config.async_flush_rows, log_config.async_flush_interval);
+}
+
+
+/// closes the column logs, inserts the remaining entries and stops the log thread
+void do_final_log(void)
+{
+	ColumnLog_Free(log_columnar_pick);
+	ColumnLog_Free(log_columnar_zeny);
+	log_columnar_pick = NULL;
+	log_columnar_zeny = NULL;
+
+	if( !log_async.running )
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(log_async.mutex);
+
+		log_async.stop = true;
+	}
+	log_async.cond.notify_one();
+	log_async.thread.join();
+	log_async.running = false;
+
+	aFree(log_async.queue);
+	log_async.queue = NULL;
+	Sql_Free(log_async.handle);
+	log_async.handle = NULL;
+}
+
 void log_set_defaults(void)
 {
 	memset(&log_config, 0, sizeof(log_config));
@@ -587,6 +1202,17 @@ void log_set_defaults(void)
 	log_config.price_items_log  = 1000; // 1000z
 	log_config.amount_items_log = 100;
 
+	log_config.async = false;
+	log_config.async_queue_size = 8192;
+	log_config.async_flush_interval = 500;
+	log_config.async_flush_rows = 200;
+	log_config.async_overflow = LOG_OVERFLOW_DROP;
+
+	safestrncpy(log_config.columnar_path, "log", sizeof(log_config.columnar_path));
+	log_config.columnar_block_rows = 4096;
+	log_config.columnar_segment_blocks = 1024;
+	log_config.columnar_flush_interval = 60;
+
 	safestrncpy(log_timestamp_format, "%m/%d/%Y %H:%M:%S", sizeof(log_timestamp_format));
 }
 
@@ -617,6 +1243,28 @@ int log_config_read(const char* cfgName)
 				log_config.enable_logs = (e_log_pick_type)config_switch(w2);
 			else if( strcmpi(w1, "sql_logs") == 0 )
 				log_config.sql_logs = config_switch(w2) > 0;
+			else if( strcmpi(w1, "log_async") == 0 )
+				log_config.async = config_switch(w2) > 0;
+			else if( strcmpi(w1, "log_async_queue_size") == 0 )
+				log_config.async_queue_size = cap_value(atoi(w2), 64, 1048576);
+			else if( strcmpi(w1, "log_async_flush_interval") == 0 )
+				log_config.async_flush_interval = cap_value(atoi(w2), 10, 60000);
+			else if( strcmpi(w1, "log_async_flush_rows") == 0 )
+				log_config.async_flush_rows = cap_value(atoi(w2), 1, 10000);
+			else if( strcmpi(w1, "log_async_overflow") == 0 )
+				log_config.async_overflow = cap_value(atoi(w2), LOG_OVERFLOW_DROP, LOG_OVERFLOW_SYNC);
+			else if( strcmpi(w1, "log_async_journal") == 0 )
+				safestrncpy(log_config.async_journal, w2, sizeof(log_config.async_journal));
+			else if( strcmpi(w1, "log_columnar") == 0 )
+				log_config.columnar = config_switch(w2) > 0;
+			else if( strcmpi(w1, "log_columnar_path") == 0 )
+				safestrncpy(log_config.columnar_path, w2, sizeof(log_config.columnar_path));
+			else if( strcmpi(w1, "log_columnar_block_rows") == 0 )
+				log_config.columnar_block_rows = cap_value(atoi(w2), 16, 65536);
+			else if( strcmpi(w1, "log_columnar_segment_blocks") == 0 )
+				log_config.columnar_segment_blocks = cap_value(atoi(w2), 1, 65536);
+			else if( strcmpi(w1, "log_columnar_flush_interval") == 0 )
+				log_config.columnar_flush_interval = cap_value(atoi(w2), 1, 3600);
 //start of common filter settings
 			else if( strcmpi(w1, "rare_items_log") == 0 )
 				log_config.rare_items_log = atoi(w2);
@@ -684,7 +1332,10 @@ int log_config_read(const char* cfgName)
 
 		if( log_config.enable_logs && log_config.filter )
 		{
-			ShowInfo("Logging item transactions to %s '%s'.\n", target, log_config.log_pick);
+			if( log_config.columnar )
+				ShowInfo("Logging item transactions to column log '%s/pick_*.clog'.\n", log_config.columnar_path);
+			else
+				ShowInfo("Logging item transactions to %s '%s'.\n", target, log_config.log_pick);
 		}
 		if( log_config.branch )
 		{
@@ -708,7 +1359,10 @@ int log_config_read(const char* cfgName)
 		}
 		if( log_config.zeny )
 		{
-			ShowInfo("Logging Zeny transactions to %s '%s'.\n", target, log_config.log_zeny);
+			if( log_config.columnar )
+				ShowInfo("Logging Zeny transactions to column log '%s/zeny_*.clog'.\n", log_config.columnar_path);
+			else
+				ShowInfo("Logging Zeny transactions to %s '%s'.\n", target, log_config.log_zeny);
 		}
 		if( log_config.cash ){
 			ShowInfo( "Logging Cash transactions to %s '%s'.\n", target, log_config.log_cash );
@@ -85,6 +85,9 @@ void log_mvpdrop(struct map_session_data* sd, int monster_id, unsigned int* log_
 
 int log_config_read(const char* cfgName);
 
+void do_init_log(void);
+void do_final_log(void);
+
 extern struct Log_Config
 {
 	e_log_pick_type enable_logs;
@@ -97,6 +100,14 @@ extern struct Log_Config
 	unsigned feeding : 2;
 	char log_branch[64], log_pick[64], log_zeny[64], log_mvpdrop[64], log_gm[64], log_npc[64], log_chat[64], log_cash[64];
 	char log_feeding[64];
+	// asynchronous sql logging
+	bool async;
+	int async_queue_size, async_flush_interval, async_flush_rows, async_overflow;
+	char async_journal[256];
+	// column log for item and zeny transactions
+	bool columnar;
+	char columnar_path[256];
+	int columnar_block_rows, columnar_segment_blocks, columnar_flush_interval;
 } log_config;
 
 #endif /* LOG_HPP */
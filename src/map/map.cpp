@@ -3,8 +3,21 @@
 
 #include "map.hpp"
 
+#include <atomic>
 #include <stdlib.h>
 #include <math.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#ifdef WIN32
+#include "../common/winapi.hpp"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include "../common/cbasetypes.hpp"
 #include "../common/cli.hpp"
@@ -108,9 +121,22 @@ static DBMap* charid_db=NULL; /// uint32 char_id -> struct map_session_data*
 static DBMap* regen_db=NULL; /// int id -> struct block_list* (status_natural_heal processing)
 static DBMap* map_msg_db=NULL;
 
+/// Directly indexed table of the ids in id_db, used by the map_id2* lookups.
+/// The ids are split in segments of IDTABLE_SEGMENT_SIZE consecutive ids, a segment
+/// is allocated when its first id is added and freed when its last id is removed.
+#define IDTABLE_SEGMENT_BITS 14
+#define IDTABLE_SEGMENT_SIZE (1 << IDTABLE_SEGMENT_BITS)
+#define IDTABLE_SEGMENTS ((INT_MAX >> IDTABLE_SEGMENT_BITS) + 1)
+struct s_idtable_segment {
+	struct block_list* bl[IDTABLE_SEGMENT_SIZE];
+	uint32 generation[IDTABLE_SEGMENT_SIZE]; ///< Generation of the block_list of the id, see map_id2generation
+	int count; ///< Ids in use
+};
+static struct s_idtable_segment** idtable = NULL; /// id >> IDTABLE_SEGMENT_BITS -> segment
+static uint32 idtable_generation = 0; ///< Last generation handed out
+
 static int map_users=0;
 
-#define BLOCK_SIZE 8
 #define block_free_max 1048576
 struct block_list *block_free[block_free_max];
 static int block_free_count = 0, block_free_lock = 0;
@@ -159,6 +185,48 @@ struct map_cache_map_info {
 	int32 len;
 };
 
+// Map cache version 2 starts with this header instead, followed by the index
+// of all maps sorted by name and the cells of the maps
+#define MAP_CACHE_MAGIC "RAMC"
+#define MAP_CACHE_VERSION 2
+struct map_cache_header2 {
+	char magic[4];
+	uint16 version;
+	uint16 flags;
+	uint32 map_count;
+	uint32 file_size;
+};
+
+// Index entry of a map in version 2
+struct map_cache_index2 {
+	char name[MAP_NAME_LENGTH];
+	int16 xs;
+	int16 ys;
+	uint8 encoding; // enum e_map_cache_encoding
+	uint8 reserved[3];
+	uint32 offset; // from the start of the file
+	uint32 len;
+};
+
+enum e_map_cache_encoding : uint8 {
+	MAPCACHE_ZLIB = 0, // zlib compressed gat types
+	MAPCACHE_RAW, // one byte gat type per cell
+};
+
+// A map cache opened for reading, the file is mapped into memory if possible
+struct s_map_cache {
+	char* data;
+	size_t size;
+	bool mapped;
+#ifdef WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+	const struct map_cache_index2* index; // version 2, sorted by name
+	uint32 map_count;
+	std::unordered_map<std::string, const struct map_cache_map_info*> names; // version 1
+};
+
 char motd_txt[256] = "conf/motd.txt";
 char charhelp_txt[256] = "conf/charhelp.txt";
 char channel_conf[256] = "conf/channels.conf";
@@ -180,6 +248,7 @@ struct s_map_default map_default;
 int console = 0;
 int enable_spy = 0; //To enable/disable @spy commands, which consume too much cpu time when sending packets. [Skotlex]
 int enable_grf = 0;	//To enable/disable reading maps from GRF files, bypassing mapcache [blackhole89]
+int map_load_threads = 0; // Threads decoding the map cache on startup, 0: one per core
 
 /**
  * Get the map data
@@ -216,6 +285,15 @@ int map_usercount(void)
 }
 
 
+/// Releases the memory of a block, monsters go back to their pool.
+static void map_freeblock_sub(struct block_list *bl)
+{
+	if (bl->type == BL_MOB)
+		mob_pool.free((struct mob_data*)bl);
+	else
+		aFree(bl);
+}
+
 /*==========================================
  * Attempt to free a map blocklist
  *------------------------------------------*/
@@ -224,7 +302,7 @@ int map_freeblock (struct block_list *bl)
 	nullpo_retr(block_free_lock, bl);
 	if (block_free_lock == 0 || block_free_count >= block_free_max)
 	{
-		aFree(bl);
+		map_freeblock_sub(bl);
 		bl = NULL;
 		if (block_free_count >= block_free_max)
 			ShowWarning("map_freeblock: too many free block! %d %d\n", block_free_count, block_free_lock);
@@ -250,7 +328,7 @@ int map_freeblock_unlock (void)
 		int i;
 		for (i = 0; i < block_free_count; i++)
 		{
-			aFree(block_free[i]);
+			map_freeblock_sub(block_free[i]);
 			block_free[i] = NULL;
 		}
 		block_free_count = 0;
@@ -283,6 +361,386 @@ TIMER_FUNC(map_freeblock_timer){
  *------------------------------------------*/
 static struct block_list bl_head;
 
+/*==========================================
+ * Cell bitplanes
+ * The terrain flags of the cells are kept a second time as one bit per
+ * cell, so a check over a row segment or rectangle handles 64 cells at
+ * once. The dynamic flags are only kept in mapcell.
+ *------------------------------------------*/
+
+/// Bitplane words of the cell check, see map_cell_planequery
+struct s_mapcell_planequery {
+	int count; // number of planes
+	const uint64* plane[2];
+	uint64 invert[2]; // ~0 if the flag must not be set
+};
+
+/// Number of bits that are set.
+static inline int map_cell_popcount(uint64 v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_popcountll(v);
+#else
+	v = v - ((v >> 1) & 0x5555555555555555ULL);
+	v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+	v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return (int)((v * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+/// Writes the terrain flags of a cell into the bitplanes.
+static void map_cell_planeset(struct map_data* mapdata, int16 x, int16 y, const struct mapcell* cell)
+{
+	struct s_mapcell_planes* planes = mapdata->cell_planes;
+
+	if( planes == NULL )
+		return;
+
+	size_t w = (size_t)y * planes->stride + (x >> 6);
+	uint64 bit = 1ULL << (x & 63);
+
+	planes->walkable[w] = cell->walkable ? ( planes->walkable[w] | bit ) : ( planes->walkable[w] & ~bit );
+	planes->shootable[w] = cell->shootable ? ( planes->shootable[w] | bit ) : ( planes->shootable[w] & ~bit );
+	planes->water[w] = cell->water ? ( planes->water[w] | bit ) : ( planes->water[w] & ~bit );
+}
+
+/// Allocates the bitplanes of a map, optionally copying them from another map.
+static struct s_mapcell_planes* map_cell_planealloc(struct map_data* mapdata, const struct s_mapcell_planes* src)
+{
+	struct s_mapcell_planes* planes;
+	int32 stride = ((mapdata->xs + 511) / 512) * 8; // whole cache lines of 64 bytes
+	size_t words = (size_t)stride * mapdata->ys;
+
+	CREATE(planes, struct s_mapcell_planes, 1);
+	planes->stride = stride;
+	planes->buffer = aCalloc(3 * words * sizeof(uint64) + 64, 1);
+	planes->walkable = (uint64*)(((uintptr_t)planes->buffer + 63) & ~(uintptr_t)63);
+	planes->shootable = planes->walkable + words;
+	planes->water = planes->shootable + words;
+
+	if( src != NULL )
+		memcpy(planes->walkable, src->walkable, 3 * words * sizeof(uint64));
+	return planes;
+}
+
+/// Builds the bitplanes from the cells of a map.
+static void map_cell_planebuild(struct map_data* mapdata)
+{
+	if( mapdata->cell == NULL || mapdata->cell_planes != NULL )
+		return;
+
+	struct s_mapcell_planes* planes = map_cell_planealloc(mapdata, NULL);
+
+	for( int16 y = 0; y < mapdata->ys; y++ ) {
+		const struct mapcell* row = &mapdata->cell[(size_t)y * mapdata->xs];
+		size_t base = (size_t)y * planes->stride;
+
+		for( int16 x = 0; x < mapdata->xs; x++ ) {
+			uint64 bit = 1ULL << (x & 63);
+
+			if( row[x].walkable )
+				planes->walkable[base + (x >> 6)] |= bit;
+			if( row[x].shootable )
+				planes->shootable[base + (x >> 6)] |= bit;
+			if( row[x].water )
+				planes->water[base + (x >> 6)] |= bit;
+		}
+	}
+
+	mapdata->cell_planes = planes;
+}
+
+/// Releases the bitplanes of a map.
+static void map_cell_planefree(struct s_mapcell_planes* planes)
+{
+	if( planes == NULL )
+		return;
+	aFree(planes->buffer);
+	aFree(planes);
+}
+
+/// Describes a cell check as the bitplanes that must all match.
+/// @return false if the check depends on more than the terrain flags
+static bool map_cell_planequery(const struct s_mapcell_planes* planes, cell_chk cellchk, struct s_mapcell_planequery* q)
+{
+	if( planes == NULL )
+		return false;
+
+	switch( cellchk ) {
+		case CELL_CHKWALL:
+			*q = { 2, { planes->walkable, planes->shootable }, { ~0ULL, ~0ULL } };
+			return true;
+		case CELL_CHKCLIFF:
+			*q = { 2, { planes->walkable, planes->shootable }, { ~0ULL, 0 } };
+			return true;
+		case CELL_CHKWATER:
+			*q = { 1, { planes->water, NULL }, { 0, 0 } };
+			return true;
+#ifndef CELL_NOSTACK
+		case CELL_CHKPASS:
+#endif
+		case CELL_CHKREACH:
+			*q = { 1, { planes->walkable, NULL }, { 0, 0 } };
+			return true;
+#ifndef CELL_NOSTACK
+		case CELL_CHKNOPASS:
+#endif
+		case CELL_CHKNOREACH:
+			*q = { 1, { planes->walkable, NULL }, { ~0ULL, 0 } };
+			return true;
+		default:
+			return false;
+	}
+}
+
+/// Scans the cells x0..x1 of a row.
+/// @param count: true to count the matching cells, false to stop at the first one
+/// @return number of matching cells (at most 1 if not counting)
+static int map_cell_planerow(const struct s_mapcell_planes* planes, const struct s_mapcell_planequery* q, int16 y, int16 x0, int16 x1, bool count)
+{
+	size_t base = (size_t)y * planes->stride;
+	int w0 = x0 >> 6, w1 = x1 >> 6;
+	int found = 0;
+
+	for( int w = w0; w <= w1; w++ ) {
+		uint64 bits = q->plane[0][base + w] ^ q->invert[0];
+
+		if( q->count > 1 )
+			bits &= q->plane[1][base + w] ^ q->invert[1];
+		if( w == w0 )
+			bits &= ~0ULL << (x0 & 63);
+		if( w == w1 )
+			bits &= ~0ULL >> (63 - (x1 & 63));
+
+		if( !count ) {
+			if( bits )
+				return 1;
+		} else
+			found += map_cell_popcount(bits);
+	}
+
+	return found;
+}
+
+/// Checks or counts the cells of a rectangle.
+/// Cells outside the map behave like in map_getcellp.
+static int map_cell_scanrect(struct map_data* m, int16 x0, int16 y0, int16 x1, int16 y1, cell_chk cellchk, bool count)
+{
+	struct s_mapcell_planequery q;
+	int found = 0;
+
+	nullpo_ret(m);
+
+	if( x0 > x1 )
+		SWAP(x0, x1);
+	if( y0 > y1 )
+		SWAP(y0, y1);
+
+	if( !map_cell_planequery(m->cell_planes, cellchk, &q) ) {
+		for( int16 y = y0; y <= y1; y++ ) {
+			for( int16 x = x0; x <= x1; x++ ) {
+				if( map_getcellp(m, x, y, cellchk) ) {
+					if( !count )
+						return 1;
+					found++;
+				}
+			}
+		}
+		return found;
+	}
+
+	//NOTE: map_getcellp intentionally overrides the last row and column
+	int16 cx0 = max(x0, 0), cy0 = max(y0, 0);
+	int16 cx1 = min(x1, m->xs - 2), cy1 = min(y1, m->ys - 2);
+	int inside = ( cx0 <= cx1 && cy0 <= cy1 ) ? ( cx1 - cx0 + 1 ) * ( cy1 - cy0 + 1 ) : 0;
+
+	if( cellchk == CELL_CHKNOPASS ) {// cells outside the map are not passable
+		int outside = ( x1 - x0 + 1 ) * ( y1 - y0 + 1 ) - inside;
+
+		if( outside > 0 ) {
+			if( !count )
+				return 1;
+			found += outside;
+		}
+	}
+
+	if( inside == 0 )
+		return found;
+
+	for( int16 y = cy0; y <= cy1; y++ ) {
+		int n = map_cell_planerow(m->cell_planes, &q, y, cx0, cx1, count);
+
+		if( n && !count )
+			return 1;
+		found += n;
+	}
+
+	return found;
+}
+
+/*==========================================
+ * Checks if the batch queries answer the check from the bitplanes.
+ * Otherwise they fall back to checking the cells one by one.
+ *------------------------------------------*/
+bool map_cell_planecheck(struct map_data* m, cell_chk cellchk)
+{
+	struct s_mapcell_planequery q;
+
+	return m != NULL && map_cell_planequery(m->cell_planes, cellchk, &q);
+}
+
+/*==========================================
+ * Checks if any cell of the row segment (x0..x1,y) matches the check.
+ *------------------------------------------*/
+bool map_cell_anyrow(struct map_data* m, int16 y, int16 x0, int16 x1, cell_chk cellchk)
+{
+	return map_cell_scanrect(m, x0, y, x1, y, cellchk, false) != 0;
+}
+
+/*==========================================
+ * Checks if any cell of the rectangle (x0,y0)-(x1,y1) matches the check.
+ * "All cells passable" is !map_cell_anyrect(..., CELL_CHKNOPASS).
+ *------------------------------------------*/
+bool map_cell_anyrect(struct map_data* m, int16 x0, int16 y0, int16 x1, int16 y1, cell_chk cellchk)
+{
+	return map_cell_scanrect(m, x0, y0, x1, y1, cellchk, false) != 0;
+}
+
+/*==========================================
+ * Counts the cells of the rectangle (x0,y0)-(x1,y1) that match the check.
+ *------------------------------------------*/
+int map_cell_countrect(struct map_data* m, int16 x0, int16 y0, int16 x1, int16 y1, cell_chk cellchk)
+{
+	return map_cell_scanrect(m, x0, y0, x1, y1, cellchk, true);
+}
+
+/*==========================================
+ * Cells of instance maps
+ * Instance maps use the cells of their source map for the terrain.
+ * Their dynamic flags (npc, icewall, landprotector, ...) are kept in
+ * cell_overlay, only for cells that have any. The first change of the
+ * terrain of either map gives the instance map a copy of its own.
+ *------------------------------------------*/
+
+/// Copies the dynamic flags of a cell.
+static inline void map_cell_copydynamic(struct mapcell* dst, const struct mapcell* src)
+{
+	dst->npc = src->npc;
+	dst->basilica = src->basilica;
+	dst->landprotector = src->landprotector;
+	dst->novending = src->novending;
+	dst->nochat = src->nochat;
+	dst->maelstrom = src->maelstrom;
+	dst->icewall = src->icewall;
+#ifdef CELL_NOSTACK
+	dst->cell_bl = src->cell_bl;
+#endif
+}
+
+/// Checks if a cell has no dynamic flags.
+static inline bool map_cell_nodynamic(const struct mapcell* cell)
+{
+	if( cell->npc || cell->basilica || cell->landprotector || cell->novending || cell->nochat || cell->maelstrom || cell->icewall )
+		return false;
+#ifdef CELL_NOSTACK
+	if( cell->cell_bl )
+		return false;
+#endif
+	return true;
+}
+
+/// Returns the cell whose dynamic flags are changed.
+/// Call map_cell_dynamic_done afterwards.
+static struct mapcell* map_cell_dynamic(struct map_data* mapdata, int32 j)
+{
+	if( !mapdata->cell_shared )
+		return &mapdata->cell[j];
+	return &mapdata->cell_overlay[j];
+}
+
+/// Removes the overlay entry of a cell that no longer has dynamic flags.
+static void map_cell_dynamic_done(struct map_data* mapdata, int32 j)
+{
+	if( !mapdata->cell_shared )
+		return;
+
+	auto it = mapdata->cell_overlay.find(j);
+
+	if( it != mapdata->cell_overlay.end() && map_cell_nodynamic(&it->second) )
+		mapdata->cell_overlay.erase(it);
+}
+
+/// Shares the cells of the source map with an instance map.
+/// The dynamic flags the source map has at this time are copied, like a copy of the cells would.
+static void map_cell_share(struct map_data* dst_map, struct map_data* src_map)
+{
+	size_t num_cell = (size_t)src_map->xs * src_map->ys;
+
+	dst_map->cell = src_map->cell;
+	dst_map->cell_planes = src_map->cell_planes;
+	dst_map->cell_shared = true;
+	dst_map->cell_overlay.clear();
+
+	if( src_map->cell_shared ) {
+		dst_map->cell_overlay = src_map->cell_overlay;
+		return;
+	}
+
+	for( size_t j = 0; j < num_cell; j++ ) {
+		if( !map_cell_nodynamic(&src_map->cell[j]) )
+			map_cell_copydynamic(&dst_map->cell_overlay[(int32)j], &src_map->cell[j]);
+	}
+}
+
+/// Gives an instance map a copy of the cells it shares.
+static void map_cell_unshare(struct map_data* mapdata)
+{
+	static const struct mapcell empty = {};
+	size_t num_cell = (size_t)mapdata->xs * mapdata->ys;
+	struct mapcell* cell;
+
+	CREATE(cell, struct mapcell, num_cell);
+	memcpy(cell, mapdata->cell, num_cell * sizeof(struct mapcell));
+	for( size_t j = 0; j < num_cell; j++ )
+		map_cell_copydynamic(&cell[j], &empty);
+	for( auto& entry : mapdata->cell_overlay )
+		map_cell_copydynamic(&cell[entry.first], &entry.second);
+
+	mapdata->cell = cell;
+	if( mapdata->cell_planes != NULL )
+		mapdata->cell_planes = map_cell_planealloc(mapdata, mapdata->cell_planes);
+	mapdata->cell_shared = false;
+	mapdata->cell_overlay.clear();
+}
+
+/// Must be called before the terrain of a map is changed.
+/// The map itself or the instance maps sharing its cells get a copy first.
+static void map_cell_terrain_write(struct map_data* mapdata)
+{
+	if( mapdata->cell_shared ) {
+		map_cell_unshare(mapdata);
+		return;
+	}
+
+	for( int i = instance_start; instance_start && i < map_num; i++ ) {
+		if( map[i].cell_shared && map[i].cell == mapdata->cell )
+			map_cell_unshare(&map[i]);
+	}
+}
+
+/// Releases the cells of a map.
+static void map_cell_free(struct map_data* mapdata)
+{
+	if( mapdata->cell && !mapdata->cell_shared ) {
+		aFree(mapdata->cell);
+		map_cell_planefree(mapdata->cell_planes);
+	}
+	mapdata->cell = NULL;
+	mapdata->cell_planes = NULL;
+	mapdata->cell_shared = false;
+	mapdata->cell_overlay.clear();
+}
+
 #ifdef CELL_NOSTACK
 /*==========================================
  * These pair of functions update the counter of how many objects
@@ -294,7 +752,7 @@ static void map_addblcell(struct block_list *bl)
 
 	if( bl->m<0 || bl->x<0 || bl->x>=mapdata->xs || bl->y<0 || bl->y>=mapdata->ys || !(bl->type&BL_CHAR) )
 		return;
-	mapdata->cell[bl->x+bl->y*mapdata->xs].cell_bl++;
+	map_cell_dynamic(mapdata, bl->x+bl->y*mapdata->xs)->cell_bl++;
 	return;
 }
 
@@ -304,7 +762,8 @@ static void map_delblcell(struct block_list *bl)
 
 	if( bl->m <0 || bl->x<0 || bl->x>=mapdata->xs || bl->y<0 || bl->y>=mapdata->ys || !(bl->type&BL_CHAR) )
 		return;
-	mapdata->cell[bl->x+bl->y*mapdata->xs].cell_bl--;
+	map_cell_dynamic(mapdata, bl->x+bl->y*mapdata->xs)->cell_bl--;
+	map_cell_dynamic_done(mapdata, bl->x+bl->y*mapdata->xs);
 }
 #endif
 
@@ -1560,7 +2019,7 @@ int map_get_new_object_id(void)
 		if( i == MAX_FLOORITEM )
 			i = MIN_FLOORITEM;
 
-		if( !idb_exists(id_db, i) )
+		if( !map_blid_exists(i) )
 			break;
 
 		++i;
@@ -1582,7 +2041,7 @@ int map_get_new_object_id(void)
  * Called each flooritem_lifetime ms
  *------------------------------------------*/
 TIMER_FUNC(map_clearflooritem_timer){
-	struct flooritem_data* fitem = (struct flooritem_data*)idb_get(id_db, id);
+	struct flooritem_data* fitem = (struct flooritem_data*)map_id2bl(id);
 
 	if (fitem == NULL || fitem->bl.type != BL_ITEM || (fitem->cleartimer != tid)) {
 		ShowError("map_clearflooritem_timer : error\n");
@@ -1970,6 +2429,44 @@ void map_reqnickdb(struct map_session_data * sd, int charid)
 	chrif_searchcharid(charid);
 }
 
+/**
+ * Sets the block_list of an id in the id table.
+ * A different block_list gets a new generation.
+ * @param id: Block list ID
+ * @param bl: Block list or NULL to remove the id
+ */
+static void map_idtable_set(int id, struct block_list *bl)
+{
+	struct s_idtable_segment* segment;
+	int index = id & (IDTABLE_SEGMENT_SIZE - 1);
+
+	if( id <= 0 )
+		return;
+
+	segment = idtable[id >> IDTABLE_SEGMENT_BITS];
+	if( bl != NULL ) {
+		if( segment == NULL ) {
+			CREATE(segment, struct s_idtable_segment, 1);
+			idtable[id >> IDTABLE_SEGMENT_BITS] = segment;
+		}
+		if( segment->bl[index] == bl )
+			return;
+		if( segment->bl[index] == NULL )
+			segment->count++;
+		segment->bl[index] = bl;
+		if( ++idtable_generation == 0 ) // 0 is used for unused ids
+			idtable_generation = 1;
+		segment->generation[index] = idtable_generation;
+	} else if( segment != NULL && segment->bl[index] != NULL ) {
+		segment->bl[index] = NULL;
+		segment->generation[index] = 0;
+		if( --segment->count == 0 ) {
+			aFree(segment);
+			idtable[id >> IDTABLE_SEGMENT_BITS] = NULL;
+		}
+	}
+}
+
 /*==========================================
  * add bl to id_db
  *------------------------------------------*/
@@ -1996,6 +2493,7 @@ void map_addiddb(struct block_list *bl)
 		idb_put(regen_db, bl->id, bl);
 
 	idb_put(id_db,bl->id,bl);
+	map_idtable_set(bl->id, bl);
 }
 
 /*==========================================
@@ -2021,6 +2519,7 @@ void map_deliddb(struct block_list *bl)
 		idb_remove(regen_db,bl->id);
 
 	idb_remove(id_db,bl->id);
+	map_idtable_set(bl->id, NULL);
 }
 
 /*==========================================
@@ -2204,13 +2703,13 @@ int map_quit(struct map_session_data *sd) {
  * Lookup, id to session (player,mob,npc,homon,merc..)
  *------------------------------------------*/
 struct map_session_data * map_id2sd(int id){
-	if (id <= 0) return NULL;
-	return (struct map_session_data*)idb_get(pc_db,id);
+	struct block_list* bl = map_id2bl(id);
+	return BL_CAST(BL_PC, bl);
 }
 
 struct mob_data * map_id2md(int id){
-	if (id <= 0) return NULL;
-	return (struct mob_data*)idb_get(mobid_db,id);
+	struct block_list* bl = map_id2bl(id);
+	return BL_CAST(BL_MOB, bl);
 }
 
 struct npc_data * map_id2nd(int id){
@@ -2320,17 +2819,52 @@ struct map_session_data * map_nick2sd(const char *nick, bool allow_partial)
 }
 
 /*==========================================
- * Looksup id_db DBMap and returns BL pointer of 'id' or NULL if not found
+ * Looksup the id table and returns BL pointer of 'id' or NULL if not found
  *------------------------------------------*/
 struct block_list * map_id2bl(int id) {
-	return (struct block_list*)idb_get(id_db,id);
+	struct s_idtable_segment* segment;
+
+	if( id <= 0 || (segment = idtable[id >> IDTABLE_SEGMENT_BITS]) == NULL )
+		return NULL;
+	return segment->bl[id & (IDTABLE_SEGMENT_SIZE - 1)];
 }
 
 /**
  * Same as map_id2bl except it only checks for its existence
  **/
 bool map_blid_exists( int id ) {
-	return (idb_exists(id_db,id));
+	return (map_id2bl(id) != NULL);
+}
+
+/**
+ * Returns the generation of the block_list of an id.
+ * Every block_list that is registered with an id gets a new generation, so
+ * an id saved together with its generation can not refer to a block_list
+ * that reused the id later, see map_id2bl_generation.
+ * @param id: Block list ID
+ * @return Generation or 0 if the id is not in use
+ */
+uint32 map_id2generation(int id) {
+	struct s_idtable_segment* segment;
+
+	if( id <= 0 || (segment = idtable[id >> IDTABLE_SEGMENT_BITS]) == NULL )
+		return 0;
+	return segment->generation[id & (IDTABLE_SEGMENT_SIZE - 1)];
+}
+
+/**
+ * Same as map_id2bl but only returns the block_list of the given generation.
+ * @param id: Block list ID
+ * @param generation: Generation returned by map_id2generation
+ * @return Block list or NULL if not found or the id was reused
+ */
+struct block_list * map_id2bl_generation(int id, uint32 generation) {
+	struct s_idtable_segment* segment;
+	int index = id & (IDTABLE_SEGMENT_SIZE - 1);
+
+	if( id <= 0 || (segment = idtable[id >> IDTABLE_SEGMENT_BITS]) == NULL || segment->generation[index] != generation )
+		return NULL;
+	return segment->bl[index];
 }
 
 /*==========================================
@@ -2385,25 +2919,25 @@ void map_foreachpc(int (*func)(struct map_session_data* sd, va_list args), ...)
 }
 
 /// Applies func to all the mobs in the db.
+/// Walks mob_pool in memory order instead of mobid_db.
 /// Stops iterating if func returns -1.
 void map_foreachmob(int (*func)(struct mob_data* md, va_list args), ...)
 {
-	DBIterator* iter;
-	struct mob_data* md;
+	va_list ap;
 
-	iter = db_iterator(mobid_db);
-	for( md = (struct mob_data*)dbi_first(iter); dbi_exists(iter); md = (struct mob_data*)dbi_next(iter) )
-	{
+	va_start(ap, func);
+	mob_pool.foreach( [&]( struct mob_data* md ) -> int {
 		va_list args;
 		int ret;
 
-		va_start(args, func);
+		if( map_id2bl(md->bl.id) != &md->bl )
+			return 0;// removed, waiting for map_freeblock_unlock
+		va_copy(args, ap);
 		ret = func(md, args);
 		va_end(args);
-		if( ret == -1 )
-			break;// stop iterating
-	}
-	dbi_destroy(iter);
+		return ret;
+	} );
+	va_end(ap);
 }
 
 /// Applies func to all the npcs in the db.
@@ -2679,6 +3213,7 @@ bool map_addnpc(int16 m,struct npc_data *nd)
 	}
 	mapdata->npc_num++;
 	idb_put(id_db,nd->bl.id,nd);
+	map_idtable_set(nd->bl.id, &nd->bl);
 	return true;
 }
 
@@ -2689,7 +3224,7 @@ int map_addinstancemap(const char *name, unsigned short instance_id)
 {
 	int16 src_m = map_mapname2mapid(name);
 	char iname[MAP_NAME_LENGTH];
-	size_t num_cell, size;
+	size_t size;
 
 	if(src_m < 0)
 		return -1;
@@ -2746,10 +3281,8 @@ int map_addinstancemap(const char *name, unsigned short instance_id)
 	dst_map->npc_num_area = 0;
 	dst_map->npc_num_warp = 0;
 
-	// Reallocate cells
-	num_cell = dst_map->xs * dst_map->ys;
-	CREATE( dst_map->cell, struct mapcell, num_cell );
-	memcpy( dst_map->cell, src_map->cell, num_cell * sizeof(struct mapcell) );
+	// Share the terrain of the source map
+	map_cell_share(dst_map, src_map);
 
 	size = dst_map->bxs * dst_map->bys * sizeof(struct block_list*);
 	dst_map->block = (struct block_list **)aCalloc(1,size);
@@ -2834,9 +3367,7 @@ int map_delinstancemap(int m)
 	mapdata->mob_delete_timer = INVALID_TIMER;
 
 	// Free memory
-	if (mapdata->cell)
-		aFree(mapdata->cell);
-	mapdata->cell = NULL;
+	map_cell_free(mapdata);
 	if (mapdata->block)
 		aFree(mapdata->block);
 	mapdata->block = NULL;
@@ -2846,7 +3377,7 @@ int map_delinstancemap(int m)
 
 	map_free_questinfo(mapdata);
 	mapdata->damage_adjust = {};
-	mapdata->flag.clear();
+	mapdata->flag.fill(0);
 	mapdata->skill_damage.clear();
 
 	mapindex_removemap(mapdata->index);
@@ -3193,6 +3724,28 @@ int map_getcell(int16 m,int16 x,int16 y,cell_chk cellchk)
 		return map_getcellp(map_getmapdata(m), x, y, cellchk);
 }
 
+/// Checks if the result of a cell check depends on the dynamic flags of the cell.
+static inline bool map_cell_chkdynamic(cell_chk cellchk)
+{
+	switch( cellchk ) {
+		case CELL_GETTYPE:
+		case CELL_CHKWALL:
+		case CELL_CHKWATER:
+		case CELL_CHKCLIFF:
+		case CELL_CHKREACH:
+		case CELL_CHKNOREACH:
+			return false;
+#ifndef CELL_NOSTACK
+		case CELL_CHKPASS:
+		case CELL_CHKNOPASS:
+		case CELL_CHKSTACK:
+			return false;
+#endif
+		default:
+			return true;
+	}
+}
+
 int map_getcellp(struct map_data* m,int16 x,int16 y,cell_chk cellchk)
 {
 	struct mapcell cell;
@@ -3205,6 +3758,14 @@ int map_getcellp(struct map_data* m,int16 x,int16 y,cell_chk cellchk)
 
 	cell = m->cell[x + y*m->xs];
 
+	// The terrain of instance maps comes from the shared cells, the dynamic flags from the overlay
+	if( m->cell_shared && map_cell_chkdynamic(cellchk) ) {
+		static const struct mapcell empty = {};
+		auto it = m->cell_overlay.find(x + y*m->xs);
+
+		map_cell_copydynamic(&cell, it != m->cell_overlay.end() ? &it->second : &empty);
+	}
+
 	switch(cellchk)
 	{
 		// gat type retrieval
@@ -3273,6 +3834,7 @@ int map_getcellp(struct map_data* m,int16 x,int16 y,cell_chk cellchk)
 void map_setcell(int16 m, int16 x, int16 y, cell_t cell, bool flag)
 {
 	int j;
+	struct mapcell* c;
 	struct map_data *mapdata = map_getmapdata(m);
 
 	if( m < 0 || x < 0 || x >= mapdata->xs || y < 0 || y >= mapdata->ys )
@@ -3280,22 +3842,30 @@ void map_setcell(int16 m, int16 x, int16 y, cell_t cell, bool flag)
 
 	j = x + y*mapdata->xs;
 
+	if( cell == CELL_WALKABLE || cell == CELL_SHOOTABLE || cell == CELL_WATER )
+		map_cell_terrain_write(mapdata);
+	c = map_cell_dynamic(mapdata, j);
+
 	switch( cell ) {
-		case CELL_WALKABLE:      mapdata->cell[j].walkable = flag;      break;
-		case CELL_SHOOTABLE:     mapdata->cell[j].shootable = flag;     break;
-		case CELL_WATER:         mapdata->cell[j].water = flag;         break;
-
-		case CELL_NPC:           mapdata->cell[j].npc = flag;           break;
-		case CELL_BASILICA:      mapdata->cell[j].basilica = flag;      break;
-		case CELL_LANDPROTECTOR: mapdata->cell[j].landprotector = flag; break;
-		case CELL_NOVENDING:     mapdata->cell[j].novending = flag;     break;
-		case CELL_NOCHAT:        mapdata->cell[j].nochat = flag;        break;
-		case CELL_MAELSTROM:	 mapdata->cell[j].maelstrom = flag;	  break;
-		case CELL_ICEWALL:		 mapdata->cell[j].icewall = flag;		  break;
+		case CELL_WALKABLE:      c->walkable = flag;      break;
+		case CELL_SHOOTABLE:     c->shootable = flag;     break;
+		case CELL_WATER:         c->water = flag;         break;
+
+		case CELL_NPC:           c->npc = flag;           break;
+		case CELL_BASILICA:      c->basilica = flag;      break;
+		case CELL_LANDPROTECTOR: c->landprotector = flag; break;
+		case CELL_NOVENDING:     c->novending = flag;     break;
+		case CELL_NOCHAT:        c->nochat = flag;        break;
+		case CELL_MAELSTROM:	 c->maelstrom = flag;	  break;
+		case CELL_ICEWALL:		 c->icewall = flag;		  break;
 		default:
 			ShowWarning("map_setcell: invalid cell type '%d'\n", (int)cell);
 			break;
 	}
+
+	if( cell == CELL_WALKABLE || cell == CELL_SHOOTABLE || cell == CELL_WATER )
+		map_cell_planeset(mapdata, x, y, c);
+	map_cell_dynamic_done(mapdata, j);
 }
 
 void map_setgatcell(int16 m, int16 x, int16 y, int gat)
@@ -3310,9 +3880,11 @@ void map_setgatcell(int16 m, int16 x, int16 y, int gat)
 	j = x + y*mapdata->xs;
 
 	cell = map_gat2cell(gat);
+	map_cell_terrain_write(mapdata);
 	mapdata->cell[j].walkable = cell.walkable;
 	mapdata->cell[j].shootable = cell.shootable;
 	mapdata->cell[j].water = cell.water;
+	map_cell_planeset(mapdata, x, y, &mapdata->cell[j]);
 }
 
 /*==========================================
@@ -3505,85 +4077,229 @@ int map_eraseipport(unsigned short mapindex, uint32 ip, uint16 port)
 }
 
 /*==========================================
- * [Shinryo]: Init the mapcache
- *------------------------------------------*/
-static char *map_init_mapcache(FILE *fp)
+ * Map cache files
+ * The file is mapped into memory, version 2 files are looked up in their
+ * sorted index, version 1 files are indexed by name once when opened.
+ *==========================================*/
+static void map_cache_close(struct s_map_cache* cache)
 {
-	size_t size = 0;
-	char *buffer;
+	if( cache->data != NULL ) {
+		if( !cache->mapped )
+			aFree(cache->data);
+#ifdef WIN32
+		else {
+			UnmapViewOfFile(cache->data);
+			CloseHandle(cache->mapping);
+			CloseHandle(cache->file);
+		}
+#else
+		else
+			munmap(cache->data, cache->size);
+#endif
+	}
+	cache->data = NULL;
+	cache->size = 0;
+	cache->mapped = false;
+	cache->index = NULL;
+	cache->map_count = 0;
+	cache->names.clear();
+}
 
-	// No file open? Return..
-	nullpo_ret(fp);
+/// Maps the file into memory, falls back to reading it.
+static bool map_cache_load(struct s_map_cache* cache, const char* path)
+{
+	FILE* fp;
+
+#ifdef WIN32
+	cache->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if( cache->file != INVALID_HANDLE_VALUE ) {
+		LARGE_INTEGER size;
+
+		if( GetFileSizeEx(cache->file, &size) && size.QuadPart > 0
+		&& (cache->mapping = CreateFileMapping(cache->file, NULL, PAGE_READONLY, 0, 0, NULL)) != NULL ) {
+			if( (cache->data = (char*)MapViewOfFile(cache->mapping, FILE_MAP_READ, 0, 0, 0)) != NULL ) {
+				cache->size = (size_t)size.QuadPart;
+				cache->mapped = true;
+				return true;
+			}
+			CloseHandle(cache->mapping);
+		}
+		CloseHandle(cache->file);
+	}
+#else
+	int fd = open(path, O_RDONLY);
+
+	if( fd >= 0 ) {
+		struct stat st;
+		void* data;
+
+		if( fstat(fd, &st) == 0 && st.st_size > 0
+		&& (data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED ) {
+			close(fd);
+			cache->data = (char*)data;
+			cache->size = (size_t)st.st_size;
+			cache->mapped = true;
+			return true;
+		}
+		close(fd);
+	}
+#endif
+
+	if( (fp = fopen(path, "rb")) == NULL )
+		return false;
 
 	// Get file size
 	fseek(fp, 0, SEEK_END);
-	size = ftell(fp);
+	cache->size = ftell(fp);
 	fseek(fp, 0, SEEK_SET);
 
-	// Allocate enough space
-	CREATE(buffer, char, size);
+	CREATE(cache->data, char, cache->size);
+	if( fread(cache->data, 1, cache->size, fp) != cache->size ) {
+		ShowError("map_cache_load: Could not read entire mapcache file\n");
+		aFree(cache->data);
+		cache->data = NULL;
+		fclose(fp);
+		return false;
+	}
+	fclose(fp);
+	return true;
+}
 
-	// No memory? Return..
-	nullpo_ret(buffer);
+/// Opens a map cache and checks its index.
+/// @return 1 on success, 0 if the file could not be opened, -1 if it is invalid
+static int map_cache_open(struct s_map_cache* cache, const char* path)
+{
+	if( !map_cache_load(cache, path) )
+		return 0;
 
-	// Read file into buffer..
-	if(fread(buffer, 1, size, fp) != size) {
-		ShowError("map_init_mapcache: Could not read entire mapcache file\n");
-		return NULL;
+	if( cache->size >= sizeof(struct map_cache_header2) && memcmp(cache->data, MAP_CACHE_MAGIC, 4) == 0 ) {
+		const struct map_cache_header2* header = (const struct map_cache_header2*)cache->data;
+
+		if( header->version != MAP_CACHE_VERSION ) {
+			ShowError("map_cache_open: Unsupported map cache version %d in %s.\n", header->version, path);
+			map_cache_close(cache);
+			return -1;
+		}
+		if( cache->size < sizeof(struct map_cache_header2) + (size_t)header->map_count * sizeof(struct map_cache_index2) ) {
+			ShowError("map_cache_open: Map cache %s is truncated.\n", path);
+			map_cache_close(cache);
+			return -1;
+		}
+		cache->index = (const struct map_cache_index2*)(cache->data + sizeof(struct map_cache_header2));
+		cache->map_count = header->map_count;
+		return 1;
+	}
+
+	// Version 1, the maps are stored one after another
+	const struct map_cache_main_header* header = (const struct map_cache_main_header*)cache->data;
+	size_t offset = sizeof(struct map_cache_main_header);
+
+	if( cache->size < sizeof(struct map_cache_main_header) ) {
+		map_cache_close(cache);
+		return -1;
 	}
 
-	return buffer;
+	for( uint16 i = 0; i < header->map_count; i++ ) {
+		const struct map_cache_map_info* info = (const struct map_cache_map_info*)(cache->data + offset);
+
+		if( offset + sizeof(struct map_cache_map_info) > cache->size || info->len < 0 || offset + sizeof(struct map_cache_map_info) + info->len > cache->size ) {
+			ShowWarning("map_cache_open: Map cache %s is truncated after %d maps.\n", path, i);
+			break;
+		}
+		// The first entry of a name is used, like the linear search did
+		cache->names.emplace(std::string(info->name, strnlen(info->name, MAP_NAME_LENGTH)), info);
+		offset += sizeof(struct map_cache_map_info) + info->len;
+	}
+	cache->map_count = (uint32)cache->names.size();
+	return 1;
+}
+
+/// Compares a map name with an index entry for the binary search.
+static bool map_cache_index_less(const struct map_cache_index2& entry, const char* name)
+{
+	return strncmp(entry.name, name, MAP_NAME_LENGTH) < 0;
 }
 
 /*==========================================
  * Map cache reading
  * [Shinryo]: Optimized some behaviour to speed this up
  *==========================================*/
-int map_readfromcache(struct map_data *m, char *buffer, char *decode_buffer)
+int map_readfromcache(struct map_data *m, struct s_map_cache* cache, char *decode_buffer)
 {
-	int i;
-	struct map_cache_main_header *header = (struct map_cache_main_header *)buffer;
-	struct map_cache_map_info *info = NULL;
-	char *p = buffer + sizeof(struct map_cache_main_header);
-
-	for(i = 0; i < header->map_count; i++) {
-		info = (struct map_cache_map_info *)p;
+	unsigned long size, xy;
+	int16 xs, ys;
+	uint8 encoding;
+	const char* payload;
+	unsigned long len;
+
+	if( cache->index != NULL ) {
+		const struct map_cache_index2* end = cache->index + cache->map_count;
+		const struct map_cache_index2* entry = std::lower_bound(cache->index, end, m->name, map_cache_index_less);
+
+		if( entry == end || strncmp(entry->name, m->name, MAP_NAME_LENGTH) != 0 )
+			return 0; // Not found
+		if( (size_t)entry->offset + entry->len > cache->size )
+			return 0; // Invalid
+
+		xs = entry->xs;
+		ys = entry->ys;
+		encoding = entry->encoding;
+		payload = cache->data + entry->offset;
+		len = entry->len;
+	} else {
+		auto it = cache->names.find(m->name);
 
-		if( strcmp(m->name, info->name) == 0 )
-			break; // Map found
+		if( it == cache->names.end() )
+			return 0; // Not found
 
-		// Jump to next entry..
-		p += sizeof(struct map_cache_map_info) + info->len;
+		xs = it->second->xs;
+		ys = it->second->ys;
+		encoding = MAPCACHE_ZLIB;
+		payload = (const char*)(it->second + 1);
+		len = it->second->len;
 	}
 
-	if( info && i < header->map_count ) {
-		unsigned long size, xy;
-
-		if( info->xs <= 0 || info->ys <= 0 )
-			return 0;// Invalid
+	if( xs <= 0 || ys <= 0 )
+		return 0;// Invalid
 
-		m->xs = info->xs;
-		m->ys = info->ys;
-		size = (unsigned long)info->xs*(unsigned long)info->ys;
+	m->xs = xs;
+	m->ys = ys;
+	size = (unsigned long)xs*(unsigned long)ys;
 
-		if(size > MAX_MAP_SIZE) {
-			ShowWarning("map_readfromcache: %s exceeded MAX_MAP_SIZE of %d\n", info->name, MAX_MAP_SIZE);
-			return 0; // Say not found to remove it from list.. [Shinryo]
-		}
-
-		// TO-DO: Maybe handle the scenario, if the decoded buffer isn't the same size as expected? [Shinryo]
-		decode_zip(decode_buffer, &size, p+sizeof(struct map_cache_map_info), info->len);
+	if(size > MAX_MAP_SIZE) {
+		ShowWarning("map_readfromcache: %s exceeded MAX_MAP_SIZE of %d\n", m->name, MAX_MAP_SIZE);
+		return 0; // Say not found to remove it from list.. [Shinryo]
+	}
 
-		CREATE(m->cell, struct mapcell, size);
+	switch( encoding ) {
+		case MAPCACHE_ZLIB: {
+			unsigned long decoded = size;
 
+			if( decode_zip(decode_buffer, &decoded, payload, len) != 0 || decoded != size ) {
+				ShowWarning("map_readfromcache: %s has damaged cells\n", m->name);
+				return 0;
+			}
+			payload = decode_buffer;
+			break;
+		}
+		case MAPCACHE_RAW:
+			// The cells are read straight from the mapped file
+			if( len != size ) {
+				ShowWarning("map_readfromcache: %s has damaged cells\n", m->name);
+				return 0;
+			}
+			break;
+		default:
+			ShowWarning("map_readfromcache: %s has unknown encoding %d\n", m->name, encoding);
+			return 0;
+	}
 
-		for( xy = 0; xy < size; ++xy )
-			m->cell[xy] = map_gat2cell(decode_buffer[xy]);
+	CREATE(m->cell, struct mapcell, size);
 
-		return 1;
-	}
+	for( xy = 0; xy < size; ++xy )
+		m->cell[xy] = map_gat2cell((uint8)payload[xy]);
 
-	return 0; // Not found
+	return 1;
 }
 
 int map_addmap(char* mapname)
@@ -3638,8 +4354,7 @@ void map_flags_init(void){
 		struct map_data *mapdata = &map[i];
 		union u_mapflag_args args = {};
 
-		mapdata->flag.clear();
-		mapdata->flag.reserve(MF_MAX); // Reserve the bucket size
+		mapdata->flag.fill(0);
 		args.flag_val = 100;
 
 		// additional mapflag data
@@ -3675,7 +4390,7 @@ void map_data_copy(struct map_data *dst_map, struct map_data *src_map) {
 	memcpy(&dst_map->save, &src_map->save, sizeof(struct point));
 	memcpy(&dst_map->damage_adjust, &src_map->damage_adjust, sizeof(struct s_skill_damage));
 
-	dst_map->flag.insert(src_map->flag.begin(), src_map->flag.end());
+	dst_map->flag = src_map->flag;
 	dst_map->skill_damage.insert(src_map->skill_damage.begin(), src_map->skill_damage.end());
 	dst_map->skill_duration.insert(src_map->skill_duration.begin(), src_map->skill_duration.end());
 
@@ -3791,15 +4506,56 @@ void map_removemapdb(struct map_data *m)
 /*======================================
  * Initiate maps loading stage
  *--------------------------------------*/
-int map_readallmaps (void)
+/*==========================================
+ * Decodes the cells of all maps from the map caches.
+ * The maps are shared out to worker threads one at a time, every map is
+ * only written by the thread decoding it. The main thread decodes as well.
+ * @param map_cache: main and import map cache
+ * @param success: set to 1 for every map that was found
+ * @return number of threads used
+ *------------------------------------------*/
+static int map_readallcaches(struct s_map_cache map_cache[2], std::vector<uint8>& success)
 {
-	FILE* fp=NULL;
-	// Has the uncompressed gat data of all maps, so just one allocation has to be made
-	char *map_cache_buffer[2] = {
-		NULL,
-		NULL
+	std::atomic<int> next(0);
+	std::vector<std::thread> workers;
+	int threads = map_load_threads;
+
+	if( threads <= 0 )
+		threads = (int)std::thread::hardware_concurrency();
+	threads = cap_value(threads, 1, max(map_num, 1));
+
+	success.assign(map_num, 0);
+
+	auto decode = [&map_cache, &success, &next]() {
+		std::vector<char> decode_buffer(MAX_MAP_SIZE);
+
+		for( int i = next++; i < map_num; i = next++ ) {
+			// Read from import first, in case of override
+			if( map_cache[1].data != NULL )
+				success[i] = map_readfromcache(&map[i], &map_cache[1], decode_buffer.data()) != 0;
+
+			// Nothing was found in import - try to find it in the main file
+			if( !success[i] )
+				success[i] = map_readfromcache(&map[i], &map_cache[0], decode_buffer.data()) != 0;
+		}
 	};
-	char map_cache_decode_buffer[MAX_MAP_SIZE];
+
+	for( int i = 1; i < threads; i++ )
+		workers.push_back(std::thread(decode));
+	decode();
+	for( std::thread& worker : workers )
+		worker.join();
+
+	return threads;
+}
+
+int map_readallmaps (void)
+{
+	// The main and the import map cache
+	struct s_map_cache map_cache[2] = {};
+	std::vector<uint8> decoded; // result of every map, in the order of the map list
+	t_tick start = gettick();
+	int threads = 1;
 
 	if( enable_grf )
 		ShowStatus("Loading maps (using GRF files)...\n");
@@ -3812,31 +4568,31 @@ int map_readallmaps (void)
 		for( int i = 0; i < 2; i++ ){
 			ShowStatus( "Loading maps (using %s as map cache)...\n", mapcachefilepath[i] );
 
-			if( ( fp = fopen(mapcachefilepath[i], "rb") ) == NULL ){
-				if( i == 0 ){
-					ShowFatalError( "Unable to open map cache file " CL_WHITE "%s" CL_RESET "\n", mapcachefilepath[i] );
-					exit(EXIT_FAILURE); //No use launching server if maps can't be read.
-				}else{
+			switch( map_cache_open(&map_cache[i], mapcachefilepath[i]) ){
+				case 0:
+					if( i == 0 ){
+						ShowFatalError( "Unable to open map cache file " CL_WHITE "%s" CL_RESET "\n", mapcachefilepath[i] );
+						exit(EXIT_FAILURE); //No use launching server if maps can't be read.
+					}
 					ShowWarning( "Unable to open map cache file " CL_WHITE "%s" CL_RESET "\n", mapcachefilepath[i] );
 					break;
-				}
-			}
-
-			// Init mapcache data. [Shinryo]
-			map_cache_buffer[i] = map_init_mapcache(fp);
-
-			if( !map_cache_buffer[i] ) {
-				ShowFatalError( "Failed to initialize mapcache data (%s)..\n", mapcachefilepath[i] );
-				exit(EXIT_FAILURE);
+				case -1:
+					ShowFatalError( "Failed to initialize mapcache data (%s)..\n", mapcachefilepath[i] );
+					exit(EXIT_FAILURE);
 			}
 
-			fclose(fp);
+			if( map_cache[i].data == NULL )
+				break;
 		}
 	}
 
 	int maps_removed = 0;
 
-	for (int i = 0; i < map_num; i++) {
+	if( !enable_grf )
+		threads = map_readallcaches(map_cache, decoded);
+
+	// Register the maps in the order of the map list, the cells have already been decoded
+	for (int i = 0, list_id = 0; i < map_num; i++, list_id++) {
 		size_t size;
 		bool success = false;
 		unsigned short idx = 0;
@@ -3849,16 +4605,7 @@ int map_readallmaps (void)
 			// try to load the map
 			success = map_readgat(mapdata) != 0;
 		}else{
-			// try to load the map
-			// Read from import first, in case of override
-			if( map_cache_buffer[1] != NULL ){
-				success = map_readfromcache( mapdata, map_cache_buffer[1], map_cache_decode_buffer ) != 0;
-			}
-
-			// Nothing was found in import - try to find it in the main file
-			if( !success ){
-				success = map_readfromcache( mapdata, map_cache_buffer[0], map_cache_decode_buffer ) != 0;
-			}
+			success = decoded[list_id] != 0;
 		}
 
 		// The map was not found - remove it
@@ -3884,6 +4631,7 @@ int map_readallmaps (void)
 		}
 
 		map_addmap2db(mapdata);
+		map_cell_planebuild(mapdata);
 
 		mapdata->m = i;
 		memset(mapdata->moblist, 0, sizeof(mapdata->moblist));	//Initialize moblist [Skotlex]
@@ -3906,17 +4654,15 @@ int map_readallmaps (void)
 
 	if( !enable_grf ) {
 		// The cache isn't needed anymore, so free it. [Shinryo]
-		if( map_cache_buffer[1] != NULL ){
-			aFree(map_cache_buffer[1]);
-		}
-		aFree(map_cache_buffer[0]);
+		map_cache_close(&map_cache[1]);
+		map_cache_close(&map_cache[0]);
 	}
 
 	if (maps_removed)
 		ShowNotice("Maps removed: '" CL_WHITE "%d" CL_RESET "'" CL_CLL ".\n", maps_removed);
 
 	// finished map loading
-	ShowInfo("Successfully loaded '" CL_WHITE "%d" CL_RESET "' maps." CL_CLL "\n",map_num);
+	ShowInfo("Successfully loaded '" CL_WHITE "%d" CL_RESET "' maps in '" CL_WHITE "%" PRtf CL_RESET "' ms using '" CL_WHITE "%d" CL_RESET "' thread(s)." CL_CLL "\n", map_num, DIFF_TICK(gettick(), start), threads);
 
 	return 0;
 }
@@ -4088,6 +4834,8 @@ int map_config_read(const char *cfgName)
 			enable_spy = config_switch(w2);
 		else if (strcmpi(w1, "use_grf") == 0)
 			enable_grf = config_switch(w2);
+		else if (strcmpi(w1, "map_load_threads") == 0)
+			map_load_threads = cap_value(atoi(w2), 0, 256);
 		else if (strcmpi(w1, "console_msg_log") == 0)
 			console_msg_log = atoi(w2);//[Ind]
 		else if (strcmpi(w1, "console_log_filepath") == 0)
@@ -4577,12 +5325,6 @@ int map_getmapflag_sub(int16 m, enum e_mapflag mapflag, union u_mapflag_args *ar
 	switch(mapflag) {
 		case MF_RESTRICTED:
 			return mapdata->zone;
-		case MF_NOLOOT:
-			return util::umap_get(mapdata->flag, static_cast<int16>(MF_NOMOBLOOT), 0) && util::umap_get(mapdata->flag, static_cast<int16>(MF_NOMVPLOOT), 0);
-		case MF_NOPENALTY:
-			return util::umap_get(mapdata->flag, static_cast<int16>(MF_NOEXPPENALTY), 0) && util::umap_get(mapdata->flag, static_cast<int16>(MF_NOZENYPENALTY), 0);
-		case MF_NOEXP:
-			return util::umap_get(mapdata->flag, static_cast<int16>(MF_NOBASEEXP), 0) && util::umap_get(mapdata->flag, static_cast<int16>(MF_NOJOBEXP), 0);
 		case MF_SKILL_DAMAGE:
 			nullpo_retr(-1, args);
 
@@ -4595,13 +5337,24 @@ int map_getmapflag_sub(int16 m, enum e_mapflag mapflag, union u_mapflag_args *ar
 				case SKILLDMG_CASTER:
 					return mapdata->damage_adjust.caster;
 				default:
-					return util::umap_get(mapdata->flag, static_cast<int16>(mapflag), 0);
+					return mapdata->flag[mapflag];
 			}
 		default:
-			return util::umap_get(mapdata->flag, static_cast<int16>(mapflag), 0);
+			return mapdata->flag[mapflag];
 	}
 }
 
+/**
+ * Updates the mapflags that combine other mapflags, so reading them is a plain lookup
+ * @param mapdata: Map data
+ */
+static void map_setmapflag_composite(struct map_data *mapdata)
+{
+	mapdata->flag[MF_NOLOOT] = mapdata->flag[MF_NOMOBLOOT] && mapdata->flag[MF_NOMVPLOOT];
+	mapdata->flag[MF_NOPENALTY] = mapdata->flag[MF_NOEXPPENALTY] && mapdata->flag[MF_NOZENYPENALTY];
+	mapdata->flag[MF_NOEXP] = mapdata->flag[MF_NOBASEEXP] && mapdata->flag[MF_NOJOBEXP];
+}
+
 /**
  * Set a mapflag
  * @param m: Map ID
@@ -4855,6 +5608,7 @@ bool map_setmapflag_sub(int16 m, enum e_mapflag mapflag, bool status, union u_ma
 			break;
 	}
 
+	map_setmapflag_composite(mapdata);
 	return true;
 }
 
@@ -4933,7 +5687,7 @@ void do_final(void){
 	for (int i = 0; i < map_num; i++) {
 		struct map_data *mapdata = map_getmapdata(i);
 
-		if(mapdata->cell) aFree(mapdata->cell);
+		map_cell_free(mapdata);
 		if(mapdata->block) aFree(mapdata->block);
 		if(mapdata->block_mob) aFree(mapdata->block_mob);
 		if(battle_config.dynamic_mobs) { //Dynamic mobs flag by [random]
@@ -4951,6 +5705,12 @@ void do_final(void){
 		grfio_final();
 
 	id_db->destroy(id_db, NULL);
+	for( int i = 0; i < IDTABLE_SEGMENTS; i++ ) {
+		if( idtable[i] != NULL )
+			aFree(idtable[i]);
+	}
+	aFree(idtable);
+	idtable = NULL;
 	pc_db->destroy(pc_db, NULL);
 	mobid_db->destroy(mobid_db, NULL);
 	bossid_db->destroy(bossid_db, NULL);
@@ -4959,6 +5719,7 @@ void do_final(void){
 	iwall_db->destroy(iwall_db, NULL);
 	regen_db->destroy(regen_db, NULL);
 
+	do_final_log();
 	map_sql_close();
 
 	ShowStatus("Finished.\n");
@@ -5199,19 +5960,21 @@ int do_init(int argc, char *argv[])
 	inter_config_read(INTER_CONF_NAME);
 	log_config_read(LOG_CONF_NAME);
 
-	id_db = idb_alloc(DB_OPT_BASE);
-	pc_db = idb_alloc(DB_OPT_BASE);	//Added for reliable map_id2sd() use. [Skotlex]
-	mobid_db = idb_alloc(DB_OPT_BASE);	//Added to lower the load of the lazy mob ai. [Skotlex]
+	id_db = idb_alloc(MAP_ID_DB_OPTIONS);
+	CREATE(idtable, struct s_idtable_segment*, IDTABLE_SEGMENTS);
+	pc_db = idb_alloc(MAP_ID_DB_OPTIONS);	//Added for reliable map_id2sd() use. [Skotlex]
+	mobid_db = idb_alloc(MAP_ID_DB_OPTIONS);	//Added to lower the load of the lazy mob ai. [Skotlex]
 	bossid_db = idb_alloc(DB_OPT_BASE); // Used for Convex Mirror quick MVP search
 	map_db = uidb_alloc(DB_OPT_BASE);
-	nick_db = idb_alloc(DB_OPT_BASE);
-	charid_db = uidb_alloc(DB_OPT_BASE);
-	regen_db = idb_alloc(DB_OPT_BASE); // efficient status_natural_heal processing
+	nick_db = idb_alloc(MAP_ID_DB_OPTIONS);
+	charid_db = uidb_alloc(MAP_ID_DB_OPTIONS);
+	regen_db = idb_alloc(MAP_ID_DB_OPTIONS); // efficient status_natural_heal processing
 	iwall_db = strdb_alloc(DB_OPT_RELEASE_DATA,2*NAME_LENGTH+2+1); // [Zephyrus] Invisible Walls
 
 	map_sql_init();
 	if (log_config.sql_logs)
 		log_sql_init();
+	do_init_log();
 
 	mapindex_init();
 	if(enable_grf)
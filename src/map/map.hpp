@@ -5,6 +5,7 @@
 #define MAP_HPP
 
 #include <algorithm>
+#include <array>
 #include <stdarg.h>
 #include <unordered_map>
 #include <vector>
@@ -42,6 +43,14 @@ void map_msg_reload(void);
 
 #define MAX_NPC_PER_MAP 512
 #define AREA_SIZE battle_config.area_size
+#define BLOCK_SIZE 8 ///< Size of the map blocks in cells
+
+/// Options of the id databases, see MAP_DB_OPEN_ADDRESSING
+#ifdef MAP_DB_OPEN_ADDRESSING
+	#define MAP_ID_DB_OPTIONS DB_OPT_OPEN_ADDRESSING
+#else
+	#define MAP_ID_DB_OPTIONS DB_OPT_BASE
+#endif
 #define DAMAGELOG_SIZE 30
 #define LOOTITEM_SIZE 10
 #define MAX_MOBSKILL 50		//Max 128, see mob skill_idx type if need this higher
@@ -701,6 +710,17 @@ struct mapcell
 #endif
 };
 
+/// Terrain flags of all cells of a map, one bit array per flag.
+/// Bit x%64 of word y*stride + x/64 belongs to cell (x,y), rows are padded
+/// to whole cache lines. Allows checking many cells with one word operation.
+struct s_mapcell_planes {
+	int32 stride; // 64-bit words per row
+	uint64* walkable;
+	uint64* shootable;
+	uint64* water;
+	void* buffer; // allocation the planes are aligned in
+};
+
 struct iwall_data {
 	char wall_name[50];
 	short m, x, y, size;
@@ -732,7 +752,7 @@ struct map_data {
 	int users_pvp;
 	int iwall_num; // Total of invisible walls in this map
 
-	std::unordered_map<int16, int> flag;
+	std::array<int, MF_MAX> flag; // value of every mapflag, MF_NOLOOT, MF_NOPENALTY and MF_NOEXP are kept up to date by map_setmapflag_sub
 	struct point save;
 	std::vector<s_drop_list> drop_list;
 	uint32 zone; // zone number (for item/skill restrictions)
@@ -747,6 +767,9 @@ struct map_data {
 	// Instance Variables
 	unsigned short instance_id;
 	int instance_src_map;
+	bool cell_shared; // cell belongs to the source map, the dynamic flags are in cell_overlay
+	struct s_mapcell_planes* cell_planes; // terrain flags of cell as bitplanes, shared along with cell
+	std::unordered_map<int32, struct mapcell> cell_overlay; // cell index -> dynamic flags of the cell (only cells with flags)
 
 	/* rAthena Local Chat */
 	struct Channel *channel;
@@ -770,6 +793,10 @@ struct map_data_other_server {
 
 int map_getcell(int16 m,int16 x,int16 y,cell_chk cellchk);
 int map_getcellp(struct map_data* m,int16 x,int16 y,cell_chk cellchk);
+bool map_cell_planecheck(struct map_data* m, cell_chk cellchk);
+bool map_cell_anyrow(struct map_data* m, int16 y, int16 x0, int16 x1, cell_chk cellchk);
+bool map_cell_anyrect(struct map_data* m, int16 x0, int16 y0, int16 x1, int16 y1, cell_chk cellchk);
+int map_cell_countrect(struct map_data* m, int16 x0, int16 y0, int16 x1, int16 y1, cell_chk cellchk);
 void map_setcell(int16 m, int16 x, int16 y, cell_t cell, bool flag);
 void map_setgatcell(int16 m, int16 x, int16 y, int gat);
 
@@ -1054,6 +1081,8 @@ struct elemental_data* map_id2ed(int id);
 struct chat_data* map_id2cd(int id);
 struct block_list * map_id2bl(int id);
 bool map_blid_exists( int id );
+uint32 map_id2generation(int id);
+struct block_list * map_id2bl_generation(int id, uint32 generation);
 
 #define map_id2index(id) map[(id)].index
 const char* map_mapid2mapname(int m);
@@ -1169,6 +1198,12 @@ extern int db_use_sqldbs;
 extern Sql* mmysql_handle;
 extern Sql* qsmysql_handle;
 extern Sql* logmysql_handle;
+extern char log_db_ip[64];
+extern int log_db_port;
+extern char log_db_id[32];
+extern char log_db_pw[32];
+extern char log_db_db[32];
+extern char default_codepage[32];
 
 extern char buyingstores_table[32];
 extern char buyingstore_items_table[32];
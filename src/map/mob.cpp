@@ -75,6 +75,9 @@ struct mob_db *mob_db( int mob_id ){
 	return util::map_find( mob_db_data, (uint16)mob_id );
 }
 
+// Storage of the spawned monsters, freed by map_freeblock
+ObjectPool<struct mob_data> mob_pool( "mob.cpp::mob_pool" );
+
 // holds Monster Spawn informations
 std::unordered_map<uint16, std::vector<spawn_info>> mob_spawn_data;
 
@@ -237,7 +240,7 @@ void mvptomb_create(struct mob_data *md, char *killer, time_t time)
 	nd->speed = 200;
 	nd->subtype = NPCTYPE_TOMB;
 
-	nd->u.tomb.md = md;
+	nd->u.tomb.md_handle = mob_pool.handle(md);
 	nd->u.tomb.kill_time = time;
 	nd->u.tomb.spawn_timer = INVALID_TIMER;
 
@@ -277,6 +280,7 @@ void mvptomb_destroy(struct mob_data *md) {
 			mapdata->npc[mapdata->npc_num] = NULL;
 		}
 		map_deliddb(&nd->bl);
+		clif_appearance_free(&nd->bl);
 		aFree(nd);
 	}
 
@@ -454,7 +458,7 @@ int mob_parse_dataset(struct spawn_data *data)
  *------------------------------------------*/
 struct mob_data* mob_spawn_dataset(struct spawn_data *data)
 {
-	struct mob_data *md = (struct mob_data*)aCalloc(1, sizeof(struct mob_data));
+	struct mob_data *md = mob_pool.alloc();
 	md->bl.id= npc_get_new_npc_id();
 	md->bl.type = BL_MOB;
 	md->bl.m = data->m;
@@ -5720,5 +5724,6 @@ void do_final_mob(bool is_reload){
 	if( !is_reload ) {
 		ers_destroy(item_drop_ers);
 		ers_destroy(item_drop_list_ers);
+		mob_pool.clear();
 	}
 }
@@ -7,6 +7,7 @@
 #include <vector>
 
 #include "../common/database.hpp"
+#include "../common/ers.hpp" // ObjectPool
 #include "../common/mmo.hpp" // struct item
 #include "../common/timer.hpp"
 
@@ -311,6 +312,8 @@ struct item_drop_list {
 	struct item_drop* item;            // linked list of drops
 };
 
+extern ObjectPool<struct mob_data> mob_pool;
+
 struct mob_db *mob_db(int mob_id);
 uint16 mobdb_searchname(const char * const str);
 struct mob_db* mobdb_search_aegisname( const char* str );
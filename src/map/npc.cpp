@@ -1272,11 +1272,12 @@ void run_tomb(struct map_session_data* sd, struct npc_data* nd)
 {
 	char buffer[200];
 	char time[10];
+	struct mob_data *md = mob_pool.get(nd->u.tomb.md_handle);
 
 	strftime(time, sizeof(time), "%H:%M", localtime(&nd->u.tomb.kill_time));
 
 	// TODO: Find exact color?
-	snprintf(buffer, sizeof(buffer), msg_txt(sd,657), nd->u.tomb.md->db->name);
+	snprintf(buffer, sizeof(buffer), msg_txt(sd,657), md ? md->db->name : "Unknown");
 	clif_scriptmes(sd, nd->bl.id, buffer);
 
 	clif_scriptmes(sd, nd->bl.id, msg_txt(sd,658));
@@ -2251,6 +2252,7 @@ int npc_unload(struct npc_data* nd, bool single) {
 	status_change_clear(&nd->bl, 1);
 	npc_remove_map(nd);
 	map_deliddb(&nd->bl);
+	clif_appearance_free(&nd->bl);
 	if( single )
 		strdb_remove(npcname_db, nd->exname);
 
@@ -3744,6 +3746,7 @@ void npc_setdisplayname(struct npc_data* nd, const char* newname)
 	nullpo_retv(nd);
 
 	safestrncpy(nd->name, newname, sizeof(nd->name));
+	clif_appearance_invalidate(&nd->bl);
 	if( map_getmapdata(nd->bl.m)->users )
 		clif_name_area(&nd->bl);
 }
@@ -89,7 +89,7 @@ struct npc_data {
 			unsigned short mapindex; // destination map
 		} warp;
 		struct {
-			struct mob_data *md;
+			uint32 md_handle; // mob_pool handle of the MvP
 			time_t kill_time;
 			char killer_name[NAME_LENGTH];
 			int spawn_timer;
@@ -0,0 +1,234 @@
+// Copyright (c) rAthena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#ifndef PACKETS_HPP
+#define PACKETS_HPP
+
+#include "../common/cbasetypes.hpp"
+#include "../common/mmo.hpp"
+#include "../config/packets.hpp"
+
+// Layouts of outgoing packets
+//
+// Every packet is a packed struct whose fields follow the client's layout
+// for the configured PACKETVER, so an encoder fills the struct in place in
+// the send buffer and the length is known at compile time.
+// packetdb_readdb compares the size of the fixed length packets with
+// clif_packetdb.hpp on startup.
+// Packets that end with a name are sent without the unused part of the name.
+
+#define DEFINE_PACKET_HEADER(name, id) const int16 HEADER_##name = id;
+
+#pragma pack(push, 1)
+
+/// 0086 <id>.L <walk data>.6B <walk start time>.L
+struct PACKET_ZC_NOTIFY_MOVE {
+	int16 PacketType;
+	uint32 GID;
+	uint8 MoveData[6];
+	uint32 moveStartTime;
+};
+DEFINE_PACKET_HEADER(ZC_NOTIFY_MOVE, 0x86)
+
+/// 0087 <walk start time>.L <walk data>.6B
+struct PACKET_ZC_NOTIFY_PLAYERMOVE {
+	int16 PacketType;
+	uint32 moveStartTime;
+	uint8 MoveData[6];
+};
+DEFINE_PACKET_HEADER(ZC_NOTIFY_PLAYERMOVE, 0x87)
+
+/// 008a <src ID>.L <dst ID>.L <server tick>.L <src speed>.L <dst speed>.L <damage>.W <div>.W <type>.B <damage2>.W (ZC_NOTIFY_ACT)
+/// 02e1 <src ID>.L <dst ID>.L <server tick>.L <src speed>.L <dst speed>.L <damage>.L <div>.W <type>.B <damage2>.L (ZC_NOTIFY_ACT2)
+/// 08c8 <src ID>.L <dst ID>.L <server tick>.L <src speed>.L <dst speed>.L <damage>.L <IsSPDamage>.B <div>.W <type>.B <damage2>.L (ZC_NOTIFY_ACT3)
+struct PACKET_ZC_NOTIFY_ACT {
+	int16 PacketType;
+	uint32 srcID;
+	uint32 targetID;
+	uint32 serverTick;
+	int32 srcSpeed;
+	int32 dmgSpeed;
+#if PACKETVER < 20071113
+	int16 damage;
+#else
+	int32 damage;
+#endif
+#if PACKETVER >= 20131223
+	uint8 isSPDamage;
+#endif
+	int16 count;
+	uint8 action;
+#if PACKETVER < 20071113
+	int16 leftDamage;
+#else
+	int32 leftDamage;
+#endif
+};
+#if PACKETVER < 20071113
+DEFINE_PACKET_HEADER(ZC_NOTIFY_ACT, 0x8a)
+#elif PACKETVER < 20131223
+DEFINE_PACKET_HEADER(ZC_NOTIFY_ACT, 0x2e1)
+#else
+DEFINE_PACKET_HEADER(ZC_NOTIFY_ACT, 0x8c8)
+#endif
+
+/// 0106 <account id>.L <hp>.W <max hp>.W (ZC_NOTIFY_HP_TO_GROUPM)
+/// 080e <account id>.L <hp>.L <max hp>.L (ZC_NOTIFY_HP_TO_GROUPM_R2)
+struct PACKET_ZC_NOTIFY_HP_TO_GROUPM {
+	int16 PacketType;
+	uint32 GID;
+#if PACKETVER < 20100126
+	int16 hp;
+	int16 maxhp;
+#else
+	int32 hp;
+	int32 maxhp;
+#endif
+};
+#if PACKETVER < 20100126
+DEFINE_PACKET_HEADER(ZC_NOTIFY_HP_TO_GROUPM, 0x106)
+#else
+DEFINE_PACKET_HEADER(ZC_NOTIFY_HP_TO_GROUPM, 0x80e)
+#endif
+
+#if PACKETVER >= 20120404
+/// 0977 <id>.L <HP>.L <maxHP>.L (ZC_HP_INFO)
+struct PACKET_ZC_HP_INFO {
+	int16 PacketType;
+	uint32 GID;
+	int32 HP;
+	int32 maxHP;
+};
+DEFINE_PACKET_HEADER(ZC_HP_INFO, 0x977)
+#endif
+
+#if PACKETVER >= 20091103
+/// Fields of a unit shared by the spawn, idle and walking packets
+/// (ZC_NOTIFY_NEWENTRY, ZC_NOTIFY_STANDENTRY, ZC_NOTIFY_MOVEENTRY and their successors).
+/// The walking packet carries its walk data in the middle, see PACKET_ZC_NOTIFY_MOVEENTRY.
+#define PACKET_UNIT_HEAD \
+	int16 PacketType; \
+	int16 PacketLength; \
+	uint8 objecttype; \
+	uint32 AID; \
+	PACKET_UNIT_GID \
+	int16 speed; \
+	int16 bodyState; \
+	int16 healthState; \
+	int32 effectState; \
+	int16 job; \
+	int16 head; \
+	int16 weapon; \
+	int16 shield; \
+	int16 accessory;
+
+#define PACKET_UNIT_LOOK \
+	int16 accessory2; \
+	int16 accessory3; \
+	int16 headpalette; \
+	int16 bodypalette; \
+	int16 headDir; \
+	PACKET_UNIT_ROBE \
+	uint32 GUID; \
+	int16 GEmblemVer; \
+	int16 honor; \
+	int32 virtue; \
+	uint8 isPKModeON; \
+	uint8 sex;
+
+#define PACKET_UNIT_TAIL \
+	int16 clevel; \
+	int16 font; \
+	PACKET_UNIT_HP \
+	PACKET_UNIT_BODY \
+	char name[NAME_LENGTH];
+
+#if PACKETVER >= 20131223
+	#define PACKET_UNIT_GID uint32 GID;
+#else
+	#define PACKET_UNIT_GID
+#endif
+#if PACKETVER >= 20110111
+	#define PACKET_UNIT_ROBE int16 robe;
+#else
+	#define PACKET_UNIT_ROBE
+#endif
+#if PACKETVER >= 20120221
+	#define PACKET_UNIT_HP int32 maxHP; int32 HP; uint8 isBoss;
+#else
+	#define PACKET_UNIT_HP
+#endif
+#if PACKETVER >= 20150513
+	#define PACKET_UNIT_BODY int16 body;
+#else
+	#define PACKET_UNIT_BODY
+#endif
+
+/// Unit appearing on screen
+struct PACKET_ZC_NOTIFY_NEWENTRY {
+	PACKET_UNIT_HEAD
+	PACKET_UNIT_LOOK
+	uint8 PosDir[3];
+	uint8 xSize;
+	uint8 ySize;
+	PACKET_UNIT_TAIL
+};
+
+/// Unit standing on screen
+struct PACKET_ZC_NOTIFY_STANDENTRY {
+	PACKET_UNIT_HEAD
+	PACKET_UNIT_LOOK
+	uint8 PosDir[3];
+	uint8 xSize;
+	uint8 ySize;
+	uint8 state;
+	PACKET_UNIT_TAIL
+};
+
+/// Unit walking on screen
+struct PACKET_ZC_NOTIFY_MOVEENTRY {
+	PACKET_UNIT_HEAD
+	uint32 moveStartTime;
+	PACKET_UNIT_LOOK
+	uint8 MoveData[6];
+	uint8 xSize;
+	uint8 ySize;
+	PACKET_UNIT_TAIL
+};
+
+#undef PACKET_UNIT_HEAD
+#undef PACKET_UNIT_LOOK
+#undef PACKET_UNIT_TAIL
+#undef PACKET_UNIT_GID
+#undef PACKET_UNIT_ROBE
+#undef PACKET_UNIT_HP
+#undef PACKET_UNIT_BODY
+
+#if PACKETVER < 20101124
+DEFINE_PACKET_HEADER(ZC_NOTIFY_NEWENTRY, 0x7f8)
+DEFINE_PACKET_HEADER(ZC_NOTIFY_STANDENTRY, 0x7f9)
+DEFINE_PACKET_HEADER(ZC_NOTIFY_MOVEENTRY, 0x7f7)
+#elif PACKETVER < 20120221
+DEFINE_PACKET_HEADER(ZC_NOTIFY_NEWENTRY, 0x858)
+DEFINE_PACKET_HEADER(ZC_NOTIFY_STANDENTRY, 0x857)
+DEFINE_PACKET_HEADER(ZC_NOTIFY_MOVEENTRY, 0x856)
+#elif PACKETVER < 20131223
+DEFINE_PACKET_HEADER(ZC_NOTIFY_NEWENTRY, 0x90f)
+DEFINE_PACKET_HEADER(ZC_NOTIFY_STANDENTRY, 0x915)
+DEFINE_PACKET_HEADER(ZC_NOTIFY_MOVEENTRY, 0x914)
+#elif PACKETVER < 20150513
+DEFINE_PACKET_HEADER(ZC_NOTIFY_NEWENTRY, 0x9dc)
+DEFINE_PACKET_HEADER(ZC_NOTIFY_STANDENTRY, 0x9dd)
+DEFINE_PACKET_HEADER(ZC_NOTIFY_MOVEENTRY, 0x9db)
+#else
+DEFINE_PACKET_HEADER(ZC_NOTIFY_NEWENTRY, 0x9fe)
+DEFINE_PACKET_HEADER(ZC_NOTIFY_STANDENTRY, 0x9ff)
+DEFINE_PACKET_HEADER(ZC_NOTIFY_MOVEENTRY, 0x9fd)
+#endif
+#endif
+
+#pragma pack(pop)
+
+#undef DEFINE_PACKET_HEADER
+
+#endif /* PACKETS_HPP */
@@ -134,6 +134,7 @@ bool path_search_long(struct shootpath_data *spd,int16 m,int16 x0,int16 y0,int16
 	int dx, dy;
 	int wx = 0, wy = 0;
 	int weight;
+	bool clear;
 	struct map_data *mapdata = map_getmapdata(m);
 	struct shootpath_data s_spd;
 
@@ -164,6 +165,9 @@ bool path_search_long(struct shootpath_data *spd,int16 m,int16 x0,int16 y0,int16
 		spd->rx = 1;
 	}
 
+	// The line stays inside the rectangle of both ends, if no cell in it is blocked the cells don't need to be checked one by one
+	clear = map_cell_planecheck(mapdata, cell) && !map_cell_anyrect(mapdata, x0, y0, x1, y1, cell);
+
 	while (x0 != x1 || y0 != y1)
 	{
 		wx += dx;
@@ -185,7 +189,7 @@ bool path_search_long(struct shootpath_data *spd,int16 m,int16 x0,int16 y0,int16
 			spd->y[spd->len] = y0;
 			spd->len++;
 		}
-		if ((x0 != x1 || y0 != y1) && map_getcellp(mapdata,x0,y0,cell))
+		if (!clear && (x0 != x1 || y0 != y1) && map_getcellp(mapdata,x0,y0,cell))
 			return false;
 	}
 
@@ -294,6 +298,8 @@ bool path_search(struct walkpath_data *wpd, int16 m, int16 x0, int16 y0, int16 x
 	if (flag&1) {
 		// Try finding direct path to target
 		// Direct path goes diagonally first, then in straight line.
+		// It stays inside the rectangle of start and destination, which is checked at once.
+		bool clear = map_cell_planecheck(mapdata, cell) && !map_cell_anyrect(mapdata, x0, y0, x1, y1, cell);
 
 		// calculate (sgn(x1-x0), sgn(y1-y0))
 		dx = ((dx = x1-x0)) ? ((dx<0) ? -1 : 1) : 0;
@@ -314,7 +320,7 @@ bool path_search(struct walkpath_data *wpd, int16 m, int16 x0, int16 y0, int16 x
 
 			if( dx == 0 && dy == 0 )
 				break; // success
-			if( map_getcellp(mapdata,x,y,cell) )
+			if( !clear && map_getcellp(mapdata,x,y,cell) )
 				break; // obstacle = failure
 		}
 
@@ -11,6 +11,7 @@
 #include "../common/timer.hpp"
 
 #include "buyingstore.hpp" // struct s_buyingstore
+#include "cardfix_cache.hpp" // struct s_cardfix_cache
 #include "clif.hpp" //e_wip_block
 #include "itemdb.hpp" // MAX_ITEMGROUP
 #include "map.hpp" // RC_ALL
@@ -313,6 +314,7 @@ struct map_session_data {
 		bool cashshop_open;
 		bool sale_open;
 		unsigned int block_action : 10;
+		bool spawn_queued; // Registered for the next clif_spawn_queue_timer
 	} state;
 	struct {
 		unsigned char no_weapon_damage, no_magic_damage, no_misc_damage;
@@ -353,6 +355,12 @@ struct map_session_data {
 	t_tick client_tick;
 	int npc_id,npc_shopid; //for script follow scriptoid;   ,npcid
 	std::vector<int> areanpc, npc_ontouch_;	///< Array of OnTouch and OnTouch_ NPC ID
+	struct s_cardfix_cache cardfix_cache[CARDFIX_CACHE_SIZE]; ///< Cleared by status_calc_pc
+	std::vector<int> spawn_queue; ///< Units in view that were not sent yet, see client_spawn_budget
+	struct {
+		uint32 batched; ///< Walk packets received through the move batch
+		uint32 throttled; ///< Walk packets not received because of move_throttle_range
+	} move_stats;
 	int npc_item_flag; //Marks the npc_id with which you can use items during interactions with said npc (see script command enable_itemuse)
 	int npc_menu; // internal variable, used in npc menu handling
 	int npc_amount;
@@ -374,6 +374,10 @@ uint64 PetDatabase::parseBodyNode( const YAML::Node &node ){
 		}
 
 		pet->pet_bonus_script = parse_script( script.c_str(), this->getCurrentFile().c_str(), node["Script"].Mark().line + 1, SCRIPT_IGNORE_EXTERNAL_BRACKETS );
+
+		if( pet->pet_bonus_script == nullptr && !script.empty() ){
+			this->invalidScript();
+		}
 	}else{
 		if( !exists ){
 			pet->pet_bonus_script = nullptr;
@@ -388,6 +392,10 @@ uint64 PetDatabase::parseBodyNode( const YAML::Node &node ){
 		}
 
 		pet->pet_support_script = parse_script( script.c_str(), this->getCurrentFile().c_str(), node["SupportScript"].Mark().line + 1, SCRIPT_IGNORE_EXTERNAL_BRACKETS );
+
+		if( pet->pet_support_script == nullptr && !script.empty() ){
+			this->invalidScript();
+		}
 	}else{
 		if( !exists ){
 			pet->pet_support_script = nullptr;
@@ -138,6 +138,9 @@ public:
 	const std::string getDefaultLocation();
 	uint64 parseBodyNode( const YAML::Node& node );
 	bool reload();
+	bool useSnapshots(){
+		return false; // Scripts are parsed with the line of their node
+	}
 };
 
 extern PetDatabase pet_db;
@@ -13908,6 +13908,7 @@ BUILDIN_FUNC(setiteminfo)
 	if (i_data && n>=0 && n<=14) {
 		int *item_arr = (int*)&i_data->value_buy;
 		item_arr[n] = value;
+		itemdb_update_snapshot(i_data);
 		script_pushint(st,value);
 	} else
 		script_pushint(st,-1);
@@ -18124,7 +18125,7 @@ BUILDIN_FUNC(setunitdata)
 		}
 		switch (type) {
 			case UHOM_SIZE: hd->battle_status.size = hd->base_status.size = (unsigned char)value; break;
-			case UHOM_LEVEL: hd->homunculus.level = (unsigned short)value; break;
+			case UHOM_LEVEL: hd->homunculus.level = (unsigned short)value; clif_appearance_invalidate(bl); break;
 			case UHOM_HP: hd->base_status.hp = (unsigned int)value; status_set_hp(bl, (unsigned int)value, 0); break;
 			case UHOM_MAXHP: hd->base_status.hp = hd->base_status.max_hp = (unsigned int)value; status_set_maxhp(bl, (unsigned int)value, 0); break;
 			case UHOM_SP: hd->base_status.sp = (unsigned int)value; status_set_sp(bl, (unsigned int)value, 0); break;
@@ -18186,7 +18187,7 @@ BUILDIN_FUNC(setunitdata)
 		}
 		switch (type) {
 			case UPET_SIZE: pd->status.size = (unsigned char)value; break;
-			case UPET_LEVEL: pd->pet.level = (unsigned short)value; break;
+			case UPET_LEVEL: pd->pet.level = (unsigned short)value; clif_appearance_invalidate(bl); break;
 			case UPET_HP: pd->status.hp = pd->status.max_hp = (unsigned int)value; status_set_hp(bl, (unsigned int)value, 0); break;
 			case UPET_MAXHP: pd->status.hp = pd->status.max_hp = (unsigned int)value; status_set_maxhp(bl, (unsigned int)value, 0); break;
 			case UPET_MASTERAID: pd->pet.account_id = (unsigned int)value; break;
@@ -18355,7 +18356,7 @@ BUILDIN_FUNC(setunitdata)
 			return SCRIPT_CMD_FAILURE;
 		}
 		switch (type) {
-			case UNPC_LEVEL: nd->level = (unsigned int)value; break;
+			case UNPC_LEVEL: nd->level = (unsigned int)value; clif_appearance_invalidate(bl); break;
 			case UNPC_HP: nd->status.hp = (unsigned int)value; status_set_hp(bl, (unsigned int)value, 0); break;
 			case UNPC_MAXHP: nd->status.hp = nd->status.max_hp = (unsigned int)value; status_set_maxhp(bl, (unsigned int)value, 0); break;
 			case UNPC_MAPID: if (mapname) value = map_mapname2mapid(mapname); unit_warp(bl, (short)value, 0, 0, CLR_TELEPORT); break;
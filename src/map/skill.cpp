@@ -4138,7 +4138,7 @@ static TIMER_FUNC(skill_timerskill){
 		if(src->prev == NULL)
 			break; // Source not on Map
 		if(skl->target_id) {
-			target = map_id2bl(skl->target_id);
+			target = map_id2bl_generation(skl->target_id, skl->target_generation); // Not a unit that reused the id since
 			if( ( skl->skill_id == RG_INTIMIDATE || skl->skill_id == SC_FATALMENACE ) && (!target || target->prev == NULL || !check_distance_bl(src,target,AREA_SIZE)) )
 				target = src; //Required since it has to warp.
 
@@ -4422,6 +4422,7 @@ int skill_addtimerskill (struct block_list *src, t_tick tick, int target, int x,
 	ud->skilltimerskill[i]->timer = add_timer(tick, skill_timerskill, src->id, i);
 	ud->skilltimerskill[i]->src_id = src->id;
 	ud->skilltimerskill[i]->target_id = target;
+	ud->skilltimerskill[i]->target_generation = map_id2generation(target);
 	ud->skilltimerskill[i]->skill_id = skill_id;
 	ud->skilltimerskill[i]->skill_lv = skill_lv;
 	ud->skilltimerskill[i]->map = src->m;
@@ -15267,15 +15268,10 @@ bool skill_check_condition_castbegin(struct map_session_data* sd, uint16 skill_i
 			break;
 		case CG_MOONLIT: //Check there's no wall in the range+1 area around the caster. [Skotlex]
 			{
-				int s,range = skill_get_splash(skill_id, skill_lv)+1;
-				int size = range*2+1;
-				for (s=0;s<size*size;s++) {
-					int x = sd->bl.x+(s%size-range);
-					int y = sd->bl.y+(s/size-range);
-					if (map_getcell(sd->bl.m,x,y,CELL_CHKWALL)) {
-						clif_skill_fail(sd,skill_id,USESKILL_FAIL_LEVEL,0);
-						return false;
-					}
+				int range = skill_get_splash(skill_id, skill_lv)+1;
+				if (map_cell_anyrect(map_getmapdata(sd->bl.m), sd->bl.x-range, sd->bl.y-range, sd->bl.x+range, sd->bl.y+range, CELL_CHKWALL)) {
+					clif_skill_fail(sd,skill_id,USESKILL_FAIL_LEVEL,0);
+					return false;
 				}
 			}
 			break;
@@ -15301,15 +15297,10 @@ bool skill_check_condition_castbegin(struct map_session_data* sd, uint16 skill_i
 			if( !sc || (sc && !sc->data[SC_BASILICA])) {
 				if( sd ) {
 					// When castbegin, needs 7x7 clear area
-					int s,range = skill_get_unit_layout_type(skill_id,skill_lv)+1;
-					int size = range*2+1;
-					for( s=0;s<size*size;s++ ) {
-						int x = sd->bl.x+(s%size-range);
-						int y = sd->bl.y+(s/size-range);
-						if( map_getcell(sd->bl.m,x,y,CELL_CHKWALL) ) {
-							clif_skill_fail(sd,skill_id,USESKILL_FAIL,0);
-							return false;
-						}
+					int range = skill_get_unit_layout_type(skill_id,skill_lv)+1;
+					if( map_cell_anyrect(map_getmapdata(sd->bl.m), sd->bl.x-range, sd->bl.y-range, sd->bl.x+range, sd->bl.y+range, CELL_CHKWALL) ) {
+						clif_skill_fail(sd,skill_id,USESKILL_FAIL,0);
+						return false;
 					}
 					if( map_foreachinallrange(skill_count_wos, &sd->bl, range, BL_ALL, &sd->bl) ) {
 						clif_skill_fail(sd,skill_id,USESKILL_FAIL,0);
@@ -21972,8 +21963,8 @@ void do_init_skill(void)
 
 	skill_readdb();
 
-	skillunit_group_db = idb_alloc(DB_OPT_BASE);
-	skillunit_db = idb_alloc(DB_OPT_BASE);
+	skillunit_group_db = idb_alloc(MAP_ID_DB_OPTIONS);
+	skillunit_db = idb_alloc(MAP_ID_DB_OPTIONS);
 	skillusave_db = idb_alloc(DB_OPT_RELEASE_DATA);
 	bowling_db = idb_alloc(DB_OPT_BASE);
 	skill_unit_ers = ers_new(sizeof(struct skill_unit_group),"skill.cpp::skill_unit_ers",ERS_CACHE_OPTIONS);
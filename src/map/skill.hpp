@@ -260,6 +260,7 @@ struct skill_timerskill {
 	int timer;
 	int src_id;
 	int target_id;
+	uint32 target_generation; // see map_id2generation
 	int map;
 	short x,y;
 	uint16 skill_id,skill_lv;
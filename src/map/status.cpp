@@ -3493,6 +3493,7 @@ int status_calc_pc_sub(struct map_session_data* sd, enum e_status_calc_opt opt)
 
 	memset (&sd->right_weapon.overrefine, 0, sizeof(sd->right_weapon) - sizeof(sd->right_weapon.atkmods));
 	memset (&sd->left_weapon.overrefine, 0, sizeof(sd->left_weapon) - sizeof(sd->left_weapon.atkmods));
+	memset (sd->cardfix_cache, 0, sizeof(sd->cardfix_cache));
 
 	if (sd->special_state.intravision && !sd->sc.data[SC_INTRAVISION]) // Clear intravision as long as nothing else is using it
 		clif_status_load(&sd->bl, EFST_CLAIRVOYANCE, 0);
@@ -4883,6 +4884,7 @@ void status_calc_bl_main(struct block_list *bl, /*enum scb_flag*/int flag)
 		**/
 		if (ud)
 			ud->state.change_walk_target = ud->state.speed_changed = 1;
+		clif_appearance_invalidate(bl); // speed and level are part of the appearance
 	}
 
 	if(flag&SCB_STR) {
@@ -7971,6 +7973,8 @@ void status_set_viewdata(struct block_list *bl, int class_)
 		}
 		break;
 	}
+
+	clif_appearance_invalidate(bl);
 }
 
 /**
@@ -3140,6 +3140,8 @@ int unit_remove_map_(struct block_list *bl, clr_type clrtype, const char* file,
 void unit_refresh(struct block_list *bl) {
 	nullpo_retv(bl);
 
+	clif_appearance_invalidate(bl); // also when nobody sees it, the next spawn has to encode the change
+
 	if (bl->m < 0)
 		return;
 
@@ -3267,6 +3269,9 @@ int unit_free(struct block_list *bl, clr_type clrtype)
 				sd->combos.count = 0;
 			}
 
+			sd->spawn_queue.clear();
+			sd->spawn_queue.shrink_to_fit();
+
 			if( sd->sc_display_count ) { /* [Ind] */
 				for( i = 0; i < sd->sc_display_count; i++ )
 					ers_free(pc_sc_display_ers, sd->sc_display[i]);
@@ -3467,6 +3472,7 @@ int unit_free(struct block_list *bl, clr_type clrtype)
 	}
 
 	map_deliddb(bl);
+	clif_appearance_free(bl);
 
 	if( bl->type != BL_PC ) // Players are handled by map_quit
 		map_freeblock(bl);
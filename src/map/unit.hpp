@@ -14,6 +14,7 @@ enum sc_type : int16;
 struct block_list;
 struct unit_data;
 struct map_session_data;
+struct s_unit_appearance;
 enum clr_type : uint8;
 
 extern const short dirx[DIR_MAX]; ///lookup to know where will move to x according dir
@@ -59,6 +60,9 @@ struct unit_data {
 		unsigned blockedskill : 1;
 	} state;
 	char walk_done_event[EVENT_NAME_LENGTH];
+	struct s_unit_appearance* appearance; ///< Cached appearance packet, see clif_appearance_invalidate
+	size_t move_batch; ///< Index + 1 of the walk packet waiting in the move batch, 0 if none
+	t_tick move_throttle_tick; ///< Last walk packet that was sent to far observers, see move_throttle_range
 };
 
 struct view_data {
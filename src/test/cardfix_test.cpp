@@ -0,0 +1,247 @@
+// Copyright (c) rAthena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+// Replay of War of Emperium hits through the attacker card modifier cache
+//
+// A hit log is generated the way a castle fight looks: attackers with a fixed
+// weapon element and mostly one skill hit players of the common jobs, wearing
+// armors of a few elements, and the emperium and guardians, with single target
+// and splash skills. Each attacker reaches only the defenders at the front. Every hit is looked up through cardfix_cache_get and has to return
+// the modifier calculated without the cache. Attackers change their equipment
+// from time to time, which clears their cache like status_calc_pc.
+// With --bench the replay is timed with and without the cache, the calculation
+// walks bonus tables of the size of map_session_data.
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "../map/cardfix_cache.hpp"
+
+#define TEST_ATTACKERS 40
+#define TEST_DEFENDERS 120
+#define TEST_CASTS 200000
+#define TEST_REGEAR_INTERVAL 500 // casts between equipment changes of an attacker
+#define TEST_SPLASH_MAX 12 // targets of a splash skill
+#define TEST_FRONT_WIDTH 20 // defenders in reach of an attacker
+#define TEST_FRONT_INTERVAL 2000 // casts before the fight moves on
+
+// Bonus table sizes of map_session_data
+#define TEST_RACES 12
+#define TEST_RACES2 16
+#define TEST_ELEMENTS 11
+#define TEST_SIZES 4
+#define TEST_CLASSES 4
+#define TEST_ADD_DMG 8
+
+/// Card bonuses of an attacker
+struct s_test_bonus {
+	int addrace[TEST_RACES], addrace2[TEST_RACES2], addele[TEST_ELEMENTS], atk_ele[TEST_ELEMENTS];
+	int addsize[TEST_SIZES], addclass[TEST_CLASSES];
+	struct { uint16 id; int val; } add_dmg[TEST_ADD_DMG];
+};
+
+struct s_test_attacker {
+	struct s_test_bonus bonus;
+	struct s_cardfix_cache cache[CARDFIX_CACHE_SIZE];
+	uint8 rh_ele;
+	uint8 attack_type;
+	uint16 flag; // damage flags of the main skill
+};
+
+struct s_test_defender {
+	uint16 t_class;
+	uint8 race, race2, def_ele, size, class_;
+};
+
+/// Hit of the log
+struct s_test_hit {
+	uint16 attacker;
+	uint16 defender;
+	uint16 flag;
+	bool regear; // the attacker changed the equipment before the hit
+};
+
+/// xorshift
+static uint32 test_rand(uint32& state) {
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static void test_gear(struct s_test_bonus& bonus, uint32& state) {
+	int* tables[] = { bonus.addrace, bonus.addrace2, bonus.addele, bonus.atk_ele, bonus.addsize, bonus.addclass };
+	size_t sizes[] = { TEST_RACES, TEST_RACES2, TEST_ELEMENTS, TEST_ELEMENTS, TEST_SIZES, TEST_CLASSES };
+
+	for( size_t t = 0; t < sizeof(tables) / sizeof(tables[0]); t++ ) {
+		for( size_t i = 0; i < sizes[t]; i++ )
+			tables[t][i] = ( test_rand(state) % 4 == 0 ) ? (int)( test_rand(state) % 40 ) : 0;
+	}
+	for( int i = 0; i < TEST_ADD_DMG; i++ ) {
+		bonus.add_dmg[i].id = (uint16)( 1285 + test_rand(state) % 4 );
+		bonus.add_dmg[i].val = (int)( test_rand(state) % 20 );
+	}
+}
+
+/// Modifier without the cache, shaped like battle_calc_cardfix_atk
+static short test_calc(const struct s_test_bonus& bonus, const struct s_test_defender& d, uint8 rh_ele, uint8 attack_type) {
+	short cardfix = 1000;
+
+	cardfix = cardfix * ( 100 + bonus.addrace[d.race] + bonus.addrace[TEST_RACES - 1] ) / 100;
+	cardfix = cardfix * ( 100 + bonus.addele[d.def_ele] + bonus.addele[TEST_ELEMENTS - 1] ) / 100;
+	if( attack_type == 1 )
+		cardfix = cardfix * ( 100 + bonus.atk_ele[rh_ele] + bonus.atk_ele[TEST_ELEMENTS - 1] ) / 100;
+	cardfix = cardfix * ( 100 + bonus.addsize[d.size] + bonus.addsize[TEST_SIZES - 1] ) / 100;
+	cardfix = cardfix * ( 100 + bonus.addrace2[d.race2] ) / 100;
+	cardfix = cardfix * ( 100 + bonus.addclass[d.class_] + bonus.addclass[TEST_CLASSES - 1] ) / 100;
+	for( int i = 0; i < TEST_ADD_DMG; i++ ) {
+		if( bonus.add_dmg[i].id == d.t_class ) {
+			cardfix = cardfix * ( 100 + bonus.add_dmg[i].val ) / 100;
+			break;
+		}
+	}
+	return cardfix;
+}
+
+/// Generates the hit log of a castle fight
+static void test_log(std::vector<struct s_test_hit>& log, std::vector<struct s_test_defender>& defenders, std::vector<struct s_test_attacker>& attackers) {
+	static const uint16 jobs[] = { 4008, 4010, 4012, 4013, 4015, 4017, 4019, 4020, 4021, 4047, 4049, 4057, 4058, 4059 };
+	static const uint8 armors[] = { 0, 0, 0, 1, 2, 3, 4 }; // mostly neutral, else water, earth, fire, wind
+	uint32 state = 2463534242U;
+
+	for( int i = 0; i < TEST_DEFENDERS; i++ ) {
+		struct s_test_defender d;
+
+		if( i < 5 ) {// emperium and guardians
+			d.t_class = (uint16)( i == 0 ? 1288 : 1285 + i % 3 );
+			d.race = ( i == 0 ) ? 0 : 7;
+			d.race2 = 0;
+			d.def_ele = ( i == 0 ) ? 10 : 0;
+			d.size = ( i == 0 ) ? 0 : 2;
+			d.class_ = ( i == 0 ) ? 2 : 0;
+		} else {
+			d.t_class = jobs[test_rand(state) % ( sizeof(jobs) / sizeof(jobs[0]) )];
+			d.race = 7; // demi-human
+			d.race2 = 0;
+			d.def_ele = armors[test_rand(state) % sizeof(armors)];
+			d.size = 1;
+			d.class_ = 0;
+		}
+		defenders.push_back(d);
+	}
+
+	attackers.resize(TEST_ATTACKERS);
+	for( struct s_test_attacker& a : attackers ) {
+		test_gear(a.bonus, state);
+		memset(a.cache, 0, sizeof(a.cache));
+		a.rh_ele = (uint8)( test_rand(state) % 5 );
+		a.attack_type = (uint8)( test_rand(state) % 2 );
+		a.flag = (uint16)( 0x100 << ( test_rand(state) % 3 ) );
+	}
+
+	for( int cast = 0; cast < TEST_CASTS; cast++ ) {
+		struct s_test_hit hit;
+		int targets = ( test_rand(state) % 3 == 0 ) ? 1 + test_rand(state) % TEST_SPLASH_MAX : 1;
+		// the defenders in reach, the emperium room or a gate, change as the fight moves on
+		int first = ( cast / TEST_FRONT_INTERVAL ) * TEST_FRONT_WIDTH / 2 + test_rand(state) % TEST_FRONT_WIDTH;
+
+		hit.attacker = (uint16)( test_rand(state) % TEST_ATTACKERS );
+		// mostly the main skill of the attacker
+		hit.flag = ( test_rand(state) % 5 != 0 ) ? attackers[hit.attacker].flag : (uint16)( 0x100 << ( test_rand(state) % 3 ) );
+		hit.regear = ( test_rand(state) % TEST_REGEAR_INTERVAL == 0 );
+		// a splash hits the defenders standing together
+		for( int t = 0; t < targets; t++ ) {
+			hit.defender = (uint16)( ( first + t ) % TEST_DEFENDERS );
+			log.push_back(hit);
+			hit.regear = false;
+		}
+	}
+}
+
+/// Replays the log, returns the number of cache misses or -1 if a checked modifier differs
+template <bool cached, bool check>
+static int test_replay(const std::vector<struct s_test_hit>& log, const std::vector<struct s_test_defender>& defenders, std::vector<struct s_test_attacker>& attackers, long long& sum) {
+	uint32 state = 88172645U;
+	int misses = 0;
+
+	for( const struct s_test_hit& hit : log ) {
+		struct s_test_attacker& a = attackers[hit.attacker];
+		const struct s_test_defender& d = defenders[hit.defender];
+
+		if( hit.regear ) {// status_calc_pc
+			test_gear(a.bonus, state);
+			memset(a.cache, 0, sizeof(a.cache));
+		}
+
+		if( !cached ) {
+			sum += test_calc(a.bonus, d, a.rh_ele, a.attack_type);
+			continue;
+		}
+
+		struct s_cardfix_cache::s_cardfix_key key;
+
+		memset(&key, 0, sizeof(key));
+		key.t_class = d.t_class;
+		key.flag = hit.flag;
+		key.attack_type = a.attack_type;
+		key.race = d.race;
+		key.race2 = d.race2;
+		key.def_ele = d.def_ele;
+		key.size = d.size;
+		key.class_ = d.class_;
+		key.rh_ele = a.rh_ele;
+
+		short cardfix = cardfix_cache_get(a.cache, key, [&]() {
+			misses++;
+			return test_calc(a.bonus, d, a.rh_ele, a.attack_type);
+		});
+
+		if( check && cardfix != test_calc(a.bonus, d, a.rh_ele, a.attack_type) ) {
+			printf("cardfix_test: attacker %d got %d instead of %d against class %d\n", hit.attacker, cardfix, test_calc(a.bonus, d, a.rh_ele, a.attack_type), d.t_class);
+			return -1;
+		}
+		sum += cardfix;
+	}
+	return misses;
+}
+
+/// Returns the nanoseconds per hit of a replay
+template <bool cached>
+static double bench_replay(const std::vector<struct s_test_hit>& log, const std::vector<struct s_test_defender>& defenders, const std::vector<struct s_test_attacker>& attackers) {
+	std::vector<struct s_test_attacker> copy = attackers;
+	long long sum = 0;
+	auto start = std::chrono::steady_clock::now();
+
+	test_replay<cached, false>(log, defenders, copy, sum);
+
+	double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / log.size();
+
+	if( sum == 0 )
+		printf("cardfix_test: empty replay\n");
+	return ns;
+}
+
+int main(int argc, char** argv) {
+	std::vector<struct s_test_hit> log;
+	std::vector<struct s_test_defender> defenders;
+	std::vector<struct s_test_attacker> attackers;
+	long long sum = 0;
+
+	test_log(log, defenders, attackers);
+
+	std::vector<struct s_test_attacker> replay = attackers;
+	int misses = test_replay<true, true>(log, defenders, replay, sum);
+
+	if( misses < 0 )
+		return EXIT_FAILURE;
+	printf("cardfix_test: %d hits replayed, %.1f%% served by the cache\n", (int)log.size(), 100.0 * ( log.size() - misses ) / log.size());
+
+	if( argc > 1 && strcmp(argv[1], "--bench") == 0 ) {
+		printf("cardfix_test: ns per hit, cache / calculation: %.1f / %.1f\n",
+			bench_replay<true>(log, defenders, attackers), bench_replay<false>(log, defenders, attackers));
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,275 @@
+// Copyright (c) rAthena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+// Crash consistency of the write-back journal
+//
+// A child process plays the char-server: every save is kept in a CharWriteback
+// and acknowledged, and every few saves the pending saves are flushed to a
+// database file, one of several flushes failing on purpose. The parent kills
+// the child at a random point, then loads the journal and flushes it the way
+// the char-server does at startup and checks that no acknowledged save was lost.
+
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+#include <io.h>
+#else
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "../char/char_journal.hpp"
+
+#define TEST_KEYS 16
+#define TEST_FLUSH_INTERVAL 37
+#define TEST_ITERATIONS 50
+#define TEST_FAIL_INTERVAL 3 // every third flush fails
+
+struct s_test_save {
+	uint32 key;
+	uint32 value;
+};
+
+static char journal_file[256];
+static char db_file[256];
+static char db_tmp_file[256];
+
+/// Writes the whole state, a rename keeps the database consistent on a crash
+static bool test_db_write(const std::map<uint32, uint32>& db) {
+	FILE* fp = fopen(db_tmp_file, "wb");
+
+	if( fp == NULL )
+		return false;
+	for( const auto& it : db ) {
+		struct s_test_save save = { it.first, it.second };
+
+		fwrite(&save, sizeof(save), 1, fp);
+	}
+	fflush(fp);
+#ifdef WIN32
+	_commit(_fileno(fp));
+#else
+	fsync(fileno(fp));
+#endif
+	fclose(fp);
+	return rename(db_tmp_file, db_file) == 0;
+}
+
+static void test_db_read(std::map<uint32, uint32>& db) {
+	FILE* fp = fopen(db_file, "rb");
+	struct s_test_save save;
+
+	if( fp == NULL )
+		return;
+	while( fread(&save, sizeof(save), 1, fp) == 1 )
+		db[save.key] = save.value;
+	fclose(fp);
+}
+
+/// Writes groups of pending saves to the database file, like char_writeback_write_groups
+static bool test_db_flush(CharWriteback* pending, const std::vector<std::vector<uint64>>& groups, bool fail) {
+	std::map<uint32, uint32> db;
+
+	if( fail )
+		return false;
+	test_db_read(db);
+	for( const std::vector<uint64>& group : groups ) {
+		for( uint64 key : group ) {
+			struct s_test_save save;
+
+			memcpy(&save, CharWriteback_Get(pending, key, NULL, NULL), sizeof(save));
+			db[save.key] = save.value;
+		}
+	}
+	return test_db_write(db);
+}
+
+/// Flushes everything pending, one group per key
+static int test_flush(CharWriteback* pending, size_t batch, bool fail) {
+	std::vector<std::vector<uint64>> groups;
+
+	for( uint64 key : CharWriteback_Keys(pending) )
+		groups.push_back({ key });
+	return CharWriteback_Flush(pending, groups, batch, [pending, fail]( const std::vector<std::vector<uint64>>& part ) {
+		return test_db_flush(pending, part, fail);
+	});
+}
+
+static uint64 test_key(uint8 type, const void* data, uint32 length) {
+	struct s_test_save save;
+
+	if( length != sizeof(save) )
+		return 0;
+	memcpy(&save, data, sizeof(save));
+	return save.key + 1;
+}
+
+/// A failed flush keeps its saves pending and in the journal, a later one writes and truncates them
+static bool test_failed_flush(void) {
+	CharJournal* journal = CharJournal_Open(journal_file, false);
+	CharWriteback* pending;
+	std::map<uint32, uint32> db;
+	uint32 seq;
+	bool success = true;
+
+	remove(db_file);
+	if( journal == NULL )
+		return false;
+	pending = CharWriteback_Create(journal);
+	for( seq = 1; seq <= TEST_KEYS * 2; seq++ ) {
+		struct s_test_save save = { seq % TEST_KEYS, seq };
+
+		CharWriteback_Put(pending, test_key(0, &save, sizeof(save)), 0, &save, sizeof(save));
+	}
+
+	if( test_flush(pending, 4, true) != TEST_KEYS || CharWriteback_Size(pending) != TEST_KEYS ) {
+		printf("failed flush: saves were not kept pending\n");
+		success = false;
+	}
+	if( !CharWriteback_Truncate(pending) || CharJournal_Replay(journal_file, []( uint8 type, const void* data, uint32 length ) {}) != TEST_KEYS * 2 ) {
+		printf("failed flush: journal was truncated with saves pending\n");
+		success = false;
+	}
+	if( test_flush(pending, 4, false) != 0 || CharWriteback_Size(pending) != 0 || !CharWriteback_Truncate(pending)
+	||	CharJournal_Replay(journal_file, []( uint8 type, const void* data, uint32 length ) {}) != 0 ) {
+		printf("failed flush: retry did not write and truncate the saves\n");
+		success = false;
+	}
+
+	test_db_read(db);
+	for( seq = TEST_KEYS + 1; seq <= TEST_KEYS * 2; seq++ ) {
+		if( db[seq % TEST_KEYS] != seq ) {
+			printf("failed flush: save %u of key %u is missing\n", seq, seq % TEST_KEYS);
+			success = false;
+		}
+	}
+
+	CharWriteback_Destroy(pending);
+	CharJournal_Close(journal, true);
+	return success;
+}
+
+#ifndef WIN32
+/// Saves until it is killed, acknowledging every save through the pipe
+static void test_server(int ack) {
+	CharJournal* journal = CharJournal_Open(journal_file, false);
+	CharWriteback* pending;
+	uint32 seq;
+
+	if( journal == NULL )
+		_exit(EXIT_FAILURE);
+	pending = CharWriteback_Create(journal);
+
+	for( seq = 1; ; seq++ ) {
+		struct s_test_save save = { seq % TEST_KEYS, seq };
+
+		if( !CharWriteback_Put(pending, test_key(0, &save, sizeof(save)), 0, &save, sizeof(save)) )
+			_exit(EXIT_FAILURE);
+		if( write(ack, &seq, sizeof(seq)) != sizeof(seq) )
+			_exit(EXIT_FAILURE);
+
+		if( seq % TEST_FLUSH_INTERVAL == 0 ) {
+			bool fail = ( seq / TEST_FLUSH_INTERVAL ) % TEST_FAIL_INTERVAL == 0;
+
+			if( test_flush(pending, 4, fail) == 0 && !CharWriteback_Truncate(pending) )
+				_exit(EXIT_FAILURE);
+		}
+	}
+}
+
+/// Runs one server until a random acknowledgement and checks the recovery
+static bool test_iteration(int iteration) {
+	std::map<uint32, uint32> db;
+	uint32 kill_at = 1 + rand() % ( TEST_FLUSH_INTERVAL * 8 );
+	uint32 acked = 0, seq;
+	int fds[2];
+	pid_t pid;
+
+	remove(journal_file);
+	remove(db_file);
+	if( pipe(fds) != 0 )
+		return false;
+
+	pid = fork();
+	if( pid < 0 )
+		return false;
+	if( pid == 0 ) {
+		close(fds[0]);
+		test_server(fds[1]);
+	}
+	close(fds[1]);
+
+	while( acked < kill_at && read(fds[0], &seq, sizeof(seq)) == sizeof(seq) )
+		acked = seq;
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+	// saves acknowledged while the parent was killing the child count as well
+	while( read(fds[0], &seq, sizeof(seq)) == sizeof(seq) )
+		acked = seq;
+	close(fds[0]);
+
+	if( acked < kill_at ) {
+		printf("iteration %d: server stopped after %u saves\n", iteration, acked);
+		return false;
+	}
+
+	// recovery of the char-server: one flush of everything in the journal
+	CharWriteback* pending = CharWriteback_Create(NULL);
+
+	CharWriteback_Load(pending, journal_file, test_key);
+	if( test_flush(pending, CharWriteback_Size(pending), false) != 0 ) {
+		printf("iteration %d: recovery could not be written\n", iteration);
+		CharWriteback_Destroy(pending);
+		return false;
+	}
+	CharWriteback_Destroy(pending);
+	test_db_read(db);
+
+	for( seq = ( acked > TEST_KEYS ? acked - TEST_KEYS + 1 : 1 ); seq <= acked; seq++ ) {
+		auto it = db.find(seq % TEST_KEYS);
+
+		if( it == db.end() || it->second < seq ) {
+			printf("iteration %d: acknowledged save %u of key %u was lost\n", iteration, seq, seq % TEST_KEYS);
+			return false;
+		}
+	}
+	return true;
+}
+#endif
+
+int main(int argc, char** argv) {
+#ifdef WIN32
+	printf("char_journal_test: skipped, requires fork\n");
+	return EXIT_SUCCESS;
+#else
+	int i;
+
+	snprintf(journal_file, sizeof(journal_file), "char_journal_test_%d.log", (int)getpid());
+	snprintf(db_file, sizeof(db_file), "char_journal_test_%d.db", (int)getpid());
+	snprintf(db_tmp_file, sizeof(db_tmp_file), "char_journal_test_%d.tmp", (int)getpid());
+	srand((unsigned int)getpid());
+
+	if( !test_failed_flush() )
+		i = 0;
+	else {
+		for( i = 0; i < TEST_ITERATIONS; i++ ) {
+			if( !test_iteration(i) )
+				break;
+		}
+	}
+
+	remove(journal_file);
+	remove(db_file);
+	remove(db_tmp_file);
+
+	if( i < TEST_ITERATIONS )
+		return EXIT_FAILURE;
+	printf("char_journal_test: %d crashes recovered\n", TEST_ITERATIONS);
+	return EXIT_SUCCESS;
+#endif
+}
@@ -0,0 +1,171 @@
+// Copyright (c) rAthena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+// Test and benchmark of the DBMap backends
+//
+// Random puts, removes and ensures are applied to a DBMap and to a std::map,
+// after which both have to hold the same entries. This is done for the
+// hashtable of red-black trees and for DB_OPT_OPEN_ADDRESSING, which also has
+// to iterate its entries in insertion order. The benchmark looks up random
+// keys among consecutive ids like the ones of id_db.
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "../common/cbasetypes.hpp"
+#include "../common/core.hpp"
+#include "../common/db.hpp"
+#include "../common/showmsg.hpp"
+
+#define TEST_KEYS 5000
+#define TEST_OPERATIONS 200000
+#define BENCH_LOOKUPS 2000000
+#define BENCH_START_ID 110000000 // first id of the lookups, like START_ACCOUNT_NUM
+
+/// xorshift
+static uint32 test_rand(uint32& state) {
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+/// Created value of ensure, derived from the key
+static DBData test_create(DBKey key, va_list args) {
+	return db_i2data(key.i * 3);
+}
+
+/// Compares a db with the expected entries, order lists the keys in insertion order if it matters
+static bool test_same(DBMap* db, const std::map<int, int>& expected, const std::vector<int>* order, const char* name) {
+	DBIterator* iter = db_iterator(db);
+	DBKey key;
+	DBData* data;
+	size_t count = 0;
+	bool same = true;
+
+	if( db_size(db) != expected.size() ) {
+		ShowError("db_test: %s holds %u entries instead of %" PRIuPTR ".\n", name, db_size(db), expected.size());
+		same = false;
+	}
+
+	for( data = iter->first(iter, &key); dbi_exists(iter); data = iter->next(iter, &key), count++ ) {
+		auto it = expected.find(key.i);
+
+		if( it == expected.end() || db_data2i(data) != it->second ) {
+			ShowError("db_test: %s iterated the unexpected entry %d.\n", name, key.i);
+			same = false;
+			break;
+		}
+		if( order != NULL && ( count >= order->size() || (*order)[count] != key.i ) ) {
+			ShowError("db_test: %s iterated %d out of insertion order.\n", name, key.i);
+			same = false;
+			break;
+		}
+	}
+	dbi_destroy(iter);
+
+	for( const auto& entry : expected ) {
+		if( !idb_exists(db, entry.first) || idb_iget(db, entry.first) != entry.second ) {
+			ShowError("db_test: %s lost the entry %d.\n", name, entry.first);
+			return false;
+		}
+	}
+	return same;
+}
+
+/// Applies the same random operations to a db and a std::map
+static bool test_compare(DBOptions options, const char* name) {
+	DBMap* db = idb_alloc(options);
+	std::map<int, int> expected;
+	std::vector<int> order; // keys in insertion order
+	uint32 state = 2463534242U;
+	bool ok = true;
+
+	for( int i = 0; i < TEST_OPERATIONS && ok; i++ ) {
+		int key = (int)( test_rand(state) % TEST_KEYS ) - TEST_KEYS / 2;
+		uint32 op = test_rand(state) % 10;
+
+		if( op < 4 ) {
+			int value = (int)test_rand(state);
+
+			if( expected.find(key) == expected.end() )
+				order.push_back(key);
+			idb_iput(db, key, value);
+			expected[key] = value;
+		} else if( op < 7 ) {
+			idb_remove(db, key);
+			if( expected.erase(key) > 0 )
+				order.erase(std::find(order.begin(), order.end(), key));
+		} else if( op < 9 ) {
+			if( expected.find(key) == expected.end() ) {
+				order.push_back(key);
+				expected[key] = key * 3;
+			}
+			if( db_data2i(db->ensure(db, db_i2key(key), test_create)) != expected[key] ) {
+				ShowError("db_test: %s ensured the wrong value for %d.\n", name, key);
+				ok = false;
+			}
+		} else if( i % 1000 == 9 )
+			ok = test_same(db, expected, ( options&DB_OPT_OPEN_ADDRESSING ) ? &order : NULL, name);
+	}
+	if( ok )
+		ok = test_same(db, expected, ( options&DB_OPT_OPEN_ADDRESSING ) ? &order : NULL, name);
+
+	db_clear(db);
+	if( ok && db_size(db) != 0 ) {
+		ShowError("db_test: %s holds entries after a clear.\n", name);
+		ok = false;
+	}
+	db_destroy(db);
+	return ok;
+}
+
+/// Returns the nanoseconds per lookup in a db of consecutive ids
+static double bench_lookup(DBOptions options, int entries) {
+	DBMap* db = idb_alloc(options);
+	uint32 state = 88172645U;
+	int found = 0;
+
+	for( int i = 0; i < entries; i++ )
+		idb_iput(db, BENCH_START_ID + i, i);
+
+	auto start = std::chrono::steady_clock::now();
+
+	for( int i = 0; i < BENCH_LOOKUPS; i++ )
+		found += idb_exists(db, BENCH_START_ID + (int)( test_rand(state) % entries ));
+
+	double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BENCH_LOOKUPS;
+
+	if( found != BENCH_LOOKUPS )
+		ShowError("db_test: %d lookups failed.\n", BENCH_LOOKUPS - found);
+	db_destroy(db);
+	return ns;
+}
+
+static void bench(void) {
+	static const int entries[] = { 20000, 200000, 1000000 };
+
+	ShowInfo("db_test: ns per lookup, red-black trees / open addressing:\n");
+	for( int count : entries )
+		ShowMessage("  %7d entries: %7.1f / %7.1f\n", count, bench_lookup(DB_OPT_BASE, count), bench_lookup(DB_OPT_OPEN_ADDRESSING, count));
+}
+
+int do_init(int argc, char** argv)
+{
+	db_init();
+	if( !test_compare(DB_OPT_BASE, "red-black trees") || !test_compare(DB_OPT_OPEN_ADDRESSING, "open addressing") )
+		exit(EXIT_FAILURE);
+	ShowInfo("db_test: both backends match std::map after %d operations.\n", TEST_OPERATIONS);
+	if( argc > 1 && strcmp(argv[1], "--bench") == 0 )
+		bench();
+	db_final();
+	return 0;
+}
+
+void do_final(void)
+{
+}
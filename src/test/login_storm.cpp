@@ -0,0 +1,168 @@
+// Copyright (c) rAthena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+// Connection storm against a running login-server
+//
+// Several threads connect to the login-server, send a login request (0x0064)
+// and wait for the answer or for the server to close the connection, as many
+// times as requested. Every connection passes ipban_check and every refused
+// login is counted by the failed-login tracking, so with a wrong password this
+// measures both while the server is flooded. Once dynamic_pass_failure_ban
+// bans the address, the remaining connections are closed by the ban check.
+//
+// It needs a login-server with its database (MariaDB or MySQL) and is not run
+// by ctest.
+//
+// Usage: login_storm <host> <port> [connections] [threads] [username] [password]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../common/cbasetypes.hpp"
+
+#define STORM_CONNECTIONS 10000
+#define STORM_THREADS 32
+#define STORM_NAME_LENGTH 24
+
+/// How a connection ended
+enum e_storm_result {
+	STORM_ACCEPTED = 0, // 0x0069 or 0x0ac4
+	STORM_REFUSED,      // 0x006a or 0x083e
+	STORM_BLOCKED,      // 0x0081, closed by the server
+	STORM_CLOSED,       // closed without an answer, a ban of the address
+	STORM_FAILED,       // could not connect or send
+	STORM_MAX
+};
+
+static const char* storm_names[STORM_MAX] = { "accepted", "refused", "blocked", "closed", "failed" };
+
+static struct sockaddr_in storm_addr;
+static uint8 storm_request[55];
+static std::atomic<int> storm_next;
+static int storm_connections;
+static std::mutex storm_mutex;
+static std::vector<double> storm_latencies; // milliseconds
+static int storm_results[STORM_MAX];
+
+/// Connects, sends the login request and waits for the first packet of the answer
+static enum e_storm_result storm_login(void) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	uint8 answer[2];
+	size_t length = 0;
+	int yes = 1;
+
+	if( fd < 0 )
+		return STORM_FAILED;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+	if( connect(fd, (struct sockaddr*)&storm_addr, sizeof(storm_addr)) != 0
+	||  send(fd, storm_request, sizeof(storm_request), 0) != (ssize_t)sizeof(storm_request) ) {
+		close(fd);
+		return STORM_FAILED;
+	}
+
+	while( length < sizeof(answer) ) {
+		ssize_t n = recv(fd, answer + length, sizeof(answer) - length, 0);
+
+		if( n <= 0 )
+			break;
+		length += (size_t)n;
+	}
+	close(fd);
+
+	if( length < sizeof(answer) )
+		return STORM_CLOSED;
+	switch( answer[0] | ( answer[1] << 8 ) ) {
+		case 0x0069:
+		case 0x0ac4:
+			return STORM_ACCEPTED;
+		case 0x006a:
+		case 0x083e:
+			return STORM_REFUSED;
+		default:
+			return STORM_BLOCKED;
+	}
+}
+
+static void storm_worker(void) {
+	std::vector<double> latencies;
+	int results[STORM_MAX] = {};
+
+	while( storm_next++ < storm_connections ) {
+		auto start = std::chrono::steady_clock::now();
+
+		results[storm_login()]++;
+		latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	std::lock_guard<std::mutex> lock(storm_mutex);
+
+	storm_latencies.insert(storm_latencies.end(), latencies.begin(), latencies.end());
+	for( int i = 0; i < STORM_MAX; i++ )
+		storm_results[i] += results[i];
+}
+
+int main(int argc, char** argv) {
+	std::vector<std::thread> threads;
+	struct addrinfo hints, *info;
+	const char* username = ( argc > 5 ) ? argv[5] : "storm";
+	const char* password = ( argc > 6 ) ? argv[6] : "wrong password";
+	int thread_count;
+
+	if( argc < 3 ) {
+		printf("Usage: %s <host> <port> [connections] [threads] [username] [password]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	storm_connections = ( argc > 3 ) ? atoi(argv[3]) : STORM_CONNECTIONS;
+	thread_count = ( argc > 4 ) ? atoi(argv[4]) : STORM_THREADS;
+	if( storm_connections <= 0 || thread_count <= 0 ) {
+		printf("login_storm: connections and threads must be positive\n");
+		return EXIT_FAILURE;
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	if( getaddrinfo(argv[1], argv[2], &hints, &info) != 0 ) {
+		printf("login_storm: unknown host %s\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+	memcpy(&storm_addr, info->ai_addr, sizeof(storm_addr));
+	freeaddrinfo(info);
+
+	// S 0064 <version>.L <username>.24B <password>.24B <clienttype>.B
+	memset(storm_request, 0, sizeof(storm_request));
+	storm_request[0] = 0x64;
+	strncpy((char*)storm_request + 6, username, STORM_NAME_LENGTH - 1);
+	strncpy((char*)storm_request + 30, password, STORM_NAME_LENGTH - 1);
+
+	auto start = std::chrono::steady_clock::now();
+
+	for( int i = 0; i < thread_count; i++ )
+		threads.emplace_back(storm_worker);
+	for( std::thread& thread : threads )
+		thread.join();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::sort(storm_latencies.begin(), storm_latencies.end());
+	printf("login_storm: %d connections with %d threads in %.2f s, %.0f per second\n", storm_connections, thread_count, seconds, storm_connections / seconds);
+	printf("login_storm: latency ms p50 %.2f, p99 %.2f, max %.2f\n",
+		storm_latencies[storm_latencies.size() / 2], storm_latencies[storm_latencies.size() * 99 / 100], storm_latencies.back());
+	for( int i = 0; i < STORM_MAX; i++ )
+		printf("  %-8s %d\n", storm_names[i], storm_results[i]);
+	return ( storm_results[STORM_FAILED] == storm_connections ) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
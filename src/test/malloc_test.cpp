@@ -0,0 +1,246 @@
+// Copyright (c) rAthena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+// Stress test and benchmark of the memory manager
+//
+// Several threads allocate, grow, shrink and free blocks of all sizes (small
+// units, medium blocks of malloc and large mappings) and hand some of them to
+// another thread to free. Every block is filled with a pattern that is checked
+// before it is resized or freed (only the edges of large blocks). A thread that only frees has to report its
+// usage when it ends. The benchmark compares the memory manager with the
+// malloc of the system, single-threaded and with TEST_THREADS threads.
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "../common/cbasetypes.hpp"
+#include "../common/core.hpp"
+#include "../common/malloc.hpp"
+#include "../common/showmsg.hpp"
+
+#define TEST_THREADS 4
+#define TEST_SLOTS 512
+#define TEST_OPERATIONS 50000
+#define TEST_EDGE 4096 // bytes filled and checked at both ends of a block
+#define BENCH_OPERATIONS 1000000
+#define BENCH_SLOTS 64
+
+struct s_test_block {
+	uint8* data;
+	size_t size;
+	uint8 pattern;
+};
+
+static std::mutex exchange_mutex;
+static std::vector<struct s_test_block> exchange; // blocks freed by another thread
+static bool test_failed = false;
+
+/// xorshift, every thread has its own state
+static uint32 test_rand(uint32& state) {
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+/// Returns a size of one of the ranges of the memory manager
+static size_t test_size(uint32& state) {
+	uint32 r = test_rand(state) % 100;
+
+	if( r < 70 )
+		return 1 + test_rand(state) % 256;
+	if( r < 90 )
+		return 257 + test_rand(state) % 16000;
+	if( r < 98 )
+		return 16 * 1024 + test_rand(state) % ( 1024 * 1024 );
+	return 1024 * 1024 + test_rand(state) % ( 2 * 1024 * 1024 );
+}
+
+static void test_fill(struct s_test_block& block) {
+	if( block.size <= 2 * TEST_EDGE )
+		memset(block.data, block.pattern, block.size);
+	else {
+		memset(block.data, block.pattern, TEST_EDGE);
+		memset(block.data + block.size - TEST_EDGE, block.pattern, TEST_EDGE);
+	}
+}
+
+/// Checks the first size bytes of a block, which were filled with test_fill
+static bool test_check(const struct s_test_block& block, size_t size) {
+	for( size_t i = 0; i < size; i++ ) {
+		if( i == TEST_EDGE && block.size > 2 * TEST_EDGE )
+			i = std::max(i, block.size - TEST_EDGE);
+		if( i >= size )
+			break;
+		if( block.data[i] != block.pattern ) {
+			ShowError("malloc_test: block %p of %" PRIuPTR " bytes is damaged at byte %" PRIuPTR ".\n", block.data, block.size, i);
+			test_failed = true;
+			return false;
+		}
+	}
+	return true;
+}
+
+static void test_free(struct s_test_block& block) {
+	test_check(block, block.size);
+	aFree(block.data);
+	block.data = NULL;
+}
+
+/// Allocates, resizes and frees random blocks
+static void test_worker(uint32 seed) {
+	std::vector<struct s_test_block> blocks(TEST_SLOTS);
+	uint32 state = seed;
+
+	for( int i = 0; i < TEST_OPERATIONS && !test_failed; i++ ) {
+		struct s_test_block& block = blocks[test_rand(state) % TEST_SLOTS];
+		uint32 op = test_rand(state) % 10;
+
+		if( block.data == NULL ) {
+			block.size = test_size(state);
+			block.pattern = (uint8)test_rand(state);
+			block.data = (uint8*)aMalloc(block.size);
+			test_fill(block);
+		} else if( op < 3 ) {// resize, keeping the common part
+			size_t size = test_size(state);
+			size_t kept = std::min(std::min(size, block.size), (size_t)TEST_EDGE); // the end moves
+
+			test_check(block, block.size);
+			block.data = (uint8*)aRealloc(block.data, size);
+			test_check(block, kept);
+			block.size = size;
+			test_fill(block);
+		} else if( op < 4 ) {// freed by another thread
+			std::lock_guard<std::mutex> lock(exchange_mutex);
+
+			exchange.push_back(block);
+			block.data = NULL;
+		} else if( op < 5 ) {
+			std::vector<struct s_test_block> other;
+
+			{
+				std::lock_guard<std::mutex> lock(exchange_mutex);
+
+				other.swap(exchange);
+			}
+			for( struct s_test_block& b : other )
+				test_free(b);
+		} else
+			test_free(block);
+	}
+
+	for( struct s_test_block& block : blocks ) {
+		if( block.data != NULL )
+			test_free(block);
+	}
+}
+
+static bool test_stress(void) {
+	std::vector<std::thread> threads;
+	size_t usage = malloc_usage();
+
+	for( uint32 i = 0; i < TEST_THREADS; i++ )
+		threads.emplace_back(test_worker, 2463534242U + i * 7919);
+	for( std::thread& thread : threads )
+		thread.join();
+	for( struct s_test_block& block : exchange )
+		test_free(block);
+	exchange.clear();
+
+	if( test_failed )
+		return false;
+	if( malloc_usage() != usage ) {
+		ShowError("malloc_test: %" PRIuPTR " KB in use after the stress test, %" PRIuPTR " KB before.\n", malloc_usage(), usage);
+		return false;
+	}
+	ShowInfo("malloc_test: %d threads did %d operations each.\n", TEST_THREADS, TEST_OPERATIONS);
+	return true;
+}
+
+/// A thread that frees blocks of another thread without allocating reports them when it ends
+static bool test_foreign_free(void) {
+	std::vector<void*> blocks;
+	size_t usage = malloc_usage();
+
+	for( int i = 0; i < 10000; i++ )
+		blocks.push_back(aMalloc(64));
+	std::thread thread([&blocks]() {
+		for( void* p : blocks )
+			aFree(p);
+	});
+	thread.join();
+
+	if( malloc_usage() != usage ) {
+		ShowError("malloc_test: %" PRIuPTR " KB in use after a thread freed everything, %" PRIuPTR " KB before.\n", malloc_usage(), usage);
+		return false;
+	}
+	return true;
+}
+
+/// Allocates and frees blocks of the size with a working set of BENCH_SLOTS blocks
+template <bool memmgr>
+static void bench_worker(size_t size) {
+	void* slots[BENCH_SLOTS] = {};
+	uint32 state = 88172645U;
+
+	for( int i = 0; i < BENCH_OPERATIONS; i++ ) {
+		void*& slot = slots[test_rand(state) % BENCH_SLOTS];
+
+		if( memmgr ) {
+			aFree(slot);
+			slot = aMalloc(size);
+		} else {
+			free(slot);
+			slot = malloc(size);
+		}
+		*(volatile uint8*)slot = 1;
+	}
+	for( void* slot : slots ) {
+		if( memmgr )
+			aFree(slot);
+		else
+			free(slot);
+	}
+}
+
+/// Returns the nanoseconds per operation of threads running bench_worker
+template <bool memmgr>
+static double bench_run(size_t size, int thread_count) {
+	std::vector<std::thread> threads;
+	auto start = std::chrono::steady_clock::now();
+
+	for( int i = 0; i < thread_count; i++ )
+		threads.emplace_back(bench_worker<memmgr>, size);
+	for( std::thread& thread : threads )
+		thread.join();
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BENCH_OPERATIONS;
+}
+
+static void bench(void) {
+	static const size_t sizes[] = { 32, 200, 1000, 4000, 20000, 100000, 500000 };
+
+	ShowInfo("malloc_test: ns per allocation and free, memmgr / system malloc:\n");
+	for( size_t size : sizes ) {
+		ShowMessage("  %7" PRIuPTR " bytes: 1 thread %7.1f / %7.1f, %d threads %7.1f / %7.1f\n", size,
+			bench_run<true>(size, 1), bench_run<false>(size, 1),
+			TEST_THREADS, bench_run<true>(size, TEST_THREADS), bench_run<false>(size, TEST_THREADS));
+	}
+}
+
+int do_init(int argc, char** argv)
+{
+	if( !test_foreign_free() || !test_stress() )
+		exit(EXIT_FAILURE);
+	if( argc > 1 && strcmp(argv[1], "--bench") == 0 )
+		bench();
+	return 0;
+}
+
+void do_final(void)
+{
+}
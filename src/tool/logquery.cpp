@@ -0,0 +1,312 @@
+// Copyright (c) rAthena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <time.h>
+#include <vector>
+
+#include "../common/cbasetypes.hpp"
+#include "../common/columnlog.hpp"
+#include "../common/core.hpp"
+#include "../common/showmsg.hpp"
+#include "../common/strlib.hpp"
+
+// Condition of the query, column = value
+struct s_condition {
+	std::string column;
+	int64 value;
+	bool is_string;
+	std::string text;
+};
+
+std::vector<std::string> segment_files;
+std::vector<s_condition> conditions;
+std::string table_filter;
+int64 time_from = INT64_MIN;
+int64 time_to = INT64_MAX;
+bool count_only = false;
+bool show_info = false;
+
+// Statistics of the query
+uint64 rows_scanned = 0;
+uint64 rows_matched = 0;
+uint32 blocks_read = 0;
+uint32 blocks_skipped = 0;
+uint32 segments_skipped = 0;
+
+// Parses a unix timestamp, 'YYYY-MM-DD' or 'YYYY-MM-DD HH:MM:SS' (local time)
+bool parse_time(const char* str, int64& out)
+{
+	struct tm t = {};
+	char* end;
+
+	if( sscanf(str, "%d-%d-%d%*[ T]%d:%d:%d", &t.tm_year, &t.tm_mon, &t.tm_mday, &t.tm_hour, &t.tm_min, &t.tm_sec) >= 3 ) {
+		t.tm_year -= 1900;
+		t.tm_mon -= 1;
+		t.tm_isdst = -1;
+		out = (int64)mktime(&t);
+		return true;
+	}
+
+	out = strtoll(str, &end, 10);
+	return *end == '\0' && end != str;
+}
+
+// Parses 'column=value'
+// Values that are not numeric are compared with string columns or, if they
+// are a single character, with the character code of integer columns (e.g. type=T)
+bool parse_condition(const char* str, s_condition& condition)
+{
+	const char* sep = strchr(str, '=');
+	char* end;
+
+	if( sep == NULL || sep == str )
+		return false;
+
+	condition.column.assign(str, sep - str);
+	condition.text = sep + 1;
+	condition.value = strtoll(sep + 1, &end, 10);
+	condition.is_string = ( *end != '\0' || end == sep + 1 );
+	if( condition.is_string && condition.text.size() == 1 )
+		condition.value = (uint8)condition.text[0];
+	return true;
+}
+
+// Processes command-line arguments
+bool process_args(int argc, char *argv[])
+{
+	for( int i = 1; i < argc; i++ ) {
+		if( strcmp(argv[i], "-table") == 0 && i + 1 < argc ) {
+			table_filter = argv[++i];
+		} else if( strcmp(argv[i], "-from") == 0 && i + 1 < argc ) {
+			if( !parse_time(argv[++i], time_from) ) {
+				ShowError("Invalid time '%s'.\n", argv[i]);
+				return false;
+			}
+		} else if( strcmp(argv[i], "-to") == 0 && i + 1 < argc ) {
+			if( !parse_time(argv[++i], time_to) ) {
+				ShowError("Invalid time '%s'.\n", argv[i]);
+				return false;
+			}
+		} else if( strcmp(argv[i], "-where") == 0 && i + 1 < argc ) {
+			s_condition condition;
+
+			if( !parse_condition(argv[++i], condition) ) {
+				ShowError("Invalid condition '%s', expected column=value.\n", argv[i]);
+				return false;
+			}
+			conditions.push_back(condition);
+		} else if( strcmp(argv[i], "-count") == 0 ) {
+			count_only = true;
+		} else if( strcmp(argv[i], "-info") == 0 ) {
+			show_info = true;
+		} else if( argv[i][0] == '-' ) {
+			ShowError("Unknown option '%s'.\n", argv[i]);
+			return false;
+		} else
+			segment_files.push_back(argv[i]);
+	}
+
+	return !segment_files.empty();
+}
+
+void display_helpscreen(void)
+{
+	ShowInfo("Usage: logquery [options] <segment files...>\n");
+	ShowInfo("Scans the column log segments written with log_columnar.\n");
+	ShowInfo("Options:\n");
+	ShowInfo("  -table <name>         only segments of the table (pick, zeny)\n");
+	ShowInfo("  -from <time>          rows at or after the time\n");
+	ShowInfo("  -to <time>            rows at or before the time\n");
+	ShowInfo("                        (unix timestamp, YYYY-MM-DD or \"YYYY-MM-DD HH:MM:SS\")\n");
+	ShowInfo("  -where <column=value> rows with the value, can be given multiple times\n");
+	ShowInfo("  -count                only print the number of matching rows\n");
+	ShowInfo("  -info                 print the index of the segments instead of rows\n");
+	ShowInfo("Example, every trade of item 512 by account 2000000:\n");
+	ShowInfo("  logquery -table pick -where type=T -where nameid=512 -where account_id=2000000 log/*.clog\n");
+}
+
+// Returns the column of the segment or -1
+int find_column(const s_columnlog_segment& segment, const std::string& name)
+{
+	for( size_t i = 0; i < segment.columns.size(); i++ )
+		if( segment.columns[i].name == name )
+			return (int)i;
+	return -1;
+}
+
+// Checks if the index ranges may contain matching rows
+bool ranges_match(const s_columnlog_segment& segment, const std::vector<s_columnlog_range>& ranges, int time_column)
+{
+	for( size_t i = 0; i < segment.indexed.size(); i++ ) {
+		int column = segment.indexed[i];
+
+		if( ranges[i].min > ranges[i].max )
+			continue; // no rows
+
+		if( column == time_column && ( ranges[i].max < time_from || ranges[i].min > time_to ) )
+			return false;
+
+		for( const s_condition& condition : conditions ) {
+			if( segment.columns[column].name == condition.column && ( condition.value < ranges[i].min || condition.value > ranges[i].max ) )
+				return false;
+		}
+	}
+
+	return true;
+}
+
+void print_value(const s_columnlog_segment& segment, const s_columnlog_block& block, int column, uint32 row, int time_column)
+{
+	if( segment.columns[column].type == COLUMNLOG_STRING ) {
+		printf("%s", block.strings[column][row].c_str());
+		return;
+	}
+
+	int64 value = block.ints[column][row];
+
+	if( column == time_column ) {
+		char timestring[32];
+		time_t t = (time_t)value;
+
+		strftime(timestring, sizeof(timestring), "%Y-%m-%d %H:%M:%S", localtime(&t));
+		printf("%s", timestring);
+	} else if( segment.columns[column].name == "type" && value > 32 && value < 127 )
+		printf("%c", (char)value);
+	else
+		printf("%" PRId64, value);
+}
+
+void print_index(const char* filename, const s_columnlog_segment& segment, const std::vector<s_columnlog_range>& ranges, const char* what, uint64 rows)
+{
+	printf("%s %s: %" PRIu64 " rows", filename, what, rows);
+	for( size_t i = 0; i < segment.indexed.size(); i++ )
+		printf(", %s %" PRId64 "..%" PRId64, segment.columns[segment.indexed[i]].name.c_str(), ranges[i].min, ranges[i].max);
+	printf("\n");
+}
+
+void query_segment(const char* filename)
+{
+	s_columnlog_segment segment;
+	s_columnlog_block block;
+	std::vector<int> columns;
+	int time_column;
+	static std::string printed_table;
+
+	if( !ColumnLog_OpenSegment(filename, segment) ) {
+		ShowError("Could not open segment '%s'.\n", filename);
+		return;
+	}
+
+	if( !table_filter.empty() && segment.table != table_filter ) {
+		ColumnLog_CloseSegment(segment);
+		return;
+	}
+
+	time_column = find_column(segment, "time");
+	for( const s_condition& condition : conditions ) {
+		int column = find_column(segment, condition.column);
+
+		if( column < 0 ) {// table does not have the column
+			ColumnLog_CloseSegment(segment);
+			segments_skipped++;
+			return;
+		}
+		columns.push_back(column);
+	}
+
+	if( show_info && segment.has_footer )
+		print_index(filename, segment, segment.ranges, "segment", segment.rows);
+
+	if( segment.has_footer && !show_info && !ranges_match(segment, segment.ranges, time_column) ) {
+		ColumnLog_CloseSegment(segment);
+		segments_skipped++;
+		return;
+	}
+
+	if( !count_only && !show_info && printed_table != segment.table ) {// header line
+		for( size_t i = 0; i < segment.columns.size(); i++ )
+			printf("%s%s", i ? "\t" : "", segment.columns[i].name.c_str());
+		printf("\n");
+		printed_table = segment.table;
+	}
+
+	while( ColumnLog_NextBlock(segment, block) ) {
+		if( show_info ) {
+			print_index(filename, segment, block.ranges, "block", block.rows);
+			ColumnLog_SkipBlock(segment, block);
+			continue;
+		}
+
+		if( !ranges_match(segment, block.ranges, time_column) ) {
+			ColumnLog_SkipBlock(segment, block);
+			blocks_skipped++;
+			continue;
+		}
+
+		if( !ColumnLog_ReadBlock(segment, block) ) {
+			ShowError("Damaged block in '%s', skipping the rest of the segment.\n", filename);
+			break;
+		}
+		blocks_read++;
+
+		for( uint32 row = 0; row < block.rows; row++ ) {
+			bool match = true;
+
+			rows_scanned++;
+			if( time_column >= 0 && ( block.ints[time_column][row] < time_from || block.ints[time_column][row] > time_to ) )
+				continue;
+
+			for( size_t i = 0; i < conditions.size() && match; i++ ) {
+				int column = columns[i];
+
+				if( segment.columns[column].type == COLUMNLOG_STRING )
+					match = ( block.strings[column][row] == conditions[i].text );
+				else
+					match = ( block.ints[column][row] == conditions[i].value );
+			}
+			if( !match )
+				continue;
+
+			rows_matched++;
+			if( count_only )
+				continue;
+
+			for( size_t i = 0; i < segment.columns.size(); i++ ) {
+				if( i )
+					printf("\t");
+				print_value(segment, block, (int)i, row, time_column);
+			}
+			printf("\n");
+		}
+	}
+
+	ColumnLog_CloseSegment(segment);
+}
+
+int do_init(int argc, char** argv)
+{
+	if( !process_args(argc, argv) ) {
+		display_helpscreen();
+		return 0;
+	}
+
+	for( const std::string& file : segment_files )
+		query_segment(file.c_str());
+
+	if( count_only )
+		printf("%" PRIu64 "\n", rows_matched);
+
+	if( !show_info )
+		ShowInfo("%" PRIu64 " of %" PRIu64 " scanned rows matched, %u blocks read, %u blocks and %u segments skipped by the index.\n",
+			rows_matched, rows_scanned, blocks_read, blocks_skipped, segments_skipped);
+
+	return 0;
+}
+
+void do_final(void)
+{
+}
@@ -1,10 +1,13 @@
 // Copyright (c) rAthena Dev Teams - Licensed under GNU GPL
 // For more information, see LICENCE in the main folder
 
+#include <algorithm>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <string>
+#include <unordered_map>
 #ifndef _WIN32
 #include <unistd.h>
 #endif
@@ -23,11 +26,11 @@ std::string grf_list_file = "conf/grf-files.txt";
 std::string map_list_file = "map_index.txt";
 std::string map_cache_file;
 int rebuild = 0;
+int format = 2; // map cache version to write
+bool raw_cells = false; // store the cells uncompressed instead of zlib compressed (version 2 only)
 
 FILE *map_cache_fp;
 
-unsigned long file_size;
-
 // Used internally, this structure contains the physical map cells
 struct map_data {
 	int16 xs;
@@ -39,7 +42,7 @@ struct map_data {
 struct main_header {
 	uint32 file_size;
 	uint16 map_count;
-} header;
+};
 
 // This is the header appended before every compressed map cells info
 struct map_info {
@@ -49,6 +52,46 @@ struct map_info {
 	int32 len;
 };
 
+// Version 2 starts with this header instead, followed by the index of all
+// maps sorted by name and the cells of the maps
+#define MAP_CACHE_MAGIC "RAMC"
+#define MAP_CACHE_VERSION 2
+struct main_header2 {
+	char magic[4];
+	uint16 version;
+	uint16 flags;
+	uint32 map_count;
+	uint32 file_size;
+};
+
+// Index entry of a map in version 2
+struct map_index2 {
+	char name[MAP_NAME_LENGTH];
+	int16 xs;
+	int16 ys;
+	uint8 encoding; // enum e_map_cache_encoding
+	uint8 reserved[3];
+	uint32 offset; // from the start of the file
+	uint32 len;
+};
+
+enum e_map_cache_encoding : uint8 {
+	MAPCACHE_ZLIB = 0, // zlib compressed gat types
+	MAPCACHE_RAW, // one byte gat type per cell
+};
+
+// A map of the cache, kept in memory until the file is written
+struct cache_entry {
+	char name[MAP_NAME_LENGTH];
+	int16 xs;
+	int16 ys;
+	uint8 encoding;
+	std::vector<unsigned char> payload;
+};
+
+std::vector<cache_entry> cache;
+std::unordered_map<std::string, size_t> cache_names;
+
 
 // Reads a map from GRF's GAT and RSW files
 int read_map(char *name, struct map_data *m)
@@ -109,54 +152,204 @@ int read_map(char *name, struct map_data *m)
 // Adds a map to the cache
 void cache_map(char *name, struct map_data *m)
 {
-	struct map_info info;
-	unsigned long len;
-	unsigned char *write_buf;
-
-	// Create an output buffer twice as big as the uncompressed map... this way we're sure it fits
-	len = (unsigned long)m->xs*(unsigned long)m->ys*2;
-	write_buf = (unsigned char *)aMalloc(len);
-	// Compress the cells and get the compressed length
-	encode_zip(write_buf, &len, m->cells, m->xs*m->ys);
+	struct cache_entry entry = {};
+	unsigned long size = (unsigned long)m->xs*(unsigned long)m->ys;
 
-	// Fill the map header
 	if (strlen(name) > MAP_NAME_LENGTH) // It does not hurt to warn that there are maps with name longer than allowed.
 		ShowWarning ("Map name '%s' size '%" PRIuPTR "' is too long. Truncating to '%d'.\n", name, strlen(name), MAP_NAME_LENGTH);
-	strncpy(info.name, name, MAP_NAME_LENGTH);
-	info.xs = MakeShortLE(m->xs);
-	info.ys = MakeShortLE(m->ys);
-	info.len = MakeLongLE(len);
-
-	// Append map header then compressed cells at the end of the file
-	fseek(map_cache_fp, header.file_size, SEEK_SET);
-	fwrite(&info, sizeof(struct map_info), 1, map_cache_fp);
-	fwrite(write_buf, 1, len, map_cache_fp);
-	header.file_size += sizeof(struct map_info) + len;
-	header.map_count++;
-
-	aFree(write_buf);
+	strncpy(entry.name, name, MAP_NAME_LENGTH);
+	entry.name[MAP_NAME_LENGTH-1] = '\0';
+	entry.xs = m->xs;
+	entry.ys = m->ys;
+
+	// The cells are stored in the encoding of the file when it is written
+	entry.encoding = MAPCACHE_RAW;
+	entry.payload.assign(m->cells, m->cells + size);
+
 	aFree(m->cells);
 
-	return;
+	cache_names[entry.name] = cache.size();
+	cache.push_back(std::move(entry));
 }
 
 // Checks whether a map is already is the cache
 int find_map(char *name)
 {
-	int i;
-	struct map_info info;
+	return cache_names.find(name) != cache_names.end();
+}
 
-	fseek(map_cache_fp, sizeof(struct main_header), SEEK_SET);
+// Reads the maps of an existing cache of either version
+bool read_cache(FILE *fp)
+{
+	std::vector<unsigned char> buf;
+	long size;
+
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	if (size <= 0)
+		return false;
+	buf.resize(size);
+	if (fread(buf.data(), 1, size, fp) != (size_t)size)
+		return false;
+
+	if (size >= (long)sizeof(struct main_header2) && memcmp(buf.data(), MAP_CACHE_MAGIC, 4) == 0) {
+		uint32 map_count = GetULong(buf.data() + offsetof(struct main_header2, map_count));
+
+		if (GetUShort(buf.data() + offsetof(struct main_header2, version)) != MAP_CACHE_VERSION) {
+			ShowError("Unsupported map cache version %d\n", GetUShort(buf.data() + offsetof(struct main_header2, version)));
+			return false;
+		}
 
-	for(i = 0; i < header.map_count; i++) {
-		if(fread(&info, sizeof(info), 1, map_cache_fp) != 1) printf("An error as occured in fread while reading map_cache\n");
-		if(strcmp(name, info.name) == 0) // Map found
-			return 1;
-		else // Map not found, jump to the beginning of the next map info header
-			fseek(map_cache_fp, GetLong((unsigned char *)&(info.len)), SEEK_CUR);
+		for (uint32 i = 0; i < map_count; i++) {
+			size_t pos = sizeof(struct main_header2) + i * sizeof(struct map_index2);
+			struct cache_entry entry = {};
+			uint32 offset, len;
+
+			if (pos + sizeof(struct map_index2) > (size_t)size)
+				return false;
+			memcpy(entry.name, buf.data() + pos, MAP_NAME_LENGTH);
+			entry.name[MAP_NAME_LENGTH-1] = '\0';
+			entry.xs = (int16)GetUShort(buf.data() + pos + offsetof(struct map_index2, xs));
+			entry.ys = (int16)GetUShort(buf.data() + pos + offsetof(struct map_index2, ys));
+			entry.encoding = buf[pos + offsetof(struct map_index2, encoding)];
+			offset = GetULong(buf.data() + pos + offsetof(struct map_index2, offset));
+			len = GetULong(buf.data() + pos + offsetof(struct map_index2, len));
+			if ((size_t)offset + len > (size_t)size)
+				return false;
+			entry.payload.assign(buf.data() + offset, buf.data() + offset + len);
+
+			cache_names[entry.name] = cache.size();
+			cache.push_back(std::move(entry));
+		}
+		return true;
 	}
 
-	return 0;
+	// Version 1
+	uint16 map_count = GetUShort(buf.data() + offsetof(struct main_header, map_count));
+	size_t pos = sizeof(struct main_header);
+
+	for (uint16 i = 0; i < map_count; i++) {
+		struct cache_entry entry = {};
+		int32 len;
+
+		if (pos + sizeof(struct map_info) > (size_t)size)
+			return false;
+		memcpy(entry.name, buf.data() + pos, MAP_NAME_LENGTH);
+		entry.name[MAP_NAME_LENGTH-1] = '\0';
+		entry.xs = (int16)GetUShort(buf.data() + pos + offsetof(struct map_info, xs));
+		entry.ys = (int16)GetUShort(buf.data() + pos + offsetof(struct map_info, ys));
+		entry.encoding = MAPCACHE_ZLIB;
+		len = GetLong(buf.data() + pos + offsetof(struct map_info, len));
+		pos += sizeof(struct map_info);
+		if (len < 0 || pos + len > (size_t)size)
+			return false;
+		entry.payload.assign(buf.data() + pos, buf.data() + pos + len);
+		pos += len;
+
+		if (cache_names.find(entry.name) != cache_names.end())
+			continue; // the first entry of a name is the one used
+		cache_names[entry.name] = cache.size();
+		cache.push_back(std::move(entry));
+	}
+	return true;
+}
+
+// Converts the cells of a map to another encoding
+void convert_entry(struct cache_entry &entry, uint8 encoding)
+{
+	unsigned long size = (unsigned long)entry.xs*(unsigned long)entry.ys;
+	std::vector<unsigned char> cells;
+
+	if (entry.encoding == encoding)
+		return;
+
+	if (encoding == MAPCACHE_RAW) {
+		cells.resize(size);
+		decode_zip(cells.data(), &size, entry.payload.data(), (unsigned long)entry.payload.size());
+	} else {
+		unsigned long len = size*2 + 64;
+
+		cells.resize(len);
+		encode_zip(cells.data(), &len, entry.payload.data(), (unsigned long)entry.payload.size());
+		cells.resize(len);
+	}
+
+	entry.payload.swap(cells);
+	entry.encoding = encoding;
+}
+
+// Writes the cache in version 1, maps are stored one after another
+bool write_cache1(FILE *fp)
+{
+	struct main_header header;
+
+	header.file_size = sizeof(struct main_header);
+	header.map_count = 0;
+	fseek(fp, sizeof(struct main_header), SEEK_SET);
+
+	for (auto &entry : cache) {
+		struct map_info info;
+
+		convert_entry(entry, MAPCACHE_ZLIB); // version 1 only knows compressed cells
+
+		memcpy(info.name, entry.name, MAP_NAME_LENGTH);
+		info.xs = MakeShortLE(entry.xs);
+		info.ys = MakeShortLE(entry.ys);
+		info.len = MakeLongLE((int32)entry.payload.size());
+		fwrite(&info, sizeof(struct map_info), 1, fp);
+		fwrite(entry.payload.data(), 1, entry.payload.size(), fp);
+		header.file_size += (uint32)(sizeof(struct map_info) + entry.payload.size());
+		header.map_count++;
+	}
+
+	header.file_size = (uint32)MakeLongLE(header.file_size);
+	header.map_count = (uint16)MakeShortLE(header.map_count);
+	fseek(fp, 0, SEEK_SET);
+	return fwrite(&header, sizeof(struct main_header), 1, fp) == 1;
+}
+
+// Writes the cache in version 2, with the index sorted by name
+bool write_cache2(FILE *fp)
+{
+	struct main_header2 header = {};
+	std::vector<size_t> order(cache.size());
+	uint32 offset;
+
+	for (size_t i = 0; i < order.size(); i++) {
+		order[i] = i;
+		convert_entry(cache[i], raw_cells ? MAPCACHE_RAW : MAPCACHE_ZLIB);
+	}
+	std::sort(order.begin(), order.end(), [](size_t a, size_t b) {
+		return strncmp(cache[a].name, cache[b].name, MAP_NAME_LENGTH) < 0;
+	});
+
+	offset = (uint32)(sizeof(struct main_header2) + cache.size() * sizeof(struct map_index2));
+
+	memcpy(header.magic, MAP_CACHE_MAGIC, 4);
+	header.version = MakeShortLE(MAP_CACHE_VERSION);
+	header.map_count = MakeLongLE((int32)cache.size());
+	fwrite(&header, sizeof(struct main_header2), 1, fp);
+
+	for (size_t i : order) {
+		struct map_index2 index = {};
+
+		memcpy(index.name, cache[i].name, MAP_NAME_LENGTH);
+		index.xs = MakeShortLE(cache[i].xs);
+		index.ys = MakeShortLE(cache[i].ys);
+		index.encoding = cache[i].encoding;
+		index.offset = MakeLongLE(offset);
+		index.len = MakeLongLE((int32)cache[i].payload.size());
+		fwrite(&index, sizeof(struct map_index2), 1, fp);
+		offset += (uint32)cache[i].payload.size();
+	}
+
+	for (size_t i : order)
+		fwrite(cache[i].payload.data(), 1, cache[i].payload.size(), fp);
+
+	header.file_size = MakeLongLE(offset);
+	fseek(fp, 0, SEEK_SET);
+	return fwrite(&header, sizeof(struct main_header2), 1, fp) == 1;
 }
 
 // Cuts the extension from a map name
@@ -188,6 +381,11 @@ void process_args(int argc, char *argv[])
 				map_cache_file = argv[i];
 		} else if(strcmp(argv[i], "-rebuild") == 0)
 			rebuild = 1;
+		else if(strcmp(argv[i], "-format") == 0) {
+			if(++i < argc)
+				format = (atoi(argv[i]) == 1) ? 1 : 2;
+		} else if(strcmp(argv[i], "-raw") == 0)
+			raw_cells = true;
 	}
 
 }
@@ -203,23 +401,22 @@ int do_init(int argc, char** argv)
 	ShowStatus("Initializing grfio with %s\n", grf_list_file.c_str());
 	grfio_init(grf_list_file.c_str());
 
-	// Attempt to open the map cache file and force rebuild if not found
+	// Attempt to read the map cache file and force rebuild if not found
 	ShowStatus("Opening map cache: %s\n", map_cache_file.c_str());
 	if(!rebuild) {
 		map_cache_fp = fopen(map_cache_file.c_str(), "rb");
 		if(map_cache_fp == NULL) {
 			ShowNotice("Existing map cache not found, forcing rebuild mode\n");
 			rebuild = 1;
-		} else
+		} else {
+			if(!read_cache(map_cache_fp)) {
+				ShowError("Failure when reading map cache file %s, forcing rebuild mode\n", map_cache_file.c_str());
+				cache.clear();
+				cache_names.clear();
+				rebuild = 1;
+			}
 			fclose(map_cache_fp);
-	}
-	if(rebuild)
-		map_cache_fp = fopen(map_cache_file.c_str(), "w+b");
-	else
-		map_cache_fp = fopen(map_cache_file.c_str(), "r+b");
-	if(map_cache_fp == NULL) {
-		ShowError("Failure when opening map cache file %s\n", map_cache_file.c_str());
-		exit(EXIT_FAILURE);
+		}
 	}
 
 	// Open the map list
@@ -236,16 +433,6 @@ int do_init(int argc, char** argv)
 			exit(EXIT_FAILURE);
 		}
 
-		// Initialize the main header
-		if (rebuild) {
-			header.file_size = sizeof(struct main_header);
-			header.map_count = 0;
-		} else {
-			if (fread(&header, sizeof(struct main_header), 1, map_cache_fp) != 1) { printf("An error as occured while reading map_cache_fp \n"); }
-			header.file_size = GetULong((unsigned char *)&(header.file_size));
-			header.map_count = GetUShort((unsigned char *)&(header.map_count));
-		}
-
 		// Read and process the map list
 		char line[1024];
 
@@ -281,16 +468,21 @@ int do_init(int argc, char** argv)
 		fclose(list);
 	}
 
-	// Write the main header and close the map cache
-	ShowStatus("Closing map cache: %s\n", map_cache_file.c_str());
-	fseek(map_cache_fp, 0, SEEK_SET);
-	fwrite(&header, sizeof(struct main_header), 1, map_cache_fp);
+	// Write the map cache, the index of version 2 needs all maps so the file is written at once
+	ShowStatus("Writing map cache (version %d): %s\n", format, map_cache_file.c_str());
+	map_cache_fp = fopen(map_cache_file.c_str(), "wb");
+	if(map_cache_fp == NULL) {
+		ShowError("Failure when opening map cache file %s\n", map_cache_file.c_str());
+		exit(EXIT_FAILURE);
+	}
+	if(!(format == 1 ? write_cache1(map_cache_fp) : write_cache2(map_cache_fp)))
+		ShowError("Failure when writing map cache file %s\n", map_cache_file.c_str());
 	fclose(map_cache_fp);
 
 	ShowStatus("Finalizing grfio\n");
 	grfio_final();
 
-	ShowInfo("%d maps now in cache\n", header.map_count);
+	ShowInfo("%d maps now in cache\n", (int)cache.size());
 
 	return 0;
 }